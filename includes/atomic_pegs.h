@@ -0,0 +1,44 @@
+#ifndef atomic_pegs_2c7d49b0
+#define atomic_pegs_2c7d49b0
+
+// Snort includes
+#include <framework/counts.h>
+
+// System includes
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Local includes
+
+// Debug includes
+
+namespace Common {
+
+// Peg counts of a module whose counts are updated by many threads, e.g. a
+// serializer used from every packet thread, kept as atomics so updating them
+// takes no lock.  Counts must be a struct of only std::atomic<PegCount>
+// members, in the order of the module's PegInfo array.
+template <class Counts> class AtomicPegs {
+  static_assert(sizeof(std::atomic<PegCount>) == sizeof(PegCount));
+  static_assert(sizeof(Counts) % sizeof(PegCount) == 0);
+
+  std::array<PegCount, sizeof(Counts) / sizeof(PegCount)> copy;
+
+public:
+  // Returns a copy of counts, for Module::get_counts(), valid until the next
+  // call
+  PegCount *get(const Counts &counts) {
+    auto atomics = reinterpret_cast<const std::atomic<PegCount> *>(&counts);
+
+    for (std::size_t index = 0; index < copy.size(); index++) {
+      copy[index] = atomics[index].load(std::memory_order_relaxed);
+    }
+
+    return copy.data();
+  }
+};
+
+} // namespace Common
+
+#endif // #ifndef atomic_pegs_2c7d49b0
@@ -0,0 +1,186 @@
+#ifndef bill_4f6a2d18
+#define bill_4f6a2d18
+
+// Snort includes
+
+// System includes
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Local includes
+
+// Global includes
+
+// Debug includes
+
+// Decoder for the streams written by LioLi (serializer_bill and
+// serializer_raw).  Trees and nodes are views into the decoded buffer, e.g. a
+// mapped file, nothing is copied and the views are only valid while it is.
+//
+// A stream starts with a 16 byte header:
+//
+//   '\x4' "BILL" '\x0' '\x2' <9 byte secret>   or
+//   '\x4' "RAW " '\x0' '\x1' <9 byte secret>
+//
+// followed by the trees, each is the varint (Go style) length of its raw
+// string and the string, then for BILL the varint length of the encoded nodes
+// and the nodes.  A node is encoded as:
+//
+//   [2 byte length of rest of node, only if node has children]
+//   2 byte name length, name
+//   1, 2 or 4 byte start (relative to end of previous sibling, or start of
+//   parent for the first child) and length of the node's part of raw
+//   children
+//
+// Trees serialized without a root node have the root's children at the top.
+
+namespace Bill {
+
+enum class Format { bill, raw };
+
+constexpr std::size_t header_size = 16;
+
+struct Header {
+  Format format;
+  std::array<uint8_t, 9> secret;
+
+  // Returns false if data doesn't start with a valid header
+  bool parse(const uint8_t *data, std::size_t size);
+};
+
+class NodeCursor;
+
+class NodeView {
+  std::string_view raw;      // Raw string of the tree
+  std::string_view my_name;
+  std::size_t start = 0;
+  std::size_t end = 0;
+  std::string_view encoded_children;
+
+  friend class NodeCursor;
+
+public:
+  std::string_view name() const { return my_name; }
+  std::size_t get_start() const { return start; }
+  std::size_t get_end() const { return end; }
+
+  // Part of raw captured by this node
+  std::string_view value() const { return raw.substr(start, end - start); }
+
+  bool has_children() const { return !encoded_children.empty(); }
+  NodeCursor children() const;
+
+  // Appends node in the same format as LioLi::Tree::as_lorth()
+  void as_lorth(std::string &output, unsigned level = 0) const;
+};
+
+// Iterates a sequence of sibling nodes
+class NodeCursor {
+  std::string_view raw;
+  std::string_view encoded;
+  std::size_t delta; // Position the start of the next node is relative to
+  std::size_t parent_end;
+  bool failed = false;
+
+public:
+  NodeCursor(std::string_view raw, std::string_view encoded, std::size_t delta,
+             std::size_t parent_end)
+      : raw(raw), encoded(encoded), delta(delta), parent_end(parent_end) {}
+
+  // Returns false when there are no more nodes, or the encoding is corrupt
+  bool next(NodeView &node);
+
+  // True if next() stopped on a corrupt encoding
+  bool is_corrupt() const { return failed; }
+};
+
+inline NodeCursor NodeView::children() const {
+  return NodeCursor(raw, encoded_children, start, end);
+}
+
+class TreeView {
+  std::string_view raw;
+  std::string_view encoded; // Empty for RAW streams
+
+  friend class StreamReader;
+
+public:
+  std::string_view get_raw() const { return raw; }
+  std::string_view get_encoded() const { return encoded; }
+
+  // Top level nodes of the tree, the root node unless it was left out
+  NodeCursor nodes() const {
+    return NodeCursor(raw, encoded, 0, raw.size());
+  }
+
+  // Calls lambda for each node matching the dotted path, where the first
+  // name is matched against the top level nodes.  Stops if lambda returns
+  // false, returns false if the encoding is corrupt.
+  template <class Lambda>
+  bool for_each_match(std::string_view path, Lambda lambda) const {
+    bool corrupt = false;
+    auto cursor = nodes();
+    match(cursor, path, lambda, corrupt);
+    return !corrupt;
+  }
+
+  // Same format as LioLi::Tree::as_lorth()
+  std::string as_lorth() const;
+
+private:
+  // Returns false if lambda stopped the iteration
+  template <class Lambda>
+  static bool match(NodeCursor &cursor, std::string_view path, Lambda &lambda,
+                    bool &corrupt) {
+    auto dot_pos = path.find('.');
+    auto name = path.substr(0, dot_pos);
+    NodeView node;
+    bool more = true;
+
+    while (more && cursor.next(node)) {
+      if (node.name() != name) {
+        continue;
+      }
+
+      if (dot_pos == std::string_view::npos) {
+        more = lambda(node);
+      } else {
+        auto children = node.children();
+        more = match(children, path.substr(dot_pos + 1), lambda, corrupt);
+      }
+    }
+
+    corrupt |= cursor.is_corrupt();
+    return more;
+  }
+};
+
+// Iterates the trees of a stream
+class StreamReader {
+  const uint8_t *data;
+  std::size_t size;
+  std::size_t pos = 0;
+  Header stream_header;
+  bool header_ok;
+
+public:
+  StreamReader(const uint8_t *data, std::size_t size);
+
+  // False if the stream doesn't start with a valid header
+  bool has_header() const { return header_ok; }
+  const Header &header() const { return stream_header; }
+
+  // Returns false when there are no more complete trees
+  bool next(TreeView &tree);
+
+  // Bytes not consumed by next(), non zero at the end means a truncated or
+  // corrupt stream
+  std::size_t remaining() const { return size - pos; }
+};
+
+} // namespace Bill
+
+#endif // bill_4f6a2d18
@@ -0,0 +1,334 @@
+#ifndef columnar_9b27e4d0
+#define columnar_9b27e4d0
+
+// Snort includes
+
+// System includes
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Local includes
+#include <mapped_file.h>
+
+// Global includes
+
+// Debug includes
+
+// Format of the blocks written by serializer_columnar, and a reader for them.
+//
+// A stream is a sequence of self contained blocks.  All numbers are little
+// endian and all sections start 8 byte aligned relative to the block, so a
+// mapped file can be scanned in place:
+//
+//   BlockHeader
+//   ColumnHeader[column_count]
+//   per column: name, null bitmap and data sections
+//
+// The null bitmap has a bit per row (LSB first), set if the row has no value.
+//
+// String columns are dictionary encoded: uint32_t offsets[dictionary_count+1]
+// into the dictionary text that follows them, then uint32_t index[row_count].
+//
+// Int and timestamp columns (timestamps are ns since epoch) are delta
+// encoded: int64_t first value, uint8_t delta width (1, 2, 4 or 8) padded to
+// 8 bytes, then delta width bytes per row with the zigzag encoded difference
+// to the previous row (0 for null rows, which repeat the previous value).
+
+namespace Columnar {
+
+constexpr char block_magic[4] = {'L', 'L', 'C', 'B'};
+constexpr uint16_t block_version = 1;
+
+enum class Type : uint8_t { string = 1, integer = 2, timestamp = 3 };
+enum class Encoding : uint8_t { dictionary = 1, delta = 2 };
+
+struct BlockHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t column_count;
+  uint32_t row_count;
+  uint32_t reserved;
+  uint64_t block_size; // Including this header
+  uint64_t reserved2;
+};
+
+struct ColumnHeader {
+  Type type;
+  Encoding encoding;
+  uint16_t name_length;
+  uint32_t dictionary_count; // Entries in dictionary of string columns
+  uint64_t name_offset;      // Offsets are relative to start of block
+  uint64_t null_bitmap_offset;
+  uint64_t data_offset;
+};
+
+static_assert(sizeof(BlockHeader) == 32 && sizeof(ColumnHeader) == 32,
+              "Columnar headers must have a fixed layout");
+
+constexpr uint64_t align(uint64_t offset) { return (offset + 7) & ~7ul; }
+
+constexpr uint64_t zigzag_encode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+constexpr int64_t zigzag_decode(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// View of a column in a block, only valid while the block data is
+class ColumnView {
+  const uint8_t *block;
+  const ColumnHeader *header;
+  uint32_t rows;
+
+public:
+  ColumnView(const uint8_t *block, const ColumnHeader *header, uint32_t rows)
+      : block(block), header(header), rows(rows) {}
+
+  std::string_view name() const {
+    return {reinterpret_cast<const char *>(block + header->name_offset),
+            header->name_length};
+  }
+
+  Type type() const { return header->type; }
+  uint32_t row_count() const { return rows; }
+
+  bool is_null(uint32_t row) const {
+    return block[header->null_bitmap_offset + row / 8] & (1 << (row % 8));
+  }
+
+  // Dictionary of string columns
+  uint32_t dictionary_count() const { return header->dictionary_count; }
+
+  std::string_view dictionary_entry(uint32_t index) const {
+    const uint32_t *offsets =
+        reinterpret_cast<const uint32_t *>(block + header->data_offset);
+    const char *text = reinterpret_cast<const char *>(
+        offsets + header->dictionary_count + 1);
+    return {text + offsets[index], offsets[index + 1] - offsets[index]};
+  }
+
+  // Dictionary index of each row of string columns
+  const uint32_t *indexes() const {
+    const uint32_t *offsets =
+        reinterpret_cast<const uint32_t *>(block + header->data_offset);
+    uint64_t text_end = align(header->data_offset +
+                              (header->dictionary_count + 1) * sizeof(uint32_t) +
+                              offsets[header->dictionary_count]);
+    return reinterpret_cast<const uint32_t *>(block + text_end);
+  }
+
+  // Value of row of string columns, empty for null rows
+  std::string_view string(uint32_t row) const {
+    return is_null(row) ? std::string_view() : dictionary_entry(indexes()[row]);
+  }
+
+  // Calls lambda(row, value) for each row of int and timestamp columns, in
+  // order, null rows are skipped
+  template <class Lambda> void for_each_integer(Lambda lambda) const {
+    const uint8_t *data = block + header->data_offset;
+    int64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    uint8_t width = data[8];
+    const uint8_t *deltas = data + 16;
+
+    for (uint32_t row = 0; row < rows; row++) {
+      uint64_t delta = 0;
+      std::memcpy(&delta, deltas + row * width, width);
+      value = static_cast<int64_t>(static_cast<uint64_t>(value) +
+                                   static_cast<uint64_t>(zigzag_decode(delta)));
+
+      if (!is_null(row)) {
+        lambda(row, value);
+      }
+    }
+  }
+};
+
+// View of a block, only valid while the data is
+class BlockView {
+  const uint8_t *data = nullptr;
+
+  const BlockHeader *header() const {
+    return reinterpret_cast<const BlockHeader *>(data);
+  }
+
+  // True if length bytes at offset are within size, without overflowing
+  static bool fits(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+  }
+
+  // True if all the sections of column are within the block, aligned, and
+  // what the views read from them stays within it
+  static bool check_column(const uint8_t *data, uint64_t size,
+                           const ColumnHeader &column, uint32_t rows) {
+    if (!fits(column.name_offset, column.name_length, size) ||
+        !fits(column.null_bitmap_offset, (uint64_t(rows) + 7) / 8, size) ||
+        column.data_offset % 8 != 0) {
+      return false;
+    }
+
+    if (column.type == Type::string) {
+      uint64_t count = column.dictionary_count;
+      uint64_t offsets_size = (count + 1) * sizeof(uint32_t);
+
+      if (column.encoding != Encoding::dictionary ||
+          !fits(column.data_offset, offsets_size, size)) {
+        return false;
+      }
+
+      // Offsets must be ascending, and the text within the block
+      uint32_t previous = 0;
+
+      for (uint64_t entry = 0; entry <= count; entry++) {
+        uint32_t offset;
+        std::memcpy(&offset,
+                    data + column.data_offset + entry * sizeof(uint32_t),
+                    sizeof(offset));
+
+        if (offset < previous) {
+          return false;
+        }
+        previous = offset;
+      }
+
+      uint64_t text_start = column.data_offset + offsets_size;
+
+      if (!fits(text_start, previous, size) ||
+          !fits(align(text_start + previous), uint64_t(rows) * sizeof(uint32_t),
+                size)) {
+        return false;
+      }
+
+      // Indexes of rows with a value must be in the dictionary
+      const uint8_t *indexes = data + align(text_start + previous);
+
+      for (uint32_t row = 0; row < rows; row++) {
+        uint32_t index;
+        std::memcpy(&index, indexes + row * sizeof(uint32_t), sizeof(index));
+
+        bool is_null = data[column.null_bitmap_offset + row / 8] &
+                       (1 << (row % 8));
+
+        if (!is_null && index >= count) {
+          return false;
+        }
+      }
+
+      return true;
+    } else if (column.type == Type::integer ||
+               column.type == Type::timestamp) {
+      if (column.encoding != Encoding::delta ||
+          !fits(column.data_offset, 16, size)) {
+        return false;
+      }
+
+      uint8_t width = data[column.data_offset + 8];
+
+      return (width == 1 || width == 2 || width == 4 || width == 8) &&
+             fits(column.data_offset + 16, uint64_t(rows) * width, size);
+    }
+
+    return false;
+  }
+
+public:
+  BlockView() = default;
+  BlockView(const uint8_t *data) : data(data) {}
+
+  // Returns the size of the block at data, or 0 if there isn't a complete
+  // valid block in size bytes.  Every column is checked, so the views of a
+  // block that passed never read outside it, even if the data is hostile.
+  static uint64_t check(const uint8_t *data, uint64_t size) {
+    if (size < sizeof(BlockHeader)) {
+      return 0;
+    }
+
+    auto header = reinterpret_cast<const BlockHeader *>(data);
+
+    if (std::memcmp(header->magic, block_magic, sizeof(block_magic)) ||
+        header->version != block_version || header->block_size > size ||
+        header->block_size % 8 != 0 ||
+        header->block_size < sizeof(BlockHeader) + header->column_count *
+                                                      sizeof(ColumnHeader)) {
+      return 0;
+    }
+
+    auto columns =
+        reinterpret_cast<const ColumnHeader *>(data + sizeof(BlockHeader));
+
+    for (uint16_t index = 0; index < header->column_count; index++) {
+      if (!check_column(data, header->block_size, columns[index],
+                        header->row_count)) {
+        return 0;
+      }
+    }
+
+    return header->block_size;
+  }
+
+  uint64_t size() const { return header()->block_size; }
+  uint32_t row_count() const { return header()->row_count; }
+  uint16_t column_count() const { return header()->column_count; }
+
+  ColumnView column(uint16_t index) const {
+    return ColumnView(
+        data,
+        reinterpret_cast<const ColumnHeader *>(data + sizeof(BlockHeader)) +
+            index,
+        row_count());
+  }
+
+  // Returns index of column with name, or column_count() if not found
+  uint16_t find_column(std::string_view name) const {
+    for (uint16_t index = 0; index < column_count(); index++) {
+      if (column(index).name() == name) {
+        return index;
+      }
+    }
+
+    return column_count();
+  }
+};
+
+// Iterates the blocks of a buffer, e.g. a mapped file
+class StreamReader {
+  const uint8_t *data;
+  uint64_t size;
+  uint64_t pos = 0;
+
+public:
+  StreamReader(const uint8_t *data, uint64_t size) : data(data), size(size) {}
+
+  // Returns false when there are no more complete blocks
+  bool next(BlockView &block) {
+    uint64_t block_size = BlockView::check(data + pos, size - pos);
+
+    if (!block_size) {
+      return false;
+    }
+
+    block = BlockView(data + pos);
+    pos += block_size;
+    return true;
+  }
+
+  // Bytes not consumed by next(), non zero at the end means a truncated or
+  // corrupt stream
+  uint64_t remaining() const { return size - pos; }
+};
+
+// Read only mapping of a file of blocks
+class MappedFile : public Common::MappedFile {
+public:
+  using Common::MappedFile::MappedFile;
+
+  StreamReader reader() const { return StreamReader(data(), size()); }
+};
+
+} // namespace Columnar
+
+#endif // columnar_9b27e4d0
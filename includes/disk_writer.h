@@ -0,0 +1,156 @@
+#ifndef disk_writer_3e9a47c1
+#define disk_writer_3e9a47c1
+
+// Snort includes
+
+// System includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+// Local includes
+
+// Global includes
+
+// Debug includes
+
+namespace Common {
+
+// Append only file writer for disk outputs that must not block the thread
+// writing.  Data is copied into a few large buffers, and a full buffer is
+// handed to io_uring, so the caller only blocks on a memcpy.  Buffers are
+// registered with the ring when the memlock limit allows it, and the file
+// can be written with O_DIRECT and be preallocated ahead of the writes.
+//
+// When io_uring isn't available (old kernel, disabled by sysctl or seccomp)
+// buffers are written with write(2) as they fill up, blocking like a stream
+// would.
+//
+// Not thread safe, a writer belongs to one thread.
+class DiskWriter {
+public:
+  struct Config {
+    std::size_t buffer_bytes = 1 << 20; // Rounded up to a multiple of 4096
+    unsigned buffers = 8;               // Being filled or written, min 2
+    bool direct = false;                // O_DIRECT, bypassing the page cache
+    uint64_t preallocate_bytes = 0; // Allocated ahead in steps of, 0 = never
+    bool uring = true;              // false = always use write(2)
+  };
+
+  struct Stats {
+    uint64_t written;   // Bytes written since last call
+    uint64_t dropped;   // Bytes dropped since last call, see write()
+    uint64_t submits;   // Submissions (io_uring_enter or write) since last call
+    uint64_t failures;  // Writes failed since last call
+  };
+
+  explicit DiskWriter(const Config &config);
+  ~DiskWriter();
+
+  DiskWriter(const DiskWriter &) = delete;
+  DiskWriter &operator=(const DiskWriter &) = delete;
+
+  // Creates, or truncates, path and opens it.  Returns false with errno set
+  // if it can't be opened.
+  bool open(const std::string &path);
+
+  bool is_open() const { return fd != -1; }
+
+  // True if writes go through io_uring
+  bool is_async() const { return ring_fd != -1; }
+
+  // True if a write() of size bytes would be dropped only because the
+  // buffers are being written, the caller may then wait for get_event_fd()
+  // and ask again.  False if it would be taken, or never will be.
+  bool is_busy(std::size_t size);
+
+  // Readable when a write completes, -1 if writes never leave us busy
+  int get_event_fd() const { return event_fd; }
+
+  // Appends count parts, all or nothing.  Returns false, dropping the data,
+  // if the buffers are all being written, or a write has failed.
+  bool write(const iovec *parts, std::size_t count);
+  bool write(const void *data, std::size_t size) {
+    iovec part = {const_cast<void *>(data), size};
+    return write(&part, 1);
+  }
+  bool write(const std::string &data) {
+    return write(data.data(), data.size());
+  }
+
+  // Starts writing what's buffered, with O_DIRECT a trailing partial block
+  // is kept until close()
+  void flush();
+
+  // Writes the rest, waits for all of it and closes the file, blocking.
+  // Returns false if any write of the file failed.
+  bool close();
+
+  // As close(), without waiting for the disk.  Returns false while the rest
+  // is being written, the caller may then wait for get_event_fd() and ask
+  // again.  Once it returns true the file is closed, see get_error().
+  bool try_close();
+
+  // Bytes appended to the file, including what isn't written yet
+  uint64_t size() const { return offset + fill; }
+
+  // errno of the first failed write of the file, 0 if none
+  int get_error() const { return error; }
+
+  Stats take_stats();
+
+private:
+  struct Ring; // The io_uring's mappings
+
+  struct Buffer {
+    uint8_t *data;      // 4096 aligned, buffer_bytes long
+    uint64_t at = 0;    // File offset being written to
+    std::size_t length = 0; // Bytes being written
+    std::size_t done = 0;   // Bytes of them written so far
+  };
+
+  Config config;
+  std::vector<Buffer> buffers;
+  std::vector<unsigned> unused; // Buffers not being filled or written
+
+  int fd = -1;
+  bool direct = false; // The open file has O_DIRECT
+  int error = 0;
+
+  int ring_fd = -1; // -1 if io_uring isn't used
+  Ring *ring = nullptr;
+  int event_fd = -1; // Signaled by the ring on completions
+  bool fixed = false;  // Buffers are registered with the ring
+  unsigned queued = 0; // Entries in the ring not yet submitted
+  unsigned in_flight = 0; // Buffers being written
+
+  unsigned current = 0; // Buffer being filled, if has_current
+  bool has_current = false;
+  std::size_t fill = 0; // Bytes in the current buffer
+  uint64_t offset = 0;  // File offset of the current buffer
+
+  uint64_t allocated = 0;     // Preallocated up to this offset
+  uint64_t allocating_to = 0; // Offset being preallocated up to
+  bool preallocating = false; // A fallocate is in the ring
+
+  Stats stats = {};
+
+  void setup_ring();
+  void teardown_ring();
+
+  bool take_buffer();
+  void write_rest();
+  void write_buffer(std::size_t length);
+  void queue_write(unsigned index);
+  void preallocate(uint64_t end);
+  bool submit();
+  void reap(bool wait);
+  void fail(int err, uint64_t bytes);
+  std::size_t room() const;
+};
+
+} // namespace Common
+
+#endif // disk_writer_3e9a47c1
@@ -9,9 +9,11 @@
 #include <forward_list>
 #include <functional>
 #include <iterator>
+#include <memory>
 #include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // Local includes
@@ -26,6 +28,11 @@ class LioLi;
 // the data it contains, and a node tree that names specific substrings
 // of the main string in a tree structure
 class Tree {
+public:
+  // A lookup key split into node names, see compile_key()
+  using Key = std::vector<std::string>;
+
+private:
   class Node {
     std::string my_name;
     size_t start = 0;
@@ -34,7 +41,16 @@ class Tree {
     std::forward_list<Node>::iterator last_child_added =
         children.before_begin();
 
+    // Encodings of a memoized node, shared between copies of the node, a
+    // mutation of the node gives it a new (empty) cache
+    struct EncodingCache;
+    std::shared_ptr<EncodingCache> encoding_cache;
+
     void adjust(size_t delta);
+    void invalidate_cache();
+    std::string dump_binary_children() const;
+    std::string dump_lorth_uncached(const std::string &raw,
+                                    unsigned level) const;
 
     void recalc_last_child() {
       auto next_child = children.before_begin();
@@ -59,13 +75,22 @@ class Tree {
     void append(const Node &node);
     void append(Node &&node);
 
-    void set_name(const std::string &new_name) { my_name = new_name; }
+    void set_name(const std::string &new_name) {
+      my_name = new_name;
+      invalidate_cache();
+    }
     const std::string &get_name() const { return my_name; }
 
+    void memoize();
+
+    std::size_t footprint() const;
+
     std::string dump_string(const std::string &raw, unsigned level = 0) const;
     std::string dump_lorth(const std::string &raw, unsigned level = 0) const;
     std::string dump_python(const std::string &raw, unsigned level = 0,
                             bool array_item = false) const;
+    void dump_json(const std::string &raw, std::string &output, bool add_text,
+                   bool as_object = false) const; // Appends value of node
     std::string dump_binary(size_t delta, bool add_root_node) const;
 
     // For debug/test
@@ -75,7 +100,9 @@ class Tree {
     bool
     lookup(std::string key, size_t &start, size_t &end,
            size_t &skip) const; // get pos of child, returns false if not found
-    bool regex_lookup(std::regex &regex,
+    bool lookup(const Key &key, size_t depth, size_t &start,
+                size_t &end) const; // key[depth] must match this node
+    bool regex_lookup(const std::regex &regex,
                       std::function<bool(size_t start, size_t end)> lambda,
                       std::string &rkey)
         const; // Calls lambda with start and end of all keys matching regex
@@ -98,6 +125,17 @@ public:
   void merge(const Tree &tree, bool node_merge = false);
   void merge(Tree &&tree, bool node_merge = false);
 
+  // Caches the BILL and lorth encodings of this tree, once they are generated,
+  // for reuse by all copies of it.  Use for subtrees that are emitted many
+  // times without changing, any later change to the tree clears the cache.
+  // Called on a temporary it returns it as one, so it's moved on
+  Tree &memoize() &;
+  Tree &&memoize() &&;
+
+  // Approximate number of bytes of memory used by the tree, memoized
+  // encodings are not included as they are shared with other trees
+  std::size_t footprint() const;
+
   bool operator==(const Tree &tree) const;
   bool operator!=(const Tree &tree) const { return !(*this == tree); }
 
@@ -106,6 +144,8 @@ public:
   std::string as_string() const;
   std::string as_lorth() const;
   std::string as_python() const;
+  void as_json(std::string &output,
+               bool add_text = false) const; // Appends tree as a JSON object
 
   std::string lookup(std::string key) const; // value of key
 
@@ -113,6 +153,14 @@ public:
                     std::function<bool(std::string value)> lambda)
       const; // Calls lambda with value of all keys matching regex
 
+  // Versions of the lookups for keys/regexes that are prepared once and used
+  // on many trees, returned values are only valid while the tree is unchanged
+  static Key compile_key(const std::string &key);
+  std::string_view lookup(const Key &key) const; // value of key
+  bool contains(const Key &key) const; // true if key is found, even if empty
+  void regex_lookup(const std::regex &regex,
+                    std::function<bool(std::string_view value)> lambda) const;
+
   uint32_t hash() const {
     return raw.length();
   } // Very fast and simple hash function
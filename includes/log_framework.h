@@ -9,7 +9,9 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
 
 // Local includes
 #include "lioli.h"
@@ -69,6 +71,22 @@ class Serializer : public LogBase {
 public:
   Serializer(const char *my_name) : LogBase(my_name) {}
 
+  // Collects the output of a batch in one contiguous buffer, so a logger can
+  // write it with a single syscall
+  class Sink {
+    std::string data;
+
+  public:
+    void append(std::string_view bytes) { data.append(bytes); }
+
+    // Direct access for serializers that encode in place, and for loggers
+    // that want to take over the buffer
+    std::string &buffer() { return data; }
+
+    bool empty() const { return data.empty(); }
+    void clear() { data.clear(); }
+  };
+
   // There might be multiple serialization contexts in use at any given time or
   // sequentially, if serialization is in anyway state full, then we need  a
   // different object for each
@@ -79,6 +97,15 @@ public:
     // might return an empty object
     virtual std::string serialize(const Tree &&) = 0;
 
+    // Serializes trees in order, appending the output to sink, the output is
+    // the same as calling serialize() for each tree.  Serializers with locks
+    // or pegs should override it, to take them once per batch
+    virtual void serialize_batch(std::span<const Tree> trees, Sink &sink) {
+      for (auto &tree : trees) {
+        sink.append(serialize(std::move(tree)));
+      }
+    }
+
     // Terminate current context, returned byte sequence is any remaining
     // data/end marker of current context.  Context object is invalid after
     // this, except the is_closed() function.
@@ -95,17 +122,32 @@ public:
 
   virtual std::shared_ptr<Context> create_context() = 0;
 
+  // Returns a context whose output continues a stream started by a context
+  // from create_context(), i.e. without any stream header, and whose close()
+  // only ends the batch.  Used to serialize batches in parallel, returns
+  // nullptr if the serializer can't do that.
+  virtual std::shared_ptr<Context> create_batch_context() { return nullptr; }
+
   static std::shared_ptr<Serializer> &get_null_obj();
 };
 
+// Class of a logged tree, for loggers that queue trees, telling which queue
+// it goes to and so which budget it's counted against.  Queues are drained in
+// this order.
+enum class Priority { high, normal, bulk };
+constexpr std::size_t priority_count = 3;
+
 class Logger : public LogBase {
 
 public:
   Logger(const char *my_name) : LogBase(my_name) {}
 
-  // Must be non-blocking
+  // Must be non-blocking, logs with Priority::normal
   virtual void operator<<(const Tree &&tree) = 0;
 
+  // Must be non-blocking, loggers without queues ignore the priority
+  virtual void log(const Tree &&tree, Priority) { *this << std::move(tree); }
+
   virtual bool had_data_loss(bool clear_flag = true) = 0;
 
   static std::shared_ptr<Logger> &get_null_obj();
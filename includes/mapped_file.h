@@ -0,0 +1,65 @@
+#ifndef mapped_file_c71f0a3e
+#define mapped_file_c71f0a3e
+
+// Snort includes
+
+// System includes
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Local includes
+
+// Global includes
+
+// Debug includes
+
+namespace Common {
+
+// Read only mapping of a file, used by the readers of the binary formats
+class MappedFile {
+  void *mapping = MAP_FAILED;
+  uint64_t length = 0;
+
+public:
+  MappedFile(const char *file_name) {
+    int fd = ::open(file_name, O_RDONLY);
+
+    if (fd == -1) {
+      return;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      length = st.st_size;
+      mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    ::close(fd);
+  }
+
+  ~MappedFile() {
+    if (mapping != MAP_FAILED) {
+      munmap(mapping, length);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool is_open() const { return mapping != MAP_FAILED; }
+
+  const uint8_t *data() const {
+    return is_open() ? static_cast<const uint8_t *>(mapping) : nullptr;
+  }
+
+  uint64_t size() const { return is_open() ? length : 0; }
+};
+
+} // namespace Common
+
+#endif // mapped_file_c71f0a3e
@@ -0,0 +1,131 @@
+#ifndef reactor_8c3e51b0
+#define reactor_8c3e51b0
+
+// Snort includes
+
+// System includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Local includes
+
+// Global includes
+
+// Debug includes
+
+namespace Common {
+
+// Runs the output workers (loggers, pcap dumpers, ...) on a few shared
+// threads, rather than a thread each.  A worker is a Task, a non blocking
+// state machine: it does what it can in run(), tells what it waits for (fds
+// and/or a time) and returns.  A task is always run by the same thread, never
+// concurrently with itself, so its state needs no locking against itself.
+//
+// Each thread waits with its own epoll, watches are one shot, so a task is
+// woken once for each time it asks, and must ask again if it still waits.
+class Reactor {
+  struct Loop;
+
+public:
+  using clock = std::chrono::steady_clock;
+
+  class Task {
+    friend class Reactor;
+
+    std::atomic<Loop *> loop = nullptr;
+    std::vector<int> watched; // fds added to the loop's epoll
+    clock::time_point deadline = clock::time_point::max();
+    bool queued = false; // In the loop's ready list, protected by its mutex
+
+  protected:
+    // The functions below may only be called from run()
+
+    // Wakes the task once fd has one of the events (EPOLLIN, EPOLLOUT), or
+    // has an error or hang up
+    void watch(int fd, uint32_t events);
+
+    // Stops watching fd, must be called before fd is closed
+    void unwatch(int fd);
+
+    // Wakes the task at when, replacing an earlier time (max() = never)
+    void wake_at(clock::time_point when) { deadline = when; }
+
+  public:
+    Task() = default;
+    virtual ~Task() = default;
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    // Does what can be done without blocking, called on the task's thread
+    // when it's added, woken by wake(), one of its fds or its time.  Might be
+    // called when there's nothing to do.
+    virtual void run() = 0;
+
+    // Makes the task run soon, safe from any thread
+    void wake();
+  };
+
+  // The reactor shared by all outputs
+  static Reactor &get();
+
+  Reactor() = default;
+  ~Reactor();
+
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+
+  // Makes sure there are at least count threads, tasks already added stay
+  // where they are.  There's one thread until something asks for more.
+  void set_threads(std::size_t count);
+
+  std::size_t get_threads();
+
+  // Adds task to the thread with the fewest tasks, and runs it
+  void add(Task &task);
+
+  // Removes task, waiting for it to return if it's running.  Must not be
+  // called from the task's own thread.
+  void remove(Task &task);
+
+private:
+  struct Loop {
+    int epoll_fd = -1;
+    int event_fd = -1; // Wakes the thread when the ready list changes
+
+    std::mutex mutex; // Protects the members below
+    std::condition_variable cv; // Signaled when running changes
+    std::unordered_set<Task *> tasks;
+    std::deque<Task *> ready;
+    Task *running = nullptr;
+    bool polling = false; // In epoll_wait, must be woken by event_fd
+    bool stopping = false;
+
+    std::thread thread;
+
+    Loop();
+    ~Loop();
+
+    // Puts task in the ready list, mutex must be held
+    void make_ready(Task *task);
+
+    clock::time_point next_deadline();
+    void thread_loop();
+  };
+
+  std::mutex mutex; // Protects loops
+  std::vector<std::unique_ptr<Loop>> loops;
+};
+
+} // namespace Common
+
+#endif // reactor_8c3e51b0
@@ -0,0 +1,324 @@
+#ifndef segment_store_5b1e8f26
+#define segment_store_5b1e8f26
+
+// Snort includes
+
+// System includes
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Local includes
+#include "mapped_file.h"
+
+// Global includes
+
+// Debug includes
+
+// Local store of serialized trees, written by logger_store, so the last hours
+// of output can be queried on the box by time and by the value of a key.
+//
+// A store is a directory of fixed size segment files, named by a sequence
+// number as 16 hex digits and ".seg", e.g. "000000000000002a.seg".  Only the
+// segment with the highest number is written to, it's mapped by the writer
+// and readers alike, so records are visible as soon as they're published.
+// When the next record doesn't fit, the segment is sealed and a new one
+// started.  The oldest segments are deleted to keep the store below a size.
+//
+// Layout of a segment, little endian as on the host:
+//
+//   0       Header (see below), header_size bytes
+//   4096    time index, TimeEntry[time_index_max]
+//   ...     records, from data_start up to data_end
+//   ...     unused
+//   ...     key index, KeyEntry[key_entries], up to segment_size, once sealed
+//
+// Records are 8 byte aligned:
+//
+//   4 byte payload length
+//   4 byte flags (see Flags)
+//   8 byte time, ns since epoch, never lower than the previous record's
+//   8 byte hash of the value of the indexed key, see key_hash()
+//   payload, padded to 8 bytes
+//
+// The time index is sparse, there's an entry for the first record starting
+// in each index_interval bytes of records, so a time is found by a binary
+// search and a scan of at most index_interval bytes.
+//
+// The key index has an entry for every record with the key, sorted by hash
+// and offset, a key is found by a binary search.  It's written when the
+// segment is sealed, the segment being written is searched by going through
+// the record headers (not the payloads).  A hash match might, very rarely,
+// be a different value.
+//
+// Every segment has a serializer context of its own, its first record has
+// the context_start flag (and carries any header of the serializer), and the
+// output of closing it is a record with the context_end flag.  A serializer
+// whose trees can be read on their own (txt, ndjson, ...) lets any record be
+// read without the rest of the segment.
+
+namespace SegmentStore {
+
+constexpr char magic[8] = {'L', 'I', 'O', 'L', 'I', 'S', 'E', 'G'};
+constexpr uint32_t version = 1;
+constexpr std::size_t header_size = 4096;
+constexpr std::size_t record_header_size = 24;
+
+enum Flags : uint32_t {
+  context_start = 1, // First record of the segment's serializer context
+  context_end = 2,   // The output of closing the context, might be empty
+  has_key = 4        // The tree had the indexed key, key_hash is set
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t segment_size;
+  uint64_t sequence;       // Number of the segment, as in its name
+  uint64_t data_start;     // Offset of the first record
+  uint32_t index_interval; // Bytes of records per time index entry
+  uint32_t time_index_max; // Entries there's room for
+  char serializer[64];     // Name, zero terminated
+  char key[256];           // Indexed key, e.g. "$.principal.addr.ip", or ""
+
+  alignas(64) std::atomic<uint64_t> data_end; // Records before it are valid
+  std::atomic<uint64_t> time_entries;
+  std::atomic<int64_t> first_time; // Of the first and last record published
+  std::atomic<int64_t> last_time;
+
+  alignas(64) std::atomic<uint64_t> key_entries; // Valid once sealed
+  std::atomic<uint32_t> sealed;
+};
+
+struct TimeEntry {
+  int64_t time;
+  uint64_t offset;
+};
+
+struct KeyEntry {
+  uint64_t hash;
+  uint64_t offset;
+};
+
+static_assert(sizeof(Header) <= header_size);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<int64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// A record, read in place, valid while its Segment is
+struct Record {
+  uint64_t offset;
+  uint32_t flags;
+  int64_t time;
+  uint64_t key_hash;
+  std::string_view payload;
+};
+
+// 64 bit FNV-1a of the key's value, never 0
+uint64_t key_hash(std::string_view value);
+
+// File name of segment number sequence, and the number of a file name, false
+// if it isn't the name of a segment
+std::string segment_name(uint64_t sequence);
+bool parse_segment_name(std::string_view name, uint64_t &sequence);
+
+// Paths of the segments in directory, oldest first
+std::vector<std::string> list_segments(const std::string &directory);
+
+// The segment being written, used by logger_store
+class Writer {
+  Header *header = nullptr;
+  uint8_t *data = nullptr;
+  uint64_t segment_size = 0;
+  int fd = -1;
+
+  uint64_t data_end = 0; // Ahead of header->data_end until published
+  uint64_t end_reserve = 0;
+  int64_t last_time = 0;
+  bool has_records = false;
+  std::vector<KeyEntry> keys; // The key index, written when sealed
+
+public:
+  struct Config {
+    uint64_t segment_size = 64 << 20;
+    uint32_t index_interval = 64 << 10;
+    uint32_t end_reserve = 4096; // Kept for the context_end record
+    std::string serializer;
+    std::string key;
+  };
+
+  // Creates the segment, check is_open() for success (errno is then set)
+  Writer(const std::string &path, uint64_t sequence, const Config &config);
+  ~Writer();
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  bool is_open() const { return header != nullptr; }
+
+  // Largest payload append() can take, in an empty segment
+  uint64_t max_payload() const;
+
+  // Copies a record into the segment, returns false if it doesn't fit in
+  // what's left, less end_reserve unless it's the context_end record.  time
+  // is raised to that of the previous record if lower.  key is nullptr if
+  // the tree doesn't have the key.
+  bool append(std::string_view payload, uint32_t flags, int64_t time,
+              const uint64_t *key);
+
+  // Makes appended records visible to readers
+  void publish();
+
+  // Publishes, writes the key index and marks the segment sealed, nothing
+  // can be appended after it
+  void seal();
+
+  // Bytes of records appended
+  uint64_t used() const;
+
+  // Seals a segment left unsealed, e.g. by a crash, its key index is built
+  // from the record headers.  Returns false if it isn't a valid segment.
+  static bool recover(const std::string &path);
+};
+
+// Read only view of a segment, mapped
+class Segment {
+  Common::MappedFile file;
+  const Header *header = nullptr;
+
+  // Where a scan for the records with time >= from starts, at or after
+  // offset
+  uint64_t seek(uint64_t offset, int64_t from) const;
+  bool read(uint64_t offset, uint64_t end, Record &record) const;
+
+public:
+  explicit Segment(const std::string &path);
+
+  Segment(const Segment &) = delete;
+  Segment &operator=(const Segment &) = delete;
+
+  // False if the file isn't a segment, or is truncated
+  bool is_valid() const { return header != nullptr; }
+
+  const Header &get_header() const { return *header; }
+
+  // Calls lambda(const Record &) for each record with from <= time <= to, in
+  // order, until it returns false.  Returns false if lambda did.
+  template <class Lambda>
+  bool for_each(int64_t from, int64_t to, Lambda lambda) const {
+    uint64_t end = header->data_end.load(std::memory_order_acquire);
+    Record record;
+
+    for (uint64_t offset = seek(header->data_start, from);
+         read(offset, end, record) && record.time <= to;
+         offset += record_size(record)) {
+      if (record.time >= from && !lambda(record)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // As for_each(), for the records whose key has hash
+  template <class Lambda>
+  bool for_each_key(uint64_t hash, int64_t from, int64_t to,
+                    Lambda lambda) const {
+    if (!header->sealed.load(std::memory_order_acquire)) {
+      return for_each(from, to, [&](const Record &record) {
+        return !(record.flags & has_key) || record.key_hash != hash ||
+               lambda(record);
+      });
+    }
+
+    uint64_t end = header->data_end.load(std::memory_order_acquire);
+    Record record;
+
+    for (auto entry = find_key(hash); entry != key_end() &&
+                                      entry->hash == hash;
+         entry++) {
+      if (read(entry->offset, end, record) && record.time >= from &&
+          record.time <= to && !lambda(record)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  static uint64_t record_size(const Record &record) {
+    return (record_header_size + record.payload.size() + 7) & ~uint64_t(7);
+  }
+
+private:
+  const KeyEntry *find_key(uint64_t hash) const;
+  const KeyEntry *key_end() const;
+};
+
+// Queries over all segments of a store, segments are mapped one at a time
+class Store {
+  std::string directory;
+
+public:
+  explicit Store(const std::string &directory) : directory(directory) {}
+
+  // Calls lambda(const Segment &, const Record &) for each record with
+  // from <= time <= to, oldest first, until it returns false.  Segments that
+  // can't be read, or are deleted while we look, are skipped.
+  template <class Lambda>
+  void for_each(int64_t from, int64_t to, Lambda lambda) const {
+    visit(from, to, [&](const Segment &segment) {
+      return segment.for_each(from, to, [&](const Record &record) {
+        return lambda(segment, record);
+      });
+    });
+  }
+
+  // As for_each(), for records whose key has value
+  template <class Lambda>
+  void for_each_key(std::string_view value, int64_t from, int64_t to,
+                    Lambda lambda) const {
+    uint64_t hash = key_hash(value);
+
+    visit(from, to, [&](const Segment &segment) {
+      return segment.for_each_key(hash, from, to, [&](const Record &record) {
+        return lambda(segment, record);
+      });
+    });
+  }
+
+private:
+  // Calls visitor(const Segment &) for the segments that might have records
+  // in the time range, until it returns false
+  template <class Visitor>
+  void visit(int64_t from, int64_t to, Visitor visitor) const {
+    for (auto &path : list_segments(directory)) {
+      Segment segment(path);
+
+      if (!segment.is_valid()) {
+        continue;
+      }
+
+      auto &header = segment.get_header();
+
+      if (header.data_end.load(std::memory_order_acquire) ==
+              header.data_start ||
+          header.first_time.load(std::memory_order_relaxed) > to ||
+          header.last_time.load(std::memory_order_relaxed) < from) {
+        continue;
+      }
+
+      if (!visitor(segment)) {
+        return;
+      }
+    }
+  }
+};
+
+} // namespace SegmentStore
+
+#endif // segment_store_5b1e8f26
@@ -0,0 +1,106 @@
+#ifndef serialization_pool_2b9e41c6
+#define serialization_pool_2b9e41c6
+
+// Snort includes
+
+// System includes
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+
+// Debug includes
+
+namespace LioLi {
+
+// Serializes batches of trees on a number of worker threads, for a logger
+// whose single writer thread can't keep up with the serializer.  Batches get
+// sequence numbers when submitted, and their output is taken in that order.
+//
+// The first batch of a stream must be serialized on the stream context (it
+// might add a header), later batches are serialized in parallel on batch
+// contexts from Serializer::create_batch_context().
+class SerializationPool {
+  struct Job {
+    uint64_t sequence;
+    uint64_t generation;
+    std::shared_ptr<Serializer::Context> context;
+    bool close; // Append context->close() to the output, for batch contexts
+    std::vector<Tree> trees;
+  };
+
+  struct Result {
+    std::string output;
+    std::size_t tree_count;
+  };
+
+  std::shared_ptr<Serializer> serializer;
+  std::function<void()> on_ready;
+
+  std::mutex mutex; // Protects members below
+  std::condition_variable cv;
+  bool terminate = false;
+  uint64_t generation = 0; // Results of older generations are dropped
+  uint64_t next_submit = 0;
+  uint64_t next_take = 0;
+  std::deque<Job> jobs;
+  std::map<uint64_t, Result> results;
+  std::vector<std::thread> workers;
+
+  void worker_loop();
+
+public:
+  // Number of trees per batch, enough to amortize the per batch overhead but
+  // small enough to spread a queue over the workers
+  static constexpr std::size_t batch_size = 64;
+
+  // Returns a pool with threads workers, or nullptr if threads is 0 or the
+  // serializer can't serialize batches in parallel
+  static std::unique_ptr<SerializationPool>
+  create(std::shared_ptr<Serializer> serializer, unsigned threads,
+         std::function<void()> on_ready);
+
+  // on_ready is called, without pool locks held, when the next result in
+  // order might be ready
+  SerializationPool(std::shared_ptr<Serializer> serializer, unsigned threads,
+                    std::function<void()> on_ready);
+  ~SerializationPool();
+
+  SerializationPool(const SerializationPool &) = delete;
+  SerializationPool &operator=(const SerializationPool &) = delete;
+
+  // Queues trees for serialization, on stream_context if set (the first batch
+  // of a stream) otherwise on a new batch context.  Returns the number of
+  // batches waiting for a worker.
+  std::size_t submit(std::vector<Tree> &&trees,
+                     std::shared_ptr<Serializer::Context> stream_context);
+
+  // Gets the output of the next batch in submit order, returns false if it
+  // isn't done yet.  waiting is set to the number of finished batches held
+  // back by it.
+  bool take(std::string &output, std::size_t &tree_count,
+            std::size_t &waiting);
+
+  // True if take() would return a result
+  bool is_ready();
+
+  // Number of batches submitted but not yet taken
+  std::size_t outstanding();
+
+  // Drops all batches not yet taken, e.g. when the stream was lost
+  void discard();
+};
+
+} // namespace LioLi
+
+#endif // serialization_pool_2b9e41c6
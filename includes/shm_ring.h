@@ -0,0 +1,187 @@
+#ifndef shm_ring_2d9a71e4
+#define shm_ring_2d9a71e4
+
+// Snort includes
+
+// System includes
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Local includes
+
+// Global includes
+
+// Debug includes
+
+// Single producer, single consumer ring of records in shared memory, written
+// by logger_shm.  The consumer maps the ring and reads the records in place,
+// no syscalls are made per record, and the doorbell (an eventfd) is only rung
+// when the consumer has said it is going to sleep.
+//
+// The ring is a sealed memfd, handed to the consumer together with the
+// doorbell over a unix domain socket: the consumer connects, and receives one
+// byte with both fds (SCM_RIGHTS, ring first).  The connection is kept open
+// while the consumer is attached, there's only ever one.
+//
+// Layout of the memfd, little endian as on the host:
+//
+//   0     8 byte magic "LIOLISHM"
+//   8     4 byte version (1)
+//   12    4 byte header size (4096), offset of the data area
+//   16    8 byte data size, a power of two
+//   64    8 byte write position, set by the producer
+//   72    8 byte sequence number of the next record
+//   128   8 byte read position, set by the consumer
+//   136   4 byte consumer waiting flag
+//   4096  data area
+//
+// Positions count bytes since the ring was created, the offset in the data
+// area is the position modulo the data size.  The producer never writes past
+// read position + data size, so nothing is lost in the ring, a consumer that
+// doesn't keep up makes the logger's queue overflow instead.
+//
+// Records are 8 byte aligned and never wrap:
+//
+//   4 byte payload length
+//   4 byte flags (see Flags)
+//   8 byte sequence number, one higher than the previous record
+//   payload, padded to 8 bytes
+//
+// When a record doesn't fit before the end of the data area, the rest of it is
+// skipped, with a padding record if there's room for its header.  The records
+// of a serializer context concatenated give the serializer's output.
+
+namespace ShmRing {
+
+constexpr char magic[8] = {'L', 'I', 'O', 'L', 'I', 'S', 'H', 'M'};
+constexpr uint32_t version = 1;
+constexpr std::size_t header_size = 4096;
+constexpr std::size_t record_header_size = 16;
+
+enum Flags : uint32_t {
+  context_start = 1, // First record of a serializer context
+  context_end = 2,   // The output of closing the context, might be empty
+  padding = 4        // Not a record, skip to the start of the data area
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t data_size;
+
+  alignas(64) std::atomic<uint64_t> write_pos;
+  std::atomic<uint64_t> write_seq;
+
+  alignas(64) std::atomic<uint64_t> read_pos;
+  std::atomic<uint32_t> consumer_waiting;
+};
+
+static_assert(sizeof(Header) <= header_size);
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// A record, read in place, its payload is valid until Reader::release()
+struct Record {
+  uint64_t seq;
+  uint32_t flags;
+  std::string_view payload;
+};
+
+// Producer side, used by logger_shm
+class Writer {
+  Header *header = nullptr;
+  uint8_t *data = nullptr;
+  uint64_t data_size = 0;
+  int memory_fd = -1;
+  int doorbell_fd = -1;
+
+  uint64_t write_pos = 0; // Ahead of header->write_pos until published
+  uint64_t seq = 0;
+  uint64_t read_pos = 0; // Last seen header->read_pos
+
+public:
+  // data_size must be a power of two, check is_open() for success
+  Writer(const char *name, uint64_t data_size);
+  ~Writer();
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  bool is_open() const { return header != nullptr; }
+
+  // Largest payload write() can take
+  uint64_t max_payload() const { return data_size / 2 - record_header_size; }
+
+  // Copies a record into the ring, returns false if there's no room for it
+  // until the consumer has read more, or it's larger than max_payload()
+  bool write(std::string_view payload, uint32_t flags);
+
+  // Makes written records visible to the consumer, ringing the doorbell if it
+  // waits.  Returns true if the doorbell was rung.
+  bool publish();
+
+  // Bytes written but not yet read
+  uint64_t used_bytes() const {
+    return write_pos - header->read_pos.load(std::memory_order_acquire);
+  }
+
+  // Sends the ring and doorbell fds on a connected unix socket
+  bool hand_out(int socket) const;
+};
+
+// Consumer side
+class Reader {
+  Header *header = nullptr;
+  const uint8_t *data = nullptr;
+  uint64_t data_size = 0;
+  int doorbell_fd = -1;
+  int socket = -1; // The connection we got the fds on, if any
+
+  uint64_t read_pos = 0;  // Position of the next record
+  uint64_t available = 0; // Last seen header->write_pos
+  bool failed = false;
+
+public:
+  Reader() = default;
+  ~Reader();
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+
+  // Connects to logger_shm's socket and attaches to the ring it hands out
+  bool connect(const char *socket_path);
+
+  // Receives the fds on a connected socket and attaches, keeps the socket
+  bool receive(int socket);
+
+  // Takes ownership of the fds, returns false if they don't hold a valid ring
+  bool attach(int memory_fd, int doorbell_fd);
+
+  bool is_attached() const { return header != nullptr; }
+
+  // Returns false when there are no more published records, or the ring is
+  // corrupt
+  bool next(Record &record);
+
+  // Lets the producer reuse the space of the records returned by next()
+  void release() {
+    header->read_pos.store(read_pos, std::memory_order_release);
+  }
+
+  // Sleeps until more records are published or timeout_ms has passed (-1 =
+  // forever), returns false if the producer has closed our connection
+  bool wait(int timeout_ms);
+
+  // True if next() stopped on a corrupt record
+  bool is_corrupt() const { return failed; }
+
+  uint64_t get_data_size() const { return data_size; }
+};
+
+} // namespace ShmRing
+
+#endif // shm_ring_2d9a71e4
@@ -0,0 +1,123 @@
+#ifndef spill_ring_8b2f64d0
+#define spill_ring_8b2f64d0
+
+// Snort includes
+
+// System includes
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+// Local includes
+
+// Debug includes
+
+namespace LioLi {
+
+// Append only ring of segment files, keeping serialized output on disk while
+// it can't be sent, e.g. during a collector outage.  Output is read back in
+// the order it was written.
+//
+// Segments are the unit of loss: when a new segment would take the ring over
+// max_bytes the oldest segments are deleted, and a segment with a failed write
+// is discarded.  Writers that close their serializer context before sealing a
+// segment thus never lose half a context.
+//
+// A segment is read one at a time, and kept until all of it has been
+// acknowledged as sent, so a broken stream rewinds to its start rather than
+// losing what was read but never made it out.
+//
+// Files are named <dir>/<name>.<n>.spill, left over files of an earlier run are
+// removed, and the files of this run are removed when the ring is destroyed.
+// Not thread safe, meant for a logger's worker thread.
+class SpillRing {
+public:
+  enum class Sync {
+    never,   // Leave it to the kernel
+    segment, // fsync() when a segment is sealed
+    write    // fsync() after every write
+  };
+
+  struct Stats {
+    uint64_t spilled;  // Bytes written since last call
+    uint64_t replayed; // Bytes acknowledged since last call
+    uint64_t dropped;  // Bytes deleted unread since last call
+    uint64_t bytes;    // Bytes currently kept
+  };
+
+  SpillRing(std::string dir, std::string name, uint64_t max_bytes,
+            uint64_t segment_bytes, Sync sync);
+  ~SpillRing();
+
+  SpillRing(const SpillRing &) = delete;
+  SpillRing &operator=(const SpillRing &) = delete;
+
+  // Makes sure a segment is open for writing, returns false if that isn't
+  // possible within max_bytes, or the segment can't be created
+  bool reserve();
+
+  // Appends to the open segment, which must be reserved.  Returns false if the
+  // write failed, the open segment is then discarded.
+  bool write(const std::string &data);
+
+  // True when the open segment has reached the segment size, and should be
+  // sealed
+  bool segment_full() const;
+
+  // Ends the open segment, making it readable, the next write needs a new
+  // reserve()
+  void seal();
+
+  // True if nothing is kept, sealed or not, acknowledged or not
+  bool empty() const;
+
+  // Moves up to max bytes of the oldest sealed segment to data, returns false
+  // if there is nothing sealed left to read, or all of the oldest segment has
+  // been read but not yet acknowledged
+  bool read(std::string &data, std::size_t max);
+
+  // Tells that bytes more of what read() gave, in order, has been sent, the
+  // segment is removed once all of it has
+  void acknowledge(uint64_t bytes);
+
+  // Reads the segment being read from its start again, e.g. as the stream it
+  // was sent on broke
+  void rewind();
+
+  Stats take_stats();
+
+private:
+  struct Segment {
+    uint64_t number;
+    uint64_t size;
+  };
+
+  std::string dir;
+  std::string name;
+  uint64_t max_bytes;
+  uint64_t segment_bytes;
+  Sync sync;
+
+  std::deque<Segment> sealed; // Oldest first
+  Segment open = {0, 0};
+  int write_fd = -1; // fd of open, -1 if no segment is open
+  int read_fd = -1;  // fd of sealed.front(), -1 if it isn't being read
+  uint64_t read_offset = 0;
+  uint64_t acked = 0; // Bytes of sealed.front() acknowledged
+  uint64_t next_number = 0;
+  uint64_t total_bytes = 0; // Sealed and open, not yet acknowledged
+
+  uint64_t spilled = 0;
+  uint64_t replayed = 0;
+  uint64_t dropped = 0;
+
+  std::string path(uint64_t number) const;
+  void discard_open();
+  void remove_front();
+  bool make_room();
+};
+
+} // namespace LioLi
+
+#endif // spill_ring_8b2f64d0
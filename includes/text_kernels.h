@@ -0,0 +1,51 @@
+#ifndef text_kernels_5e0d2b91
+#define text_kernels_5e0d2b91
+
+// Snort includes
+
+// System includes
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Local includes
+
+// Global includes
+
+// Debug includes
+
+// Text encoding kernels used by the text based serializers.
+//
+// Each kernel has a scalar version and, on x86-64, SSE4.2 and AVX2 versions.
+// The best version supported by the CPU is selected the first time a kernel
+// is used, all versions give identical output.
+
+namespace Common {
+
+enum class TextKernelsIsa { scalar, sse42, avx2 };
+
+// Returns the kernel set in use
+TextKernelsIsa text_kernels_isa();
+const char *text_kernels_isa_name(TextKernelsIsa isa);
+
+// Selects a kernel set, returns false if the CPU doesn't support it.  Only
+// meant for tests and benchmarks, must not be called while kernels are in use
+bool select_text_kernels(TextKernelsIsa isa);
+
+// Appends in to output with \ " newline tab and carriage return escaped C
+// style, and all other chars outside printable ascii as \xNN
+void append_escaped(std::string &output, std::string_view in);
+
+// Appends in to output escaped as the content of a JSON string, bytes outside
+// printable ascii are written as \u00NN (e.i. read as latin-1)
+void append_json_escaped(std::string &output, std::string_view in);
+
+// Appends in to output as lower case hex, 2 chars per byte
+void append_hex(std::string &output, std::string_view in);
+
+// Appends in to output as base64 (RFC 4648, with padding)
+void append_base64(std::string &output, std::string_view in);
+
+} // namespace Common
+
+#endif // text_kernels_5e0d2b91
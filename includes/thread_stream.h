@@ -0,0 +1,123 @@
+#ifndef thread_stream_c41e9b27
+#define thread_stream_c41e9b27
+
+// Snort includes
+
+// System includes
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+
+// Debug includes
+
+namespace LioLi {
+
+// Output stream owned by a single packet thread, for loggers that give every
+// packet thread its own serializer context and connection/pipe.  Trees are
+// serialized and written on the calling thread, so the logging path takes no
+// lock shared with other threads, only the serializer's peg counts, which are
+// atomic, are updated by all of them.
+//
+// Writes never block, output that can't be written right away is kept, up to
+// max_pending bytes, after which trees are dropped.  A broken stream is
+// reopened, at most once per retry interval, trees logged in between are
+// dropped.
+class ThreadStream {
+public:
+  // Returns a non-blocking fd for the stream, or -1 if it can't be opened now
+  using Opener = std::function<int()>;
+
+  struct Counts {
+    uint64_t logs_in = 0;
+    uint64_t logs_out = 0;
+    uint64_t overflows = 0;
+    uint64_t write_errors = 0;
+    uint64_t restarts = 0;
+  };
+
+  // Gets the counts since last call, called by the owning thread at most once
+  // a second and when the stream is closed
+  using Reporter = std::function<void(const Counts &)>;
+
+  ThreadStream(std::shared_ptr<Serializer> serializer, Opener opener,
+               Reporter reporter, std::size_t max_pending,
+               uint32_t restart_interval_s, uint32_t retry_interval_ms);
+  ~ThreadStream();
+
+  ThreadStream(const ThreadStream &) = delete;
+  ThreadStream &operator=(const ThreadStream &) = delete;
+
+  void write(const Tree &tree);
+
+  // Ends the context and writes what's pending, waiting at most a second for
+  // the stream to accept it
+  void close();
+
+  // Safe from any thread
+  bool had_data_loss(bool clear_flag) {
+    return clear_flag ? data_loss.exchange(false) : data_loss.load();
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  std::shared_ptr<Serializer> serializer;
+  std::shared_ptr<Serializer::Context> context;
+  Opener opener;
+  Reporter reporter;
+  std::size_t max_pending;
+  std::chrono::seconds restart_interval;
+  std::chrono::milliseconds retry_interval;
+
+  int fd = -1;
+  std::string pending; // Serialized, but not yet written
+  std::size_t pending_index = 0;
+
+  clock::time_point next_restart;
+  clock::time_point next_retry;
+  clock::time_point next_report;
+  Counts counts;
+
+  std::atomic<bool> data_loss = false;
+
+  bool ensure_open(clock::time_point now);
+  void flush();
+  void drop_stream();
+  void report(clock::time_point now, bool force = false);
+};
+
+// The streams of a logger, one slot per packet thread (snort instance id).
+// Slots are only touched by their own thread, except for had_data_loss().
+class ThreadStreams {
+  std::mutex mutex; // Protects slots against had_data_loss() while changing
+  std::unique_ptr<std::unique_ptr<ThreadStream>[]> slots;
+  unsigned slot_count = 0;
+
+public:
+  // Call before packet threads start, later calls are ignored
+  void resize(unsigned count);
+
+  // Installs the stream of the calling packet thread, call from tinit
+  void open(std::unique_ptr<ThreadStream> stream);
+
+  // Closes the stream of the calling packet thread, call from tterm
+  void close();
+
+  // Stream of the calling thread, nullptr if it doesn't have one (e.g. it
+  // isn't a packet thread)
+  ThreadStream *get();
+
+  bool had_data_loss(bool clear_flag);
+};
+
+} // namespace LioLi
+
+#endif // thread_stream_c41e9b27
@@ -0,0 +1,235 @@
+#ifndef tree_ring_5d07a3e1
+#define tree_ring_5d07a3e1
+
+// Snort includes
+#include <framework/parameter.h>
+#include <framework/value.h>
+
+// System includes
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+
+// Debug includes
+
+namespace LioLi {
+
+struct QueueConfig;
+
+// Bounded lock free queue of trees, for loggers with many producers (the packet
+// threads) and a single worker thread consuming.  Producers never take a lock,
+// and only signal the consumer when it has announced it's going to sleep, so
+// a busy consumer is woken once per batch rather than once per tree.
+//
+// Each priority class has its own sub queue, with its own capacity, byte budget
+// and drop policy, so e.g. a flood of bulk trees can't push out alerts.  The
+// consumer always takes from the highest priority class that has trees queued.
+//
+// Bytes are the trees' footprint(), a tree larger than the budget is still
+// queued when its class is otherwise empty.
+class TreeRing {
+public:
+  enum class DropPolicy {
+    oldest,      // Make space by dropping the oldest trees queued
+    newest,      // Drop the tree being pushed
+    random_early // As newest, but start dropping at random once half full
+  };
+
+  struct Stats {
+    uint64_t pushed;  // Trees pushed since last call
+    uint64_t dropped; // Trees dropped since last call, because ring was full
+    uint64_t dropped_bytes; // Bytes of the dropped trees
+    std::size_t size;       // Trees currently queued
+    std::size_t bytes;      // Bytes currently queued
+    uint64_t class_dropped[priority_count]; // dropped, split by Priority
+
+    uint64_t dropped_of(Priority priority) const {
+      return class_dropped[static_cast<std::size_t>(priority)];
+    }
+  };
+
+private:
+  struct Cell {
+    std::atomic<uint64_t> sequence; // Position this cell is ready for, see .cc
+    Tree tree;
+    std::size_t bytes;
+  };
+
+  // The sub queue of a priority class
+  struct Lane {
+    std::unique_ptr<Cell[]> cells;
+    std::size_t cell_count = 0; // At least 2, as needed by the sequence scheme
+    std::size_t capacity = 0;   // Max number of trees queued
+    std::atomic<std::size_t> max_bytes = 0; // 0 = no limit
+    std::atomic<DropPolicy> policy = DropPolicy::oldest;
+
+    // Producers and consumer are kept on separate cache lines
+    alignas(64) std::atomic<uint64_t> head = 0; // Next position to pop
+    alignas(64) std::atomic<uint64_t> tail = 0; // Next position to push
+    alignas(64) std::atomic<uint64_t> queued_bytes = 0;
+    alignas(64) std::atomic<uint64_t> dropped = 0;
+    std::atomic<uint64_t> dropped_bytes = 0;
+    std::atomic<uint64_t> rejected = 0; // Dropped without being queued
+
+    // Consumer only, values seen by the last take_stats()
+    uint64_t last_pushed = 0;
+    uint64_t last_dropped = 0;
+    uint64_t last_dropped_bytes = 0;
+
+    std::size_t set_capacity(std::size_t capacity);
+    bool enqueue(Tree &tree, std::size_t bytes);
+    bool take(Tree &tree, std::size_t &bytes);
+    bool drop_oldest();
+    void reject(std::size_t bytes);
+    bool drop_early(std::size_t bytes);
+    double fill(std::size_t bytes) const;
+    bool empty() const;
+  };
+
+  Lane lanes[priority_count];
+
+  std::atomic<bool> sleeping = false; // Consumer is, or will be, waiting
+  int event_fd;
+
+  Lane &lane(Priority priority) {
+    return lanes[static_cast<std::size_t>(priority)];
+  }
+
+public:
+  TreeRing(std::size_t capacity = 1);
+  ~TreeRing();
+
+  TreeRing(const TreeRing &) = delete;
+  TreeRing &operator=(const TreeRing &) = delete;
+
+  // The functions below take the class they act on, default the normal one
+
+  // Changes the number of trees that can be queued, returns the number of
+  // trees dropped because they didn't fit.  Must not be called concurrently
+  // with any other member, e.g. only during configuration.
+  std::size_t set_capacity(std::size_t capacity,
+                           Priority priority = Priority::normal);
+
+  // Limits the bytes queued, 0 = no limit.  Safe from any thread.
+  void set_max_bytes(std::size_t max, Priority priority = Priority::normal) {
+    lane(priority).max_bytes = max;
+  }
+
+  // What to drop when full or over budget.  Safe from any thread.
+  void set_drop_policy(DropPolicy policy,
+                       Priority priority = Priority::normal) {
+    lane(priority).policy = policy;
+  }
+
+  // All of the above, for every class, returns the number of trees dropped
+  // because they didn't fit.  As set_capacity(), only during configuration.
+  std::size_t configure(const QueueConfig &config);
+
+  // Queues tree, or drops a tree as told by the drop policy.  Safe from any
+  // thread.
+  void push(Tree &&tree, Priority priority = Priority::normal);
+
+  // Wakes the consumer, e.g. when it should look at something besides the
+  // queue.  Safe from any thread.
+  void kick();
+
+  // The functions below are only for the consumer thread, and cover all
+  // classes
+
+  bool empty() const;
+
+  // Fill of the fullest class, by count or bytes, from 0 (empty) to 1 (full)
+  double fill() const;
+
+  // Moves the oldest tree of the highest priority class to tree, returns false
+  // if empty
+  bool pop(Tree &tree);
+
+  // Moves up to max trees to the end of trees, in pop() order, returns number
+  // moved
+  std::size_t pop_all(std::vector<Tree> &trees, std::size_t max = SIZE_MAX);
+
+  // Sleeps until something is queued, kick() is called or deadline passes
+  void wait_until(std::chrono::steady_clock::time_point deadline);
+
+  // wait_until() split up, for a consumer that waits elsewhere, e.g. in a
+  // Common::Reactor.  If prepare_wait() returns true the consumer may sleep
+  // until get_event_fd() is readable, and then calls finish_wait().  If it
+  // returns false something is already queued.
+  bool prepare_wait();
+  int get_event_fd() const { return event_fd; }
+  void finish_wait();
+
+  Stats take_stats();
+};
+
+// Module parameters of a logger with a TreeRing, its own params (ended by the
+// null row) with the rows of the queue settings inserted before the end:
+// queue_max, queue_max_bytes and drop_policy, and the same prefixed by high_
+// and bulk_ for those classes
+std::vector<snort::Parameter>
+with_queue_params(std::span<const snort::Parameter> params);
+
+// The queue settings given by the rows of with_queue_params()
+struct QueueConfig {
+  std::size_t max[priority_count] = {1024, 1024, 1024};
+  std::size_t max_bytes[priority_count] = {}; // 0 = no limit
+  TreeRing::DropPolicy policy[priority_count] = {};
+
+  // Takes val if it's one of the queue settings, returns false if it isn't
+  bool set(const snort::Value &val);
+};
+
+// What the consumer of a TreeRing does with its stats, shared by the loggers:
+// warns when trees start being dropped and when output resumes, and adds the
+// stats to the queue pegs of the logger
+class QueueAccount {
+  uint64_t dropped_sequence_count = 0; // Trees dropped since output resumed
+
+  // Warns as above, returns true if trees were dropped
+  bool warn(const TreeRing::Stats &stats, const char *name);
+
+public:
+  // Accounts for what producers did to queue since last call.  counts is the
+  // logger's PegCounts, updated with peg_mutex held, the overflows per class
+  // are only counted if it has them.  Returns true if trees were dropped.
+  template <class Counts>
+  bool take(TreeRing &queue, const char *name, Counts &counts,
+            std::mutex &peg_mutex) {
+    auto stats = queue.take_stats();
+    bool dropped = warn(stats, name);
+
+    std::scoped_lock lock(peg_mutex);
+    counts.logs_in += stats.pushed;
+    counts.overflows += stats.dropped;
+    if (counts.max_queued < stats.size) {
+      counts.max_queued = stats.size;
+    }
+    counts.queued_bytes = stats.bytes;
+    if (counts.max_queued_bytes < stats.bytes) {
+      counts.max_queued_bytes = stats.bytes;
+    }
+    counts.overflow_bytes += stats.dropped_bytes;
+
+    if constexpr (requires { counts.bulk_overflows; }) {
+      counts.high_overflows += stats.dropped_of(Priority::high);
+      counts.normal_overflows += stats.dropped_of(Priority::normal);
+      counts.bulk_overflows += stats.dropped_of(Priority::bulk);
+    }
+
+    return dropped;
+  }
+};
+
+} // namespace LioLi
+
+#endif // tree_ring_5d07a3e1
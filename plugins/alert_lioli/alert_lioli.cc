@@ -109,12 +109,14 @@ private:
 
   void alert(snort::Packet *pkt, const char *msg, const Event &e) override {
     s_peg_counts.alerts_generated++;
-    get_logger() << std::move(gen_tree("alert", pkt, msg, &e));
+    get_logger().log(std::move(gen_tree("alert", pkt, msg, &e)),
+                     LioLi::Priority::high);
   }
 
   void log(snort::Packet *pkt, const char *msg, Event *e) override {
     s_peg_counts.logs_generated++;
-    get_logger() << std::move(gen_tree("log", pkt, msg, e));
+    get_logger().log(std::move(gen_tree("log", pkt, msg, e)),
+                     LioLi::Priority::high);
   }
 
   LioLi::Tree gen_tree(const char *type, snort::Packet *pkt, const char *msg,
@@ -45,6 +45,13 @@ static const snort::Parameter module_params[] = {
      "Set the true if pcap filters should be optimized, false if not"},
     {"rotate_limit", snort::Parameter::PT_INT, "0:max31", "2147483647",
      "Set the limit of data writen to each pcap, 0 = no limit"},
+    {"io_uring", snort::Parameter::PT_BOOL, nullptr, "true",
+     "Write pcaps through io_uring when the kernel has it, if not, or false, "
+     "they are written with write()"},
+    {"direct_io", snort::Parameter::PT_BOOL, nullptr, "false",
+     "Write pcaps with O_DIRECT, bypassing the page cache"},
+    {"preallocate", snort::Parameter::PT_INT, "0:max31", "0",
+     "Bytes pcaps are allocated on disk ahead of the writes, 0 = none"},
     {"map", snort::Parameter::PT_LIST, map_item, nullptr,
      "Map with rules and pcap file prefixes, if a packet matches a rule, it "
      "will be written to the pcap"},
@@ -68,6 +75,8 @@ const PegInfo s_pegs[] = {
     {CountType::SUM, "port hint mismatch",
      "Number of times a port hint rejected a package"},
     {CountType::SUM, "port hint match", "Number of times a port hint matched"},
+    {CountType::SUM, "packets dropped",
+     "Number of packages not written, as the disk was behind"},
     {CountType::END, nullptr, nullptr}};
 
 // TODO: Understand the pegs in a threaded context...
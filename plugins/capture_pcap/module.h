@@ -32,6 +32,7 @@ struct PegCounts {
   PegCount ip_hint_match = 0;
   PegCount port_hint_mismatch = 0;
   PegCount port_hint_match = 0;
+  PegCount pkg_dropped = 0;
 };
 
 class Module : public snort::Module {
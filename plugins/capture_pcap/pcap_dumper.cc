@@ -4,8 +4,11 @@
 #include <protocols/packet.h>
 
 // System includes
+#include <cerrno>
 #include <cstring> // For memcpy to queue raw packages
 #include <queue>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 
 // Local includes
 #include "common.h"
@@ -17,7 +20,17 @@
 
 namespace capture_pcap {
 
-namespace {}
+namespace {
+
+// Record header as pcap_dump() writes it, the file format has 32 bit times
+struct RecordHeader {
+  uint32_t ts_sec;
+  uint32_t ts_usec;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+} // namespace
 
 std::string PcapDumper::gen_dump_file_name() {
   return base_name +
@@ -40,17 +53,65 @@ PcapDumper::PcapDumper(std::string base_name, Module &module)
 }
 
 PcapDumper::~PcapDumper() {
-  // Ask worker thread to terminate
-  terminate = true;
-  cv.notify_one();
-  worker_thread.join();
+  // Waits for run() to return, packages still queued are dropped
+  Common::Reactor::get().remove(*this);
+
+  // Waits for what's being written
+  writer.reset();
 }
 
 void PcapDumper::start_worker() {
-  // Start worker thread
   // dlt = get_dlt();    // Note: This needs to happen from the main thread
   dlt = DLT_EN10MB;
-  worker_thread = std::thread{&PcapDumper::worker_loop, this};
+
+  Common::Reactor::get().add(*this);
+}
+
+bool PcapDumper::open_file() {
+  if (!writer) {
+    Common::DiskWriter::Config config;
+    config.buffer_bytes = 256 * 1024;
+    config.direct = settings->direct_io;
+    config.preallocate_bytes = settings->preallocate;
+    config.uring = settings->io_uring;
+
+    writer = std::make_unique<Common::DiskWriter>(config);
+  }
+
+  std::string file_name = gen_dump_file_name();
+
+  if (!writer->open(file_name)) {
+    snort::ErrorMessage("ERROR: \"%s\" when trying to open \"%s\" for "
+                        "writing\n",
+                        std::strerror(errno), file_name.c_str());
+    return false;
+  }
+
+  pcap_file_header header = {};
+  header.magic = 0xa1b2c3d4; // Microsecond timestamps
+  header.version_major = PCAP_VERSION_MAJOR;
+  header.version_minor = PCAP_VERSION_MINOR;
+  header.snaplen = settings->snaplen;
+  header.linktype = dlt;
+
+  writer->write(&header, sizeof(header));
+  data_written = 0;
+
+  return true;
+}
+
+bool PcapDumper::close_file() {
+  closing = !writer->try_close();
+  return !closing;
+}
+
+void PcapDumper::wait_for_writer() {
+  watch(writer->get_event_fd(), EPOLLIN);
+
+  // In case the disk is done without signaling, e.g. when it's out of
+  // io_uring entries
+  wake_at(Common::Reactor::clock::now() +
+          std::chrono::milliseconds(100));
 }
 
 PcapDumper::PackageBufferElement::PackageBufferElement(snort::Packet *p)
@@ -75,66 +136,96 @@ size_t PcapDumper::PackageBufferElement::get_data_size() {
 pcap_pkthdr *PcapDumper::PackageBufferElement::get_pkthdr() { return &pcaphdr; }
 
 void PcapDumper::queue_package(snort::Packet *p) {
-  std::scoped_lock lock(mutex);
-  queue.emplace(p);
-  cv.notify_one();
+  bool was_empty;
+
+  {
+    std::scoped_lock lock(mutex);
+    was_empty = queue.empty();
+    queue.emplace(p);
+  }
+
+  // Otherwise run() hasn't emptied the queue yet, and will get to it
+  if (was_empty) {
+    wake();
+  }
 }
 
-void PcapDumper::worker_loop() {
-  pcap_dumper_t *dumper = nullptr; // Handle to the dump file
-  pcap_t *dead = pcap_open_dead(dlt, settings->snaplen);
-  size_t data_written = 0;
+void PcapDumper::run() {
+  // Bounded, so other outputs on the reactor thread get their turn
+  constexpr int max_packages = 256;
 
-  assert(dead); // This is not expected to fail (i.e. something is wrong in the
-                // code if it happens)
+  // Unless we wait for the disk below
+  wake_at(Common::Reactor::clock::time_point::max());
+
+  // The next file is opened once the last is closed
+  if (closing && !close_file()) {
+    wait_for_writer();
+    return;
+  }
 
   std::unique_lock lock(mutex);
-  while (!terminate) {
-    while (!queue.empty() && !terminate) {
-      PackageBufferElement &front = queue.front();
-      lock.unlock(); // We don't want to block while we deal with the filesystem
-                     // and we are the only thread removing elements, so our
-                     // front is good.
-
-      if (!dumper) {
-        std::string file_name = gen_dump_file_name();
-        dumper = pcap_dump_open(dead, file_name.c_str());
-        if (!dumper) {
-          snort::ErrorMessage("ERROR: pcap reports \"%s\" when trying to open "
-                              "\"%s\" for writing\n",
-                              pcap_geterr(dead), file_name.c_str());
-          // In case of failure we just skip a package and continue
-          lock.lock();
-          queue.pop();
-          continue;
-        }
-        data_written = 0;
-      }
-
-      // NOTE: pcap_dump doesn't have any return value, we assume all is good
-      pcap_dump((unsigned char *)dumper, front.get_pkthdr(), front.get_data());
+  for (int count = 0; !queue.empty(); count++) {
+    if (count == max_packages) {
+      wake(); // Come back for the rest
+      return;
+    }
+
+    PackageBufferElement &front = queue.front();
+    lock.unlock(); // We don't want to block while we deal with the filesystem
+                   // and we are the only thread removing elements, so our
+                   // front is good.
+
+    if (!(writer && writer->is_open()) && !open_file()) {
+      // In case of failure we just skip a package and continue
+      lock.lock();
+      queue.pop();
+      continue;
+    }
+
+    pcap_pkthdr *pkthdr = front.get_pkthdr();
+    RecordHeader record = {static_cast<uint32_t>(pkthdr->ts.tv_sec),
+                           static_cast<uint32_t>(pkthdr->ts.tv_usec),
+                           pkthdr->caplen, pkthdr->len};
+    iovec parts[] = {{&record, sizeof(record)},
+                     {front.get_data(), front.get_data_size()}};
+
+    // If the disk is behind, the package waits in the queue for it
+    if (writer->is_busy(sizeof(record) + front.get_data_size())) {
+      wait_for_writer();
+      return;
+    }
+
+    // Only dropped if it's too large for the buffers, or writing failed
+    if (writer->write(parts, 2)) {
       data_written += front.get_data_size();
       pegs.pkg_written++;
+    } else {
+      pegs.pkg_dropped++;
+    }
 
-      if (data_written > settings->rotate_limit) {
-        pcap_dump_close(dumper);
-        dumper = nullptr;
-      }
+    bool closed = true;
 
-      lock.lock(); // Retake the lock as we are going to manipulate queue
-      queue.pop();
+    if (writer->get_error() != 0) {
+      snort::ErrorMessage("ERROR: \"%s\" when writing pcap, starting a new "
+                          "file\n",
+                          std::strerror(writer->get_error()));
+      closed = close_file();
+    } else if (data_written > settings->rotate_limit) {
+      closed = close_file();
     }
-    cv.wait(lock, [this] { return (terminate || !queue.empty()); });
-  };
 
-  if (dumper) {
-    pcap_dump_close(dumper);
-    dumper = nullptr;
+    lock.lock(); // Retake the lock as we are going to manipulate queue
+    queue.pop();
+
+    if (!closed) {
+      wait_for_writer();
+      return;
+    }
   }
 
-  if (dead) {
-    pcap_close(dead);
-    dead = nullptr;
+  // Nothing more for now, what's buffered is written
+  if (writer) {
+    writer->flush();
   }
 }
 
@@ -4,13 +4,14 @@
 // Snort includes
 
 // System includes
-#include <condition_variable>
 #include <mutex>
 #include <pcap/pcap.h>
 #include <queue>
 #include <string>
 
 // Global includes
+#include <disk_writer.h>
+#include <reactor.h>
 
 // Local includes
 #include "module.h"
@@ -19,7 +20,8 @@
 
 namespace capture_pcap {
 
-class PcapDumper {
+// Writes on the shared Common::Reactor, rather than a thread of its own
+class PcapDumper : public Common::Reactor::Task {
   std::shared_ptr<Settings> settings;
   PegCounts &pegs;
 
@@ -42,15 +44,17 @@ class PcapDumper {
   std::mutex mutex; // Protects queue
   std::queue<PackageBufferElement> queue;
 
-  // Worker thread controls
-  void start_worker();
-  std::thread worker_thread;
-  std::condition_variable cv; // Used to enable worker to sleep when there
-                              // aren't anything for it to do
-  volatile bool terminate =
-      false;          // Set to true if worker loop should be terminated
-  void worker_loop(); // Thread doing all the fun
-  int dlt;            // dlt to use
+  void start_worker(); // Joins the reactor
+
+  // Worker state, only used by run()
+  std::unique_ptr<Common::DiskWriter> writer; // Writes the pcap files
+  size_t data_written = 0;
+  bool closing = false; // The file is being closed, the next waits for it
+  int dlt;              // dlt to use
+
+  bool open_file();  // Opens a new pcap file, and writes its header
+  bool close_file(); // Starts closing the file, true once it is closed
+  void wait_for_writer(); // Makes run() wait for the disk
 
   std::string gen_dump_file_name(); // Creates the dump file name
 
@@ -62,6 +66,8 @@ public:
   ~PcapDumper();
 
   void queue_package(snort::Packet *p); // Write p to the file
+
+  void run() override; // Writes what's queued
 };
 
 } // namespace capture_pcap
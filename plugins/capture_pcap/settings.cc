@@ -86,6 +86,12 @@ bool Settings::set(const char *, snort::Value &val) {
     optimize_filter = val.get_bool();
   } else if (val.is("rotate_limit")) {
     rotate_limit = val.get_int32();
+  } else if (val.is("io_uring")) {
+    io_uring = val.get_bool();
+  } else if (val.is("direct_io")) {
+    direct_io = val.get_bool();
+  } else if (val.is("preallocate")) {
+    preallocate = val.get_int32();
   } else if (val.is("filter")) {
     assert(current_item);
     current_item->filter =
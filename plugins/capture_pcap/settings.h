@@ -34,6 +34,9 @@ struct Settings : std::enable_shared_from_this<Settings> {
   bool testmode;
   bool optimize_filter;
   unsigned rotate_limit;
+  bool io_uring;
+  bool direct_io;
+  unsigned preallocate;
 
   struct MapItem {
     std::unique_ptr<Filter> filter;
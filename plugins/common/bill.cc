@@ -0,0 +1,253 @@
+// Snort includes
+
+// System includes
+#include <cstring>
+
+// Local includes
+#include <bill.h>
+#include <text_kernels.h>
+
+// Debug includes
+
+namespace Bill {
+namespace {
+
+constexpr char bill_magic[6] = {'\x4', 'B', 'I', 'L', 'L', '\x0'};
+constexpr char raw_magic[6] = {'\x4', 'R', 'A', 'W', ' ', '\x0'};
+constexpr uint8_t bill_version = 2;
+constexpr uint8_t raw_version = 1;
+
+// Reads a Go compatible varint at pos, returns false if it isn't complete
+bool read_varint(const uint8_t *data, std::size_t size, std::size_t &pos,
+                 uint64_t &number) {
+  number = 0;
+
+  for (unsigned shift = 0; shift < 64 && pos < size; shift += 7) {
+    uint8_t digit = data[pos++];
+    number |= static_cast<uint64_t>(digit & 0b0111'1111) << shift;
+
+    if (!(digit & 0b1000'0000)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // namespace
+
+bool Header::parse(const uint8_t *data, std::size_t size) {
+  if (size < header_size) {
+    return false;
+  }
+
+  if (std::memcmp(data, bill_magic, sizeof(bill_magic)) == 0 &&
+      data[6] == bill_version) {
+    format = Format::bill;
+  } else if (std::memcmp(data, raw_magic, sizeof(raw_magic)) == 0 &&
+             data[6] == raw_version) {
+    format = Format::raw;
+  } else {
+    return false;
+  }
+
+  std::memcpy(secret.data(), data + 7, secret.size());
+  return true;
+}
+
+bool NodeCursor::next(NodeView &node) {
+  if (failed || encoded.empty()) {
+    return false;
+  }
+
+  auto p = reinterpret_cast<const uint8_t *>(encoded.data());
+  std::size_t size = encoded.size();
+  std::size_t pos = 0;
+  std::size_t node_size = 0; // Including the length, if node has children
+
+  // Nodes with children start with the length of the rest of the node
+  bool with_children = p[0] & 0b1000'0000;
+
+  if (with_children) {
+    if (size < 2) {
+      failed = true;
+      return false;
+    }
+
+    node_size = 2 + ((p[0] & 0b0111'1111) | (p[1] << 7));
+    pos = 2;
+
+    if (node_size > size) {
+      failed = true;
+      return false;
+    }
+
+    size = node_size;
+  }
+
+  // Name
+  if (size - pos < 2 || (p[pos] & 0b1100'0000) != 0b0100'0000) {
+    failed = true;
+    return false;
+  }
+
+  std::size_t name_length = (p[pos] & 0b0011'1111) | (p[pos + 1] << 6);
+  pos += 2;
+
+  if (size - pos < name_length) {
+    failed = true;
+    return false;
+  }
+
+  node.my_name = encoded.substr(pos, name_length);
+  pos += name_length;
+
+  // Start and length
+  std::size_t skip;
+  std::size_t length;
+
+  if (size - pos < 1) {
+    failed = true;
+    return false;
+  }
+
+  if (!(p[pos] & 0b1000'0000)) {
+    skip = p[pos] >> 4;
+    length = p[pos] & 0b0000'1111;
+    pos += 1;
+  } else if (!(p[pos] & 0b0100'0000)) {
+    if (size - pos < 2) {
+      failed = true;
+      return false;
+    }
+    skip = p[pos] & 0b0011'1111;
+    length = p[pos + 1];
+    pos += 2;
+  } else {
+    if (size - pos < 4) {
+      failed = true;
+      return false;
+    }
+    skip = (p[pos] & 0b0011'1111) | (p[pos + 1] << 6);
+    length = p[pos + 2] | (p[pos + 3] << 8);
+    pos += 4;
+  }
+
+  node.raw = raw;
+  node.start = delta + skip;
+  node.end = node.start + length;
+
+  if (node.end > parent_end) {
+    failed = true;
+    return false;
+  }
+
+  if (with_children) {
+    node.encoded_children = encoded.substr(pos, node_size - pos);
+  } else {
+    node.encoded_children = {};
+    node_size = pos;
+  }
+
+  encoded.remove_prefix(node_size);
+  delta = node.end;
+
+  return true;
+}
+
+void NodeView::as_lorth(std::string &output, unsigned level) const {
+  std::string spacer(level, ' ');
+
+  output += spacer;
+  output += my_name;
+  output += ' ';
+
+  if (has_children()) {
+    output += "{\n";
+
+    std::size_t ep = start;
+    auto cursor = children();
+    NodeView child;
+
+    while (cursor.next(child)) {
+      if (ep != child.start) {
+        output += spacer + " \"";
+        output += raw.substr(ep, child.start - ep);
+        output += "\" .\n";
+      }
+      child.as_lorth(output, level + 1);
+      ep = child.end;
+    }
+    if (ep != end) {
+      output += spacer + " \"";
+      output += raw.substr(ep, end - ep);
+      output += "\" .\n";
+    }
+    output += spacer + "}\n";
+  } else {
+    output += '\"';
+    Common::append_escaped(output, value());
+    output += "\" .\n";
+  }
+}
+
+std::string TreeView::as_lorth() const {
+  std::string output;
+  auto cursor = nodes();
+  NodeView node;
+
+  while (cursor.next(node)) {
+    node.as_lorth(output);
+  }
+
+  if (!output.empty()) {
+    output.back() = ';';
+    output += '\n';
+  }
+
+  return output;
+}
+
+StreamReader::StreamReader(const uint8_t *data, std::size_t size)
+    : data(data), size(size) {
+  header_ok = stream_header.parse(data, size);
+
+  if (header_ok) {
+    pos = header_size;
+  }
+}
+
+bool StreamReader::next(TreeView &tree) {
+  if (!header_ok) {
+    return false;
+  }
+
+  std::size_t next_pos = pos;
+  uint64_t length;
+
+  if (!read_varint(data, size, next_pos, length) || length > size - next_pos) {
+    return false;
+  }
+
+  tree.raw = std::string_view(reinterpret_cast<const char *>(data + next_pos),
+                              length);
+  next_pos += length;
+
+  if (stream_header.format == Format::bill) {
+    if (!read_varint(data, size, next_pos, length) ||
+        length > size - next_pos) {
+      return false;
+    }
+
+    tree.encoded = std::string_view(
+        reinterpret_cast<const char *>(data + next_pos), length);
+    next_pos += length;
+  } else {
+    tree.encoded = {};
+  }
+
+  pos = next_pos;
+  return true;
+}
+
+} // namespace Bill
@@ -0,0 +1,620 @@
+// Snort includes
+
+// System includes
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Local includes
+#include <disk_writer.h>
+
+// Debug includes
+
+namespace Common {
+
+namespace {
+
+// O_DIRECT alignment of buffers, offsets and lengths, works for 512 and 4096
+// byte sectors alike
+constexpr std::size_t block_size = 4096;
+
+// user_data of a fallocate, writes have their buffer index
+constexpr uint64_t preallocate_data = UINT64_MAX;
+
+std::size_t round_up(std::size_t value) {
+  return (value + block_size - 1) / block_size * block_size;
+}
+
+int io_uring_setup(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete,
+                   unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int ring_fd, unsigned opcode, void *arg,
+                      unsigned nr_args) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+// The ring indexes are shared with the kernel
+unsigned load_acquire(unsigned *index) {
+  return std::atomic_ref<unsigned>(*index).load(std::memory_order_acquire);
+}
+
+void store_release(unsigned *index, unsigned value) {
+  std::atomic_ref<unsigned>(*index).store(value, std::memory_order_release);
+}
+
+} // namespace
+
+struct DiskWriter::Ring {
+  void *sq_map = MAP_FAILED;
+  std::size_t sq_map_size = 0;
+  void *cq_map = MAP_FAILED; // Same as sq_map with IORING_FEAT_SINGLE_MMAP
+  std::size_t cq_map_size = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  std::size_t sqes_size = 0;
+
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  io_uring_cqe *cqes;
+};
+
+DiskWriter::DiskWriter(const Config &config) : config(config) {
+  this->config.buffer_bytes = round_up(std::max<std::size_t>(
+      config.buffer_bytes, block_size));
+  this->config.buffers = std::max(config.buffers, 2u);
+
+  for (unsigned i = 0; i < this->config.buffers; i++) {
+    auto data = static_cast<uint8_t *>(
+        std::aligned_alloc(block_size, this->config.buffer_bytes));
+    assert(data);
+
+    buffers.push_back({data});
+    unused.push_back(i);
+  }
+
+  setup_ring();
+}
+
+DiskWriter::~DiskWriter() {
+  close();
+  teardown_ring();
+
+  for (auto &buffer : buffers) {
+    std::free(buffer.data);
+  }
+}
+
+void DiskWriter::setup_ring() {
+  if (!config.uring) {
+    return;
+  }
+
+  // Room for every buffer and a fallocate
+  io_uring_params params = {};
+  ring_fd = io_uring_setup(config.buffers + 1, &params);
+
+  if (ring_fd == -1) {
+    return; // Not available, write(2) it is
+  }
+
+  // IORING_OP_WRITE and IORING_OP_FALLOCATE came with 5.6, as did the probe
+  constexpr unsigned probe_ops = 64;
+  std::vector<uint8_t> probe_data(sizeof(io_uring_probe) +
+                                  probe_ops * sizeof(io_uring_probe_op));
+  auto probe = reinterpret_cast<io_uring_probe *>(probe_data.data());
+  auto supported = [probe](unsigned op) {
+    return op <= probe->last_op &&
+           (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  };
+
+  if (io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, probe_ops) !=
+          0 ||
+      !supported(IORING_OP_WRITE) || !supported(IORING_OP_WRITE_FIXED) ||
+      !supported(IORING_OP_FALLOCATE)) {
+    teardown_ring();
+    return;
+  }
+
+  ring = new Ring;
+  ring->sq_map_size =
+      params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_map_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->sq_map_size = ring->cq_map_size =
+        std::max(ring->sq_map_size, ring->cq_map_size);
+  }
+
+  ring->sq_map = ::mmap(nullptr, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_map = ring->sq_map;
+  } else {
+    ring->cq_map =
+        ::mmap(nullptr, ring->cq_map_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  ring->sqes = static_cast<io_uring_sqe *>(
+      ::mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+
+  if (ring->sq_map == MAP_FAILED || ring->cq_map == MAP_FAILED ||
+      ring->sqes == MAP_FAILED) {
+    teardown_ring();
+    return;
+  }
+
+  auto sq = static_cast<uint8_t *>(ring->sq_map);
+  auto cq = static_cast<uint8_t *>(ring->cq_map);
+
+  ring->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  ring->sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  ring->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  ring->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  ring->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  ring->cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  // Registered buffers spare the kernel mapping them for every write, it
+  // fails if they're more than RLIMIT_MEMLOCK allows, they then aren't
+  std::vector<iovec> iovecs;
+
+  for (auto &buffer : buffers) {
+    iovecs.push_back({buffer.data, config.buffer_bytes});
+  }
+
+  fixed = io_uring_register(ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(),
+                            iovecs.size()) == 0;
+
+  // Lets a caller that can't block wait for buffers in its own poll
+  event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (event_fd != -1 &&
+      io_uring_register(ring_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) != 0) {
+    ::close(event_fd);
+    event_fd = -1;
+  }
+}
+
+void DiskWriter::teardown_ring() {
+  if (ring) {
+    if (ring->sqes != MAP_FAILED) {
+      ::munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map != MAP_FAILED && ring->cq_map != ring->sq_map) {
+      ::munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map != MAP_FAILED) {
+      ::munmap(ring->sq_map, ring->sq_map_size);
+    }
+
+    delete ring;
+    ring = nullptr;
+  }
+
+  if (ring_fd != -1) {
+    ::close(ring_fd); // Also unregisters the buffers and event_fd
+    ring_fd = -1;
+  }
+
+  if (event_fd != -1) {
+    ::close(event_fd);
+    event_fd = -1;
+  }
+
+  fixed = false;
+}
+
+bool DiskWriter::open(const std::string &path) {
+  close();
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+  fd = ::open(path.c_str(), flags | (config.direct ? O_DIRECT : 0), 0666);
+  direct = config.direct && fd != -1;
+
+  // Not every file system does O_DIRECT (e.g. tmpfs), it's only an
+  // optimization so we do without
+  if (fd == -1 && config.direct && errno == EINVAL) {
+    fd = ::open(path.c_str(), flags, 0666);
+  }
+
+  error = 0;
+  offset = 0;
+  allocated = 0;
+
+  return fd != -1;
+}
+
+bool DiskWriter::write(const iovec *parts, std::size_t count) {
+  std::size_t size = 0;
+
+  for (std::size_t i = 0; i < count; i++) {
+    size += parts[i].iov_len;
+  }
+
+  if (fd == -1 || error != 0) {
+    stats.dropped += size;
+    return false;
+  }
+
+  if (is_async()) {
+    reap(false);
+  }
+
+  // All or nothing, a tree cut in half would corrupt what follows it
+  if (room() < size) {
+    stats.dropped += size;
+    return false;
+  }
+
+  for (std::size_t i = 0; i < count; i++) {
+    auto source = static_cast<const uint8_t *>(parts[i].iov_base);
+    std::size_t left = parts[i].iov_len;
+
+    while (left != 0) {
+      if (!has_current) {
+        take_buffer();
+      }
+
+      auto bytes = std::min(left, config.buffer_bytes - fill);
+
+      std::memcpy(buffers[current].data + fill, source, bytes);
+      fill += bytes;
+      source += bytes;
+      left -= bytes;
+
+      if (fill == config.buffer_bytes) {
+        write_buffer(fill);
+      }
+    }
+  }
+
+  // Everything filled is submitted at once
+  submit();
+  return true;
+}
+
+bool DiskWriter::is_busy(std::size_t size) {
+  if (fd == -1 || error != 0 || event_fd == -1) {
+    return false;
+  }
+
+  // Cleared before reaping, so a completion after it signals again
+  uint64_t value;
+  [[maybe_unused]] auto ret = ::read(event_fd, &value, sizeof(value));
+
+  reap(false);
+
+  return room() < size && size <= buffers.size() * config.buffer_bytes - fill;
+}
+
+void DiskWriter::flush() {
+  if (fd == -1 || !has_current || fill == 0) {
+    return;
+  }
+
+  std::size_t length = fill;
+
+  // Only whole blocks can be written, the rest is carried over to a new
+  // buffer, which there must be
+  if (direct) {
+    length = fill / block_size * block_size;
+
+    if (length == 0 || (length != fill && unused.empty())) {
+      return;
+    }
+  }
+
+  write_buffer(length);
+  submit();
+}
+
+bool DiskWriter::close() {
+  if (fd == -1) {
+    return true;
+  }
+
+  write_rest();
+
+  while (is_async() && (in_flight != 0 || preallocating)) {
+    if (!submit()) {
+      break; // The ring is broken, what's in it is lost
+    }
+
+    reap(true);
+  }
+
+  // Drops the padding and whatever was preallocated beyond the end
+  if (direct || allocated > offset) {
+    if (::ftruncate(fd, offset) != 0 && error == 0) {
+      error = errno;
+    }
+  }
+
+  ::close(fd);
+  fd = -1;
+  fill = 0;
+  offset = 0;
+
+  return error == 0;
+}
+
+bool DiskWriter::try_close() {
+  if (fd == -1) {
+    return true;
+  }
+
+  write_rest();
+
+  // A broken ring is left to close(), what's in it is lost
+  if (is_async() && submit()) {
+    if (event_fd != -1) {
+      // Cleared before reaping, so a completion after it signals again
+      uint64_t value;
+      [[maybe_unused]] auto ret = ::read(event_fd, &value, sizeof(value));
+    }
+
+    reap(false);
+
+    if (in_flight != 0 || preallocating) {
+      return false;
+    }
+  }
+
+  return close();
+}
+
+DiskWriter::Stats DiskWriter::take_stats() {
+  Stats taken = stats;
+  stats = {};
+  return taken;
+}
+
+bool DiskWriter::take_buffer() {
+  if (unused.empty()) {
+    return false;
+  }
+
+  current = unused.back();
+  unused.pop_back();
+  has_current = true;
+  fill = 0;
+
+  return true;
+}
+
+// Starts writing what's in the current buffer, for closing
+void DiskWriter::write_rest() {
+  if (has_current && fill != 0) {
+    std::size_t length = fill;
+
+    // The last block is padded, and truncated away by close()
+    if (direct) {
+      length = round_up(fill);
+      std::memset(buffers[current].data + fill, 0, length - fill);
+    }
+
+    write_buffer(length);
+  } else if (has_current) {
+    unused.push_back(current);
+    has_current = false;
+  }
+}
+
+void DiskWriter::write_buffer(std::size_t length) {
+  auto index = current;
+  auto &buffer = buffers[index];
+
+  // A partial block left by a O_DIRECT flush is written again with what
+  // follows it
+  std::size_t carry = fill - std::min(fill, length);
+
+  buffer.at = offset;
+  buffer.length = length;
+  buffer.done = 0;
+  offset += fill - carry;
+  has_current = false;
+
+  if (carry != 0) {
+    [[maybe_unused]] bool taken = take_buffer();
+    assert(taken); // Checked by flush()
+
+    std::memcpy(buffers[current].data, buffer.data + length, carry);
+    fill = carry;
+  } else {
+    fill = 0;
+  }
+
+  preallocate(buffer.at + length);
+
+  if (is_async()) {
+    in_flight++;
+    queue_write(index);
+    return;
+  }
+
+  while (buffer.done < length) {
+    auto ret = ::pwrite(fd, buffer.data + buffer.done, length - buffer.done,
+                        buffer.at + buffer.done);
+
+    if (ret > 0) {
+      buffer.done += ret;
+      stats.written += ret;
+    } else if (ret == 0 || errno != EINTR) {
+      fail(ret == 0 ? EIO : errno, length - buffer.done);
+      break;
+    }
+  }
+
+  stats.submits++;
+  unused.push_back(index);
+}
+
+void DiskWriter::queue_write(unsigned index) {
+  auto &buffer = buffers[index];
+  unsigned tail = *ring->sq_tail;
+  unsigned slot = tail & *ring->sq_mask;
+  io_uring_sqe *sqe = &ring->sqes[slot];
+
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buffer.data + buffer.done);
+  sqe->len = buffer.length - buffer.done;
+  sqe->off = buffer.at + buffer.done;
+  sqe->buf_index = index;
+  sqe->user_data = index;
+
+  ring->sq_array[slot] = slot;
+  store_release(ring->sq_tail, tail + 1);
+  queued++;
+}
+
+void DiskWriter::preallocate(uint64_t end) {
+  if (config.preallocate_bytes == 0 || preallocating || end <= allocated) {
+    return;
+  }
+
+  // A step beyond end, so the writes stay ahead of it
+  uint64_t step = config.preallocate_bytes;
+  allocating_to = (end / step + 1) * step;
+
+  if (!is_async()) {
+    if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated,
+                    allocating_to - allocated) == 0) {
+      allocated = allocating_to;
+    } else {
+      config.preallocate_bytes = 0; // Not supported, don't try again
+    }
+    return;
+  }
+
+  unsigned tail = *ring->sq_tail;
+  unsigned slot = tail & *ring->sq_mask;
+  io_uring_sqe *sqe = &ring->sqes[slot];
+
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_FALLOCATE;
+  sqe->fd = fd;
+  sqe->off = allocated;
+  sqe->addr = allocating_to - allocated; // Length
+  sqe->len = FALLOC_FL_KEEP_SIZE;        // Mode
+  sqe->user_data = preallocate_data;
+
+  ring->sq_array[slot] = slot;
+  store_release(ring->sq_tail, tail + 1);
+  queued++;
+  preallocating = true;
+}
+
+bool DiskWriter::submit() {
+  while (queued != 0) {
+    int ret = io_uring_enter(ring_fd, queued, 0, 0);
+
+    if (ret >= 0) {
+      queued -= ret;
+      stats.submits++;
+    } else if (errno == EAGAIN || errno == EBUSY) {
+      return true; // Out of resources for now, tried again with next write
+    } else if (errno != EINTR) {
+      if (error == 0) {
+        error = errno;
+      }
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void DiskWriter::reap(bool wait) {
+  unsigned head = *ring->cq_head;
+  unsigned tail = load_acquire(ring->cq_tail);
+
+  if (head == tail && wait) {
+    // Only fails if interrupted, we are then called again
+    io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+    tail = load_acquire(ring->cq_tail);
+  }
+
+  for (; head != tail; head++) {
+    io_uring_cqe &cqe = ring->cqes[head & *ring->cq_mask];
+
+    if (cqe.user_data == preallocate_data) {
+      preallocating = false;
+
+      if (cqe.res == 0) {
+        allocated = allocating_to;
+      } else {
+        config.preallocate_bytes = 0; // Not supported, don't try again
+      }
+      continue;
+    }
+
+    auto index = static_cast<unsigned>(cqe.user_data);
+    auto &buffer = buffers[index];
+
+    if (cqe.res > 0) {
+      buffer.done += cqe.res;
+      stats.written += cqe.res;
+
+      // Short write, the rest goes again
+      if (buffer.done < buffer.length) {
+        queue_write(index);
+        continue;
+      }
+    } else {
+      fail(cqe.res == 0 ? EIO : -cqe.res, buffer.length - buffer.done);
+    }
+
+    in_flight--;
+    unused.push_back(index);
+  }
+
+  store_release(ring->cq_head, head);
+
+  // Rewrites from short writes
+  submit();
+}
+
+std::size_t DiskWriter::room() const {
+  return unused.size() * config.buffer_bytes +
+         (has_current ? config.buffer_bytes - fill : 0);
+}
+
+void DiskWriter::fail(int err, uint64_t bytes) {
+  if (error == 0) {
+    error = err;
+  }
+
+  stats.failures++;
+  stats.dropped += bytes;
+}
+
+} // namespace Common
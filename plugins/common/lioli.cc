@@ -3,13 +3,17 @@
 
 // System includes
 #include <cassert>
-#include <format>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <regex>
+#include <utility>
+#include <vector>
 
 // Local includes
 #include <lioli.h>
 #include <lioli_path.h>
+#include <text_kernels.h>
 
 // Debug includes
 
@@ -33,105 +37,44 @@ public:
   }
 };
 
-class LorthHelpers {
-public:
-  static std::string escape2(const std::string &&in) {
-    std::string output;
-    for (char c : in) {
-      // Normal format chars are escaped C style
-      switch (c) {
-      case '\\':
-        output += "\\\\";
-        continue;
-      case '\"':
-        output += "\\\"";
-        continue;
-
-      case '\n':
-        output += "\\n";
-        continue;
-
-      case '\t':
-        output += "\\t";
-        continue;
-
-      case '\r':
-        output += "\\r";
-        continue;
-      }
-
-      // Printable ascii is transfered raw
-      if (c >= ' ' && c <= '~') {
-        output += c;
-        continue;
-      }
+} // namespace
 
-      // What remains are hex escaped
-      output += std::format("\\x{:02x}", c);
-    }
+// Note, encodings are relative to the start of the node, so they stay valid
+// when the node is moved around by adjust()
+struct Tree::Node::EncodingCache {
+  std::mutex mutex; // Protects members, copies of a node might be serialized
+                    // from different threads
+  std::optional<std::string> binary; // dump_binary_children() output
+  std::vector<std::pair<unsigned, std::string>> lorth; // Output per level
+};
 
-    return output;
+void Tree::Node::memoize() {
+  if (!encoding_cache) {
+    encoding_cache = std::make_shared<EncodingCache>();
   }
+}
 
-  static std::string escape(const std::string &&in) {
-    // Chars that should be escaped
-    const static std::string esc("\"\n\t\r");
-
-    std::string::size_type spos = 0;
-    std::string::size_type sfind = in.find_first_of(esc);
-
-    // Bail if nothing to do
-    if (in.npos == sfind)
-      return in;
-
-    std::string outstring;
-
-    do {
-      char replacer;
-      switch (in[sfind]) {
-      case '\"':
-        replacer = '"';
-        break;
-      case '\n':
-        replacer = 'n';
-        break;
-      case '\t':
-        replacer = 't';
-        break;
-      case '\r':
-        replacer = 'r';
-        break;
-      default:
-        assert(false); // We don't know how to replace
-      }
-
-      outstring +=
-          in.substr(spos, sfind - spos); // note, we don't add 1, as the pos we
-                                         // found shouldn't be copied
-      outstring += '\\';
-      outstring += replacer;
-      spos = sfind + 1;
-      sfind = in.find_first_of(esc, spos);
-    } while (in.npos != sfind);
-
-    // Copy reminder of string
-    outstring += in.substr(spos);
-
-    return outstring;
+void Tree::Node::invalidate_cache() {
+  // Copies of this node are still valid, so we can't clear the shared cache
+  if (encoding_cache) {
+    encoding_cache = std::make_shared<EncodingCache>();
   }
-};
-
-} // namespace
+}
 
-void Tree::Node::set_end(size_t new_end) { end = new_end; }
+void Tree::Node::set_end(size_t new_end) {
+  end = new_end;
+  invalidate_cache();
+}
 
 void Tree::Node::add_as_child(const Node &node) {
+  invalidate_cache();
   last_child_added = children.emplace_after(last_child_added, node);
   last_child_added->adjust(end);
   end = last_child_added->end;
 }
 
 void Tree::Node::add_as_child(Node &&node) {
+  invalidate_cache();
   last_child_added = children.insert_after(last_child_added, std::move(node));
   last_child_added->adjust(end);
   end = last_child_added->end;
@@ -139,6 +82,7 @@ void Tree::Node::add_as_child(Node &&node) {
 
 // Copy version of append
 void Tree::Node::append(const Node &node) {
+  invalidate_cache();
 
   // We only know how to merge node names, if one is null or they are equal
   if (node.my_name.size() == 0) {
@@ -160,6 +104,7 @@ void Tree::Node::append(const Node &node) {
 
 // Move version of append
 void Tree::Node::append(Node &&node) {
+  invalidate_cache();
   // We only know how to merge node names, if one is null or they are equal
   if (node.my_name.size() == 0) {
     // Do nothing
@@ -189,7 +134,8 @@ void Tree::Node::append(Node &&node) {
 Tree::Node::Node(){};
 
 Tree::Node::Node(const Node &p)
-    : my_name(p.my_name), start(p.start), end(p.end), children(p.children) {
+    : my_name(p.my_name), start(p.start), end(p.end), children(p.children),
+      encoding_cache(p.encoding_cache) {
   last_child_added = children.before_begin();
 
   auto tmp = last_child_added;
@@ -208,6 +154,7 @@ Tree::Node::Node(Node &&src) {
   src.end = 0;
   children = std::move(src.children);
   src.children.clear();
+  encoding_cache = std::move(src.encoding_cache);
 
   // The before begin iterator is specific to a given forward list, but
   // iterators to elements that are moved, points to the moved elements
@@ -239,7 +186,8 @@ std::string Tree::Node::dump_string(const std::string &raw,
 
   output += my_name + ": ";
 
-  output += LorthHelpers::escape2(raw.substr(start, end - start));
+  Common::append_escaped(output,
+                         std::string_view(raw).substr(start, end - start));
 
   output += "\n";
 
@@ -251,6 +199,25 @@ std::string Tree::Node::dump_string(const std::string &raw,
 
 std::string Tree::Node::dump_lorth(const std::string &raw,
                                    unsigned level) const {
+  if (!encoding_cache) {
+    return dump_lorth_uncached(raw, level);
+  }
+
+  std::scoped_lock lock(encoding_cache->mutex);
+
+  for (auto &[cached_level, output] : encoding_cache->lorth) {
+    if (cached_level == level) {
+      return output;
+    }
+  }
+
+  return encoding_cache->lorth
+      .emplace_back(level, dump_lorth_uncached(raw, level))
+      .second;
+}
+
+std::string Tree::Node::dump_lorth_uncached(const std::string &raw,
+                                            unsigned level) const {
   std::string output;
   std::string spacer;
   spacer.insert(0, level, ' ');
@@ -275,8 +242,10 @@ std::string Tree::Node::dump_lorth(const std::string &raw,
     output += spacer + "}\n";
   } else {
 
-    output +=
-        "\"" + LorthHelpers::escape2(raw.substr(start, end - start)) + "\" .\n";
+    output += '\"';
+    Common::append_escaped(output,
+                           std::string_view(raw).substr(start, end - start));
+    output += "\" .\n";
   }
 
   return output;
@@ -309,7 +278,9 @@ std::string Tree::Node::dump_python(const std::string &raw, unsigned level,
     output += '\"' + my_name + "\" : ";
   }
 
-  output += "(\"" + LorthHelpers::escape2(std::move(nc_output)) + "\",";
+  output += "(\"";
+  Common::append_escaped(output, nc_output);
+  output += "\",";
 
   if (is_array) {
     if (c_output.empty()) {
@@ -331,6 +302,66 @@ std::string Tree::Node::dump_python(const std::string &raw, unsigned level,
   return output;
 }
 
+// Nodes with children become objects, with the text between the children as
+// "_text" if add_text is set, except nodes named #... that become arrays of the
+// children's values.  Nodes without children become strings.
+void Tree::Node::dump_json(const std::string &raw, std::string &output,
+                           bool add_text, bool as_object) const {
+  if (children.empty() && !as_object) {
+    output += '"';
+    Common::append_json_escaped(
+        output, std::string_view(raw).substr(start, end - start));
+    output += '"';
+    return;
+  }
+
+  assert(my_name.size() >= 1); // A name must at least have 1 char
+  bool is_array = (my_name[0] == '#') && !as_object;
+  std::string text; // Text between children
+  size_t pos = start;
+  bool first = true;
+
+  output += is_array ? '[' : '{';
+
+  for (auto &child : children) {
+    if (!first) {
+      output += ',';
+    }
+    first = false;
+
+    if (!is_array) {
+      output += '"';
+      Common::append_json_escaped(output, child.my_name);
+      output += "\":";
+    }
+
+    child.dump_json(raw, output, add_text);
+
+    if (add_text) {
+      text.append(raw, pos, child.start - pos);
+    }
+    pos = child.end;
+  }
+
+  // The text of a root without children is always added, as it would
+  // otherwise be lost
+  if ((add_text || (as_object && children.empty())) && !is_array) {
+    text.append(raw, pos, end - pos);
+
+    if (!text.empty()) {
+      if (!first) {
+        output += ',';
+      }
+
+      output += "\"_text\":\"";
+      Common::append_json_escaped(output, text);
+      output += '"';
+    }
+  }
+
+  output += is_array ? ']' : '}';
+}
+
 std::string Tree::Node::dump_binary(size_t delta, bool add_root_node) const {
   std::string output;
 
@@ -377,14 +408,15 @@ std::string Tree::Node::dump_binary(size_t delta, bool add_root_node) const {
       output += static_cast<char>(length >> 8);
     }
   }
-  size_t new_start = start;
+  if (encoding_cache) {
+    std::scoped_lock lock(encoding_cache->mutex);
 
-  for (auto &child : children) {
-    output += child.dump_binary(new_start,
-                                true /* Can't be the root node, if it is a
-                                        child, so first node must be included */
-    );
-    new_start = child.end;
+    if (!encoding_cache->binary) {
+      encoding_cache->binary = dump_binary_children();
+    }
+    output += *encoding_cache->binary;
+  } else {
+    output += dump_binary_children();
   }
 
   if (add_root_node && !children.empty()) {
@@ -398,6 +430,21 @@ std::string Tree::Node::dump_binary(size_t delta, bool add_root_node) const {
   return output;
 }
 
+std::string Tree::Node::dump_binary_children() const {
+  std::string output;
+  size_t new_start = start;
+
+  for (auto &child : children) {
+    output += child.dump_binary(new_start,
+                                true /* Can't be the root node, if it is a
+                                        child, so first node must be included */
+    );
+    new_start = child.end;
+  }
+
+  return output;
+}
+
 bool Tree::Node::is_valid(size_t start, size_t end) const {
   if (this->start < start || this->end > end) {
     return false;
@@ -459,8 +506,29 @@ bool Tree::Node::lookup(std::string key, size_t &start, size_t &end,
   return false;
 }
 
+bool Tree::Node::lookup(const Key &key, size_t depth, size_t &start,
+                        size_t &end) const {
+  if (depth >= key.size() || my_name != key[depth]) {
+    return false;
+  }
+
+  if (depth + 1 == key.size()) {
+    start = this->start;
+    end = this->end;
+    return true;
+  }
+
+  for (auto &child : children) {
+    if (child.lookup(key, depth + 1, start, end)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 bool Tree::Node::regex_lookup(
-    std::regex &regex, std::function<bool(size_t start, size_t end)> lambda,
+    const std::regex &regex, std::function<bool(size_t start, size_t end)> lambda,
     std::string &rkey) const {
   std::cmatch m;
 
@@ -488,6 +556,17 @@ bool Tree::Node::regex_lookup(
   return true;
 }
 
+std::size_t Tree::Node::footprint() const {
+  std::size_t bytes = my_name.capacity();
+
+  // Every child is a list node, with a link to the next
+  for (auto &child : children) {
+    bytes += sizeof(void *) + sizeof(Node) + child.footprint();
+  }
+
+  return bytes;
+}
+
 Tree::Tree() {}
 
 Tree::Tree(const std::string &name) : me(name) {
@@ -572,6 +651,20 @@ void Tree::merge(Tree &&tree, bool node_merge) {
   }
 }
 
+Tree &Tree::memoize() & {
+  me.memoize();
+  return *this;
+}
+
+Tree &&Tree::memoize() && {
+  me.memoize();
+  return std::move(*this);
+}
+
+std::size_t Tree::footprint() const {
+  return sizeof(Tree) + raw.capacity() + me.footprint();
+}
+
 bool Tree::operator==(const Tree &tree) const {
   return 0 == tree.as_string().compare(as_string());
 }
@@ -590,6 +683,10 @@ std::string Tree::as_python() const {
   return output;
 }
 
+void Tree::as_json(std::string &output, bool add_text) const {
+  me.dump_json(raw, output, add_text, true);
+}
+
 std::string Tree::lookup(std::string key) const {
   size_t start;
   size_t end;
@@ -616,6 +713,49 @@ void Tree::regex_lookup(std::string regex,
       blank);
 }
 
+Tree::Key Tree::compile_key(const std::string &key) {
+  Key compiled;
+  size_t pos = 0;
+
+  do {
+    auto dot_pos = key.find('.', pos);
+    compiled.emplace_back(key.substr(pos, dot_pos - pos));
+    pos = (dot_pos == std::string::npos) ? dot_pos : dot_pos + 1;
+  } while (pos != std::string::npos);
+
+  return compiled;
+}
+
+std::string_view Tree::lookup(const Key &key) const {
+  size_t start;
+  size_t end;
+
+  if (me.lookup(key, 0, start, end)) {
+    return std::string_view(raw).substr(start, end - start);
+  }
+
+  return {};
+}
+
+bool Tree::contains(const Key &key) const {
+  size_t start;
+  size_t end;
+
+  return me.lookup(key, 0, start, end);
+}
+
+void Tree::regex_lookup(
+    const std::regex &regex,
+    std::function<bool(std::string_view value)> lambda) const {
+  std::string blank;
+  me.regex_lookup(
+      regex,
+      [this, &lambda](size_t start, size_t end) {
+        return lambda(std::string_view(raw).substr(start, end - start));
+      },
+      blank);
+}
+
 bool Tree::is_valid() const {
   size_t rs = raw.size();
 
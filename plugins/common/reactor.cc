@@ -0,0 +1,258 @@
+// Snort includes
+
+// System includes
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Local includes
+#include <reactor.h>
+
+// Debug includes
+
+namespace Common {
+
+Reactor &Reactor::get() {
+  // Never destroyed, outputs might be stopped by other static destructors
+  static Reactor *reactor = new Reactor();
+  return *reactor;
+}
+
+Reactor::~Reactor() {
+  for (auto &loop : loops) {
+    {
+      std::scoped_lock lock(loop->mutex);
+      loop->stopping = true;
+    }
+
+    uint64_t one = 1;
+    [[maybe_unused]] auto ret = ::write(loop->event_fd, &one, sizeof(one));
+    loop->thread.join();
+  }
+}
+
+void Reactor::set_threads(std::size_t count) {
+  std::scoped_lock lock(mutex);
+
+  while (loops.size() < count) {
+    auto &loop = loops.emplace_back(std::make_unique<Loop>());
+    loop->thread = std::thread(&Loop::thread_loop, loop.get());
+  }
+}
+
+std::size_t Reactor::get_threads() {
+  std::scoped_lock lock(mutex);
+  return loops.size();
+}
+
+void Reactor::add(Task &task) {
+  if (get_threads() == 0) {
+    set_threads(1);
+  }
+
+  Loop *loop;
+  {
+    std::scoped_lock lock(mutex);
+    auto least_loaded = [](auto &a, auto &b) {
+      std::scoped_lock lock(a->mutex, b->mutex);
+      return a->tasks.size() < b->tasks.size();
+    };
+
+    loop = std::min_element(loops.begin(), loops.end(), least_loaded)->get();
+  }
+
+  std::scoped_lock lock(loop->mutex);
+
+  assert(task.loop == nullptr);
+  task.loop = loop;
+  task.deadline = clock::time_point::max();
+  loop->tasks.insert(&task);
+  loop->make_ready(&task);
+}
+
+void Reactor::remove(Task &task) {
+  Loop *loop = task.loop;
+
+  if (!loop) {
+    return;
+  }
+
+  std::unique_lock lock(loop->mutex);
+
+  assert(loop->thread.get_id() != std::this_thread::get_id());
+
+  loop->cv.wait(lock, [&] { return loop->running != &task; });
+
+  loop->tasks.erase(&task);
+  std::erase(loop->ready, &task);
+  task.queued = false;
+
+  // Events already taken from the epoll are ignored, the task isn't in tasks
+  for (int fd : task.watched) {
+    ::epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  }
+
+  task.watched.clear();
+  task.loop = nullptr;
+}
+
+void Reactor::Task::watch(int fd, uint32_t events) {
+  int epoll_fd = loop.load()->epoll_fd;
+  epoll_event ev = {};
+  ev.events = events | EPOLLONESHOT;
+  ev.data.ptr = this;
+
+  bool known = std::find(watched.begin(), watched.end(), fd) != watched.end();
+
+  // The fd might have been closed and reused without unwatch()
+  if (known && ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+    return;
+  }
+
+  if (::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0 ||
+      (errno == EEXIST && ::epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0)) {
+    if (!known) {
+      watched.push_back(fd);
+    }
+  }
+}
+
+void Reactor::Task::unwatch(int fd) {
+  auto itr = std::find(watched.begin(), watched.end(), fd);
+
+  if (itr != watched.end()) {
+    ::epoll_ctl(loop.load()->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    watched.erase(itr);
+  }
+}
+
+void Reactor::Task::wake() {
+  Loop *loop = this->loop;
+
+  if (!loop) {
+    return;
+  }
+
+  std::scoped_lock lock(loop->mutex);
+
+  if (loop->tasks.contains(this)) {
+    loop->make_ready(this);
+  }
+}
+
+Reactor::Loop::Loop()
+    : epoll_fd(::epoll_create1(EPOLL_CLOEXEC)),
+      event_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+  assert(epoll_fd != -1 && event_fd != -1);
+
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev);
+}
+
+Reactor::Loop::~Loop() {
+  ::close(epoll_fd);
+  ::close(event_fd);
+}
+
+void Reactor::Loop::make_ready(Task *task) {
+  if (task->queued) {
+    return;
+  }
+
+  task->queued = true;
+  ready.push_back(task);
+
+  // Only a sleeping thread needs the syscall, a busy one looks at ready
+  // before it sleeps
+  if (polling) {
+    polling = false;
+
+    uint64_t one = 1;
+    [[maybe_unused]] auto ret = ::write(event_fd, &one, sizeof(one));
+  }
+}
+
+Reactor::clock::time_point Reactor::Loop::next_deadline() {
+  auto deadline = clock::time_point::max();
+
+  for (auto task : tasks) {
+    deadline = std::min(deadline, task->deadline);
+  }
+
+  return deadline;
+}
+
+void Reactor::Loop::thread_loop() {
+  constexpr int max_events = 64;
+  epoll_event events[max_events];
+  std::unique_lock lock(mutex);
+
+  while (!stopping) {
+    // Tasks whose time has come
+    auto now = clock::now();
+    for (auto task : tasks) {
+      if (task->deadline <= now) {
+        task->deadline = clock::time_point::max();
+        make_ready(task);
+      }
+    }
+
+    // Only the tasks ready now, one that wakes itself runs again after the
+    // fds have been looked at, so it doesn't keep the others waiting
+    for (auto count = ready.size(); count != 0 && !ready.empty(); count--) {
+      Task *task = ready.front();
+      ready.pop_front();
+      task->queued = false;
+
+      running = task;
+      lock.unlock();
+
+      task->run();
+
+      lock.lock();
+      running = nullptr;
+      cv.notify_all();
+    }
+
+    int timeout_ms = -1; // Forever
+    auto deadline = ready.empty() ? next_deadline() : clock::time_point::min();
+
+    if (deadline != clock::time_point::max()) {
+      now = clock::now();
+      timeout_ms =
+          deadline <= now
+              ? 0
+              : std::min<int64_t>(std::chrono::ceil<std::chrono::milliseconds>(
+                                      deadline - now)
+                                      .count(),
+                                  INT_MAX);
+    }
+
+    polling = true;
+    lock.unlock();
+
+    int count = ::epoll_wait(epoll_fd, events, max_events, timeout_ms);
+
+    lock.lock();
+    polling = false;
+
+    for (int i = 0; i < count; i++) {
+      auto task = static_cast<Task *>(events[i].data.ptr);
+
+      if (!task) {
+        uint64_t value;
+        [[maybe_unused]] auto ret = ::read(event_fd, &value, sizeof(value));
+      } else if (tasks.contains(task)) {
+        make_ready(task);
+      }
+    }
+  }
+}
+
+} // namespace Common
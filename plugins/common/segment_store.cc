@@ -0,0 +1,405 @@
+// Snort includes
+
+// System includes
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Local includes
+#include <segment_store.h>
+
+// Debug includes
+
+namespace SegmentStore {
+namespace {
+
+constexpr uint64_t align(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+// Closes fd without clobbering errno, for cleanup on error paths
+void close_keep_errno(int fd) {
+  int error = errno;
+  ::close(fd);
+  errno = error;
+}
+
+// Header of a record, as written
+struct RecordHeader {
+  uint32_t length;
+  uint32_t flags;
+  int64_t time;
+  uint64_t key_hash;
+};
+
+static_assert(sizeof(RecordHeader) == record_header_size);
+
+} // namespace
+
+uint64_t key_hash(std::string_view value) {
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (unsigned char c : value) {
+    hash = (hash ^ c) * 0x100000001b3;
+  }
+
+  return hash ? hash : 1;
+}
+
+std::string segment_name(uint64_t sequence) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016" PRIx64 ".seg", sequence);
+  return name;
+}
+
+bool parse_segment_name(std::string_view name, uint64_t &sequence) {
+  if (name.size() != 20 || !name.ends_with(".seg")) {
+    return false;
+  }
+
+  sequence = 0;
+
+  for (char c : name.substr(0, 16)) {
+    if (c >= '0' && c <= '9') {
+      sequence = sequence << 4 | (c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      sequence = sequence << 4 | (c - 'a' + 10);
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::vector<std::string> list_segments(const std::string &directory) {
+  std::vector<std::pair<uint64_t, std::string>> found;
+
+  if (DIR *dir = ::opendir(directory.c_str())) {
+    while (dirent *entry = ::readdir(dir)) {
+      uint64_t sequence;
+
+      if (parse_segment_name(entry->d_name, sequence)) {
+        found.emplace_back(sequence, directory + "/" + entry->d_name);
+      }
+    }
+
+    ::closedir(dir);
+  }
+
+  std::sort(found.begin(), found.end());
+
+  std::vector<std::string> paths;
+  for (auto &segment : found) {
+    paths.push_back(std::move(segment.second));
+  }
+
+  return paths;
+}
+
+Writer::Writer(const std::string &path, uint64_t sequence,
+               const Config &config)
+    : segment_size(config.segment_size & ~uint64_t(4095)),
+      end_reserve(config.end_reserve) {
+  uint32_t interval = std::max<uint32_t>(config.index_interval, 4096);
+  uint32_t time_index_max = segment_size / interval + 1;
+  uint64_t data_start =
+      align(header_size + uint64_t(time_index_max) * sizeof(TimeEntry));
+
+  if (data_start + end_reserve + record_header_size >= segment_size ||
+      config.serializer.size() >= sizeof(Header::serializer) ||
+      config.key.size() >= sizeof(Header::key)) {
+    errno = EINVAL;
+    return;
+  }
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+  if (fd == -1) {
+    return;
+  }
+
+  // Allocated up front, so a full disk is found now and not by a SIGBUS
+  int error = ::posix_fallocate(fd, 0, segment_size);
+
+  if (error != 0) {
+    ::unlink(path.c_str());
+    ::close(fd);
+    fd = -1;
+    errno = error;
+    return;
+  }
+
+  void *mapping = ::mmap(nullptr, segment_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+
+  if (mapping == MAP_FAILED) {
+    ::unlink(path.c_str());
+    close_keep_errno(fd);
+    fd = -1;
+    return;
+  }
+
+  header = new (mapping) Header{};
+  std::memcpy(header->magic, magic, sizeof(magic));
+  header->version = version;
+  header->header_size = header_size;
+  header->segment_size = segment_size;
+  header->sequence = sequence;
+  header->data_start = data_start;
+  header->index_interval = interval;
+  header->time_index_max = time_index_max;
+  std::memcpy(header->serializer, config.serializer.data(),
+              config.serializer.size());
+  std::memcpy(header->key, config.key.data(), config.key.size());
+  header->data_end.store(data_start, std::memory_order_release);
+
+  data = static_cast<uint8_t *>(mapping);
+  data_end = data_start;
+}
+
+Writer::~Writer() {
+  if (header) {
+    publish();
+    ::munmap(header, segment_size);
+    ::close(fd);
+  }
+}
+
+uint64_t Writer::max_payload() const {
+  return segment_size - header->data_start - end_reserve -
+         record_header_size - sizeof(KeyEntry);
+}
+
+bool Writer::append(std::string_view payload, uint32_t flags, int64_t time,
+                    const uint64_t *key) {
+  if (header->sealed.load(std::memory_order_relaxed)) {
+    return false;
+  }
+
+  uint64_t need = align(record_header_size + payload.size());
+  uint64_t key_room = (keys.size() + (key ? 1 : 0)) * sizeof(KeyEntry);
+  uint64_t reserve = (flags & context_end) ? 0 : end_reserve;
+
+  if (data_end + need + key_room + reserve > segment_size) {
+    return false;
+  }
+
+  time = std::max(time, last_time);
+
+  // The first record in each interval is indexed
+  auto &entries = header->time_entries;
+  uint64_t entry = entries.load(std::memory_order_relaxed);
+
+  if (entry < header->time_index_max &&
+      data_end - header->data_start >= entry * header->index_interval) {
+    auto index = reinterpret_cast<TimeEntry *>(data + header_size);
+    index[entry] = {time, data_end};
+    entries.store(entry + 1, std::memory_order_release);
+  }
+
+  if (key) {
+    flags |= has_key;
+    keys.push_back({*key, data_end});
+  }
+
+  RecordHeader record = {static_cast<uint32_t>(payload.size()), flags, time,
+                         key ? *key : 0};
+  std::memcpy(data + data_end, &record, sizeof(record));
+  std::memcpy(data + data_end + sizeof(record), payload.data(),
+              payload.size());
+
+  if (!has_records) {
+    header->first_time.store(time, std::memory_order_relaxed);
+    has_records = true;
+  }
+
+  data_end += need;
+  last_time = time;
+  return true;
+}
+
+void Writer::publish() {
+  if (data_end == header->data_end.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  header->last_time.store(last_time, std::memory_order_relaxed);
+  header->data_end.store(data_end, std::memory_order_release);
+}
+
+void Writer::seal() {
+  if (header->sealed.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  publish();
+
+  std::sort(keys.begin(), keys.end(), [](auto &a, auto &b) {
+    return a.hash < b.hash || (a.hash == b.hash && a.offset < b.offset);
+  });
+
+  std::memcpy(data + segment_size - keys.size() * sizeof(KeyEntry),
+              keys.data(), keys.size() * sizeof(KeyEntry));
+  header->key_entries.store(keys.size(), std::memory_order_relaxed);
+  header->sealed.store(1, std::memory_order_release);
+
+  keys.clear();
+  keys.shrink_to_fit();
+}
+
+uint64_t Writer::used() const { return data_end - header->data_start; }
+
+bool Writer::recover(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat st;
+
+  if (::fstat(fd, &st) != 0 || uint64_t(st.st_size) < header_size) {
+    ::close(fd);
+    return false;
+  }
+
+  uint64_t size = st.st_size;
+  void *mapping =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+
+  auto header = static_cast<Header *>(mapping);
+  auto data = static_cast<uint8_t *>(mapping);
+  uint64_t end = header->data_end.load(std::memory_order_acquire);
+
+  bool valid = std::memcmp(header->magic, magic, sizeof(magic)) == 0 &&
+               header->version == version && header->segment_size == size &&
+               header->data_start <= end && end <= size;
+
+  if (valid && !header->sealed.load(std::memory_order_relaxed)) {
+    std::vector<KeyEntry> keys;
+    uint64_t offset = header->data_start;
+
+    // Only records that were published are kept
+    for (RecordHeader record; offset + record_header_size <= end;
+         offset += align(record_header_size + record.length)) {
+      std::memcpy(&record, data + offset, sizeof(record));
+
+      if (record.length > end - offset - record_header_size) {
+        break;
+      }
+
+      if (record.flags & has_key) {
+        keys.push_back({record.key_hash, offset});
+      }
+    }
+
+    if (offset != end ||
+        end + keys.size() * sizeof(KeyEntry) > header->segment_size) {
+      valid = false;
+    } else {
+      std::sort(keys.begin(), keys.end(), [](auto &a, auto &b) {
+        return a.hash < b.hash || (a.hash == b.hash && a.offset < b.offset);
+      });
+
+      std::memcpy(data + size - keys.size() * sizeof(KeyEntry), keys.data(),
+                  keys.size() * sizeof(KeyEntry));
+      header->key_entries.store(keys.size(), std::memory_order_relaxed);
+      header->sealed.store(1, std::memory_order_release);
+    }
+  }
+
+  ::munmap(mapping, size);
+  return valid;
+}
+
+Segment::Segment(const std::string &path) : file(path.c_str()) {
+  if (file.size() < header_size) {
+    return;
+  }
+
+  auto candidate = reinterpret_cast<const Header *>(file.data());
+  uint64_t time_index_end =
+      header_size + uint64_t(candidate->time_index_max) * sizeof(TimeEntry);
+
+  if (std::memcmp(candidate->magic, magic, sizeof(magic)) != 0 ||
+      candidate->version != version ||
+      candidate->segment_size != file.size() ||
+      candidate->data_start < time_index_end ||
+      candidate->data_start > file.size()) {
+    return;
+  }
+
+  header = candidate;
+}
+
+uint64_t Segment::seek(uint64_t offset, int64_t from) const {
+  auto index = reinterpret_cast<const TimeEntry *>(file.data() + header_size);
+  uint64_t entries = std::min<uint64_t>(
+      header->time_entries.load(std::memory_order_acquire),
+      header->time_index_max);
+
+  // The last entry before from, the records from it on are scanned
+  auto entry = std::lower_bound(
+      index, index + entries, from,
+      [](const TimeEntry &entry, int64_t time) { return entry.time < time; });
+
+  if (entry != index) {
+    offset = std::max(offset, entry[-1].offset);
+  }
+
+  return offset;
+}
+
+bool Segment::read(uint64_t offset, uint64_t end, Record &record) const {
+  end = std::min(end, file.size());
+
+  if (offset < header->data_start || offset + record_header_size > end) {
+    return false;
+  }
+
+  RecordHeader stored;
+  std::memcpy(&stored, file.data() + offset, sizeof(stored));
+
+  if (stored.length > end - offset - record_header_size) {
+    return false;
+  }
+
+  record.offset = offset;
+  record.flags = stored.flags;
+  record.time = stored.time;
+  record.key_hash = stored.key_hash;
+  record.payload = std::string_view(
+      reinterpret_cast<const char *>(file.data() + offset + record_header_size),
+      stored.length);
+  return true;
+}
+
+const KeyEntry *Segment::find_key(uint64_t hash) const {
+  uint64_t end = header->data_end.load(std::memory_order_relaxed);
+  uint64_t entries = std::min<uint64_t>(
+      header->key_entries.load(std::memory_order_relaxed),
+      (file.size() - std::min(end, file.size())) / sizeof(KeyEntry));
+  auto begin = key_end() - entries;
+
+  return std::lower_bound(
+      begin, key_end(), hash,
+      [](const KeyEntry &entry, uint64_t hash) { return entry.hash < hash; });
+}
+
+const KeyEntry *Segment::key_end() const {
+  return reinterpret_cast<const KeyEntry *>(file.data() + file.size());
+}
+
+} // namespace SegmentStore
@@ -0,0 +1,361 @@
+// Snort includes
+
+// System includes
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Local includes
+#include <shm_ring.h>
+
+// Debug includes
+
+namespace ShmRing {
+namespace {
+
+constexpr uint64_t align(uint64_t size) { return (size + 7) & ~uint64_t(7); }
+
+// Closes fd without clobbering errno, for cleanup on error paths
+void close_keep_errno(int fd) {
+  int error = errno;
+  ::close(fd);
+  errno = error;
+}
+
+} // namespace
+
+Writer::Writer(const char *name, uint64_t data_size) : data_size(data_size) {
+  if (data_size < 2 * record_header_size ||
+      (data_size & (data_size - 1)) != 0) {
+    errno = EINVAL;
+    return;
+  }
+
+  memory_fd = ::memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+  if (memory_fd == -1) {
+    return;
+  }
+
+  // The consumer can rely on the size once it has checked it
+  if (::ftruncate(memory_fd, header_size + data_size) ||
+      ::fcntl(memory_fd, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+    close_keep_errno(memory_fd);
+    memory_fd = -1;
+    return;
+  }
+
+  void *mapping = ::mmap(nullptr, header_size + data_size,
+                         PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+
+  if (mapping == MAP_FAILED) {
+    close_keep_errno(memory_fd);
+    memory_fd = -1;
+    return;
+  }
+
+  doorbell_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+  if (doorbell_fd == -1) {
+    int error = errno;
+    ::munmap(mapping, header_size + data_size);
+    ::close(memory_fd);
+    memory_fd = -1;
+    errno = error;
+    return;
+  }
+
+  header = new (mapping) Header{};
+  std::memcpy(header->magic, magic, sizeof(magic));
+  header->version = version;
+  header->header_size = header_size;
+  header->data_size = data_size;
+
+  data = static_cast<uint8_t *>(mapping) + header_size;
+}
+
+Writer::~Writer() {
+  if (header) {
+    ::munmap(header, header_size + data_size);
+    ::close(memory_fd);
+    ::close(doorbell_fd);
+  }
+}
+
+bool Writer::write(std::string_view payload, uint32_t flags) {
+  if (payload.size() > max_payload()) {
+    return false;
+  }
+
+  uint64_t need = align(record_header_size + payload.size());
+  uint64_t offset = write_pos & (data_size - 1);
+  uint64_t skip = need > data_size - offset ? data_size - offset : 0;
+
+  if (write_pos + skip + need - read_pos > data_size) {
+    read_pos = header->read_pos.load(std::memory_order_acquire);
+
+    if (write_pos + skip + need - read_pos > data_size) {
+      return false;
+    }
+  }
+
+  if (skip != 0) {
+    if (skip >= record_header_size) {
+      uint32_t record[2] = {
+          static_cast<uint32_t>(skip - record_header_size), padding};
+      std::memcpy(data + offset, record, sizeof(record));
+      std::memcpy(data + offset + sizeof(record), &seq, sizeof(seq));
+    }
+
+    write_pos += skip;
+    offset = 0;
+  }
+
+  uint32_t record[2] = {static_cast<uint32_t>(payload.size()), flags};
+  std::memcpy(data + offset, record, sizeof(record));
+  std::memcpy(data + offset + sizeof(record), &seq, sizeof(seq));
+  std::memcpy(data + offset + record_header_size, payload.data(),
+              payload.size());
+
+  write_pos += need;
+  seq++;
+
+  return true;
+}
+
+bool Writer::publish() {
+  if (header->write_pos.load(std::memory_order_relaxed) == write_pos) {
+    return false;
+  }
+
+  // Both sides use sequentially consistent operations on write_pos and
+  // consumer_waiting, so either the consumer sees the new position before it
+  // sleeps, or we see that it's waiting
+  header->write_seq.store(seq, std::memory_order_relaxed);
+  header->write_pos.store(write_pos);
+
+  if (header->consumer_waiting.exchange(0) == 0) {
+    return false;
+  }
+
+  uint64_t one = 1;
+  return ::write(doorbell_fd, &one, sizeof(one)) == sizeof(one);
+}
+
+bool Writer::hand_out(int socket) const {
+  char placeholder = 0;
+  iovec iov = {&placeholder, 1};
+  int fds[2] = {memory_fd, doorbell_fd};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  return ::sendmsg(socket, &msg, MSG_NOSIGNAL) == 1;
+}
+
+Reader::~Reader() {
+  if (header) {
+    ::munmap(header, header_size + data_size);
+    ::close(doorbell_fd);
+  }
+
+  if (socket != -1) {
+    ::close(socket);
+  }
+}
+
+bool Reader::connect(const char *socket_path) {
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd == -1) {
+    return false;
+  }
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+  if (::connect(fd, (sockaddr *)&addr, sizeof(addr))) {
+    close_keep_errno(fd);
+    return false;
+  }
+
+  if (!receive(fd)) {
+    close_keep_errno(fd);
+    return false;
+  }
+
+  return true;
+}
+
+bool Reader::receive(int fd) {
+  char placeholder;
+  iovec iov = {&placeholder, 1};
+  int fds[2];
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t got;
+
+  do {
+    got = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  } while (got == -1 && errno == EINTR);
+
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+  if (got != 1 || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    // A logger that already has a consumer closes the connection
+    errno = got == 0 ? EBUSY : EPROTO;
+    return false;
+  }
+
+  std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  if (!attach(fds[0], fds[1])) {
+    return false;
+  }
+
+  socket = fd;
+  return true;
+}
+
+bool Reader::attach(int memory_fd, int new_doorbell_fd) {
+  struct stat st;
+  void *mapping = MAP_FAILED;
+
+  if (::fstat(memory_fd, &st) == 0 &&
+      static_cast<uint64_t>(st.st_size) > header_size) {
+    mapping = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     memory_fd, 0);
+  }
+
+  ::close(memory_fd);
+
+  if (mapping == MAP_FAILED) {
+    ::close(new_doorbell_fd);
+    return false;
+  }
+
+  auto *new_header = static_cast<Header *>(mapping);
+  uint64_t size = new_header->data_size;
+
+  if (std::memcmp(new_header->magic, magic, sizeof(magic)) != 0 ||
+      new_header->version != version ||
+      new_header->header_size != header_size ||
+      header_size + size != static_cast<uint64_t>(st.st_size) ||
+      (size & (size - 1)) != 0) {
+    ::munmap(mapping, st.st_size);
+    ::close(new_doorbell_fd);
+    errno = EPROTO;
+    return false;
+  }
+
+  header = new_header;
+  data = static_cast<const uint8_t *>(mapping) + header_size;
+  data_size = size;
+  doorbell_fd = new_doorbell_fd;
+
+  read_pos = header->read_pos.load(std::memory_order_acquire);
+  available = read_pos;
+  failed = false;
+
+  return true;
+}
+
+bool Reader::next(Record &record) {
+  while (true) {
+    if (read_pos == available) {
+      available = header->write_pos.load(std::memory_order_acquire);
+
+      if (read_pos == available) {
+        return false;
+      }
+    }
+
+    uint64_t offset = read_pos & (data_size - 1);
+    uint64_t left = data_size - offset;
+
+    if (left < record_header_size) {
+      read_pos += left;
+      continue;
+    }
+
+    uint32_t fields[2];
+    std::memcpy(fields, data + offset, sizeof(fields));
+
+    // Records must stay within what's published, and padding must end at the
+    // end of the data area
+    uint64_t size = align(record_header_size + fields[0]);
+
+    if (size > left || size > available - read_pos ||
+        ((fields[1] & padding) && size != left)) {
+      failed = true;
+      return false;
+    }
+
+    if (fields[1] & padding) {
+      read_pos += left;
+      continue;
+    }
+
+    record.flags = fields[1];
+    std::memcpy(&record.seq, data + offset + sizeof(fields),
+                sizeof(record.seq));
+    record.payload = {
+        reinterpret_cast<const char *>(data + offset + record_header_size),
+        fields[0]};
+
+    read_pos += align(record_header_size + fields[0]);
+    return true;
+  }
+}
+
+bool Reader::wait(int timeout_ms) {
+  header->consumer_waiting.store(1);
+
+  if (header->write_pos.load() != available) {
+    header->consumer_waiting.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  pollfd pfds[2] = {{doorbell_fd, POLLIN, 0}, {socket, POLLIN, 0}};
+  int ret = ::poll(pfds, socket != -1 ? 2 : 1, timeout_ms);
+
+  header->consumer_waiting.store(0, std::memory_order_relaxed);
+
+  if (ret > 0 && (pfds[0].revents & POLLIN)) {
+    uint64_t count;
+    [[maybe_unused]] auto ignore = ::read(doorbell_fd, &count, sizeof(count));
+  }
+
+  // The logger never writes on the connection, so readable means closed
+  return !(ret > 0 && pfds[1].revents);
+}
+
+} // namespace ShmRing
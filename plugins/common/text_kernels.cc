@@ -0,0 +1,550 @@
+
+// Snort includes
+
+// System includes
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Local includes
+#include <text_kernels.h>
+
+// Global includes
+
+// Debug includes
+
+namespace Common {
+namespace {
+
+// Escape sequence of every byte value, length 1 means no escaping is needed
+struct EscapeEntry {
+  uint8_t length;
+  char text[6];
+};
+
+using EscapeTable = std::array<EscapeEntry, 256>;
+
+// Functions implementing the kernels for a given instruction set
+struct Kernels {
+  TextKernelsIsa isa;
+  char *(*escaped)(char *out, const char *in, size_t size,
+                   const EscapeTable &table); // For tables escaping the same
+                                              // chars as escape_table, out
+                                              // holds 6 * size, returns end
+                                              // of output
+  void (*hex)(char *out, const char *in, size_t size); // out holds 2 * size
+  size_t (*base64)(char *out, const char *in,
+                   size_t size); // Encodes whole 3 byte groups only, returns
+                                 // number of bytes consumed
+};
+
+//
+// Tables
+//
+
+constexpr char hex_digits[] = "0123456789abcdef";
+
+constexpr char base64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Table for append_escaped()
+constexpr EscapeTable make_escape_table() {
+  EscapeTable table{};
+
+  for (unsigned c = 0; c < 256; c++) {
+    auto &entry = table[c];
+
+    switch (c) {
+    case '\\':
+      entry = {2, {'\\', '\\'}};
+      break;
+    case '\"':
+      entry = {2, {'\\', '\"'}};
+      break;
+    case '\n':
+      entry = {2, {'\\', 'n'}};
+      break;
+    case '\t':
+      entry = {2, {'\\', 't'}};
+      break;
+    case '\r':
+      entry = {2, {'\\', 'r'}};
+      break;
+    default:
+      if (c >= ' ' && c <= '~') {
+        entry = {1, {static_cast<char>(c)}};
+      } else {
+        entry = {4, {'\\', 'x', hex_digits[c >> 4], hex_digits[c & 0xf]}};
+      }
+    }
+  }
+
+  return table;
+}
+
+// Table for append_json_escaped(), escapes the same chars as escape_table
+constexpr EscapeTable make_json_escape_table() {
+  EscapeTable table{};
+
+  for (unsigned c = 0; c < 256; c++) {
+    auto &entry = table[c];
+
+    switch (c) {
+    case '\\':
+      entry = {2, {'\\', '\\'}};
+      break;
+    case '\"':
+      entry = {2, {'\\', '\"'}};
+      break;
+    case '\b':
+      entry = {2, {'\\', 'b'}};
+      break;
+    case '\f':
+      entry = {2, {'\\', 'f'}};
+      break;
+    case '\n':
+      entry = {2, {'\\', 'n'}};
+      break;
+    case '\t':
+      entry = {2, {'\\', 't'}};
+      break;
+    case '\r':
+      entry = {2, {'\\', 'r'}};
+      break;
+    default:
+      if (c >= ' ' && c <= '~') {
+        entry = {1, {static_cast<char>(c)}};
+      } else {
+        // Bytes are escaped as the code point of the same value, so the
+        // output is valid UTF-8 whatever the input is
+        entry = {6,
+                 {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf]}};
+      }
+    }
+  }
+
+  return table;
+}
+
+constexpr auto escape_table = make_escape_table();
+constexpr auto json_escape_table = make_json_escape_table();
+
+// Copies size bytes from in to out, replacing them with their escape sequence
+char *escape_bytes(char *out, const char *in, size_t size,
+                   const EscapeTable &table) {
+  for (size_t pos = 0; pos < size; pos++) {
+    auto &entry = table[static_cast<unsigned char>(in[pos])];
+    std::memcpy(out, entry.text, sizeof(entry.text));
+    out += entry.length;
+  }
+
+  return out;
+}
+
+// Copies size bytes from in to out, where mask has a bit set for each of the
+// bytes that must be escaped, the clean bytes between them are copied as is
+char *escape_masked_bytes(char *out, const char *in, size_t size,
+                          uint32_t mask, const EscapeTable &table) {
+  // Copying the clean runs only pays off if they are long
+  if (static_cast<size_t>(__builtin_popcount(mask)) > size / 8) {
+    return escape_bytes(out, in, size, table);
+  }
+
+  size_t pos = 0;
+
+  while (mask) {
+    size_t next = __builtin_ctz(mask);
+    std::memcpy(out, in + pos, next - pos);
+    out += next - pos;
+
+    auto &entry = table[static_cast<unsigned char>(in[next])];
+    std::memcpy(out, entry.text, sizeof(entry.text));
+    out += entry.length;
+
+    pos = next + 1;
+    mask &= mask - 1;
+  }
+
+  std::memcpy(out, in + pos, size - pos);
+  return out + size - pos;
+}
+
+//
+// Scalar versions
+//
+
+char *escaped_scalar(char *out, const char *in, size_t size,
+                     const EscapeTable &table) {
+  return escape_bytes(out, in, size, table);
+}
+
+void hex_scalar(char *out, const char *in, size_t size) {
+  for (size_t pos = 0; pos < size; pos++) {
+    auto c = static_cast<unsigned char>(in[pos]);
+    *out++ = hex_digits[c >> 4];
+    *out++ = hex_digits[c & 0xf];
+  }
+}
+
+size_t base64_scalar(char *out, const char *in, size_t size) {
+  size_t pos = 0;
+
+  for (; pos + 3 <= size; pos += 3) {
+    uint32_t group = static_cast<unsigned char>(in[pos]) << 16 |
+                     static_cast<unsigned char>(in[pos + 1]) << 8 |
+                     static_cast<unsigned char>(in[pos + 2]);
+    *out++ = base64_digits[group >> 18];
+    *out++ = base64_digits[(group >> 12) & 0x3f];
+    *out++ = base64_digits[(group >> 6) & 0x3f];
+    *out++ = base64_digits[group & 0x3f];
+  }
+
+  return pos;
+}
+
+constexpr Kernels scalar_kernels = {TextKernelsIsa::scalar, escaped_scalar,
+                                    hex_scalar, base64_scalar};
+
+#if defined(__x86_64__)
+
+//
+// SSE4.2 versions
+//
+
+// Chars needing escaping given as ranges for pcmpestri
+alignas(16) constexpr char escaped_ranges[16] = {
+    '\x00', '\x1f', '\"', '\"', '\\', '\\', '\x7f', '\xff'};
+
+__attribute__((target("sse4.2"))) char *
+escaped_sse42(char *out, const char *in, size_t size, const EscapeTable &table) {
+  const __m128i ranges =
+      _mm_load_si128(reinterpret_cast<const __m128i *>(escaped_ranges));
+  size_t pos = 0;
+
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + pos));
+    uint32_t mask = _mm_cvtsi128_si32(_mm_cmpestrm(
+        ranges, 8, data, 16,
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_BIT_MASK));
+
+    if (mask) {
+      out = escape_masked_bytes(out, in + pos, 16, mask, table);
+    } else {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out), data);
+      out += 16;
+    }
+  }
+
+  return escaped_scalar(out, in + pos, size - pos, table);
+}
+
+__attribute__((target("sse4.2"))) void hex_sse42(char *out, const char *in,
+                                                 size_t size) {
+  const __m128i digits =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex_digits));
+  const __m128i low_mask = _mm_set1_epi8(0x0f);
+  size_t pos = 0;
+
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + pos));
+    __m128i high = _mm_shuffle_epi8(
+        digits, _mm_and_si128(_mm_srli_epi16(data, 4), low_mask));
+    __m128i low = _mm_shuffle_epi8(digits, _mm_and_si128(data, low_mask));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16),
+                     _mm_unpackhi_epi8(high, low));
+    out += 32;
+  }
+
+  hex_scalar(out, in + pos, size - pos);
+}
+
+// Converts 12 bytes, in the low 12 bytes of data, to 16 base64 digits.  See
+// Wojciech Mula, "Base64 encoding with SIMD instructions"
+__attribute__((target("sse4.2"))) __m128i base64_block_sse42(__m128i data) {
+  // Every 32 bit lane gets one 3 byte group as bytes 1, 0, 2, 1
+  data = _mm_shuffle_epi8(
+      data, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+  // Move each 6 bit index to its own byte
+  __m128i t0 = _mm_and_si128(data, _mm_set1_epi32(0x0fc0fc00));
+  __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  __m128i t2 = _mm_and_si128(data, _mm_set1_epi32(0x003f03f0));
+  __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  __m128i indices = _mm_or_si128(t1, t3);
+
+  // Translate indices to digits by adding an offset per range of indices,
+  // reduced is 0 for 26..51, 1..10 for 52..61, 11 for 62, 12 for 63 and 13
+  // for 0..25
+  __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+  reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+  const __m128i offsets = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+  return _mm_add_epi8(_mm_shuffle_epi8(offsets, reduced), indices);
+}
+
+__attribute__((target("sse4.2"))) size_t base64_sse42(char *out,
+                                                      const char *in,
+                                                      size_t size) {
+  size_t pos = 0;
+
+  // Each load reads 16 bytes, but only 12 are consumed
+  for (; pos + 16 <= size; pos += 12) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + pos));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                     base64_block_sse42(data));
+    out += 16;
+  }
+
+  return pos + base64_scalar(out, in + pos, size - pos);
+}
+
+constexpr Kernels sse42_kernels = {TextKernelsIsa::sse42, escaped_sse42,
+                                   hex_sse42, base64_sse42};
+
+//
+// AVX2 versions
+//
+
+// Returns bitmask of the bytes in data that append_escaped() escapes
+__attribute__((target("avx2"))) uint32_t escaped_mask_avx2(__m256i data) {
+  // As signed bytes, all of 0x00-0x1f and 0x80-0xff are less than ' '
+  __m256i mask = _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), data);
+  mask = _mm256_or_si256(mask,
+                         _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\x7f')));
+  mask =
+      _mm256_or_si256(mask, _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\"')));
+  mask =
+      _mm256_or_si256(mask, _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\\')));
+
+  return _mm256_movemask_epi8(mask);
+}
+
+__attribute__((target("avx2"))) char *
+escaped_avx2(char *out, const char *in, size_t size, const EscapeTable &table) {
+  size_t pos = 0;
+
+  for (; pos + 32 <= size; pos += 32) {
+    __m256i data =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + pos));
+    uint32_t mask = escaped_mask_avx2(data);
+
+    if (mask) {
+      out = escape_masked_bytes(out, in + pos, 32, mask, table);
+    } else {
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), data);
+      out += 32;
+    }
+  }
+
+  return escaped_sse42(out, in + pos, size - pos, table);
+}
+
+__attribute__((target("avx2"))) void hex_avx2(char *out, const char *in,
+                                              size_t size) {
+  const __m256i digits = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(hex_digits)));
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  size_t pos = 0;
+
+  for (; pos + 32 <= size; pos += 32) {
+    __m256i data =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + pos));
+    __m256i high = _mm256_shuffle_epi8(
+        digits, _mm256_and_si256(_mm256_srli_epi16(data, 4), low_mask));
+    __m256i low = _mm256_shuffle_epi8(digits, _mm256_and_si256(data, low_mask));
+
+    // Unpacking works within 128 bit lanes, so the lanes are reordered when
+    // storing
+    __m256i first = _mm256_unpacklo_epi8(high, low);  // Bytes 0-7, 16-23
+    __m256i second = _mm256_unpackhi_epi8(high, low); // Bytes 8-15, 24-31
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                        _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32),
+                        _mm256_permute2x128_si256(first, second, 0x31));
+    out += 64;
+  }
+
+  hex_sse42(out, in + pos, size - pos);
+}
+
+__attribute__((target("avx2"))) size_t base64_avx2(char *out, const char *in,
+                                                   size_t size) {
+  size_t pos = 0;
+
+  // Each 128 bit lane encodes 12 bytes the same way as base64_block_sse42(),
+  // the upper lane is loaded from 12 bytes in so it reads up to byte 28
+  for (; pos + 28 <= size; pos += 24) {
+    __m256i data = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + pos))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + pos + 12)), 1);
+
+    data = _mm256_shuffle_epi8(
+        data, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                              10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0,
+                              1));
+
+    __m256i t0 = _mm256_and_si256(data, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(data, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i indices = _mm256_or_si256(t1, t3);
+
+    __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    reduced =
+        _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+
+    const __m256i offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(out),
+        _mm256_add_epi8(_mm256_shuffle_epi8(offsets, reduced), indices));
+    out += 32;
+  }
+
+  return pos + base64_sse42(out, in + pos, size - pos);
+}
+
+constexpr Kernels avx2_kernels = {TextKernelsIsa::avx2, escaped_avx2, hex_avx2,
+                                  base64_avx2};
+
+#endif // defined(__x86_64__)
+
+//
+// Dispatch
+//
+
+const Kernels *detect_kernels() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    return &avx2_kernels;
+  }
+
+  if (__builtin_cpu_supports("sse4.2")) {
+    return &sse42_kernels;
+  }
+#endif
+
+  return &scalar_kernels;
+}
+
+const Kernels *&kernels() {
+  static const Kernels *selected = detect_kernels();
+  return selected;
+}
+
+} // namespace
+
+TextKernelsIsa text_kernels_isa() { return kernels()->isa; }
+
+const char *text_kernels_isa_name(TextKernelsIsa isa) {
+  switch (isa) {
+  case TextKernelsIsa::scalar:
+    return "scalar";
+  case TextKernelsIsa::sse42:
+    return "sse4.2";
+  case TextKernelsIsa::avx2:
+    return "avx2";
+  }
+
+  return "unknown";
+}
+
+bool select_text_kernels(TextKernelsIsa isa) {
+  switch (isa) {
+  case TextKernelsIsa::scalar:
+    kernels() = &scalar_kernels;
+    return true;
+
+#if defined(__x86_64__)
+  case TextKernelsIsa::sse42:
+    if (!__builtin_cpu_supports("sse4.2")) {
+      return false;
+    }
+    kernels() = &sse42_kernels;
+    return true;
+
+  case TextKernelsIsa::avx2:
+    if (!__builtin_cpu_supports("avx2")) {
+      return false;
+    }
+    kernels() = &avx2_kernels;
+    return true;
+#endif
+
+  default:
+    return false;
+  }
+}
+
+void append_escaped(std::string &output, std::string_view in) {
+  size_t pos = output.size();
+
+  // Room is made for the longest escape of every char, and trimmed after
+  output.resize_and_overwrite(
+      pos + in.size() * sizeof(EscapeEntry::text), [&](char *buffer, size_t) {
+        return kernels()->escaped(buffer + pos, in.data(), in.size(),
+                                  escape_table) -
+               buffer;
+      });
+}
+
+void append_json_escaped(std::string &output, std::string_view in) {
+  size_t pos = output.size();
+
+  output.resize_and_overwrite(
+      pos + in.size() * sizeof(EscapeEntry::text), [&](char *buffer, size_t) {
+        return kernels()->escaped(buffer + pos, in.data(), in.size(),
+                                  json_escape_table) -
+               buffer;
+      });
+}
+
+void append_hex(std::string &output, std::string_view in) {
+  size_t pos = output.size();
+  output.resize(pos + in.size() * 2);
+  kernels()->hex(output.data() + pos, in.data(), in.size());
+}
+
+void append_base64(std::string &output, std::string_view in) {
+  size_t pos = output.size();
+  output.resize(pos + (in.size() + 2) / 3 * 4);
+
+  char *out = output.data() + pos;
+  size_t done = kernels()->base64(out, in.data(), in.size());
+  out += done / 3 * 4;
+
+  // Remaining 1 or 2 bytes are padded
+  if (size_t left = in.size() - done; left > 0) {
+    uint32_t group = static_cast<unsigned char>(in[done]) << 16;
+    if (left > 1) {
+      group |= static_cast<unsigned char>(in[done + 1]) << 8;
+    }
+
+    out[0] = base64_digits[group >> 18];
+    out[1] = base64_digits[(group >> 12) & 0x3f];
+    out[2] = (left > 1) ? base64_digits[(group >> 6) & 0x3f] : '=';
+    out[3] = '=';
+  }
+}
+
+} // namespace Common
@@ -0,0 +1,86 @@
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+
+// Local includes
+#include "io_reactor.h"
+#include "reactor.h"
+
+// Debug includes
+
+namespace io_reactor {
+namespace {
+
+static const char *s_name = "io_reactor";
+static const char *s_help =
+    "Threads shared by the outputs (logger_tcp, logger_pipe, capture_pcap) "
+    "for their I/O";
+
+static const snort::Parameter module_params[] = {
+    {"threads", snort::Parameter::PT_INT, "1:64", "1",
+     "Number of I/O threads, outputs started before this is configured stay "
+     "on the first thread"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {}
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    if (val.is("threads")) {
+      Common::Reactor::get().set_threads(val.get_uint32());
+      return true;
+    }
+
+    // fail if we didn't get something valid
+    return false;
+  }
+
+  Usage get_usage() const override { return GLOBAL; }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace io_reactor
@@ -0,0 +1,18 @@
+#ifndef io_reactor_5d0b93e2
+#define io_reactor_5d0b93e2
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace io_reactor {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace io_reactor
+
+#endif // #ifndef io_reactor_5d0b93e2
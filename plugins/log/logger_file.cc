@@ -6,14 +6,31 @@
 #include <log/messages.h>
 
 // System includes
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <memory>
 #include <mutex>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <vector>
 
 // Local includes
+#include "disk_writer.h"
 #include "lioli.h"
 #include "log_framework.h"
 #include "logger_file.h"
+#include "reactor.h"
+#include "serialization_pool.h"
+#include "tree_ring.h"
 
 // Debug includes
 
@@ -21,75 +38,580 @@ namespace logger_file {
 namespace {
 
 static const char *s_name = "logger_file";
-static const char *s_help =
-    "Outputs LioLi trees stdout, it only supports text output";
+static const char *s_help = "Outputs LioLi trees to a file";
 
-static const snort::Parameter module_params[] = {
+static const snort::Parameter logger_params[] = {
     {"file_name", snort::Parameter::PT_STRING, nullptr, nullptr,
      "File name logs should be written to"},
     {"file_env", snort::Parameter::PT_STRING, nullptr, nullptr,
      "File name will be read from environment variable"},
     {"serializer", snort::Parameter::PT_STRING, nullptr, nullptr,
      "Serializer to use for generating output"},
+    {"io_uring", snort::Parameter::PT_BOOL, nullptr, "true",
+     "Write through io_uring when the kernel has it, if not, or false, the "
+     "file is written with write()"},
+    {"direct_io", snort::Parameter::PT_BOOL, nullptr, "false",
+     "Write with O_DIRECT, bypassing the page cache"},
+    {"preallocate", snort::Parameter::PT_INT, "0:max53", "0",
+     "Bytes the file is allocated on disk ahead of the writes, 0 = none"},
+    {"rotate_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "Size the file may reach before it's rotated (0 = never)"},
+    {"rotate_s", snort::Parameter::PT_INT, "0:max31", "0",
+     "Seconds a file is written to before it's rotated (0 = never)"},
+    {"max_files", snort::Parameter::PT_INT, "0:max31", "0",
+     "Max number of rotated files kept, the oldest are deleted (0 = all)"},
+    {"serializer_threads", snort::Parameter::PT_INT, "0:64", "0",
+     "Number of threads serializing trees in parallel, when the serializer "
+     "supports it (0 = serialize on the writer thread)"},
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
+// With the queue settings, see tree_ring.h
+static const std::vector<snort::Parameter> module_params =
+    LioLi::with_queue_params(logger_params);
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
+    {CountType::SUM, "logs_out", "Count of logs we wrote to the file"},
+    {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
+    {CountType::MAX, "max_queued",
+     "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "high_overflows",
+     "Count of high priority logs we discarded due to overflow"},
+    {CountType::SUM, "normal_overflows",
+     "Count of normal priority logs we discarded due to overflow"},
+    {CountType::SUM, "bulk_overflows",
+     "Count of bulk logs we discarded due to overflow"},
+    {CountType::SUM, "bytes_written", "Bytes written to the file(s)"},
+    {CountType::SUM, "write_errors", "Count of write errors detected"},
+    {CountType::SUM, "rotations", "Count of files rotated"},
+    {CountType::SUM, "files_removed",
+     "Count of rotated files deleted due to max_files"},
+    {CountType::MAX, "max_pool_queued",
+     "Max number of batches ever waiting for a serializer thread"},
+    {CountType::MAX, "max_pool_reordered",
+     "Max number of serialized batches ever waiting for an earlier batch"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
+std::mutex peg_count_mutex; // Protects the peg counts
+struct PegCounts {
+  PegCount logs_in = 0;
+  PegCount logs_out = 0;
+  PegCount overflows = 0;
+  PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount high_overflows = 0;
+  PegCount normal_overflows = 0;
+  PegCount bulk_overflows = 0;
+  PegCount bytes_written = 0;
+  PegCount write_errors = 0;
+  PegCount rotations = 0;
+  PegCount files_removed = 0;
+  PegCount max_pool_queued = 0;
+  PegCount max_pool_reordered = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// Rotated files are named <file_name>.<UTC time it was rotated>, e.g.
+// "out.log.20240131T235959Z", with "-<n>" added if one was rotated in the
+// same second.  Returns the length of the time part of suffix, 0 if suffix
+// isn't one we make.
+std::size_t rotated_suffix(const std::string &suffix) {
+  constexpr std::size_t length = sizeof("20240131T235959Z") - 1;
+
+  auto digits = [&suffix](std::size_t from, std::size_t to) {
+    auto digit = [](char c) { return c >= '0' && c <= '9'; };
+    return from < to &&
+           std::all_of(suffix.begin() + from, suffix.begin() + to, digit);
+  };
+
+  if (suffix.size() < length || !digits(0, 8) || suffix[8] != 'T' ||
+      !digits(9, 15) || suffix[15] != 'Z') {
+    return 0;
+  }
+
+  if (suffix.size() > length &&
+      (suffix[length] != '-' || !digits(length + 1, suffix.size()))) {
+    return 0;
+  }
+
+  return length;
+}
+
 // MAIN object of this file
-class Logger : public LioLi::Logger {
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
+  using clock = std::chrono::steady_clock;
+
   std::mutex mutex; // Protects members
 
+  // Configs
   std::string serializer_name;
   std::string file_name;
+  uint64_t rotate_bytes = 0; // 0 = never
+  uint32_t rotate_s = 0;     // 0 = never
+  uint32_t max_files = 0;    // 0 = keep all
+  uint32_t serializer_threads = 0; // 0 = serialize on worker thread
+  LioLi::QueueAccount queue_account;
+
+  // Smaller buffers than the default, so a quiet log still reaches the disk
+  Common::DiskWriter::Config writer_config = {.buffer_bytes = 64 * 1024,
+                                              .buffers = 16};
+
+  bool data_loss = false; // Set to true when we somehow discards data, or are
+                          // unsure if we did
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
+
+  // Accounts for what producers did to the queue since last call, must be
+  // called by the worker with mutex held
+  void account_queue() {
+    if (queue_account.take(queue, s_name, s_peg_counts, peg_count_mutex)) {
+      data_loss = true;
+    }
+  }
 
+  // Worker state, only used by run()
+  std::shared_ptr<LioLi::Serializer> serializer;
   std::shared_ptr<LioLi::Serializer::Context> context;
-  std::ofstream ofile;
+  std::unique_ptr<Common::DiskWriter> writer;
+  bool files_found = false;          // Rotated files of earlier runs found
+  std::deque<std::string> rotated;   // Rotated files kept, oldest first
+  clock::time_point rotate_at;       // When the file is rotated by time
+  bool file_used = false;            // Trees are written to the file
+  clock::time_point retry_at;        // When to try opening the file again
+  bool open_failed = false;          // Reported, until it's opened again
+  clock::time_point give_up_at = clock::time_point::max(); // Of draining
+  std::string pending;               // Output not yet taken by the writer
+  std::vector<LioLi::Tree> batch;    // Trees taken from the queue
+  LioLi::Serializer::Sink sink;
+  std::unique_ptr<LioLi::SerializationPool> pool;
+  bool context_used = false; // The first batch of a context is serialized
+                             // on it, later ones on batch contexts
+  std::string output;
+
+  bool rotates() const { return rotate_bytes != 0 || rotate_s != 0; }
+
+  // Finds the files earlier runs rotated, so max_files covers them too
+  void find_rotated_files() {
+    std::filesystem::path path(file_name);
+    auto directory = path.parent_path();
+    auto prefix = path.filename().string() + ".";
+
+    std::error_code error;
+    for (auto &entry : std::filesystem::directory_iterator(
+             directory.empty() ? "." : directory, error)) {
+      auto name = entry.path().filename().string();
+
+      if (name.starts_with(prefix) &&
+          rotated_suffix(name.substr(prefix.size())) != 0) {
+        rotated.push_back((directory / name).string());
+      }
+    }
+
+    // By time, and by counter within a second
+    auto start = (directory / prefix).string().size();
+    auto key = [start](const std::string &name) {
+      auto suffix = name.substr(start);
+      return std::tuple(suffix.substr(0, rotated_suffix(suffix)),
+                        suffix.size(), suffix);
+    };
+    std::sort(rotated.begin(), rotated.end(),
+              [&key](auto &a, auto &b) { return key(a) < key(b); });
+  }
+
+  // Deletes the oldest rotated files, beyond max_files
+  void remove_old_files() {
+    while (max_files != 0 && rotated.size() > max_files) {
+      if (::unlink(rotated.front().c_str()) == 0) {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.files_removed++;
+      } else if (errno != ENOENT) {
+        snort::WarningMessage("WARNING: %s could not delete %s: %s\n", s_name,
+                              rotated.front().c_str(), std::strerror(errno));
+      }
+
+      rotated.pop_front();
+    }
+  }
 
-  bool data_loss = false;
+  // Renames file_name out of the way, it must not be open
+  void rename_file() {
+    auto base =
+        file_name + std::format(".{:%Y%m%dT%H%M%SZ}",
+                                std::chrono::floor<std::chrono::seconds>(
+                                    std::chrono::system_clock::now()));
+    auto name = base;
 
-  LioLi::Serializer::Context &get_context() {
-    if (!context) {
-      auto serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+    for (unsigned i = 1; std::filesystem::exists(name); i++) {
+      name = base + "-" + std::to_string(i);
+    }
+
+    if (::rename(file_name.c_str(), name.c_str()) != 0) {
+      if (errno != ENOENT) {
+        snort::ErrorMessage("ERROR: %s could not rotate %s: %s\n", s_name,
+                            file_name.c_str(), std::strerror(errno));
+      }
+      return;
+    }
+
+    rotated.push_back(name);
 
-      context = serializer->create_context();
+    {
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.rotations++;
     }
 
-    return *context.get();
+    remove_old_files();
   }
 
-  std::ofstream &get_ofile() {
-    if (!ofile.is_open()) {
-      std::ios_base::openmode open_mode = std::ios_base::out;
+  // Returns false if the file couldn't be opened
+  bool open_file() {
+    assert(serializer_name.length() != 0 && file_name.length() != 0);
 
-      auto serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+    // A file left by an earlier run is rotated rather than overwritten
+    if (rotates() && !files_found) {
+      files_found = true;
+      find_rotated_files();
 
-      if (serializer->is_binary()) {
-        open_mode |= std::ios_base::binary;
+      if (std::filesystem::exists(file_name)) {
+        rename_file();
       }
+    }
 
-      ofile.open(file_name, open_mode);
+    if (!writer) {
+      std::scoped_lock lock(mutex);
+      writer = std::make_unique<Common::DiskWriter>(writer_config);
+    }
 
-      if (!ofile.good()) {
-        snort::ErrorMessage("ERROR: Could not open output file %s\n",
-                            serializer_name.c_str());
+    if (!writer->open(file_name)) {
+      if (!open_failed) {
+        snort::ErrorMessage("ERROR: Could not open output file %s: %s\n",
+                            file_name.c_str(), std::strerror(errno));
+        open_failed = true;
       }
+      return false;
+    }
+
+    open_failed = false;
+
+    rotate_at = rotate_s != 0 ? clock::now() + std::chrono::seconds(rotate_s)
+                              : clock::time_point::max();
+    file_used = false;
+    return true;
+  }
+
+  // Closes the file, waiting for the disk, and rotates it if configured.  A
+  // file that failed is rotated anyway, rather than overwritten when opened
+  // again.
+  void close_file() {
+    if (auto error = writer->get_error()) {
+      snort::ErrorMessage("ERROR: %s failed writing %s: %s\n", s_name,
+                          file_name.c_str(), std::strerror(error));
+      retry_at = clock::now() + std::chrono::seconds(1);
+    }
+
+    bool failed = !writer->close();
+    account_writer();
+
+    if (rotates() || failed) {
+      rename_file();
+    }
+  }
+
+  // Accounts for what the writer did since last call
+  void account_writer() {
+    auto stats = writer->take_stats();
+
+    if (stats.failures != 0 || stats.dropped != 0) {
+      std::scoped_lock lock(mutex);
+      data_loss = true;
+    }
+
+    std::scoped_lock lock(peg_count_mutex);
+    s_peg_counts.bytes_written += stats.written;
+    s_peg_counts.write_errors += stats.failures;
+  }
+
+  // Hands pending to the writer, returns false if it must wait for the disk
+  bool write_pending() {
+    if (writer->is_busy(pending.size())) {
+      return false;
+    }
+
+    if (!writer->write(pending) && writer->get_error() == 0) {
+      snort::LogMessage("LOG: %s dropped %zu bytes too large for its buffers\n",
+                        s_name, pending.size());
     }
-    return ofile;
+
+    pending.clear();
+    account_writer();
+    return true;
+  }
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
+    }
+
+    queue.finish_wait(); // Whatever woke us
+
+    if (!serializer && !terminate) {
+      serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+
+      if (serializer == serializer->get_null_obj()) {
+        serializer.reset();
+        wake_at(clock::now() + std::chrono::seconds(1));
+        return;
+      }
+
+      // Serializes in parallel if configured, leaving us to only write
+      pool = LioLi::SerializationPool::create(serializer, serializer_threads,
+                                              [this]() { queue.kick(); });
+    }
+
+    // Bounded, so other tasks on the reactor thread get their turn
+    constexpr int max_batches = 16;
+    int budget = max_batches;
+
+    while (serializer) {
+      if (budget-- <= 0) {
+        wake(); // Come back for the rest
+        return;
+      }
+
+      // What's queued when we are stopped is still written, for a while
+      if (terminate && give_up_at == clock::time_point::max()) {
+        give_up_at = clock::now() + std::chrono::seconds(1);
+      }
+
+      if (give_up_at <= clock::now()) {
+        break;
+      }
+
+      if (!writer || !writer->is_open()) {
+        if (clock::now() < retry_at) {
+          wake_at(std::min(retry_at, give_up_at));
+          return;
+        }
+
+        if (!open_file()) {
+          retry_at = clock::now() + std::chrono::seconds(1);
+          continue;
+        }
+
+        // Every file starts with a fresh context, so it can be read on its
+        // own
+        context.reset();
+        if (pool) {
+          pool->discard(); // Belongs to the old file
+        }
+        continue;
+      }
+
+      if (!pending.empty()) {
+        if (!write_pending()) {
+          watch(writer->get_event_fd(), EPOLLIN);
+          wake_at(give_up_at);
+          return;
+        }
+      }
+
+      // A file without trees isn't rotated, it would only hold the header
+      if (rotate_at <= clock::now() && !file_used) {
+        rotate_at = clock::now() + std::chrono::seconds(rotate_s);
+      }
+
+      // A failed file is rotated too, the error might go with it
+      bool rotate_due =
+          writer->get_error() != 0 ||
+          (file_used &&
+           (rotate_at <= clock::now() ||
+            (rotate_bytes != 0 && writer->size() >= rotate_bytes)));
+
+      // All batches of a context must be written before it's closed
+      if ((rotate_due && !(pool && pool->outstanding())) || !context) {
+        if (context) {
+          pending = context->close();
+          context.reset();
+          continue; // Will eventually be written
+        }
+
+        if (rotate_due) {
+          close_file();
+          continue; // Opened again above
+        }
+
+        context = serializer->create_context();
+        context_used = false;
+      }
+
+      {
+        std::scoped_lock lock(mutex);
+        account_queue();
+      }
+
+      if (!queue.empty() && pool && !rotate_due) {
+        while (budget > 0 && queue.pop_all(batch, pool->batch_size) != 0) {
+          budget--;
+          auto queued =
+              pool->submit(std::move(batch), context_used ? nullptr : context);
+          context_used = true;
+          batch.clear();
+
+          std::scoped_lock lock(peg_count_mutex);
+          if (s_peg_counts.max_pool_queued < queued) {
+            s_peg_counts.max_pool_queued = queued;
+          }
+        }
+      } else if (!queue.empty() && !rotate_due) {
+        // Everything queued is serialized as one batch, and written at once
+        queue.pop_all(batch);
+
+        context->serialize_batch(batch, sink);
+        pending = std::move(sink.buffer());
+        sink.clear();
+        file_used = true;
+
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.logs_out += batch.size();
+        }
+
+        batch.clear();
+        continue; // Will eventually be written
+      }
+
+      std::size_t tree_count;
+      std::size_t waiting;
+
+      if (pool && pool->take(output, tree_count, waiting)) {
+        pending = std::move(output);
+        file_used = true;
+
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_out += tree_count;
+        if (s_peg_counts.max_pool_reordered < waiting) {
+          s_peg_counts.max_pool_reordered = waiting;
+        }
+        continue; // Will eventually be written
+      }
+
+      if (terminate && queue.empty() && !(pool && pool->outstanding())) {
+        break;
+      }
+
+      // Nothing is taken from the queue until the pool has drained, only
+      // the pool wakes us
+      if (rotate_due) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(give_up_at);
+        return;
+      }
+
+      // Idle, what's buffered goes to the disk
+      writer->flush();
+
+      // While batches are outstanding the pool wakes us, and we can't
+      // rotate anyway
+      auto wake_time = (pool && pool->outstanding())
+                           ? clock::time_point::max()
+                           : rotate_at;
+
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(std::min(wake_time, give_up_at));
+        return;
+      }
+    }
+
+    // The end of the file is written, waiting for the disk if need be
+    if (writer && writer->is_open()) {
+      if (context) {
+        pending += context->close();
+      }
+
+      while (!pending.empty() && !write_pending()) {
+        pollfd event = {writer->get_event_fd(), POLLIN, 0};
+        ::poll(&event, 1, 100);
+      }
+
+      writer->close();
+      account_writer();
+    }
+
+    // What's still queued is lost
+    {
+      std::scoped_lock lock(mutex);
+      account_queue();
+      data_loss |= !queue.empty();
+    }
+
+    if (writer) {
+      unwatch(writer->get_event_fd());
+    }
+    unwatch(queue.get_event_fd());
+    context.reset();
+    pool.reset();
+
+    {
+      std::scoped_lock lock(mutex);
+      worker_done = true;
+    }
+    cv.notify_all();
   }
 
 public:
   Logger(const char *name) : LioLi::Logger(name) {}
 
-  ~Logger() {
-    // We can't request a context here, as it isn't safe during shutdown
-    if (context)
-      get_ofile() << context->close();
+  ~Logger() { stop(); }
+
+  bool had_data_loss(bool clear_flag) override {
+    std::scoped_lock lock(mutex);
+
+    bool old_value = data_loss;
+
+    data_loss &= !clear_flag;
+
+    return old_value;
+  }
+
+  void operator<<(const LioLi::Tree &&tree) override {
+    log(std::move(tree), LioLi::Priority::normal);
+  }
+
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
   }
 
   void set_serializer(const char *name) {
     std::scoped_lock lock(mutex);
 
-    assert(!context ||
-           serializer_name == name); // If we have a context when a new name is
-                                     // set, it is the wrong context
+    assert(serializer_name.empty() ||
+           serializer_name == name); // We do not handle changing of the
+                                     // serializer name
 
     serializer_name = name;
   }
@@ -102,39 +624,106 @@ public:
     return true;
   }
 
-  bool had_data_loss(bool clear_flag) override {
+  void set_io_uring(bool enable) {
     std::scoped_lock lock(mutex);
+    writer_config.uring = enable;
+  }
 
-    bool old_value = data_loss;
+  void set_direct_io(bool enable) {
+    std::scoped_lock lock(mutex);
+    writer_config.direct = enable;
+  }
 
-    data_loss &= !clear_flag;
+  void set_preallocate(uint64_t bytes) {
+    std::scoped_lock lock(mutex);
+    writer_config.preallocate_bytes = bytes;
+  }
 
-    return old_value;
+  void set_rotate_bytes(uint64_t bytes) {
+    std::scoped_lock lock(mutex);
+    rotate_bytes = bytes;
   }
 
-  void operator<<(const LioLi::Tree &&tree) override {
+  void set_rotate_s(uint32_t seconds) {
     std::scoped_lock lock(mutex);
+    rotate_s = seconds;
+  }
 
-    auto &ofile = get_ofile();
-    ofile << get_context().serialize(std::move(tree));
+  void set_max_files(uint32_t max) {
+    std::scoped_lock lock(mutex);
+    max_files = max;
+  }
 
-    if (!ofile.good()) {
-      data_loss = true;
+  void set_queue_config(const LioLi::QueueConfig &config) {
+    std::scoped_lock lock(mutex);
+
+    // If queue size is being reduced, trees might be dropped
+    if (auto dropped = queue.configure(config)) {
+      snort::WarningMessage(
+          "WARNING: %s dropping %li trees from queue due to resize\n", s_name,
+          dropped);
+    }
+  }
+
+  void set_serializer_threads(uint32_t threads) {
+    std::scoped_lock lock(mutex);
+    serializer_threads = threads;
+  }
+
+  // Call after all configuration is done
+  void start() {
+    if (started) {
+      return;
+    }
+
+    terminate = false;
+    worker_done = false;
+    started = true;
+    Common::Reactor::get().add(*this);
+  }
+
+  // Call to terminate, what's queued is written first
+  void stop() {
+    // Check worker is running
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    wake();
+
+    {
+      std::unique_lock lock(mutex);
+
+      // The worker gives up draining the queue after a second, and then
+      // waits for the disk
+      cv.wait_for(lock, std::chrono::seconds(5),
+                  [this] { return worker_done; });
     }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
   }
 };
 
 class Module : public snort::Module {
-  Module() : snort::Module(s_name, s_help, module_params) {
+  Module() : snort::Module(s_name, s_help, module_params.data()) {
     LioLi::LogDB::register_type<Logger>(s_name);
   }
 
+  ~Module() {
+    // Stop worker
+    LioLi::LogDB::get<Logger>(s_name)->stop();
+  }
+
   bool file_name_set = false;
   bool serializer_set = false;
+  LioLi::QueueConfig queue_config;
 
   bool begin(const char *, int, snort::SnortConfig *) override {
     file_name_set = false;
     serializer_set = false;
+    queue_config = {};
     return true;
   }
 
@@ -145,7 +734,17 @@ class Module : public snort::Module {
     if (!serializer_set) {
       snort::ErrorMessage("ERROR: serializer not specified for %s\n", s_name);
     }
-    return file_name_set && serializer_set;
+
+    if (file_name_set && serializer_set) {
+      auto logger = LioLi::LogDB::get<Logger>(s_name);
+      logger->set_queue_config(queue_config);
+
+      // Start worker
+      logger->start();
+      return true;
+    }
+
+    return false;
   }
 
   bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
@@ -188,6 +787,35 @@ class Module : public snort::Module {
       snort::ErrorMessage(
           "ERROR: Could not read log file name from environment: %s in %s\n",
           env_name.c_str(), s_name);
+    } else if (val.is("io_uring")) {
+      logger->set_io_uring(val.get_bool());
+
+      return true;
+    } else if (val.is("direct_io")) {
+      logger->set_direct_io(val.get_bool());
+
+      return true;
+    } else if (val.is("preallocate")) {
+      logger->set_preallocate(val.get_uint64());
+
+      return true;
+    } else if (val.is("rotate_bytes")) {
+      logger->set_rotate_bytes(val.get_uint64());
+
+      return true;
+    } else if (val.is("rotate_s")) {
+      logger->set_rotate_s(val.get_uint32());
+
+      return true;
+    } else if (val.is("max_files")) {
+      logger->set_max_files(val.get_uint32());
+
+      return true;
+    } else if (queue_config.set(val)) {
+      return true;
+    } else if (val.is("serializer_threads")) {
+      logger->set_serializer_threads(val.get_uint32());
+      return true;
     }
 
     // fail if we didn't get something valid
@@ -198,6 +826,19 @@ class Module : public snort::Module {
     return GLOBAL;
   } // TODO(mkr): Figure out what the usage type means
 
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static PegCounts static_pegs;
+
+    std::scoped_lock lock(peg_count_mutex);
+    static_pegs = s_peg_counts;
+
+    return reinterpret_cast<PegCount *>(&static_pegs);
+  }
+
 public:
   static snort::Module *ctor() { return new Module(); }
   static void dtor(snort::Module *p) { delete p; }
@@ -3,23 +3,33 @@
 #include <framework/decode_data.h>
 #include <framework/inspector.h>
 #include <framework/module.h>
+#include <main/thread.h>
+#include <main/thread_config.h>
 
 // System includes
+#include <atomic>
+#include <cassert>
 #include <cerrno>
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
 #include <cstdint>
-#include <deque>
-#include <fstream>
+#include <fcntl.h>
 #include <iostream>
 #include <mutex>
+#include <sys/epoll.h>
 #include <thread>
+#include <unistd.h>
+#include <vector>
 
 // Local includes
 #include "lioli.h"
 #include "log_framework.h"
 #include "logger_pipe.h"
+#include "reactor.h"
+#include "serialization_pool.h"
+#include "thread_stream.h"
+#include "tree_ring.h"
 
 // Debug includes
 
@@ -29,29 +39,55 @@ namespace {
 static const char *s_name = "logger_pipe";
 static const char *s_help = "Outputs LioLi trees to a named pipe";
 
-static const snort::Parameter module_params[] = {
+static const snort::Parameter logger_params[] = {
     {"pipe_name", snort::Parameter::PT_STRING, nullptr, nullptr,
-     "Pipe name logs should be written to"},
+     "Pipe name logs should be written to, %t gives every packet thread its "
+     "own pipe (%t = thread number, 'main' for trees from other threads), "
+     "the pipes must exist"},
     {"pipe_env", snort::Parameter::PT_STRING, nullptr, nullptr,
      "Pipe name will be read from environment variable"},
-    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
-     "Max number of trees that will be queued before discarding"},
     {"restart_interval_s", snort::Parameter::PT_INT, "0:86400", "0",
      "Time between restarting the serializer (max: 86400 s (1 day), 0 = "
      "never))"},
+    {"serializer_threads", snort::Parameter::PT_INT, "0:64", "0",
+     "Number of threads serializing trees in parallel, when the serializer "
+     "supports it (0 = serialize on the writer thread)"},
     {"serializer", snort::Parameter::PT_STRING, nullptr, nullptr,
      "Serializer to use for generating output"},
+    {"thread_buffer_max", snort::Parameter::PT_INT, "1024:268435456", "1048576",
+     "Max bytes of output a packet thread keeps while its pipe is blocked, "
+     "before dropping trees (only with %t in the pipe name)"},
 
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
+// With the queue settings, see tree_ring.h
+static const std::vector<snort::Parameter> module_params =
+    LioLi::with_queue_params(logger_params);
+
 const PegInfo s_pegs[] = {
     {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
     {CountType::SUM, "logs_out", "Count of logs we sent on the pipe"},
     {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
     {CountType::MAX, "max_queued",
      "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "high_overflows",
+     "Count of high priority logs we discarded due to overflow"},
+    {CountType::SUM, "normal_overflows",
+     "Count of normal priority logs we discarded due to overflow"},
+    {CountType::SUM, "bulk_overflows",
+     "Count of bulk logs we discarded due to overflow"},
     {CountType::SUM, "write_errors", "Count of write errors detected"},
     {CountType::SUM, "restarts", "Count of (re)starts of the serializer"},
+    {CountType::MAX, "max_pool_queued",
+     "Max number of batches ever waiting for a serializer thread"},
+    {CountType::MAX, "max_pool_reordered",
+     "Max number of serialized batches ever waiting for an earlier batch"},
     {CountType::END, nullptr, nullptr}};
 
 // This must match the s_pegs[] array
@@ -62,8 +98,16 @@ struct PegCounts {
   PegCount logs_out = 0;
   PegCount overflows = 0;
   PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount high_overflows = 0;
+  PegCount normal_overflows = 0;
+  PegCount bulk_overflows = 0;
   PegCount write_errors = 0;
   PegCount restarts = 0;
+  PegCount max_pool_queued = 0;
+  PegCount max_pool_reordered = 0;
 } s_peg_counts;
 
 // Compile time sanity check of number of entries in s_pegs and s_peg_counts
@@ -75,8 +119,45 @@ static_assert(
 // SIGPIPE handler
 void pipe_signal_handler(int) {}
 
+// Adds the counts of a packet thread's own pipe
+void add_thread_counts(const LioLi::ThreadStream::Counts &counts) {
+  std::scoped_lock lock(peg_count_mutex);
+  s_peg_counts.logs_in += counts.logs_in;
+  s_peg_counts.logs_out += counts.logs_out;
+  s_peg_counts.overflows += counts.overflows;
+  s_peg_counts.write_errors += counts.write_errors;
+  s_peg_counts.restarts += counts.restarts;
+}
+
+// Returns pattern with all %t replaced by thread
+std::string thread_pipe(const std::string &pattern, const std::string &thread) {
+  std::string name = pattern;
+
+  for (auto pos = name.find("%t"); pos != std::string::npos;
+       pos = name.find("%t", pos + thread.size())) {
+    name.replace(pos, 2, thread);
+  }
+
+  return name;
+}
+
+// Opens the pipe name for writing, without blocking, for the main and the
+// per thread pipes alike.  Returns -1 while the pipe has no reader (ENXIO).
+// The pipe is never created, a missing pipe (or any other error) aborts, so
+// it isn't silently replaced by a regular file that grows forever.
+int open_pipe_fd(const std::string &name) {
+  int fd = ::open(name.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+
+  if (fd == -1 && errno != ENXIO) {
+    snort::ParseAbort("ERROR: Could not open output pipe: %s with reason %s\n",
+                      name.c_str(), std::strerror(errno));
+  }
+
+  return fd;
+}
+
 // MAIN object of this file
-class Logger : public LioLi::Logger {
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
   using clock = std::chrono::steady_clock;
 
   std::mutex mutex; // Protects members
@@ -84,21 +165,25 @@ class Logger : public LioLi::Logger {
   // Configs
   std::string serializer_name;
   std::string pipe_name;
-  uint32_t max_queue_size = 1;
   uint32_t serializer_restart_interval_s = 0; // 0 = never
-  uint64_t dropped_sequence_count =
-      0; // Counts the number of packages dropped in this sequence
+  uint32_t serializer_threads = 0;            // 0 = serialize on worker thread
+  LioLi::QueueAccount queue_account;
 
   bool data_loss = false; // Set to true when we somehow discards data, or are
                           // unsure if we did
-  std::deque<LioLi::Tree> queue;
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+
+  // Set if pipe_name has %t, pipes of the packet threads
+  std::string thread_pipe_name;
+  uint32_t thread_buffer_max = 1048576;
+  LioLi::ThreadStreams streams;
 
-  // Worker thread controls
-  std::thread worker_thread;
-  std::condition_variable cv; // Used to enable worker to sleep when there
-                              // aren't anything for it to do
-  bool terminate = false;     // Set to true if worker loop should be terminated
-  bool worker_done = false;   // Worker won't block anymore
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
 
   bool had_data_loss(bool clear_flag) override {
     std::scoped_lock lock(mutex);
@@ -107,93 +192,165 @@ class Logger : public LioLi::Logger {
 
     data_loss &= !clear_flag;
 
-    return old_value;
+    return streams.had_data_loss(clear_flag) || old_value;
   }
 
-  std::ofstream open_pipe(std::unique_lock<std::mutex> &lock) {
+  // Accounts for what producers did to the queue since last call, must be
+  // called by the worker with mutex held
+  void account_queue() {
+    if (queue_account.take(queue, s_name, s_peg_counts, peg_count_mutex)) {
+      data_loss = true;
+    }
+  }
+
+  // Worker state, only used by run()
+  std::shared_ptr<LioLi::Serializer> serializer;
+  std::chrono::time_point<clock>
+      next_timeout; // Keeps track of when we should restart serializer
+                    // context
+  std::shared_ptr<LioLi::Serializer::Context> context;
+  int pipe_fd = -1;
+  clock::time_point retry_at; // When to try opening the pipe again
+  std::string pending;        // Output the pipe didn't take yet
+  std::size_t pending_index = 0; // Place in pending we write from
+  std::vector<LioLi::Tree> batch; // Trees taken from the queue
+  LioLi::Serializer::Sink sink;
+  std::unique_ptr<LioLi::SerializationPool> pool;
+  bool context_used = false; // The first batch of a context is serialized
+                             // on it, later ones on batch contexts
+  std::string output;
+
+  // Returns false if the pipe couldn't be opened, which it can't until a
+  // reader is attached to it
+  bool open_pipe() {
     assert(serializer_name.length() != 0 && pipe_name.length() != 0);
 
-    if (terminate)
-      return std::ofstream();
+    // Non blocking, so a missing reader doesn't hold up the reactor
+    pipe_fd = open_pipe_fd(pipe_name);
 
-    std::ios_base::openmode openmode = std::ios::out;
+    return pipe_fd != -1;
+  }
 
-    if (LioLi::LogDB::get<LioLi::Serializer>(serializer_name)->is_binary()) {
-      openmode |= std::ios::binary;
+  void close_pipe() {
+    if (pipe_fd != -1) {
+      unwatch(pipe_fd);
+      ::close(pipe_fd);
+      pipe_fd = -1;
     }
 
-    std::string tmp_name = pipe_name;
-
-    // Release the lock while opening, as it will block until a reader is
-    // attached to the pipe
-    lock.unlock();
-    std::ofstream pipe = std::ofstream(tmp_name, openmode);
-    lock.lock();
-
-    if (!pipe.good() || !pipe.is_open()) {
-      snort::ParseAbort(
-          "ERROR: Could not open output pipe: %s with reason %s\n",
-          pipe_name.c_str(), std::strerror(errno));
+    pending.clear();
+    pending_index = 0;
+  }
 
-      // This is considered a non-recoverable error, e.g. pipe doesn't exists
-      terminate = true;
+  // Writes what the pipe will take of pending, returns false if the pipe
+  // was lost
+  bool write_pending() {
+    while (pending_index < pending.size()) {
+      auto ret = ::write(pipe_fd, pending.data() + pending_index,
+                         pending.size() - pending_index);
+
+      if (ret >= 0) {
+        pending_index += ret;
+      } else if (errno == EAGAIN) {
+        return true; // The reader is behind
+      } else if (errno != EINTR) {
+        snort::LogMessage("LOG: %s unable to write to pipe, retrying\n",
+                          s_name);
+        {
+          std::scoped_lock lock(mutex);
+          data_loss = true;
+        }
+        close_pipe();
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.write_errors++;
+        }
+        return false;
+      }
     }
 
-    return pipe;
+    pending.clear();
+    pending_index = 0;
+    return true;
   }
 
-  void worker_loop() {
-    // Stay protected
-    std::unique_lock lock(mutex);
-
-    // Keeps track of when we should restart serializer context
-    std::chrono::time_point<clock> next_timeout;
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
+    }
 
-    // Our serializer
-    auto serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+    queue.finish_wait(); // Whatever woke us
 
-    while (serializer == serializer->get_null_obj() && !terminate) {
-      lock.unlock();
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      lock.lock();
+    if (!serializer && !terminate) {
       serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
-    }
 
-    std::shared_ptr<LioLi::Serializer::Context> context;
+      if (serializer == serializer->get_null_obj()) {
+        serializer.reset();
+        wake_at(clock::now() + std::chrono::seconds(1));
+        return;
+      }
+
+      // Serializes in parallel if configured, leaving us to only write
+      pool = LioLi::SerializationPool::create(serializer, serializer_threads,
+                                              [this]() { queue.kick(); });
+    }
 
-    std::ofstream pipe;
+    // Bounded, so other tasks on the reactor thread get their turn
+    constexpr int max_batches = 16;
+    int budget = max_batches;
 
     while (!terminate) {
-      if (!pipe.is_open()) {
+      if (budget-- <= 0) {
+        wake(); // Come back for the rest
+        return;
+      }
+
+      if (pipe_fd == -1) {
+        if (clock::now() < retry_at) {
+          wake_at(retry_at);
+          return;
+        }
+
         // open_pipe will set terminate to true if something went wrong
-        pipe = open_pipe(lock);
+        if (!open_pipe()) {
+          retry_at = clock::now() + std::chrono::milliseconds(100);
+          continue;
+        }
+
         // We always start a new pipe with a fresh context
         context.reset();
+        if (pool) {
+          pool->discard(); // Belongs to the old pipe
+        }
         continue;
       }
 
-      if (next_timeout <= clock::now() || !context) {
+      // Nothing more is written until the reader has taken what's pending
+      if (!pending.empty()) {
+        if (!write_pending()) {
+          continue;
+        }
+
+        if (!pending.empty()) {
+          watch(pipe_fd, EPOLLOUT);
+          wake_at(clock::time_point::max());
+          return;
+        }
+      }
+
+      // All batches of a context must be written before it's closed
+      if ((next_timeout <= clock::now() && !(pool && pool->outstanding())) ||
+          !context) {
         if (context) {
-          lock.unlock();
-          pipe << context->close();
-          pipe.flush();
-          lock.lock();
-
-          if (!pipe.good()) {
-            snort::LogMessage("LOG: %s unable to write end to pipe, retrying\n",
-                              s_name);
-            data_loss = true;
-            pipe.close();
-            {
-              std::scoped_lock lock(peg_count_mutex);
-              s_peg_counts.write_errors++;
-            }
-
-            continue;
-          }
+          pending = context->close();
+          context.reset();
+          continue; // Will eventually be written
         }
 
         context = serializer->create_context();
+        context_used = false;
         if (serializer_restart_interval_s != 0) {
           next_timeout = clock::now() +
                          std::chrono::seconds(serializer_restart_interval_s);
@@ -207,52 +364,82 @@ class Logger : public LioLi::Logger {
         }
       }
 
-      if (!queue.empty()) {
-        if (dropped_sequence_count != 0) {
-          snort::WarningMessage(
-              "WARNING: %s droped %lu tree(s) from queue, resuming output\n",
-              s_name, dropped_sequence_count);
-          dropped_sequence_count = 0;
-        }
-        auto output = context->serialize(std::move(queue.front()));
-        queue.pop_front();
-
-        // We can't write while being locked, as the write might block
-        lock.unlock();
-        pipe << output;
-        lock.lock();
-
-        if (!pipe.good()) {
-          snort::LogMessage(
-              "LOG: %s unable to write tree to pipe, skipping and retrying\n",
-              s_name);
-          data_loss = true;
-          pipe.close();
-          {
-            std::scoped_lock lock(peg_count_mutex);
-            s_peg_counts.write_errors++;
+      {
+        std::scoped_lock lock(mutex);
+        account_queue();
+      }
+
+      if (!queue.empty() && pool) {
+        while (budget > 0 && queue.pop_all(batch, pool->batch_size) != 0) {
+          budget--;
+          auto queued =
+              pool->submit(std::move(batch), context_used ? nullptr : context);
+          context_used = true;
+          batch.clear();
+
+          std::scoped_lock lock(peg_count_mutex);
+          if (s_peg_counts.max_pool_queued < queued) {
+            s_peg_counts.max_pool_queued = queued;
           }
-          continue;
-        } else {
+        }
+      } else if (!queue.empty()) {
+        // Everything queued is serialized as one batch, and written at once
+        queue.pop_all(batch);
+
+        context->serialize_batch(batch, sink);
+        pending = std::move(sink.buffer());
+        sink.clear();
+
+        {
           std::scoped_lock lock(peg_count_mutex);
-          s_peg_counts.logs_out++;
+          s_peg_counts.logs_out += batch.size();
         }
+
+        batch.clear();
+        continue; // Will eventually be written
       }
 
-      if (!terminate && queue.empty()) {
-        cv.wait_until(lock, next_timeout);
+      std::size_t tree_count;
+      std::size_t waiting;
+
+      if (pool && pool->take(output, tree_count, waiting)) {
+        pending = std::move(output);
+
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_out += tree_count;
+        if (s_peg_counts.max_pool_reordered < waiting) {
+          s_peg_counts.max_pool_reordered = waiting;
+        }
+        continue; // Will eventually be written
+      }
+
+      // While batches are outstanding the pool wakes us, and we can't
+      // restart the context anyway
+      auto wake_time = (pool && pool->outstanding())
+                           ? std::chrono::time_point<clock>::max()
+                           : next_timeout;
+
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(wake_time);
+        return;
       }
     }
 
-    if (pipe.good() && pipe.is_open() && context) {
-      lock.unlock();
-      pipe << context->close();
-      lock.lock();
-      pipe.close();
+    // The end is only written if the reader takes it right away
+    if (pipe_fd != -1 && context) {
+      pending += context->close();
+      write_pending();
     }
 
-    worker_done = true;
-    lock.unlock();
+    unwatch(queue.get_event_fd());
+    close_pipe();
+    pool.reset();
+
+    {
+      std::scoped_lock lock(mutex);
+      worker_done = true;
+    }
     cv.notify_all();
   }
 
@@ -264,7 +451,7 @@ public:
     std::call_once(oflag, []() { std::signal(SIGPIPE, pipe_signal_handler); });
   }
 
-  ~Logger() {}
+  ~Logger() { stop(); }
 
   bool is_valid() {
     bool all_valid = true; // Assume all good
@@ -283,39 +470,19 @@ public:
   }
 
   void operator<<(const LioLi::Tree &&tree) override {
-    {
-      std::scoped_lock lock(mutex);
-
-      assert(max_queue_size > 0);
-
-      // Reduce size of the queue until there is space for the new element
-      while (queue.size() > max_queue_size - 1) {
-        if (dropped_sequence_count++ == 0) {
-          snort::WarningMessage("WARNING: %s dropping tree(s) from queue\n",
-                                s_name);
-        }
-        queue.pop_front();
-        {
-          std::scoped_lock lock(peg_count_mutex);
-          s_peg_counts.overflows++;
-          data_loss = true;
-        }
-      }
-
-      queue.push_back(std::move(tree));
-
-      {
-        std::scoped_lock lock(peg_count_mutex);
-        if (s_peg_counts.max_queued < queue.size()) {
-          s_peg_counts.max_queued = queue.size();
-        }
+    log(std::move(tree), LioLi::Priority::normal);
+  }
 
-        s_peg_counts.logs_in++;
-      }
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Packet threads with their own pipe, bypass the queue, and so don't
+    // need a priority
+    if (auto stream = streams.get()) {
+      stream->write(tree);
+      return;
     }
 
-    // Kick worker
-    cv.notify_all();
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
   }
 
   void set_serializer(const char *name) {
@@ -336,27 +503,55 @@ public:
     assert(pipe_name.empty() ||
            name == pipe_name); // We do not handle changing of the pipe name
 
+    if (name.find("%t") != std::string::npos) {
+      thread_pipe_name = name;
+      name = thread_pipe(name, "main");
+    }
+
     pipe_name = name;
   }
 
+  void set_thread_buffer_max(uint32_t max) {
+    std::scoped_lock lock(mutex);
+    thread_buffer_max = max;
+  }
+
+  // Opens the pipe of the calling packet thread, if configured
+  void thread_init() {
+    if (thread_pipe_name.empty()) {
+      return;
+    }
+
+    auto serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+
+    if (serializer == serializer->get_null_obj()) {
+      return; // Trees will go through the queue
+    }
+
+    auto name =
+        thread_pipe(thread_pipe_name, std::to_string(snort::get_instance_id()));
+
+    // Opening a pipe without a reader fails (ENXIO), and is retried later
+    auto opener = [name]() { return open_pipe_fd(name); };
+
+    streams.open(std::make_unique<LioLi::ThreadStream>(
+        serializer, opener, add_thread_counts, thread_buffer_max,
+        serializer_restart_interval_s, 1000));
+  }
+
+  void thread_term() { streams.close(); }
+
   const std::string &get_pipe_name() { return pipe_name; }
 
-  void set_max_queue_size(uint32_t max) {
+  void set_queue_config(const LioLi::QueueConfig &config) {
     std::scoped_lock lock(mutex);
 
-    assert(max > 0); // We need to be able to queue at least one element
-
-    // If queue size is being reduced, reduce it
-    if (queue.size() > max) {
+    // If queue size is being reduced, trees might be dropped
+    if (auto dropped = queue.configure(config)) {
       snort::WarningMessage(
           "WARNING: %s dropping %li trees from queue due to resize\n", s_name,
-          queue.size() - max);
+          dropped);
     }
-    while (queue.size() > max) {
-      queue.pop_front();
-    }
-
-    max_queue_size = max;
   }
 
   void set_serializer_restart_interval_s(uint32_t interval) {
@@ -366,51 +561,52 @@ public:
       serializer_restart_interval_s = interval;
     }
     // Kick worker
-    cv.notify_all();
+    queue.kick();
+  }
+
+  void set_serializer_threads(uint32_t threads) {
+    std::scoped_lock lock(mutex);
+    serializer_threads = threads;
   }
 
   // Call after all configuration is done
   void start() {
+    if (!thread_pipe_name.empty()) {
+      streams.resize(snort::ThreadConfig::get_instance_max());
+    }
+
     terminate = false;
     worker_done = false;
-    worker_thread = std::thread{&Logger::worker_loop, this};
+    started = true;
+    Common::Reactor::get().add(*this);
   }
 
   // Call to terminate
   void stop() {
     // Check worker is running
-    if (worker_thread.joinable()) {
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    wake();
+
+    {
       std::unique_lock lock(mutex);
 
-      // If thread hasn't killed it self
-      if (!worker_done) {
-        terminate = true;
-
-        // Kick worker, we do not release the lock, as we need to reach
-        // wait_for(..) before the worker is allowed to continue
-        cv.notify_all();
-
-        // Give worker a chance to go down gracefully
-        if (std::cv_status::timeout ==
-                cv.wait_for(lock, std::chrono::seconds(2)) &&
-            !worker_done) {
-          // Faking a reader (most likely it is stuck in the open)
-          std::ifstream pipe = std::ifstream(pipe_name, std::ios::in);
-          cv.wait_for(lock, std::chrono::seconds(2));
-          if (!worker_done) {
-            // Still not done, set it free
-            worker_thread.detach();
-            return;
-          }
-        }
-      }
-      worker_thread.join();
+      // Give worker a chance to go down gracefully, it never blocks on the
+      // pipe, so this is only to be sure
+      cv.wait_for(lock, std::chrono::seconds(2),
+                  [this] { return worker_done; });
     }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
   }
 };
 
 class Module : public snort::Module {
-  Module() : snort::Module(s_name, s_help, module_params) {
+  Module() : snort::Module(s_name, s_help, module_params.data()) {
     LioLi::LogDB::register_type<Logger>(s_name);
   }
 
@@ -419,11 +615,18 @@ class Module : public snort::Module {
     LioLi::LogDB::get<Logger>(s_name)->stop();
   }
 
-  bool begin(const char *, int, snort::SnortConfig *) override { return true; }
+  LioLi::QueueConfig queue_config;
+
+  bool begin(const char *, int, snort::SnortConfig *) override {
+    queue_config = {};
+    return true;
+  }
 
   bool end(const char *, int, snort::SnortConfig *) override {
     auto logger = LioLi::LogDB::get<Logger>(s_name);
     if (logger->is_valid()) {
+      logger->set_queue_config(queue_config);
+
       // Start worker
       logger->start();
       return true;
@@ -475,15 +678,17 @@ class Module : public snort::Module {
       logger->set_serializer(val.get_string());
 
       return true;
-    } else if (val.is("queue_max")) {
-      // We can't do duplication check for queue_max as it has a default value
-      // (which will be set before an explicit value)
-
-      logger->set_max_queue_size(val.get_uint32());
+    } else if (queue_config.set(val)) {
       return true;
     } else if (val.is("restart_interval_s")) {
       logger->set_serializer_restart_interval_s(val.get_uint32());
       return true;
+    } else if (val.is("serializer_threads")) {
+      logger->set_serializer_threads(val.get_uint32());
+      return true;
+    } else if (val.is("thread_buffer_max")) {
+      logger->set_thread_buffer_max(val.get_uint32());
+      return true;
     }
 
     // fail if we didn't get something valid
@@ -523,6 +728,10 @@ public:
   static void dtor(snort::Inspector *p) { delete p; }
 };
 
+void thread_init() { LioLi::LogDB::get<Logger>(s_name)->thread_init(); }
+
+void thread_term() { LioLi::LogDB::get<Logger>(s_name)->thread_term(); }
+
 } // namespace
 
 const snort::InspectApi inspect_api = {
@@ -545,8 +754,8 @@ const snort::InspectApi inspect_api = {
     nullptr, // service
     nullptr, // pinit
     nullptr, // pterm
-    nullptr, // tinit
-    nullptr, // tterm
+    thread_init,
+    thread_term,
     Inspector::ctor,
     Inspector::dtor,
     nullptr, // ssn
@@ -5,21 +5,26 @@
 #include <framework/module.h>
 
 // System includes
+#include <atomic>
 #include <cerrno>
 #include <chrono>
 #include <condition_variable>
 #include <csignal>
 #include <cstdint>
-#include <deque>
-#include <fstream>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <thread>
+#include <sys/epoll.h>
+#include <unistd.h>
 
 // Local includes
 #include "lioli.h"
 #include "log_framework.h"
 #include "logger_pipe_netflow.h"
+#include "reactor.h"
+#include "tree_ring.h"
 
 // Debug includes
 
@@ -34,13 +39,11 @@ namespace {
 static const char *s_name = "logger_pipe_netflow";
 static const char *s_help = "temporary clone of logger_pipe";
 
-static const snort::Parameter module_params[] = {
+static const snort::Parameter logger_params[] = {
     {"pipe_name", snort::Parameter::PT_STRING, nullptr, nullptr,
      "Pipe name logs should be written to"},
     {"pipe_env", snort::Parameter::PT_STRING, nullptr, nullptr,
      "Pipe name will be read from environment variable"},
-    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
-     "Max number of trees that will be queued before discarding"},
     {"restart_interval_s", snort::Parameter::PT_INT, "0:86400", "0",
      "Time between restarting the serializer (max: 86400 s (1 day), 0 = "
      "never))"},
@@ -49,12 +52,28 @@ static const snort::Parameter module_params[] = {
 
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
+// With the queue settings, see tree_ring.h
+static const std::vector<snort::Parameter> module_params =
+    LioLi::with_queue_params(logger_params);
+
 const PegInfo s_pegs[] = {
     {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
     {CountType::SUM, "logs_out", "Count of logs we sent on the pipe"},
     {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
     {CountType::MAX, "max_queued",
      "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "high_overflows",
+     "Count of high priority logs we discarded due to overflow"},
+    {CountType::SUM, "normal_overflows",
+     "Count of normal priority logs we discarded due to overflow"},
+    {CountType::SUM, "bulk_overflows",
+     "Count of bulk logs we discarded due to overflow"},
     {CountType::SUM, "write_errors", "Count of write errors detected"},
     {CountType::SUM, "restarts", "Count of (re)starts of the serializer"},
     {CountType::END, nullptr, nullptr}};
@@ -67,6 +86,12 @@ struct PegCounts {
   PegCount logs_out = 0;
   PegCount overflows = 0;
   PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount high_overflows = 0;
+  PegCount normal_overflows = 0;
+  PegCount bulk_overflows = 0;
   PegCount write_errors = 0;
   PegCount restarts = 0;
 } s_peg_counts;
@@ -81,7 +106,7 @@ static_assert(
 void pipe_signal_handler(int) {}
 
 // MAIN object of this file
-class Logger : public LioLi::Logger {
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
   using clock = std::chrono::steady_clock;
 
   std::mutex mutex; // Protects members
@@ -89,46 +114,42 @@ class Logger : public LioLi::Logger {
   // Configs
   std::string serializer_name;
   std::string pipe_name;
-  uint32_t max_queue_size = 1;
   uint32_t serializer_restart_interval_s = 0; // 0 = never
-  uint64_t dropped_sequence_count =
-      0; // Counts the number of packages dropped in this sequence
-
-  std::deque<LioLi::Tree> queue;
-
-  // Worker thread controls
-  std::thread worker_thread;
-  std::condition_variable cv; // Used to enable worker to sleep when there
-                              // aren't anything for it to do
-  bool terminate = false;     // Set to true if worker loop should be terminated
-  bool worker_done = false;   // Worker won't block anymore
+  LioLi::QueueAccount queue_account;
+
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
+
+  // Worker state, only used by run()
+  std::shared_ptr<LioLi::Serializer> serializer;
+  std::chrono::time_point<clock>
+      next_timeout; // Keeps track of when we should restart serializer
+                    // context
+  std::shared_ptr<LioLi::Serializer::Context> context;
+  int pipe = -1;
+  std::string pending; // Output the pipe hasn't taken yet
+  LioLi::Tree tree;    // Tree taken from the queue
 
   bool had_data_loss(bool) override {
     assert(false); // pipe_netflow is deprecated, and don't have the data_loss
                    // feature
   }
 
-  std::ofstream open_pipe(std::unique_lock<std::mutex> &lock) {
+  // Opens the pipe without blocking, returns false if it has no reader yet
+  bool open_pipe() {
     assert(serializer_name.length() != 0 && pipe_name.length() != 0);
 
-    if (terminate)
-      return std::ofstream();
-
-    std::ios_base::openmode openmode = std::ios::out;
-
-    if (LioLi::LogDB::get<LioLi::Serializer>(serializer_name)->is_binary()) {
-      openmode |= std::ios::binary;
-    }
-
-    std::string tmp_name = pipe_name;
-
-    // Release the lock while opening, as it will block until a reader is
-    // attached to the pipe
-    lock.unlock();
-    std::ofstream pipe = std::ofstream(tmp_name, openmode);
-    lock.lock();
+    pipe = ::open(pipe_name.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
 
-    if (!pipe.good() || !pipe.is_open()) {
+    if (pipe != -1) {
+      return true;
+    } else if (errno != ENXIO) {
       snort::ParseAbort(
           "ERROR: Could not open output pipe: %s with reason %s\n",
           pipe_name.c_str(), std::strerror(errno));
@@ -137,55 +158,115 @@ class Logger : public LioLi::Logger {
       terminate = true;
     }
 
-    return pipe;
+    return false;
+  }
+
+  void close_pipe() {
+    if (pipe != -1) {
+      unwatch(pipe);
+      ::close(pipe);
+      pipe = -1;
+    }
+
+    pending.clear();
   }
 
-  void worker_loop() {
-    // Stay protected
-    std::unique_lock lock(mutex);
+  // Writes what's pending, returns 1 when all is written, 0 if the pipe is
+  // full and -1 if the reader went away
+  int write_pending() {
+    while (!pending.empty()) {
+      ssize_t bytes = ::write(pipe, pending.data(), pending.size());
 
-    // Keeps track of when we should restart serializer context
-    std::chrono::time_point<clock> next_timeout;
+      if (bytes < 0 && errno == EINTR) {
+        continue;
+      } else if (bytes < 0 && errno == EAGAIN) {
+        return 0;
+      } else if (bytes < 0) {
+        return -1;
+      }
 
-    // Our serializer
-    auto serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+      pending.erase(0, bytes);
+    }
 
-    while (serializer == serializer->get_null_obj() && !terminate) {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+    return 1;
+  }
+
+  // Accounts for what producers did to the queue since last call, worker only
+  void account_queue() {
+    queue_account.take(queue, s_name, s_peg_counts, peg_count_mutex);
+  }
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
     }
 
-    std::shared_ptr<LioLi::Serializer::Context> context;
+    queue.finish_wait(); // Whatever woke us
 
-    std::ofstream pipe;
+    // Don't do anything until we have our serializer
+    if (!serializer && !terminate) {
+      serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+
+      if (serializer == serializer->get_null_obj()) {
+        serializer.reset();
+        wake_at(clock::now() + std::chrono::seconds(1));
+        return;
+      }
+    }
+
+    // Bounded, so other tasks on the reactor thread get their turn
+    constexpr int max_trees = 256;
+    int budget = max_trees;
 
     while (!terminate) {
-      if (!pipe.is_open()) {
+      if (budget-- <= 0) {
+        wake(); // Come back for the rest
+        return;
+      }
+
+      if (pipe == -1) {
         // open_pipe will set terminate to true if something went wrong
-        pipe = open_pipe(lock);
+        if (!open_pipe()) {
+          account_queue();
+
+          if (!terminate) {
+            // Until a reader is attached to the pipe
+            wake_at(clock::now() + std::chrono::seconds(1));
+            return;
+          }
+          continue;
+        }
+
         // We always start a new pipe with a fresh context
         context.reset();
+      }
+
+      // What the pipe didn't take is written first
+      int written = write_pending();
+
+      if (written == 0) {
+        watch(pipe, EPOLLOUT);
+        wake_at(clock::time_point::max());
+        return;
+      } else if (written == -1) {
+        snort::LogMessage("LOG: %s unable to write to pipe, skipping and "
+                          "retrying\n",
+                          s_name);
+        close_pipe();
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.write_errors++;
+        }
         continue;
       }
 
       if (next_timeout <= clock::now() || !context) {
         if (context) {
-          lock.unlock();
-          pipe << context->close();
-          pipe.flush();
-          lock.lock();
-
-          if (!pipe.good()) {
-            snort::LogMessage("LOG: %s unable to write end to pipe, retrying\n",
-                              s_name);
-            pipe.close();
-            {
-              std::scoped_lock lock(peg_count_mutex);
-              s_peg_counts.write_errors++;
-            }
-
-            continue;
-          }
+          pending = context->close();
+          context.reset();
+          continue; // Written before the new context starts
         }
 
         context = serializer->create_context();
@@ -202,51 +283,37 @@ class Logger : public LioLi::Logger {
         }
       }
 
-      if (!queue.empty()) {
-        if (dropped_sequence_count != 0) {
-          snort::WarningMessage(
-              "WARNING: %s droped %lu tree(s) from queue, resuming output\n",
-              s_name, dropped_sequence_count);
-          dropped_sequence_count = 0;
-        }
-        auto output = context->serialize(std::move(queue.front()));
-        queue.pop_front();
-
-        // We can't write while being locked, as the write might block
-        lock.unlock();
-        pipe << output;
-        lock.lock();
-
-        if (!pipe.good()) {
-          snort::LogMessage(
-              "LOG: %s unable to write tree to pipe, skipping and retrying\n",
-              s_name);
-          pipe.close();
-          {
-            std::scoped_lock lock(peg_count_mutex);
-            s_peg_counts.write_errors++;
-          }
-          continue;
-        } else {
-          std::scoped_lock lock(peg_count_mutex);
-          s_peg_counts.logs_out++;
-        }
+      account_queue();
+
+      if (queue.pop(tree)) {
+        pending = context->serialize(std::move(tree));
+
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_out++;
+        continue;
       }
 
-      if (!terminate && queue.empty()) {
-        cv.wait_until(lock, next_timeout);
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(next_timeout);
+        return;
       }
     }
 
-    if (pipe.good() && pipe.is_open() && context) {
-      lock.unlock();
-      pipe << context->close();
-      lock.lock();
-      pipe.close();
+    // The end of the context is written, as far as the pipe takes it
+    if (pipe != -1 && context) {
+      pending += context->close();
+      write_pending();
     }
 
-    worker_done = true;
-    lock.unlock();
+    context.reset();
+    close_pipe();
+    unwatch(queue.get_event_fd());
+
+    {
+      std::unique_lock lock(mutex);
+      worker_done = true;
+    }
     cv.notify_all();
   }
 
@@ -258,7 +325,9 @@ public:
     std::call_once(oflag, []() { std::signal(SIGPIPE, pipe_signal_handler); });
   }
 
-  ~Logger() {}
+  ~Logger() {
+    stop(); // Stops worker
+  }
 
   bool is_valid() {
     bool all_valid = true; // Assume all good
@@ -277,38 +346,12 @@ public:
   }
 
   void operator<<(const LioLi::Tree &&tree) override {
-    {
-      std::scoped_lock lock(mutex);
-
-      assert(max_queue_size > 0);
-
-      // Reduce size of the queue until there is space for the new element
-      while (queue.size() > max_queue_size - 1) {
-        if (dropped_sequence_count++ == 0) {
-          snort::WarningMessage("WARNING: %s dropping tree(s) from queue\n",
-                                s_name);
-        }
-        queue.pop_front();
-        {
-          std::scoped_lock lock(peg_count_mutex);
-          s_peg_counts.overflows++;
-        }
-      }
-
-      queue.push_back(std::move(tree));
-
-      {
-        std::scoped_lock lock(peg_count_mutex);
-        if (s_peg_counts.max_queued < queue.size()) {
-          s_peg_counts.max_queued = queue.size();
-        }
-
-        s_peg_counts.logs_in++;
-      }
-    }
+    log(std::move(tree), LioLi::Priority::normal);
+  }
 
-    // Kick worker
-    cv.notify_all();
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
   }
 
   void set_serializer(const char *name) {
@@ -334,22 +377,15 @@ public:
 
   const std::string &get_pipe_name() { return pipe_name; }
 
-  void set_max_queue_size(uint32_t max) {
+  void set_queue_config(const LioLi::QueueConfig &config) {
     std::scoped_lock lock(mutex);
 
-    assert(max > 0); // We need to be able to queue at least one element
-
-    // If queue size is being reduced, reduce it
-    if (queue.size() > max) {
+    // If queue size is being reduced, trees might be dropped
+    if (auto dropped = queue.configure(config)) {
       snort::WarningMessage(
           "WARNING: %s dropping %li trees from queue due to resize\n", s_name,
-          queue.size() - max);
-    }
-    while (queue.size() > max) {
-      queue.pop_front();
+          dropped);
     }
-
-    max_queue_size = max;
   }
 
   void set_serializer_restart_interval_s(uint32_t interval) {
@@ -359,51 +395,47 @@ public:
       serializer_restart_interval_s = interval;
     }
     // Kick worker
-    cv.notify_all();
+    queue.kick();
   }
 
   // Call after all configuration is done
   void start() {
+    if (started) {
+      return;
+    }
+
     terminate = false;
     worker_done = false;
-    worker_thread = std::thread{&Logger::worker_loop, this};
+    started = true;
+    Common::Reactor::get().add(*this);
   }
 
   // Call to terminate
   void stop() {
     // Check worker is running
-    if (worker_thread.joinable()) {
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    wake();
+
+    {
       std::unique_lock lock(mutex);
 
-      // If thread hasn't killed it self
-      if (!worker_done) {
-        terminate = true;
-
-        // Kick worker, we do not release the lock, as we need to reach
-        // wait_for(..) before the worker is allowed to continue
-        cv.notify_all();
-
-        // Give worker a chance to go down gracefully
-        if (std::cv_status::timeout ==
-                cv.wait_for(lock, std::chrono::seconds(2)) &&
-            !worker_done) {
-          // Faking a reader (most likely it is stuck in the open)
-          std::ifstream pipe = std::ifstream(pipe_name, std::ios::in);
-          cv.wait_for(lock, std::chrono::seconds(2));
-          if (!worker_done) {
-            // Still not done, set it free
-            worker_thread.detach();
-            return;
-          }
-        }
-      }
-      worker_thread.join();
+      // Give worker a chance to go down gracefully, it never blocks on the
+      // pipe, so this is only to be sure
+      cv.wait_for(lock, std::chrono::seconds(2),
+                  [this] { return worker_done; });
     }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
   }
 };
 
 class Module : public snort::Module {
-  Module() : snort::Module(s_name, s_help, module_params) {
+  Module() : snort::Module(s_name, s_help, module_params.data()) {
     LioLi::LogDB::register_type<Logger>(s_name);
   }
 
@@ -412,11 +444,18 @@ class Module : public snort::Module {
     LioLi::LogDB::get<Logger>(s_name)->stop();
   }
 
-  bool begin(const char *, int, snort::SnortConfig *) override { return true; }
+  LioLi::QueueConfig queue_config;
+
+  bool begin(const char *, int, snort::SnortConfig *) override {
+    queue_config = {};
+    return true;
+  }
 
   bool end(const char *, int, snort::SnortConfig *) override {
     auto logger = LioLi::LogDB::get<Logger>(s_name);
     if (logger->is_valid()) {
+      logger->set_queue_config(queue_config);
+
       // Start worker
       logger->start();
       return true;
@@ -468,11 +507,7 @@ class Module : public snort::Module {
       logger->set_serializer(val.get_string());
 
       return true;
-    } else if (val.is("queue_max")) {
-      // We can't do duplication check for queue_max as it has a default value
-      // (which will be set before an explicit value)
-
-      logger->set_max_queue_size(val.get_uint32());
+    } else if (queue_config.set(val)) {
       return true;
     } else if (val.is("restart_interval_s")) {
       logger->set_serializer_restart_interval_s(val.get_uint32());
@@ -0,0 +1,651 @@
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stack>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Local includes
+#include "atomic_pegs.h"
+#include "lioli.h"
+#include "log_framework.h"
+#include "logger_rollup.h"
+#include "reactor.h"
+
+// Debug includes
+
+namespace logger_rollup {
+namespace {
+
+const char *s_name = "logger_rollup";
+const char *s_help = "Aggregates LioLi trees over a time window, and outputs "
+                     "one summary tree per key to another logger";
+
+/*
+logger_rollup = {
+  alias = "icmp_rollup",
+  logger = "logger_file",
+  group_by = "$.src.ip $.dst.ip",
+  aggregate = "$.rev",
+  window_s = 60,
+}
+
+Trees with the same values at the group_by keys are counted together, and for
+each of the aggregate keys holding a number, the sum, min and max of it are
+kept.  When the window closes (windows are aligned to multiples of window_s
+since the epoch) a summary tree is sent on for each key seen:
+
+  $
+    log       "rollup"
+    start     start of the window, e.g. 2025-01-01T12:00:00Z
+    window_s  60
+    key
+      src_ip  value of $.src.ip (nodes are named by the whole key)
+      dst_ip  value of $.dst.ip
+    count     number of trees
+    rev
+      sum
+      min
+      max     (left out if no tree had a number there)
+
+There are at most max_keys keys in a window, trees with new keys after that
+are counted in one bucket, whose summary has an empty overflow node instead
+of the key node.  A flood thereby costs at most max_keys + 1 trees per window.
+The summaries of a window are sent sorted by their key.
+*/
+
+const snort::Parameter module_params[] = {
+    {"alias", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "The alias name for the logger with specific config"},
+    {"logger", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Logger the summary trees are sent to"},
+    {"group_by", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Space separated keys, e.g. \"$.src.ip $.sid\", trees with the same "
+     "values of these are summarized together (none = all trees)"},
+    {"aggregate", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Space separated keys of numbers to get the sum, min and max of"},
+    {"window_s", snort::Parameter::PT_INT, "1:86400", "60",
+     "Seconds each window lasts (max: 86400 s (1 day))"},
+    {"max_keys", snort::Parameter::PT_INT, "1:10000000", "10000",
+     "Max number of keys in a window, trees with further keys are counted in "
+     "the overflow bucket"},
+    {"testmode", snort::Parameter::PT_BOOL, nullptr, "false",
+     "Testmode will make deterministic (fake) window starts"},
+
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
+    {CountType::SUM, "windows", "Count of windows closed"},
+    {CountType::SUM, "summaries", "Count of summary trees output"},
+    {CountType::MAX, "max_keys", "Max number of keys ever in a window"},
+    {CountType::SUM, "overflow_logs",
+     "Count of logs counted in the overflow bucket"},
+    {CountType::SUM, "not_numbers",
+     "Count of aggregate values that weren't numbers, these are ignored"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads,
+// the counts are atomic as they are updated by every thread logging
+struct PegCounts {
+  std::atomic<PegCount> logs_in = 0;
+  std::atomic<PegCount> windows = 0;
+  std::atomic<PegCount> summaries = 0;
+  std::atomic<PegCount> max_keys = 0; // Only updated by the worker
+  std::atomic<PegCount> overflow_logs = 0;
+  std::atomic<PegCount> not_numbers = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// Names of the loggers configured, stopped at process_term()
+std::vector<std::string> logger_names;
+
+// Splits a space separated list of keys
+std::vector<std::string> split_keys(const std::string &text) {
+  std::vector<std::string> keys;
+  std::istringstream stream(text);
+  std::string key;
+
+  while (stream >> key) {
+    keys.push_back(key);
+  }
+
+  return keys;
+}
+
+// A key compiled, and the name of its node in the summary.  The node is named
+// by the whole key, e.g. src_ip for $.src.ip, as $.src.ip and $.dst.ip have
+// the same last part.
+struct Field {
+  LioLi::Tree::Key key;
+  std::string name;
+
+  Field(const std::string &text) : key(LioLi::Tree::compile_key(text)) {
+    for (std::size_t i = 1; i < key.size(); i++) {
+      for (char c : key[i]) {
+        if (c != '#') {
+          name += c;
+        }
+      }
+
+      name += '_';
+    }
+
+    if (name.empty()) {
+      name = key.back();
+    } else {
+      name.pop_back();
+    }
+  }
+};
+
+// Aggregate of one number
+struct Aggregate {
+  uint64_t count = 0;
+  int64_t sum = 0;
+  int64_t min = std::numeric_limits<int64_t>::max();
+  int64_t max = std::numeric_limits<int64_t>::min();
+
+  void add(int64_t value) {
+    count++;
+    sum += value;
+    min = std::min(min, value);
+    max = std::max(max, value);
+  }
+};
+
+// What's known of the trees with one key in the current window
+struct Bucket {
+  uint64_t count = 0;
+  std::vector<Aggregate> aggregates;
+};
+
+// Keys are the group_by values, each prefixed with its length
+using Buckets = std::unordered_map<std::string, Bucket>;
+
+// MAIN object of this file
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
+  // Buckets are spread over shards by the hash of their key, so logging
+  // threads rarely wait for each other
+  static constexpr std::size_t shard_count = 16;
+
+  struct Shard {
+    std::mutex mutex;
+    Buckets buckets;
+  };
+
+  // Configs, not changed once started
+  std::vector<Field> group_by;
+  std::vector<Field> aggregate;
+  uint32_t window_s = 60;
+  uint32_t max_keys = 10000;
+  bool testmode = false;
+  std::string logger_name;
+
+  Shard shards[shard_count];
+  std::atomic<uint32_t> key_count = 0; // Keys in all shards
+
+  std::mutex overflow_mutex;
+  Bucket overflow;
+
+  std::shared_ptr<LioLi::Logger> logger;
+  std::once_flag resolved; // The logger is looked up on first use
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::atomic<bool> terminate = false;
+
+  // Start of the current window, set by start(), then only used by run()
+  std::chrono::system_clock::time_point start_time;
+
+  // Counts the numbers of tree into bucket
+  void add(Bucket &bucket, const LioLi::Tree &tree) {
+    bucket.count++;
+    bucket.aggregates.resize(aggregate.size());
+
+    for (std::size_t i = 0; i < aggregate.size(); i++) {
+      std::string_view text = tree.lookup(aggregate[i].key);
+      int64_t value;
+
+      if (text.empty()) {
+        continue;
+      }
+
+      auto end = text.data() + text.size();
+      auto result = std::from_chars(text.data(), end, value);
+
+      if (result.ec != std::errc() || result.ptr != end) {
+        s_peg_counts.not_numbers++;
+        continue;
+      }
+
+      bucket.aggregates[i].add(value);
+    }
+  }
+
+  LioLi::Tree summary(std::string_view key, const Bucket &bucket,
+                      const std::string &start, bool is_overflow) const {
+    LioLi::Tree root("$");
+
+    root << (LioLi::Tree("log") << "rollup");
+    root << (LioLi::Tree("start") << start);
+    root << (LioLi::Tree("window_s") << std::to_string(window_s));
+
+    if (is_overflow) {
+      root << LioLi::Tree("overflow");
+    } else {
+      LioLi::Tree key_node("key");
+
+      for (auto &field : group_by) {
+        uint32_t size;
+
+        key.copy(reinterpret_cast<char *>(&size), sizeof(size));
+        key_node << (LioLi::Tree(field.name)
+                     << std::string(key.substr(sizeof(size), size)));
+        key.remove_prefix(sizeof(size) + size);
+      }
+
+      root << std::move(key_node);
+    }
+
+    root << (LioLi::Tree("count") << std::to_string(bucket.count));
+
+    for (std::size_t i = 0; i < bucket.aggregates.size(); i++) {
+      auto &values = bucket.aggregates[i];
+
+      if (values.count == 0) {
+        continue;
+      }
+
+      root << (LioLi::Tree(aggregate[i].name)
+               << (LioLi::Tree("sum") << std::to_string(values.sum))
+               << (LioLi::Tree("min") << std::to_string(values.min))
+               << (LioLi::Tree("max") << std::to_string(values.max)));
+    }
+
+    return root;
+  }
+
+  // The logger we send to might be configured after us
+  LioLi::Logger &get_logger() {
+    std::call_once(resolved, [this] {
+      logger = LioLi::LogDB::get<LioLi::Logger>(logger_name);
+    });
+    return *logger;
+  }
+
+  // Takes what's collected and sends a summary of it on
+  void close_window(std::chrono::system_clock::time_point start) {
+    std::string start_text =
+        testmode ? "1970-01-01T00:00:00Z"
+                 : std::format("{:%FT%TZ}",
+                               std::chrono::floor<std::chrono::seconds>(start));
+    Buckets taken[shard_count];
+    Bucket overflowed;
+    uint32_t keys = 0;
+
+    // All shards are taken at once, so a window never has more than max_keys
+    {
+      std::unique_lock<std::mutex> locks[shard_count];
+
+      for (std::size_t i = 0; i < shard_count; i++) {
+        locks[i] = std::unique_lock(shards[i].mutex);
+        taken[i].swap(shards[i].buckets);
+        keys += taken[i].size();
+      }
+
+      std::scoped_lock lock(overflow_mutex);
+      std::swap(overflowed, overflow);
+      key_count = 0;
+    }
+
+    // Sent in key order, so the output doesn't depend on the sharding
+    std::vector<const Buckets::value_type *> sorted;
+    sorted.reserve(keys);
+
+    for (auto &buckets : taken) {
+      for (auto &entry : buckets) {
+        sorted.push_back(&entry);
+      }
+    }
+
+    std::sort(sorted.begin(), sorted.end(),
+              [](auto a, auto b) { return a->first < b->first; });
+
+    for (auto entry : sorted) {
+      get_logger().log(summary(entry->first, entry->second, start_text, false),
+                       LioLi::Priority::normal);
+    }
+
+    if (overflowed.count != 0) {
+      get_logger().log(summary({}, overflowed, start_text, true),
+                       LioLi::Priority::normal);
+    }
+
+    s_peg_counts.windows++;
+    s_peg_counts.summaries += keys + (overflowed.count != 0);
+    if (s_peg_counts.max_keys < keys) {
+      s_peg_counts.max_keys = keys;
+    }
+  }
+
+  // Runs on the reactor, closes the windows as they end
+  void run() override {
+    using clock = std::chrono::system_clock;
+
+    auto window = std::chrono::seconds(window_s);
+
+    while (!terminate) {
+      auto end = start_time + window;
+      auto now = clock::now();
+
+      // Woken too early, e.g. if the clock was set back
+      if (now < end) {
+        wake_at(Common::Reactor::clock::now() + (end - now));
+        return;
+      }
+
+      close_window(start_time);
+
+      // Skip windows that passed while the machine slept
+      start_time = end + (now - end) / window * window;
+    }
+  }
+
+public:
+  Logger(const char *name) : LioLi::Logger(name) {}
+
+  ~Logger() {
+    stop(); // Stops worker
+  }
+
+  // Overflowing keys are counted, so nothing is lost here
+  bool had_data_loss(bool clear_flag) override {
+    return get_logger().had_data_loss(clear_flag);
+  }
+
+  void operator<<(const LioLi::Tree &&tree) override {
+    s_peg_counts.logs_in++;
+
+    // Reused so building the key doesn't allocate
+    thread_local std::string key;
+    key.clear();
+
+    for (auto &field : group_by) {
+      std::string_view value = tree.lookup(field.key);
+      uint32_t size = value.size();
+
+      key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+      key.append(value);
+    }
+
+    auto &shard = shards[std::hash<std::string>{}(key) % shard_count];
+
+    {
+      std::scoped_lock lock(shard.mutex);
+      auto bucket = shard.buckets.find(key);
+
+      if (bucket != shard.buckets.end()) {
+        add(bucket->second, tree);
+        return;
+      }
+
+      // A new key, if there's room for it
+      if (key_count.fetch_add(1) < max_keys) {
+        add(shard.buckets[key], tree);
+        return;
+      }
+
+      key_count--;
+    }
+
+    {
+      std::scoped_lock lock(overflow_mutex);
+      add(overflow, tree);
+    }
+
+    s_peg_counts.overflow_logs++;
+  }
+
+  void set_config(const std::string &logger, const std::string &group_by,
+                  const std::string &aggregate, uint32_t window_s,
+                  uint32_t max_keys, bool testmode) {
+    logger_name = logger;
+
+    for (auto &key : split_keys(group_by)) {
+      this->group_by.emplace_back(key);
+    }
+
+    for (auto &key : split_keys(aggregate)) {
+      this->aggregate.emplace_back(key);
+    }
+
+    this->window_s = window_s;
+    this->max_keys = max_keys;
+    this->testmode = testmode;
+  }
+
+  // Call after all configuration is done
+  void start() {
+    if (started) {
+      return;
+    }
+
+    auto window = std::chrono::seconds(window_s);
+    auto start = std::chrono::floor<std::chrono::seconds>(
+        std::chrono::system_clock::now());
+    start_time = start - start.time_since_epoch() % window;
+
+    terminate = false;
+    started = true;
+    Common::Reactor::get().add(*this);
+  }
+
+  // Call to terminate, outputs what's collected in the current window
+  void stop() {
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    Common::Reactor::get().remove(*this);
+    started = false;
+
+    // The window isn't complete, but what's collected isn't lost
+    close_window(start_time);
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {}
+
+  ~Module() {}
+
+  struct ConfigColector {
+    std::string name;
+    std::string logger;
+    std::string group_by;
+    std::string aggregate;
+    uint32_t window_s = 60;
+    uint32_t max_keys = 10000;
+    bool testmode = false;
+  };
+
+  std::stack<ConfigColector> config_stack;
+
+  bool begin(const char *, int, snort::SnortConfig *) override {
+    // Make new element
+    config_stack.emplace();
+    return true;
+  }
+
+  bool end(const char *, int, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    // Check validity
+    if (config_stack.top().name.empty()) {
+      if (config_stack.size() > 1) {
+        snort::ErrorMessage("ERROR: No alias given for entry\n");
+        config_stack.pop();
+        return false;
+      }
+
+      config_stack.top().name = s_name;
+    }
+
+    if (config_stack.top().logger.empty() ||
+        config_stack.top().logger == config_stack.top().name) {
+      snort::ErrorMessage("ERROR: %s needs another logger to output to\n",
+                          config_stack.top().name.c_str());
+      config_stack.pop();
+      return false;
+    }
+
+    // Create entry in DB
+    if (!LioLi::LogDB::register_type<Logger>(config_stack.top().name.c_str())) {
+      snort::ErrorMessage("ERROR: Found duplicate name/alias '%s'\n",
+                          config_stack.top().name.c_str());
+      config_stack.pop();
+      return false;
+    }
+
+    auto logger = LioLi::LogDB::get<Logger>(config_stack.top().name.c_str());
+
+    if (!logger) {
+      snort::ErrorMessage("ERROR: Unable to initialize logger\n");
+      config_stack.pop();
+      return false;
+    }
+
+    // Initialize specific logger
+    logger->set_config(config_stack.top().logger, config_stack.top().group_by,
+                       config_stack.top().aggregate,
+                       config_stack.top().window_s,
+                       config_stack.top().max_keys,
+                       config_stack.top().testmode);
+
+    // Start the logger
+    logger->start();
+    logger_names.push_back(config_stack.top().name);
+
+    config_stack.pop();
+    return true;
+  }
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    if (val.is("alias")) {
+      std::string alias = val.get_as_string();
+
+      if (alias.empty()) {
+        snort::ErrorMessage("ERROR: Alias specified with empty name\n");
+        return false;
+      }
+
+      config_stack.top().name = alias;
+    } else if (val.is("logger")) {
+      config_stack.top().logger = val.get_as_string();
+    } else if (val.is("group_by")) {
+      config_stack.top().group_by = val.get_as_string();
+    } else if (val.is("aggregate")) {
+      config_stack.top().aggregate = val.get_as_string();
+    } else if (val.is("window_s")) {
+      config_stack.top().window_s = val.get_uint32();
+    } else if (val.is("max_keys")) {
+      config_stack.top().max_keys = val.get_uint32();
+    } else if (val.is("testmode")) {
+      config_stack.top().testmode = val.get_bool();
+    } else {
+      // fail if we didn't get something valid
+      return false;
+    }
+
+    return true;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static Common::AtomicPegs<PegCounts> static_pegs;
+    return static_pegs.get(s_peg_counts);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+// The current windows are closed before the loggers we send to are stopped,
+// which happens when their modules are deleted, after this
+void process_term() {
+  for (auto &name : logger_names) {
+    LioLi::LogDB::get<Logger>(name.c_str())->stop();
+  }
+}
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    process_term,
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace logger_rollup
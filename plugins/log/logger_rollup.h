@@ -0,0 +1,18 @@
+#ifndef logger_rollup_5b7e29d1
+#define logger_rollup_5b7e29d1
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace logger_rollup {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace logger_rollup
+
+#endif // #ifndef logger_rollup_5b7e29d1
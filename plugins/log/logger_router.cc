@@ -0,0 +1,655 @@
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+#include <arpa/inet.h>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <stack>
+#include <string>
+#include <vector>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+#include "logger_router.h"
+
+// Debug includes
+
+namespace logger_router {
+namespace {
+
+const char *s_name = "logger_router";
+const char *s_help =
+    "Routes LioLi trees to other loggers, or drops them, by their content";
+
+/*
+logger_router = {
+  alias = "router",
+  routes = { { path = "$.principal.addr.ip", match = "cidr",
+               value = "10.0.0.0/8", logger = "drop" },
+             { path = "$.protocol", match = "equals", value = "DNS",
+               logger = "dns_file", sample_one_in = 10,
+               sample_by = "$.principal.addr.ip" },
+             { logger = "logger_file" } }
+}
+
+Routes are tried in order and a tree goes to the logger of the first route
+that matches it, a route without a path matches every tree.  Trees that match
+no route, that go to the "drop" logger, or that the sampling of their route
+doesn't pick, are dropped here, before anything is spent on serializing them.
+
+Sampling picks one in sample_one_in of the trees matching the route, every
+n'th tree, or with sample_by, the trees whose value at that path hashes to a
+multiple of n, so e.g. all trees of a host are either kept or dropped.
+
+The routes are compiled when the configuration ends, logging doesn't take
+any locks, except for counting, and runs on the calling thread.
+*/
+
+const snort::Parameter route_params[] = {
+    {"path", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Key of the node the route looks at, e.g. $.protocol, if not given the "
+     "route matches every tree"},
+    {"match", snort::Parameter::PT_ENUM, "exists | equals | prefix | range | "
+                                         "cidr",
+     "exists",
+     "How the value of the node is matched: the node exists, equals value, "
+     "starts with value, is a number in the range value (min:max, either can "
+     "be left out), or is an IP address in the CIDR value (e.g. 10.0.0.0/8)"},
+    {"value", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "What the node is matched against"},
+    {"invert", snort::Parameter::PT_BOOL, nullptr, "false",
+     "If true the route matches the trees the predicate doesn't match"},
+    {"logger", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Logger the matching trees are sent to, \"drop\" drops them"},
+    {"sample_one_in", snort::Parameter::PT_INT, "1:max32", "1",
+     "Only one in this many of the matching trees is sent on, the rest are "
+     "dropped (1 = all)"},
+    {"sample_by", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Key of a node whose value is hashed to pick the sampled trees, if not "
+     "given every n'th tree is picked"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const snort::Parameter module_params[] = {
+    {"alias", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "The alias name for the logger with specific config"},
+    {"routes", snort::Parameter::PT_LIST, route_params, nullptr,
+     "Routes tried in order, the first that matches a tree decides where it "
+     "goes"},
+
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
+    {CountType::SUM, "routed", "Count of logs sent on to another logger"},
+    {CountType::SUM, "dropped", "Count of logs routed to drop"},
+    {CountType::SUM, "sampled_out",
+     "Count of logs dropped as the sampling of their route didn't pick them"},
+    {CountType::SUM, "unmatched",
+     "Count of logs dropped as no route matched them"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as logging isn't limited to
+// packet threads
+std::mutex peg_count_mutex; // Protects the peg counts
+struct PegCounts {
+  PegCount logs_in = 0;
+  PegCount routed = 0;
+  PegCount dropped = 0;
+  PegCount sampled_out = 0;
+  PegCount unmatched = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// Must match the order of the match parameter
+enum class Match { exists, equals, prefix, range, cidr };
+
+const char *match_names[] = {"exists", "equals", "prefix", "range", "cidr"};
+
+// A route as given in the configuration
+struct RouteConfig {
+  std::string path;
+  Match match = Match::exists;
+  std::string value;
+  bool invert = false;
+  std::string logger;
+  uint32_t sample_one_in = 1;
+  std::string sample_by;
+};
+
+// An IP address, IPv4 or IPv6
+struct Address {
+  int family = AF_UNSPEC;
+  uint8_t bytes[16] = {};
+
+  // Returns false if text isn't an address, IPv6 addresses might be in
+  // brackets as written by TreeGenerators
+  bool parse(std::string_view text) {
+    char buffer[INET6_ADDRSTRLEN];
+
+    if (text.size() > 2 && text.front() == '[' && text.back() == ']') {
+      text = text.substr(1, text.size() - 2);
+    }
+
+    if (text.size() >= sizeof(buffer)) {
+      return false;
+    }
+
+    text.copy(buffer, text.size());
+    buffer[text.size()] = '\0';
+
+    family = std::strchr(buffer, ':') ? AF_INET6 : AF_INET;
+    return inet_pton(family, buffer, bytes) == 1;
+  }
+
+  unsigned bits() const { return family == AF_INET ? 32 : 128; }
+};
+
+// A route compiled to the form used while logging
+struct Route {
+  RouteConfig config;
+  LioLi::Tree::Key key;
+  LioLi::Tree::Key sample_key;
+  int64_t min = std::numeric_limits<int64_t>::min();
+  int64_t max = std::numeric_limits<int64_t>::max();
+  Address network;
+  unsigned prefix_bits = 0;
+
+  std::shared_ptr<LioLi::Logger> logger; // nullptr = drop
+
+  // Updated by all threads logging
+  std::atomic<uint64_t> seen = 0;    // Trees matched
+  std::atomic<uint64_t> sampled = 0; // Trees matched and picked
+
+  Route(const RouteConfig &config) : config(config) {}
+
+  // Returns an error message if the route can't be compiled
+  const char *compile() {
+    if (!config.path.empty()) {
+      key = LioLi::Tree::compile_key(config.path);
+    } else if (config.invert || config.match != Match::exists) {
+      return "route without a path can't match or invert";
+    }
+
+    if (!config.sample_by.empty()) {
+      sample_key = LioLi::Tree::compile_key(config.sample_by);
+    }
+
+    if (config.match == Match::range) {
+      std::string_view value = config.value;
+      auto colon = value.find(':');
+
+      if (colon == std::string_view::npos ||
+          !parse_bound(value.substr(0, colon), min) ||
+          !parse_bound(value.substr(colon + 1), max) || min > max) {
+        return "range must be <min>:<max>";
+      }
+    } else if (config.match == Match::cidr) {
+      std::string_view value = config.value;
+      auto slash = value.find('/');
+
+      if (!network.parse(value.substr(0, slash))) {
+        return "cidr must be <address>/<prefix length>";
+      }
+
+      prefix_bits = network.bits();
+
+      if (slash != std::string_view::npos) {
+        auto bits = value.substr(slash + 1);
+        auto end = bits.data() + bits.size();
+        auto result = std::from_chars(bits.data(), end, prefix_bits);
+
+        if (bits.empty() || result.ec != std::errc() ||
+            result.ptr != end ||
+            prefix_bits > network.bits()) {
+          return "cidr must be <address>/<prefix length>";
+        }
+      }
+    }
+
+    return nullptr;
+  }
+
+  // An empty bound is left as it is, i.e. open
+  static bool parse_bound(std::string_view text, int64_t &bound) {
+    if (text.empty()) {
+      return true;
+    }
+
+    auto end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, bound);
+
+    return result.ec == std::errc() && result.ptr == end;
+  }
+
+  bool in_network(std::string_view text) const {
+    Address address;
+
+    if (!address.parse(text) || address.family != network.family) {
+      return false;
+    }
+
+    unsigned whole = prefix_bits / 8;
+    unsigned rest = prefix_bits % 8;
+
+    if (std::memcmp(address.bytes, network.bytes, whole) != 0) {
+      return false;
+    }
+
+    uint8_t mask = 0xff << (8 - rest);
+    return rest == 0 ||
+           (address.bytes[whole] & mask) == (network.bytes[whole] & mask);
+  }
+
+  bool predicate(const LioLi::Tree &tree) const {
+    if (config.match == Match::exists) {
+      return tree.contains(key);
+    }
+
+    std::string_view value = tree.lookup(key);
+
+    if (value.data() == nullptr) {
+      return false; // Not found
+    }
+
+    switch (config.match) {
+    case Match::equals:
+      return value == config.value;
+    case Match::prefix:
+      return value.starts_with(config.value);
+    case Match::range: {
+      int64_t number;
+      auto result =
+          std::from_chars(value.data(), value.data() + value.size(), number);
+
+      return result.ec == std::errc() &&
+             result.ptr == value.data() + value.size() && min <= number &&
+             number <= max;
+    }
+    case Match::cidr:
+      return in_network(value);
+    default:
+      return false;
+    }
+  }
+
+  bool matches(const LioLi::Tree &tree) const {
+    return key.empty() || predicate(tree) != config.invert;
+  }
+
+  // FNV-1a, finished with a multiply so the low bits depend on all of value
+  static uint64_t hash(std::string_view value) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (unsigned char c : value) {
+      hash = (hash ^ c) * 0x100000001b3;
+    }
+
+    return (hash ^ (hash >> 32)) * 0x9e3779b97f4a7c15;
+  }
+
+  // Counts a matched tree, returns true if the sampling picks it
+  bool sample(const LioLi::Tree &tree) {
+    uint64_t count = seen.fetch_add(1, std::memory_order_relaxed);
+    bool picked;
+
+    if (config.sample_one_in == 1) {
+      picked = true;
+    } else if (sample_key.empty()) {
+      picked = count % config.sample_one_in == 0;
+    } else {
+      picked =
+          (hash(tree.lookup(sample_key)) >> 32) % config.sample_one_in == 0;
+    }
+
+    if (picked) {
+      sampled.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return picked;
+  }
+
+  std::string describe() const {
+    if (config.path.empty()) {
+      return "any tree";
+    }
+
+    std::string text = config.path + (config.invert ? " not " : " ") +
+                       match_names[static_cast<int>(config.match)];
+
+    if (config.match != Match::exists) {
+      text += " " + config.value;
+    }
+    return text;
+  }
+};
+
+// MAIN object of this file
+class Logger : public LioLi::Logger {
+  std::deque<Route> routes; // Not changed once logging starts
+  std::once_flag resolved;  // Loggers are looked up on first use
+
+  // The loggers we route to might be configured after us, so they are looked
+  // up when all configuration is done
+  void resolve() {
+    for (auto &route : routes) {
+      if (route.config.logger == "drop") {
+        continue;
+      }
+
+      auto logger = LioLi::LogDB::get<LioLi::Logger>(route.config.logger);
+
+      if (logger == LioLi::Logger::get_null_obj()) {
+        snort::WarningMessage("WARNING: %s has no logger named '%s', the "
+                              "trees routed to it are dropped\n",
+                              get_name(), route.config.logger.c_str());
+        continue;
+      }
+
+      if (logger.get() == this) {
+        snort::WarningMessage("WARNING: %s can't route to itself, the trees "
+                              "routed to it are dropped\n",
+                              get_name());
+        continue;
+      }
+
+      route.logger = logger;
+    }
+  }
+
+public:
+  Logger(const char *name) : LioLi::Logger(name) {}
+
+  ~Logger() {
+    for (auto &route : routes) {
+      snort::LogMessage("LOG: %s route %s -> %s matched %lu trees, sent on "
+                        "%lu\n",
+                        get_name(), route.describe().c_str(),
+                        route.config.logger.c_str(), route.seen.load(),
+                        route.sampled.load());
+    }
+  }
+
+  // Compiles the routes, returns false if one can't be compiled
+  bool set_routes(const std::vector<RouteConfig> &configs) {
+    for (auto &config : configs) {
+      auto &route = routes.emplace_back(config);
+
+      if (auto error = route.compile()) {
+        snort::ErrorMessage("ERROR: %s %s: %s (value '%s')\n", get_name(),
+                            route.describe().c_str(), error,
+                            config.value.c_str());
+        routes.clear();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // Data is lost if any logger we route to has lost data
+  bool had_data_loss(bool clear_flag) override {
+    std::call_once(resolved, [this] { resolve(); });
+    bool data_loss = false;
+
+    for (auto &route : routes) {
+      if (route.logger) {
+        data_loss |= route.logger->had_data_loss(clear_flag);
+      }
+    }
+
+    return data_loss;
+  }
+
+  void operator<<(const LioLi::Tree &&tree) override {
+    log(std::move(tree), LioLi::Priority::normal);
+  }
+
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    std::call_once(resolved, [this] { resolve(); });
+
+    for (auto &route : routes) {
+      if (!route.matches(tree)) {
+        continue;
+      }
+
+      if (!route.sample(tree)) {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_in++;
+        s_peg_counts.sampled_out++;
+        return;
+      }
+
+      if (!route.logger) {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_in++;
+        s_peg_counts.dropped++;
+        return;
+      }
+
+      {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_in++;
+        s_peg_counts.routed++;
+      }
+
+      route.logger->log(std::move(tree), priority);
+      return;
+    }
+
+    std::scoped_lock lock(peg_count_mutex);
+    s_peg_counts.logs_in++;
+    s_peg_counts.unmatched++;
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {}
+
+  ~Module() {}
+
+  struct ConfigColector {
+    std::string name;
+    std::vector<RouteConfig> routes;
+  };
+
+  std::stack<ConfigColector> config_stack;
+
+  static bool is_route(const char *fqn) {
+    return std::string_view(fqn).ends_with(".routes");
+  }
+
+  bool begin(const char *fqn, int idx, snort::SnortConfig *) override {
+    if (is_route(fqn)) {
+      assert(!config_stack.empty());
+
+      if (idx > 0) {
+        config_stack.top().routes.emplace_back();
+      }
+      return true;
+    }
+
+    // Make new element
+    config_stack.emplace();
+    return true;
+  }
+
+  bool end(const char *fqn, int idx, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    if (is_route(fqn)) {
+      if (idx > 0 && config_stack.top().routes.back().logger.empty()) {
+        snort::ErrorMessage("ERROR: %s no logger given for route %d, use "
+                            "\"drop\" to drop the trees\n",
+                            s_name, idx);
+        return false;
+      }
+      return true;
+    }
+
+    // Check validity
+    if (config_stack.top().name.empty()) {
+      if (config_stack.size() > 1) {
+        snort::ErrorMessage("ERROR: No alias given for entry\n");
+        config_stack.pop();
+        return false;
+      }
+
+      config_stack.top().name = s_name;
+    }
+
+    if (config_stack.top().routes.empty()) {
+      snort::ErrorMessage("ERROR: %s needs at least one route\n", s_name);
+      config_stack.pop();
+      return false;
+    }
+
+    // Create entry in DB
+    if (!LioLi::LogDB::register_type<Logger>(config_stack.top().name.c_str())) {
+      snort::ErrorMessage("ERROR: Found duplicate name/alias '%s'\n",
+                          config_stack.top().name.c_str());
+      config_stack.pop();
+      return false;
+    }
+
+    auto logger = LioLi::LogDB::get<Logger>(config_stack.top().name.c_str());
+
+    if (!logger) {
+      snort::ErrorMessage("ERROR: Unable to initialize logger\n");
+      config_stack.pop();
+      return false;
+    }
+
+    // Initialize specific logger
+    if (!logger->set_routes(config_stack.top().routes)) {
+      config_stack.pop();
+      return false;
+    }
+
+    config_stack.pop();
+    return true;
+  }
+
+  bool set(const char *fqn, snort::Value &val, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    if (std::string_view(fqn).find(".routes.") != std::string_view::npos) {
+      if (config_stack.top().routes.empty()) {
+        return false;
+      }
+
+      auto &route = config_stack.top().routes.back();
+
+      if (val.is("path")) {
+        route.path = val.get_as_string();
+      } else if (val.is("match")) {
+        route.match = static_cast<Match>(val.get_uint8());
+      } else if (val.is("value")) {
+        route.value = val.get_as_string();
+      } else if (val.is("invert")) {
+        route.invert = val.get_bool();
+      } else if (val.is("logger")) {
+        route.logger = val.get_as_string();
+      } else if (val.is("sample_one_in")) {
+        route.sample_one_in = val.get_uint32();
+      } else if (val.is("sample_by")) {
+        route.sample_by = val.get_as_string();
+      } else {
+        return false;
+      }
+
+      return true;
+    }
+
+    if (val.is("alias")) {
+      std::string alias = val.get_as_string();
+
+      if (alias.empty()) {
+        snort::ErrorMessage("ERROR: Alias specified with empty name\n");
+        return false;
+      }
+
+      config_stack.top().name = alias;
+    } else {
+      // fail if we didn't get something valid
+      return false;
+    }
+
+    return true;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static PegCounts static_pegs;
+
+    std::scoped_lock lock(peg_count_mutex);
+    static_pegs = s_peg_counts;
+
+    return reinterpret_cast<PegCount *>(&static_pegs);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace logger_router
@@ -0,0 +1,18 @@
+#ifndef logger_router_a4c81f93
+#define logger_router_a4c81f93
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace logger_router {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace logger_router
+
+#endif // #ifndef logger_router_a4c81f93
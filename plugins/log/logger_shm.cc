@@ -0,0 +1,795 @@
+
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <stack>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+#include "logger_shm.h"
+#include "reactor.h"
+#include "shm_ring.h"
+#include "tree_ring.h"
+
+// Debug includes
+
+namespace logger_shm {
+namespace {
+
+const char *s_name = "logger_shm";
+const char *s_help =
+    "Outputs LioLi trees to a shared memory ring, read in place by a local "
+    "consumer";
+
+const snort::Parameter module_params[] = {
+    {"alias", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "The alias name for the logger with specific config"},
+    {"socket_path", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Path of the unix domain socket the consumer connects to, to get the "
+     "ring (see includes/shm_ring.h)"},
+    {"ring_bytes", snort::Parameter::PT_INT, "65536:max53", "67108864",
+     "Size of the ring's data area, must be a power of two, a serialized tree "
+     "can be at most half of it"},
+    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
+     "Max number of trees of each priority that will be queued before "
+     "discarding"},
+    {"queue_max_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "Max bytes of memory used by queued trees of each priority before "
+     "discarding (0 = no limit)"},
+    {"drop_policy", snort::Parameter::PT_ENUM, "oldest | newest | random_early",
+     "oldest",
+     "What is discarded when a queue is full, the oldest queued tree, the new "
+     "tree, or new trees at random once half full"},
+    {"restart_interval_s", snort::Parameter::PT_INT, "0:86400", "0",
+     "Seconds between restarting the serializer (max: 86400 s (1 day), 0 = "
+     "never))"},
+    {"serializer", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Serializer to use for generating output"},
+
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
+    {CountType::SUM, "logs_out", "Count of logs we wrote to the ring"},
+    {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
+    {CountType::MAX, "max_queued",
+     "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "restarts", "Count of (re)starts of the serializer"},
+    {CountType::SUM, "records", "Number of records written to the ring"},
+    {CountType::SUM, "record_bytes", "Payload bytes written to the ring"},
+    {CountType::SUM, "ring_full",
+     "Number of times we waited for the consumer to make room in the ring"},
+    {CountType::MAX, "max_ring_bytes",
+     "Max bytes of the ring ever in use, written but not read"},
+    {CountType::SUM, "oversized",
+     "Count of logs discarded as they were larger than half the ring"},
+    {CountType::SUM, "consumers", "Number of consumers that attached"},
+    {CountType::SUM, "doorbells", "Number of times the consumer was woken"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
+std::mutex peg_count_mutex; // Protects the peg counts
+struct PegCounts {
+  PegCount logs_in = 0;
+  PegCount logs_out = 0;
+  PegCount overflows = 0;
+  PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount restarts = 0;
+  PegCount records = 0;
+  PegCount record_bytes = 0;
+  PegCount ring_full = 0;
+  PegCount max_ring_bytes = 0;
+  PegCount oversized = 0;
+  PegCount consumers = 0;
+  PegCount doorbells = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// MAIN object of this file
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
+  using clock = std::chrono::steady_clock;
+
+  std::mutex mutex; // Protects members
+
+  // Configs
+  std::string serializer_name;
+  std::string socket_path;
+  uint64_t ring_bytes = 67108864;
+  uint32_t serializer_restart_interval_s = 0; // 0 = never
+  LioLi::QueueAccount queue_account; // Only used by the worker
+
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
+  bool data_loss = false;   // Set to true when we might have lost data
+
+  // The ring and who reads it, only used by the worker
+  class Output {
+    ShmRing::Writer ring;
+    int listener = -1; // Where consumers connect
+    int consumer = -1; // Connection of the attached consumer
+    std::string path;
+    uint32_t pending_flags = 0; // Flags for the next record written
+    bool full = false;          // The last write didn't fit
+
+  public:
+    Output(const char *name, const std::string &path, uint64_t ring_bytes)
+        : ring(name, ring_bytes), path(path) {
+      if (!ring.is_open()) {
+        snort::ErrorMessage("ERROR: %s could not create ring: %s\n", name,
+                            std::strerror(errno));
+        return;
+      }
+
+      listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          0);
+
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+
+      // A socket left by an earlier run would make bind() fail
+      ::unlink(path.c_str());
+
+      if (listener == -1 ||
+          ::bind(listener, (sockaddr *)&addr, sizeof(addr)) ||
+          ::listen(listener, 4)) {
+        snort::ErrorMessage("ERROR: %s could not listen on %s: %s\n", name,
+                            path.c_str(), std::strerror(errno));
+        if (listener != -1) {
+          ::close(listener);
+          listener = -1;
+        }
+      }
+    }
+
+    ~Output() {
+      if (consumer != -1) {
+        ::close(consumer);
+      }
+
+      if (listener != -1) {
+        ::close(listener);
+        ::unlink(path.c_str());
+      }
+    }
+
+    operator bool() const { return listener != -1; }
+
+    uint64_t max_payload() const { return ring.max_payload(); }
+
+    int get_listener() const { return listener; }
+    int get_consumer() const { return consumer; }
+
+    // Notices consumers leaving and hands the ring to a new one, returns true
+    // if the consumer changed.  forget(fd) is called before the connection
+    // of a consumer that left is closed.
+    template <class Lambda> bool serve(Lambda forget) {
+      bool changed = false;
+
+      // The consumer never writes, so readable means it's gone
+      if (consumer != -1) {
+        pollfd pfd = {consumer, POLLIN, 0};
+
+        if (::poll(&pfd, 1, 0) > 0) {
+          forget(consumer);
+          ::close(consumer);
+          consumer = -1;
+          changed = true;
+        }
+      }
+
+      int fd;
+
+      while ((fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC)) != -1) {
+        // There can only be one consumer, others are turned away
+        if (consumer == -1 && ring.hand_out(fd)) {
+          consumer = fd;
+          changed = true;
+
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.consumers++;
+        } else {
+          ::close(fd);
+        }
+      }
+
+      return changed;
+    }
+
+    void start_context() { pending_flags = ShmRing::context_start; }
+
+    // Writes a record, returns false if there's no room for it until the
+    // consumer has read more
+    bool write(std::string_view payload, uint32_t flags) {
+      if (!ring.write(payload, flags | pending_flags)) {
+        // Counted once per record we wait with
+        if (!full) {
+          full = true;
+
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.ring_full++;
+        }
+
+        // Let the consumer see what we have, so it can make room
+        publish();
+        return false;
+      }
+
+      pending_flags = 0;
+      full = false;
+
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.records++;
+      s_peg_counts.record_bytes += payload.size();
+
+      return true;
+    }
+
+    void publish() {
+      bool rang = ring.publish();
+      uint64_t used = ring.used_bytes();
+
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.doorbells += rang;
+      if (s_peg_counts.max_ring_bytes < used) {
+        s_peg_counts.max_ring_bytes = used;
+      }
+    }
+  };
+
+  // Accounts for what producers did to the queue since last call, worker only
+  void account_queue() {
+    if (queue_account.take(queue, get_name(), s_peg_counts, peg_count_mutex)) {
+      std::scoped_lock lock(mutex);
+      data_loss = true;
+    }
+  }
+
+  // Worker state, only used by run()
+  std::shared_ptr<LioLi::Serializer> serializer;
+  std::chrono::time_point<clock>
+      next_timeout; // Keeps track of when we should restart serializer
+                    // context
+  std::shared_ptr<LioLi::Serializer::Context> context;
+  std::unique_ptr<Output> output;
+  std::vector<LioLi::Tree> batch; // Trees taken from the queue
+  std::size_t batch_index = 0;    // Next tree of batch to serialize
+  std::string pending;            // Record waiting for room in the ring
+  uint32_t pending_flags = 0;
+  bool has_pending = false;
+  bool pending_is_tree = false;  // Counted as logged once written
+  bool consumer_changed = false; // Since the context was last restarted
+
+  // Makes record the next one written
+  void put(std::string record, uint32_t flags, bool is_tree) {
+    pending = std::move(record);
+    pending_flags = flags;
+    pending_is_tree = is_tree;
+    has_pending = true;
+  }
+
+  // Watches what wakes us, besides the queue and the time
+  void watch_consumers() {
+    watch(output->get_listener(), EPOLLIN);
+
+    if (output->get_consumer() != -1) {
+      watch(output->get_consumer(), EPOLLIN);
+    }
+  }
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
+    }
+
+    queue.finish_wait(); // Whatever woke us
+
+    // Don't do anything until we have our serializer
+    if (!serializer && !terminate) {
+      serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+
+      if (serializer == serializer->get_null_obj()) {
+        serializer.reset();
+        wake_at(clock::now() + std::chrono::milliseconds(100));
+        return;
+      }
+    }
+
+    if (!output && !terminate) {
+      output = std::make_unique<Output>(get_name(), socket_path, ring_bytes);
+
+      if (!*output) {
+        terminate = true; // Trees will be dropped by the queue
+      }
+    }
+
+    // Bounded, so other tasks on the reactor thread get their turn
+    constexpr int max_trees = 256;
+    int budget = max_trees;
+
+    while (!terminate) {
+      if (budget-- <= 0) {
+        wake(); // Come back for the rest
+        return;
+      }
+
+      if (output->serve([this](int fd) { unwatch(fd); })) {
+        consumer_changed = true;
+
+        // This might set the data_loss too frequently, but it's only a help,
+        // not a promise
+        std::scoped_lock lock(mutex);
+        data_loss = true;
+      }
+
+      // Nothing more is written until the consumer has made room for what's
+      // pending
+      if (has_pending) {
+        if (!output->write(pending, pending_flags)) {
+          // The consumer doesn't tell when it has read, so we look now and
+          // then, without one only a new one can make room
+          watch_consumers();
+          wake_at(output->get_consumer() != -1
+                      ? clock::now() + std::chrono::milliseconds(1)
+                      : clock::time_point::max());
+          return;
+        }
+
+        has_pending = false;
+
+        if (pending_is_tree) {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.logs_out++;
+        }
+      }
+
+      // Restart the context when it's time, or when the consumer changed, as
+      // a new one can't make sense of the middle of a context.  The next tree
+      // starts a new one.
+      if (context && (consumer_changed || next_timeout <= clock::now())) {
+        put(context->close(), ShmRing::context_end, false);
+        context.reset();
+        consumer_changed = false;
+        continue; // Will eventually be written
+      }
+
+      consumer_changed = false;
+
+      if (batch_index < batch.size()) {
+        auto &tree = batch[batch_index++];
+
+        if (!context) {
+          context = serializer->create_context();
+          output->start_context();
+
+          if (serializer_restart_interval_s != 0) {
+            next_timeout = clock::now() +
+                           std::chrono::seconds(serializer_restart_interval_s);
+          } else {
+            next_timeout = std::chrono::time_point<clock>::max();
+          }
+
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.restarts++;
+        }
+
+        std::string record = context->serialize(std::move(tree));
+
+        if (record.empty()) {
+          continue;
+        }
+
+        if (record.size() > output->max_payload()) {
+          snort::WarningMessage(
+              "WARNING: %s discarding %zu byte tree, larger than half the "
+              "ring\n",
+              get_name(), record.size());
+
+          {
+            std::scoped_lock lock(peg_count_mutex);
+            s_peg_counts.oversized++;
+          }
+
+          // What the serializer put in the record might be needed by the
+          // ones that follow, so the context is ended
+          put(context->close(), ShmRing::context_end, false);
+          context.reset();
+          continue;
+        }
+
+        put(std::move(record), 0, true);
+        continue; // Will eventually be written
+      }
+
+      if (!batch.empty()) {
+        batch.clear();
+        batch_index = 0;
+        output->publish();
+      }
+
+      account_queue();
+
+      if (!queue.empty()) {
+        queue.pop_all(batch);
+        continue;
+      }
+
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        watch_consumers();
+        wake_at(next_timeout);
+        return;
+      }
+    }
+
+    // End the context if there's room for it, we don't wait for the consumer
+    if (output && *output) {
+      if (context && !has_pending) {
+        output->write(context->close(), ShmRing::context_end);
+      }
+
+      output->publish();
+      unwatch(output->get_listener());
+      if (output->get_consumer() != -1) {
+        unwatch(output->get_consumer());
+      }
+    }
+
+    unwatch(queue.get_event_fd());
+    output.reset();
+
+    {
+      std::scoped_lock lock(mutex);
+      worker_done = true;
+    }
+    cv.notify_all();
+  }
+
+public:
+  Logger(const char *name) : LioLi::Logger(name) {}
+
+  ~Logger() {
+    stop(); // Stops worker
+  }
+
+  bool had_data_loss(bool clear_flag) override {
+    std::scoped_lock lock(mutex);
+    bool old_value = data_loss;
+
+    data_loss &= !clear_flag;
+
+    return old_value;
+  }
+
+  void operator<<(const LioLi::Tree &&tree) override {
+    log(std::move(tree), LioLi::Priority::normal);
+  }
+
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
+  }
+
+  void set_serializer(const char *name) {
+    std::scoped_lock lock(mutex);
+
+    assert(serializer_name.empty() ||
+           name == serializer_name); // We do not handle changing of the
+                                     // serializer name
+
+    serializer_name = name;
+  }
+
+  void set_ring(std::string path, uint64_t bytes) {
+    socket_path = path;
+    ring_bytes = bytes;
+  }
+
+  // Applied to every priority class
+  void set_queue_limits(uint32_t max, uint64_t max_bytes,
+                        LioLi::TreeRing::DropPolicy policy) {
+    std::scoped_lock lock(mutex);
+
+    assert(max > 0); // We need to be able to queue at least one element
+
+    for (std::size_t i = 0; i < LioLi::priority_count; i++) {
+      auto priority = static_cast<LioLi::Priority>(i);
+
+      // If queue size is being reduced, trees might be dropped
+      if (auto dropped = queue.set_capacity(max, priority)) {
+        snort::WarningMessage(
+            "WARNING: %s dropping %li trees from queue due to resize\n",
+            get_name(), dropped);
+      }
+      queue.set_max_bytes(max_bytes, priority);
+      queue.set_drop_policy(policy, priority);
+    }
+  }
+
+  void set_serializer_restart_interval_s(uint32_t interval) {
+    {
+      std::scoped_lock lock(mutex);
+
+      serializer_restart_interval_s = interval;
+    }
+    // Kick worker
+    queue.kick();
+  }
+
+  // Call after all configuration is done
+  void start() {
+    if (started) {
+      return;
+    }
+
+    terminate = false;
+    worker_done = false;
+    started = true;
+    Common::Reactor::get().add(*this);
+  }
+
+  // Call to terminate
+  void stop() {
+    // Check worker is running
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    wake();
+
+    {
+      std::unique_lock lock(mutex);
+
+      // Give worker a chance to go down gracefully, it never waits for the
+      // consumer, so this is only to be sure
+      cv.wait_for(lock, std::chrono::seconds(2),
+                  [this] { return worker_done; });
+    }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {}
+
+  ~Module() {}
+
+  struct ConfigColector {
+    std::string name;
+    std::string socket_path;
+    uint64_t ring_bytes = 67108864;
+    uint32_t queue_limit;
+    uint64_t queue_limit_bytes = 0;
+    LioLi::TreeRing::DropPolicy drop_policy = {};
+    uint32_t restart_interval;
+    std::string serializer;
+  };
+
+  std::stack<ConfigColector> config_stack;
+
+  bool begin(const char *, int, snort::SnortConfig *) override {
+    // Make new element
+    config_stack.emplace();
+    return true;
+  }
+
+  bool end(const char *, int, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    // Check validity
+    if (config_stack.top().name.empty()) {
+      if (config_stack.size() > 1) {
+        snort::ErrorMessage("ERROR: No alias given for entry\n");
+        config_stack.pop();
+        return false;
+      }
+
+      config_stack.top().name = s_name;
+    }
+
+    if (config_stack.top().serializer.empty()) {
+      snort::ErrorMessage("ERROR: No serializer given for entry\n");
+      config_stack.pop();
+      return false;
+    }
+
+    if (config_stack.top().socket_path.empty() ||
+        config_stack.top().socket_path.size() >=
+            sizeof(sockaddr_un::sun_path)) {
+      snort::ErrorMessage("ERROR: %s needs a socket_path of 1 to %zu chars\n",
+                          s_name, sizeof(sockaddr_un::sun_path) - 1);
+      config_stack.pop();
+      return false;
+    }
+
+    uint64_t ring_bytes = config_stack.top().ring_bytes;
+
+    if ((ring_bytes & (ring_bytes - 1)) != 0) {
+      snort::ErrorMessage("ERROR: %s ring_bytes must be a power of two\n",
+                          s_name);
+      config_stack.pop();
+      return false;
+    }
+
+    // Create entry in DB
+    if (!LioLi::LogDB::register_type<Logger>(config_stack.top().name.c_str())) {
+      snort::ErrorMessage("ERROR: Found duplicate name/alias '%s'\n",
+                          config_stack.top().name.c_str());
+      config_stack.pop();
+      return false;
+    }
+
+    auto logger = LioLi::LogDB::get<Logger>(config_stack.top().name.c_str());
+
+    if (!logger) {
+      snort::ErrorMessage("ERROR: Unable to initialize logger\n");
+      config_stack.pop();
+      return false;
+    }
+
+    // Initialize specific logger
+    logger->set_serializer(config_stack.top().serializer.c_str());
+    logger->set_ring(config_stack.top().socket_path, ring_bytes);
+    logger->set_queue_limits(config_stack.top().queue_limit,
+                             config_stack.top().queue_limit_bytes,
+                             config_stack.top().drop_policy);
+    logger->set_serializer_restart_interval_s(
+        config_stack.top().restart_interval);
+
+    // Start the logger
+    logger->start();
+
+    config_stack.pop();
+    return true;
+  }
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    if (val.is("alias")) {
+      std::string alias = val.get_as_string();
+
+      if (alias.empty()) {
+        snort::ErrorMessage("ERROR: Alias specified with empty name\n");
+        return false;
+      }
+
+      config_stack.top().name = alias;
+    } else if (val.is("socket_path")) {
+      config_stack.top().socket_path = val.get_as_string();
+    } else if (val.is("ring_bytes")) {
+      config_stack.top().ring_bytes = val.get_uint64();
+    } else if (val.is("queue_max")) {
+      config_stack.top().queue_limit = val.get_uint32();
+    } else if (val.is("queue_max_bytes")) {
+      config_stack.top().queue_limit_bytes = val.get_uint64();
+    } else if (val.is("drop_policy")) {
+      config_stack.top().drop_policy =
+          static_cast<LioLi::TreeRing::DropPolicy>(val.get_uint8());
+    } else if (val.is("restart_interval_s")) {
+      config_stack.top().restart_interval = val.get_uint32();
+    } else if (val.is("serializer")) {
+      std::string serializer = val.get_as_string();
+
+      if (serializer.empty()) {
+        snort::ErrorMessage("ERROR: empty name given for serializer\n");
+        return false;
+      }
+
+      config_stack.top().serializer = serializer;
+    } else {
+      // fail if we didn't get something valid
+      return false;
+    }
+
+    return true;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // TODO: This will mess when snort tries to clear the pegs, find a solution
+    // that lets this work in a multithreaded environment
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static PegCounts static_pegs;
+
+    std::scoped_lock lock(peg_count_mutex);
+    static_pegs = s_peg_counts;
+
+    return reinterpret_cast<PegCount *>(&static_pegs);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace logger_shm
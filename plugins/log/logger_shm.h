@@ -0,0 +1,18 @@
+#ifndef logger_shm_a85c3f19
+#define logger_shm_a85c3f19
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace logger_shm {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace logger_shm
+
+#endif // #ifndef logger_shm_a85c3f19
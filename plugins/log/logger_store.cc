@@ -0,0 +1,705 @@
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+#include <log/messages.h>
+
+// System includes
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+#include "logger_store.h"
+#include "reactor.h"
+#include "segment_store.h"
+#include "tree_ring.h"
+
+// Debug includes
+
+namespace logger_store {
+namespace {
+
+static const char *s_name = "logger_store";
+static const char *s_help =
+    "Keeps LioLi trees in local segment files, indexed by time and key, to "
+    "be queried on the box (see includes/segment_store.h)";
+
+static const snort::Parameter module_params[] = {
+    {"store_dir", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Directory the segments are written to, it must exist"},
+    {"serializer", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Serializer to use for generating output, one whose trees can be read "
+     "on their own (e.g. ndjson) lets queries return single trees"},
+    {"key", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Key of a node whose value is indexed, e.g. $.principal.addr.ip"},
+    {"segment_bytes", snort::Parameter::PT_INT, "1048576:max32", "67108864",
+     "Size of each segment file, a serialized tree must fit in one"},
+    {"max_bytes", snort::Parameter::PT_INT, "0:max53", "1073741824",
+     "Bytes of segments kept, the oldest are deleted to stay below it (0 = "
+     "no limit)"},
+    {"index_interval", snort::Parameter::PT_INT, "4096:16777216", "65536",
+     "Bytes of records between entries of the time index, a time is found "
+     "by scanning at most this much"},
+    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
+     "Max number of trees of each priority that will be queued before "
+     "discarding"},
+    {"queue_max_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "Max bytes of memory used by queued trees of each priority before "
+     "discarding (0 = no limit)"},
+    {"drop_policy", snort::Parameter::PT_ENUM, "oldest | newest | random_early",
+     "oldest",
+     "What is discarded when a queue is full, the oldest queued tree, the new "
+     "tree, or new trees at random once half full"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
+    {CountType::SUM, "logs_out", "Count of logs we wrote to the store"},
+    {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
+    {CountType::MAX, "max_queued",
+     "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "record_bytes", "Payload bytes written to the store"},
+    {CountType::SUM, "keyed", "Count of logs that had the indexed key"},
+    {CountType::SUM, "oversized",
+     "Count of logs discarded as they were larger than a segment"},
+    {CountType::SUM, "segments", "Count of segments started"},
+    {CountType::SUM, "segments_removed",
+     "Count of segments deleted due to max_bytes"},
+    {CountType::SUM, "write_errors",
+     "Count of segments that couldn't be created"},
+    {CountType::NOW, "store_bytes", "Bytes of segments in the store"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
+std::mutex peg_count_mutex; // Protects the peg counts
+struct PegCounts {
+  PegCount logs_in = 0;
+  PegCount logs_out = 0;
+  PegCount overflows = 0;
+  PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount record_bytes = 0;
+  PegCount keyed = 0;
+  PegCount oversized = 0;
+  PegCount segments = 0;
+  PegCount segments_removed = 0;
+  PegCount write_errors = 0;
+  PegCount store_bytes = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// MAIN object of this file
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
+  using clock = std::chrono::steady_clock;
+
+  std::mutex mutex; // Protects members
+
+  // Configs
+  std::string store_dir;
+  std::string key_name;
+  uint64_t max_bytes = 1073741824; // 0 = no limit
+  SegmentStore::Writer::Config segment_config;
+  LioLi::QueueAccount queue_account;
+
+  bool data_loss = false; // Set to true when we somehow discards data, or are
+                          // unsure if we did
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
+
+  // Accounts for what producers did to the queue since last call, must be
+  // called by the worker with mutex held
+  void account_queue() {
+    if (queue_account.take(queue, s_name, s_peg_counts, peg_count_mutex)) {
+      data_loss = true;
+    }
+  }
+
+  // Worker state, only used by run()
+  std::shared_ptr<LioLi::Serializer> serializer;
+  std::shared_ptr<LioLi::Serializer::Context> context;
+  uint32_t context_flags = 0; // Flags of the next record
+  LioLi::Tree::Key key;
+  std::unique_ptr<SegmentStore::Writer> segment;
+  bool store_opened = false;
+  uint64_t next_sequence = 0;
+  std::deque<std::pair<std::string, uint64_t>> segments; // Path and size,
+                                                         // oldest first
+  uint64_t store_bytes = 0;
+  clock::time_point retry_at; // When to try creating a segment again
+  bool create_failed = false; // Reported, until one is created
+  std::vector<LioLi::Tree> batch; // Trees taken from the queue
+
+  // Finds the segments of earlier runs, sealing the one being written if it
+  // wasn't, so they count against max_bytes and aren't overwritten
+  void open_store() {
+    store_opened = true;
+
+    if (!key_name.empty()) {
+      key = LioLi::Tree::compile_key(key_name);
+    }
+
+    for (auto &path : SegmentStore::list_segments(store_dir)) {
+      struct stat st;
+      uint64_t sequence;
+
+      if (::stat(path.c_str(), &st) != 0 ||
+          !SegmentStore::parse_segment_name(
+              path.substr(path.find_last_of('/') + 1), sequence)) {
+        continue;
+      }
+
+      if (!SegmentStore::Writer::recover(path)) {
+        snort::WarningMessage("WARNING: %s %s isn't a valid segment\n",
+                              s_name, path.c_str());
+      }
+
+      segments.emplace_back(path, st.st_size);
+      store_bytes += st.st_size;
+      next_sequence = sequence + 1;
+    }
+  }
+
+  // Deletes the oldest segments, beyond max_bytes, never the one written
+  void remove_old_segments() {
+    while (max_bytes != 0 && store_bytes > max_bytes && segments.size() > 1) {
+      auto &[path, size] = segments.front();
+
+      if (::unlink(path.c_str()) == 0 || errno == ENOENT) {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.segments_removed++;
+      } else {
+        snort::WarningMessage("WARNING: %s could not delete %s: %s\n", s_name,
+                              path.c_str(), std::strerror(errno));
+      }
+
+      store_bytes -= size;
+      segments.pop_front();
+    }
+
+    std::scoped_lock lock(peg_count_mutex);
+    s_peg_counts.store_bytes = store_bytes;
+  }
+
+  // Returns false if the segment couldn't be created
+  bool open_segment() {
+    if (!store_opened) {
+      open_store();
+    }
+
+    auto path = store_dir + "/" + SegmentStore::segment_name(next_sequence);
+
+    segment = std::make_unique<SegmentStore::Writer>(path, next_sequence,
+                                                     segment_config);
+
+    if (!segment->is_open()) {
+      if (!create_failed) {
+        snort::ErrorMessage("ERROR: %s could not create segment %s: %s\n",
+                            s_name, path.c_str(), std::strerror(errno));
+        create_failed = true;
+      }
+
+      segment.reset();
+      next_sequence++; // In case the name is taken
+
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.write_errors++;
+      return false;
+    }
+
+    create_failed = false;
+    next_sequence++;
+    segments.emplace_back(path, segment_config.segment_size);
+    store_bytes += segment_config.segment_size;
+
+    {
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.segments++;
+    }
+
+    remove_old_segments();
+
+    // Every segment starts with a fresh context, so it can be read on its
+    // own
+    context = serializer->create_context();
+    context_flags = SegmentStore::context_start;
+    return true;
+  }
+
+  void close_segment() {
+    // The end is dropped if there's no room for it
+    if (context) {
+      segment->append(context->close(), SegmentStore::context_end, now(),
+                      nullptr);
+      context.reset();
+    }
+
+    segment->seal();
+    segment.reset();
+  }
+
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // Appends tree to the segment, starting a new one if it's full, returns
+  // false if the tree was lost.  There must be a segment.
+  bool write(const LioLi::Tree &tree) {
+    uint64_t hash;
+    const uint64_t *key_hash = nullptr;
+
+    if (!key.empty() && tree.contains(key)) {
+      hash = SegmentStore::key_hash(tree.lookup(key));
+      key_hash = &hash;
+    }
+
+    for (bool fresh = false;; fresh = true) {
+      auto payload = context->serialize(std::move(tree));
+
+      if (segment->append(payload, context_flags, now(), key_hash)) {
+        context_flags = 0;
+
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_out++;
+        s_peg_counts.record_bytes += payload.size();
+        s_peg_counts.keyed += key_hash ? 1 : 0;
+        return true;
+      }
+
+      // Didn't fit in an empty segment either
+      if (fresh || payload.size() > segment->max_payload()) {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.oversized++;
+        return false;
+      }
+
+      // The tree goes in the next one
+      close_segment();
+
+      if (!open_segment()) {
+        retry_at = clock::now() + std::chrono::seconds(1);
+        return false;
+      }
+    }
+  }
+
+  // Writes what's queued, up to max_batches of 256 trees, returns false if a
+  // tree was lost
+  bool write_queued(std::size_t max_batches = SIZE_MAX) {
+    bool all_written = true;
+
+    for (std::size_t count = 0;
+         count < max_batches && segment && queue.pop_all(batch, 256) != 0;
+         count++) {
+      for (auto &tree : batch) {
+        all_written &= segment && write(tree);
+      }
+
+      batch.clear();
+
+      if (segment) {
+        segment->publish();
+      }
+    }
+
+    return all_written;
+  }
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
+    }
+
+    queue.finish_wait(); // Whatever woke us
+
+    if (!serializer && !terminate) {
+      serializer = LioLi::LogDB::get<LioLi::Serializer>(
+          segment_config.serializer.c_str());
+
+      if (serializer == serializer->get_null_obj()) {
+        serializer.reset();
+        wake_at(clock::now() + std::chrono::seconds(1));
+        return;
+      }
+    }
+
+    while (!terminate) {
+      if (!segment) {
+        if (clock::now() < retry_at) {
+          wake_at(retry_at);
+          return;
+        }
+
+        if (!open_segment()) {
+          retry_at = clock::now() + std::chrono::seconds(1);
+          continue;
+        }
+      }
+
+      {
+        std::scoped_lock lock(mutex);
+        account_queue();
+      }
+
+      // Bounded, so other tasks on the reactor thread get their turn
+      if (!write_queued(16)) {
+        std::scoped_lock lock(mutex);
+        data_loss = true;
+      }
+
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(clock::time_point::max());
+        return;
+      }
+
+      if (segment) {
+        wake(); // Come back for the rest
+        return;
+      }
+    }
+
+    // What's queued is written, it only takes copying
+    bool all_written = write_queued();
+
+    if (segment) {
+      close_segment();
+    }
+
+    unwatch(queue.get_event_fd());
+
+    {
+      std::scoped_lock lock(mutex);
+      account_queue();
+      data_loss |= !all_written || !queue.empty();
+      worker_done = true;
+    }
+    cv.notify_all();
+  }
+
+public:
+  Logger(const char *name) : LioLi::Logger(name) {}
+
+  ~Logger() { stop(); }
+
+  bool had_data_loss(bool clear_flag) override {
+    std::scoped_lock lock(mutex);
+
+    bool old_value = data_loss;
+
+    data_loss &= !clear_flag;
+
+    return old_value;
+  }
+
+  void operator<<(const LioLi::Tree &&tree) override {
+    log(std::move(tree), LioLi::Priority::normal);
+  }
+
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
+  }
+
+  bool is_valid() {
+    bool all_valid = true; // Assume all good
+
+    if (store_dir.empty()) {
+      snort::ErrorMessage("ERROR: no store_dir specified for %s\n",
+                          get_name());
+      all_valid = false;
+    }
+    if (segment_config.serializer.empty()) {
+      snort::ErrorMessage("ERROR: no serializer specified for %s\n",
+                          get_name());
+      all_valid = false;
+    }
+    if (segment_config.key.size() >= sizeof(SegmentStore::Header::key)) {
+      snort::ErrorMessage("ERROR: key is too long for %s\n", get_name());
+      all_valid = false;
+    }
+
+    return all_valid;
+  }
+
+  void set_serializer(const char *name) {
+    std::scoped_lock lock(mutex);
+
+    assert(segment_config.serializer.empty() ||
+           segment_config.serializer ==
+               name); // We do not handle changing of the serializer name
+
+    segment_config.serializer = name;
+  }
+
+  const std::string &get_serializer() { return segment_config.serializer; }
+
+  void set_store_dir(std::string dir) {
+    std::scoped_lock lock(mutex);
+
+    // Segment paths are made by appending their name
+    while (dir.size() > 1 && dir.ends_with('/')) {
+      dir.pop_back();
+    }
+
+    store_dir = dir;
+  }
+
+  const std::string &get_store_dir() { return store_dir; }
+
+  void set_key(std::string name) {
+    std::scoped_lock lock(mutex);
+    key_name = name;
+    segment_config.key = name;
+  }
+
+  void set_segment_bytes(uint64_t bytes) {
+    std::scoped_lock lock(mutex);
+    segment_config.segment_size = bytes;
+  }
+
+  void set_max_bytes(uint64_t bytes) {
+    std::scoped_lock lock(mutex);
+    max_bytes = bytes;
+  }
+
+  void set_index_interval(uint32_t bytes) {
+    std::scoped_lock lock(mutex);
+    segment_config.index_interval = bytes;
+  }
+
+  void set_max_queue_size(uint32_t max) {
+    std::scoped_lock lock(mutex);
+
+    assert(max > 0); // We need to be able to queue at least one element
+
+    for (std::size_t i = 0; i < LioLi::priority_count; i++) {
+      // If queue size is being reduced, trees might be dropped
+      if (auto dropped =
+              queue.set_capacity(max, static_cast<LioLi::Priority>(i))) {
+        snort::WarningMessage(
+            "WARNING: %s dropping %li trees from queue due to resize\n",
+            s_name, dropped);
+      }
+    }
+  }
+
+  void set_max_queue_bytes(uint64_t max) {
+    for (std::size_t i = 0; i < LioLi::priority_count; i++) {
+      queue.set_max_bytes(max, static_cast<LioLi::Priority>(i));
+    }
+  }
+
+  void set_drop_policy(LioLi::TreeRing::DropPolicy policy) {
+    for (std::size_t i = 0; i < LioLi::priority_count; i++) {
+      queue.set_drop_policy(policy, static_cast<LioLi::Priority>(i));
+    }
+  }
+
+  // Call after all configuration is done
+  void start() {
+    if (started) {
+      return;
+    }
+
+    terminate = false;
+    worker_done = false;
+    started = true;
+    Common::Reactor::get().add(*this);
+  }
+
+  // Call to terminate, what's queued is written first
+  void stop() {
+    // Check worker is running
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    wake();
+
+    {
+      std::unique_lock lock(mutex);
+
+      // Give worker a chance to go down gracefully, it never waits for
+      // anything, so this is only to be sure
+      cv.wait_for(lock, std::chrono::seconds(2),
+                  [this] { return worker_done; });
+    }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {
+    LioLi::LogDB::register_type<Logger>(s_name);
+  }
+
+  ~Module() {
+    // Stop worker
+    LioLi::LogDB::get<Logger>(s_name)->stop();
+  }
+
+  bool begin(const char *, int, snort::SnortConfig *) override { return true; }
+
+  bool end(const char *, int, snort::SnortConfig *) override {
+    auto logger = LioLi::LogDB::get<Logger>(s_name);
+    if (logger->is_valid()) {
+      // Start worker
+      logger->start();
+      return true;
+    }
+
+    return false;
+  }
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    auto logger = LioLi::LogDB::get<Logger>(s_name);
+    assert(logger); // Something went very wrong, if we can't find our self
+
+    if (val.is("store_dir") && val.get_as_string().size() > 0) {
+      if (!logger->get_store_dir().empty()) {
+        snort::ErrorMessage("ERROR: You can only set store_dir once in %s\n",
+                            s_name);
+        return false;
+      }
+
+      logger->set_store_dir(val.get_string());
+      return true;
+    } else if (val.is("serializer") && val.get_as_string().size() > 0) {
+      if (!logger->get_serializer().empty()) {
+        snort::ErrorMessage("ERROR: You can only set serializer once in %s\n",
+                            s_name);
+        return false;
+      }
+
+      logger->set_serializer(val.get_string());
+      return true;
+    } else if (val.is("key")) {
+      logger->set_key(val.get_string());
+      return true;
+    } else if (val.is("segment_bytes")) {
+      logger->set_segment_bytes(val.get_uint64());
+      return true;
+    } else if (val.is("max_bytes")) {
+      logger->set_max_bytes(val.get_uint64());
+      return true;
+    } else if (val.is("index_interval")) {
+      logger->set_index_interval(val.get_uint32());
+      return true;
+    } else if (val.is("queue_max")) {
+      logger->set_max_queue_size(val.get_uint32());
+      return true;
+    } else if (val.is("queue_max_bytes")) {
+      logger->set_max_queue_bytes(val.get_uint64());
+      return true;
+    } else if (val.is("drop_policy")) {
+      logger->set_drop_policy(
+          static_cast<LioLi::TreeRing::DropPolicy>(val.get_uint8()));
+      return true;
+    }
+
+    // fail if we didn't get something valid
+    return false;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static PegCounts static_pegs;
+
+    std::scoped_lock lock(peg_count_mutex);
+    static_pegs = s_peg_counts;
+
+    return reinterpret_cast<PegCount *>(&static_pegs);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace logger_store
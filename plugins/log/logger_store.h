@@ -0,0 +1,18 @@
+#ifndef logger_store_7e2c94d1
+#define logger_store_7e2c94d1
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace logger_store {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace logger_store
+
+#endif // #ifndef logger_store_7e2c94d1
@@ -3,21 +3,34 @@
 #include <framework/decode_data.h>
 #include <framework/inspector.h>
 #include <framework/module.h>
+#include <main/thread_config.h>
 
 // System includes
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <thread>
+#include <utility>
+#include <vector>
 
 // Local includes
 #include "lioli.h"
 #include "log_framework.h"
 #include "logger_tcp.h"
+#include "reactor.h"
+#include "serialization_pool.h"
+#include "spill_ring.h"
+#include "thread_stream.h"
+#include "tree_ring.h"
 
 // Debug includes
 
@@ -27,7 +40,7 @@ namespace {
 const char *s_name = "logger_tcp";
 const char *s_help = "Outputs LioLi trees over a tcp connection";
 
-const snort::Parameter module_params[] = {
+const snort::Parameter logger_params[] = {
     {"alias", snort::Parameter::PT_STRING, nullptr, nullptr,
      "The alias name for the logger with specific config"},
     {"output_ip", snort::Parameter::PT_IP4, nullptr, nullptr,
@@ -40,8 +53,6 @@ const snort::Parameter module_params[] = {
     {"output_port_env", snort::Parameter::PT_STRING, nullptr, nullptr,
      "Name of an environment variable containing the port number data should "
      "be written to"},
-    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
-     "Max number of trees that will be queued before discarding"},
     {"restart_interval_s", snort::Parameter::PT_INT, "0:86400", "0",
      "Seconds between restarting the serializer (max: 86400 s (1 day), 0 = "
      "never)), a restart will result in a new connection being made to the "
@@ -51,21 +62,81 @@ const snort::Parameter module_params[] = {
     {"retry_interval_ms", snort::Parameter::PT_INT, "10:10000", "100",
      "ms between retries after a log output tcp connection has been rejected "
      "or closed by the receiving side"},
+    {"serializer_threads", snort::Parameter::PT_INT, "0:64", "0",
+     "Number of threads serializing trees in parallel, when the serializer "
+     "supports it (0 = serialize on the writer thread)"},
+    {"per_thread", snort::Parameter::PT_BOOL, nullptr, "false",
+     "Every packet thread makes its own connection, and writes its trees to "
+     "it without any queue (trees from other threads use a shared "
+     "connection)"},
+    {"thread_buffer_max", snort::Parameter::PT_INT, "1024:268435456", "1048576",
+     "Max bytes of output a packet thread keeps while its connection is "
+     "blocked, before dropping trees (only with per_thread)"},
+    {"max_flush_latency_ms", snort::Parameter::PT_INT, "0:10000", "0",
+     "ms output may be held back, to be written together with later output "
+     "(0 = write as soon as nothing more is ready)"},
+    {"max_batch_bytes", snort::Parameter::PT_INT, "4096:67108864", "1048576",
+     "Max bytes gathered for one write to the connection"},
+    {"spill_dir", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Directory where serialized trees are kept, once the queue is half full, "
+     "while the server is down or slow, and sent from when it's back (not "
+     "set = trees are dropped)"},
+    {"spill_max_bytes", snort::Parameter::PT_INT, "65536:max53", "1073741824",
+     "Max bytes kept in spill_dir, the oldest segments are deleted to make "
+     "room"},
+    {"spill_segment_bytes", snort::Parameter::PT_INT, "65536:max53",
+     "16777216", "Bytes of a spill file, the unit of spill_max_bytes"},
+    {"spill_fsync", snort::Parameter::PT_ENUM, "never | segment | write",
+     "segment",
+     "When spill files are synced to disk, never, when a segment is full or "
+     "after every write"},
 
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
+// With the queue settings, see tree_ring.h
+const std::vector<snort::Parameter> module_params =
+    LioLi::with_queue_params(logger_params);
+
 const PegInfo s_pegs[] = {
     {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
     {CountType::SUM, "logs_out", "Count of logs we sent on the connection"},
     {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
     {CountType::MAX, "max_queued",
      "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "high_overflows",
+     "Count of high priority logs we discarded due to overflow"},
+    {CountType::SUM, "normal_overflows",
+     "Count of normal priority logs we discarded due to overflow"},
+    {CountType::SUM, "bulk_overflows",
+     "Count of bulk logs we discarded due to overflow"},
     {CountType::SUM, "write_errors", "Count of write errors detected"},
     {CountType::SUM, "restarts", "Count of (re)starts of the serializer"},
     {CountType::SUM, "epoll_err", "Number of errors from epoll"},
     {CountType::SUM, "would_block",
      "Number of time we couldn't write to a socket that we were told was "
      "writable"},
+    {CountType::SUM, "writes", "Number of writes to the socket"},
+    {CountType::SUM, "written_bytes", "Bytes written to the socket"},
+    {CountType::NOW, "avg_write_bytes",
+     "Average bytes per write to the socket, written_bytes / writes"},
+    {CountType::MAX, "max_pool_queued",
+     "Max number of batches ever waiting for a serializer thread"},
+    {CountType::MAX, "max_pool_reordered",
+     "Max number of serialized batches ever waiting for an earlier batch"},
+    {CountType::SUM, "logs_spilled",
+     "Count of logs we kept in the spill, rather than discarding"},
+    {CountType::SUM, "spilled_bytes", "Bytes written to the spill"},
+    {CountType::SUM, "replayed_bytes",
+     "Bytes read from the spill and sent on the connection"},
+    {CountType::SUM, "spill_dropped_bytes",
+     "Bytes deleted from the spill before being sent"},
+    {CountType::NOW, "spill_bytes", "Bytes kept in the spill, when last checked"},
     {CountType::END, nullptr, nullptr}};
 
 // This must match the s_pegs[] array
@@ -76,10 +147,26 @@ struct PegCounts {
   PegCount logs_out = 0;
   PegCount overflows = 0;
   PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount high_overflows = 0;
+  PegCount normal_overflows = 0;
+  PegCount bulk_overflows = 0;
   PegCount write_errors = 0;
   PegCount restarts = 0;
   PegCount epoll_err = 0;
   PegCount would_block = 0;
+  PegCount writes = 0;
+  PegCount written_bytes = 0;
+  PegCount avg_write_bytes = 0;
+  PegCount max_pool_queued = 0;
+  PegCount max_pool_reordered = 0;
+  PegCount logs_spilled = 0;
+  PegCount spilled_bytes = 0;
+  PegCount replayed_bytes = 0;
+  PegCount spill_dropped_bytes = 0;
+  PegCount spill_bytes = 0;
 } s_peg_counts;
 
 // Compile time sanity check of number of entries in s_pegs and s_peg_counts
@@ -88,8 +175,18 @@ static_assert(
         sizeof(PegCounts) / sizeof(PegCount),
     "Entries in s_pegs doesn't match number of entries in s_peg_counts");
 
+// Adds the counts of a packet thread's own connection
+void add_thread_counts(const LioLi::ThreadStream::Counts &counts) {
+  std::scoped_lock lock(peg_count_mutex);
+  s_peg_counts.logs_in += counts.logs_in;
+  s_peg_counts.logs_out += counts.logs_out;
+  s_peg_counts.overflows += counts.overflows;
+  s_peg_counts.write_errors += counts.write_errors;
+  s_peg_counts.restarts += counts.restarts;
+}
+
 // MAIN object of this file
-class Logger : public LioLi::Logger {
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
   using clock = std::chrono::steady_clock;
 
   std::mutex mutex; // Protects members
@@ -98,91 +195,74 @@ class Logger : public LioLi::Logger {
   std::string serializer_name;
   uint16_t port;
   uint32_t ipv4;
-  uint32_t max_queue_size = 1;
   uint32_t serializer_restart_interval_s = 0; // 0 = never
-  uint64_t dropped_sequence_count =
-      0; // Counts the number of packages dropped in this sequence
+  LioLi::QueueAccount queue_account; // Only used by the worker
   uint32_t retry_interval_ms = 100;
-
-  std::deque<LioLi::Tree> queue;
-
-  // Worker thread controls
-  std::thread worker_thread;
-  std::condition_variable cv; // Used to enable worker to sleep when there
-                              // aren't anything for it to do
-  bool terminate = false;     // Set to true if worker loop should be terminated
-  bool worker_done = false;   // Worker won't block anymore
+  uint32_t serializer_threads = 0; // 0 = serialize on the worker thread
+  bool per_thread = false;
+  uint32_t thread_buffer_max = 1048576;
+  uint32_t max_flush_latency_ms = 0; // 0 = write once nothing more is ready
+  std::size_t max_batch_bytes = 1048576; // Max bytes gathered for a write
+  std::string spill_dir; // Empty = no spill
+  uint64_t spill_max_bytes = 0;
+  uint64_t spill_segment_bytes = 0;
+  LioLi::SpillRing::Sync spill_sync = LioLi::SpillRing::Sync::segment;
+
+  // Bytes read from the spill at a time, when replaying
+  static constexpr std::size_t spill_read_size = 262144;
+
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+  LioLi::ThreadStreams streams; // Connections of packet threads, if per_thread
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
   bool data_loss = false;     // Set to true when we might have lost data
 
   class Socket {
     // NOTE: Calling functions in this class has a lot of sideeffects, use with
     // caution
+    Logger &logger; // Whose reactor task watches the socket
     uint32_t ipv4;
     uint16_t port;
 
-    int epfd = epoll_create1(EPOLL_CLOEXEC); // epoll socket
-    int osocket = -1;                        // Socket used for communication
-    std::string output_string; // What we are currently trying to write
-    ssize_t output_index = 0; // Place in output_string that we are writing from
+    int osocket = -1;                // Socket used for communication
+    std::deque<std::string> outputs; // What we are trying to write, in order
+    std::size_t output_index = 0; // Place in outputs.front() we write from
+    std::size_t output_bytes = 0; // Bytes in outputs not yet written
+    uint64_t queued_total = 0;    // Bytes ever queued on this connection
+    clock::time_point first_queued; // When the oldest of outputs was queued
+    bool writable = false; // The last write took everything we gave it
     std::string my_name;
 
-    bool add_socket_to_epoll() {
-      // Create epool struct corresponding to this socket
-      epoll_event ev;
-
-      ev.events = EPOLLOUT;
-      ev.data.fd = osocket;
-
-      if (::epoll_ctl(epfd, EPOLL_CTL_ADD, osocket, &ev)) {
-        snort::ParseError("TCP Logger connection error (Could not add socket "
-                          "to epoll for: %s reason: %s)\n",
-                          my_name.c_str(), std::strerror(errno));
-        return false;
-      }
-      return true;
-    }
-
-    bool remove_socket_from_epoll() {
-      // Create epool struct corresponding to this socket
-      epoll_event ev;
-
-      ev.events = EPOLLOUT;
-      ev.data.fd = osocket;
-
-      if (::epoll_ctl(epfd, EPOLL_CTL_DEL, osocket, &ev)) {
-        snort::ParseError("TCP Logger connection error (Could not remove "
-                          "socket from epoll for: %s reason: %s)\n",
-                          my_name.c_str(), std::strerror(errno));
-        return false;
-      }
-      return true;
-    }
+    // Max buffers gathered by one write
+    static constexpr int max_iov = 256;
 
     void close_socket() {
 
       if (-1 != osocket) {
-        remove_socket_from_epoll(); // Just to be nice, the ::close should also
-                                    // to this
+        logger.unwatch(osocket);
         ::close(osocket);
       }
 
       osocket = -1;
+      writable = false;
 
       // We never split an output over multiple connections
-      output_string.clear();
+      outputs.clear();
       output_index = 0;
+      output_bytes = 0;
+      queued_total = 0;
     }
 
   public:
-    Socket(uint32_t ipv4, uint16_t port, std::string my_name)
-        : ipv4(ipv4), port(port), my_name(my_name) {
-      assert(-1 != epfd);
-    }
+    Socket(Logger &logger, uint32_t ipv4, uint16_t port, std::string my_name)
+        : logger(logger), ipv4(ipv4), port(port), my_name(my_name) {}
 
-    ~Socket() {
-      close_socket();
-      ::close(epfd);
-    }
+    ~Socket() { close_socket(); }
 
     bool connect() {
       close_socket(); // Make sure we are in a known state
@@ -203,80 +283,119 @@ class Logger : public LioLi::Logger {
         return false;
       }
 
-      add_socket_to_epoll();
-
       return true;
     }
 
     operator bool() const { return (-1 != osocket); }
 
-    // Returns -1 on fatal error, 0 on restart loop, 1 if socket writeable
-    int epoll_wait(uint32_t retry_interval_ms) {
-      // Wait for something to happen with the socket
-      epoll_event wait_ev;
-      int epwret = ::epoll_wait(epfd, &wait_ev, 1, 1000 /* max ms to wait */);
+    // Returns -1 if the socket was closed, 0 if it isn't writable yet, and
+    // the caller should watch it, 1 if socket writeable
+    int poll() {
+      pollfd pfd = {osocket, POLLOUT, 0};
+      int ret = ::poll(&pfd, 1, 0);
 
-      if (0 == epwret) {
+      if (0 == ret) {
         return 0;
-      } else if (-1 == epwret) {
-        snort::ParseError("TCP Logger connection error (Epoll wait returned "
-                          "with error for: %s reason: %s)\n",
+      } else if (-1 == ret) {
+        snort::ParseError("TCP Logger connection error (Poll returned with "
+                          "error for: %s reason: %s)\n",
                           my_name.c_str(), std::strerror(errno));
 
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.epoll_err++;
+        }
+        close_socket();
         return -1;
       }
 
-      assert(1 == epwret); // if anything excpet 1 is seen at this point we have
-                           // a programming or fatal error
-
-      if (wait_ev.events & (EPOLLHUP | EPOLLERR)) {
-        if (wait_ev.events & EPOLLERR) {
+      if (pfd.revents & (POLLHUP | POLLERR)) {
+        if (pfd.revents & POLLERR) {
           std::scoped_lock lock(peg_count_mutex);
           s_peg_counts.epoll_err++;
         }
         close_socket();
-        std::this_thread::sleep_for(
-            std::chrono::milliseconds(retry_interval_ms));
-        return 0;
+        return -1;
       }
 
-      assert(wait_ev.events & EPOLLOUT); // If this fires, there is some
-                                         // condition we aren't handling
+      assert(pfd.revents & POLLOUT); // If this fires, there is some condition
+                                     // we aren't handling
 
+      writable = true;
       return 1;
     }
 
+    int fd() const { return osocket; }
+
+    // True if we must wait for the socket before writing, it's connecting or
+    // didn't take all of the last write
+    bool blocked() const { return !writable; }
+
     void queue(std::string &&input) {
-      assert(output_string.empty());
-      output_string = input;
+      if (input.empty()) {
+        return;
+      }
+
+      if (outputs.empty()) {
+        first_queued = clock::now();
+      }
+
+      output_bytes += input.size();
+      queued_total += input.size();
+      outputs.push_back(std::move(input));
+    }
+
+    // Bytes queued but not yet written
+    std::size_t pending() const { return output_bytes; }
+
+    // Bytes ever queued and written on this connection, written() reaching
+    // what queued() was after a queue() tells that output went out
+    uint64_t queued() const { return queued_total; }
+    uint64_t written() const { return queued_total - output_bytes; }
+
+    // When what's pending has been held back for latency
+    clock::time_point flush_deadline(std::chrono::milliseconds latency) const {
+      return first_queued + latency;
     }
 
+    // Writes what's pending, gathering up to max_bytes of it per write.
     // Returns true if flush was complete, false if loop should be restarted
     // NOTE: Flush is only for our internal stuff, it's not a connection flush
-    bool flush(bool has_more) {
-      // Output what we are waiting to output
-      if (static_cast<ssize_t>(output_string.length()) > output_index) {
-        ssize_t remaining = output_string.length() - output_index;
-        ssize_t bytes = ::send(osocket, output_string.data() + output_index,
-                               remaining, (has_more) ? 0 : MSG_MORE);
-
-        if (bytes >= 0) {
-          assert(remaining <= bytes);
-
-          // All was not sent
-          if (remaining > bytes) {
-            output_index += bytes;
-            return false;
-          }
+    bool flush(std::size_t max_bytes) {
+      while (output_bytes != 0) {
+        iovec iov[max_iov];
+        int count = 0;
+        std::size_t bytes = 0;
+        std::size_t index = output_index;
+
+        for (auto itr = outputs.begin();
+             itr != outputs.end() && count < max_iov && bytes < max_bytes;
+             itr++) {
+          iov[count].iov_base = itr->data() + index;
+          iov[count].iov_len = std::min(itr->size() - index, max_bytes - bytes);
+          bytes += iov[count].iov_len;
+          index = 0;
+          count++;
+        }
+
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
 
-          // All was sent
-          output_string.clear();
-          output_index = 0;
-          return true;
-        } else {                                // Some error
+        // Only hint at more when we already have it, or a lone partial
+        // segment could be held back
+        ssize_t sent = ::sendmsg(osocket, &msg,
+                                 MSG_NOSIGNAL |
+                                     (bytes < output_bytes ? MSG_MORE : 0));
+
+        if (sent < 0) {
           static_assert(EAGAIN == EWOULDBLOCK); // Holds true on Linux, fix if
                                                 // new platform is introduced
-          if (errno == EWOULDBLOCK) {
+          if (errno == EINTR) {
+            continue;
+          } else if (errno == EWOULDBLOCK) {
+            writable = false;
+
             std::scoped_lock lock(peg_count_mutex);
             s_peg_counts.would_block++;
           } else {
@@ -284,37 +403,229 @@ class Logger : public LioLi::Logger {
           }
           return false;
         }
+
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.writes++;
+          s_peg_counts.written_bytes += sent;
+          s_peg_counts.avg_write_bytes =
+              s_peg_counts.written_bytes / s_peg_counts.writes;
+        }
+
+        consume(sent);
+
+        // All was not sent
+        if (static_cast<std::size_t>(sent) < bytes) {
+          writable = false;
+          return false;
+        }
       }
+
       return true;
     }
+
+  private:
+    void consume(std::size_t bytes) {
+      output_bytes -= bytes;
+
+      while (bytes != 0) {
+        std::size_t left = outputs.front().size() - output_index;
+
+        if (bytes < left) {
+          output_index += bytes;
+          return;
+        }
+
+        bytes -= left;
+        outputs.pop_front();
+        output_index = 0;
+      }
+    }
   };
 
-  void worker_loop() {
-    std::shared_ptr<LioLi::Serializer> serializer;
+  // Accounts for what producers did to the queue since last call, worker only
+  void account_queue() {
+    if (queue_account.take(queue, get_name(), s_peg_counts, peg_count_mutex)) {
+      std::scoped_lock lock(mutex);
+      data_loss = true;
+    }
+  }
 
-    // Don't do anything until we have our serializer
-    while (!terminate) {
-      serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+  // Moves everything queued to the spill, serialized on context which is
+  // closed when the segment is full, worker only
+  void spill_queue(LioLi::SpillRing &spill, LioLi::Serializer &serializer,
+                   std::shared_ptr<LioLi::Serializer::Context> &context,
+                   std::vector<LioLi::Tree> &batch,
+                   LioLi::Serializer::Sink &sink) {
+    if (!spill.reserve()) {
+      return; // Trees are left for the queue to drop
+    }
+
+    if (!context) {
+      context = serializer.create_context();
+    }
 
-      if (serializer != serializer->get_null_obj())
-        break;
+    queue.pop_all(batch);
+    context->serialize_batch(batch, sink);
 
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    bool written = spill.write(sink.buffer());
+    sink.clear();
+
+    if (written && spill.segment_full()) {
+      written = spill.write(context->close());
+      context.reset();
+      spill.seal();
+    }
+
+    std::scoped_lock lock(peg_count_mutex);
+
+    if (written) {
+      s_peg_counts.logs_spilled += batch.size();
+    } else {
+      // The segment is gone, and with it our context
+      context.reset();
+      s_peg_counts.overflows += batch.size();
     }
 
-    std::chrono::time_point<clock>
-        next_timeout; // Keeps track of when we should restart serializer
-                      // context
-    std::shared_ptr<LioLi::Serializer::Context> context;
-    Socket socket(ipv4, port, get_name());
+    batch.clear();
+  }
+
+  // Acknowledges the reads from the spill that the socket has written
+  void acknowledge_spill() {
+    while (!spill_sent.empty() &&
+           spill_sent.front().first <= socket->written()) {
+      spill->acknowledge(spill_sent.front().second);
+      spill_sent.pop_front();
+    }
+  }
+
+  // Accounts for what happened to the spill since last call, worker only
+  void account_spill(LioLi::SpillRing &spill) {
+    auto stats = spill.take_stats();
+
+    if (stats.dropped != 0) {
+      snort::WarningMessage("WARNING: %s dropped %lu spilled bytes\n",
+                            get_name(), stats.dropped);
+
+      std::scoped_lock lock(mutex);
+      data_loss = true;
+    }
+
+    std::scoped_lock lock(peg_count_mutex);
+    s_peg_counts.spilled_bytes += stats.spilled;
+    s_peg_counts.replayed_bytes += stats.replayed;
+    s_peg_counts.spill_dropped_bytes += stats.dropped;
+    s_peg_counts.spill_bytes = stats.bytes;
+  }
+
+  // Worker state, only used by run()
+  std::shared_ptr<LioLi::Serializer> serializer;
+  std::chrono::time_point<clock>
+      next_timeout; // Keeps track of when we should restart serializer
+                    // context
+  std::shared_ptr<LioLi::Serializer::Context> context;
+  std::unique_ptr<Socket> socket;
+  clock::time_point retry_at; // When to connect again after losing connection
+  std::vector<LioLi::Tree> batch; // Trees taken from the queue
+  LioLi::Serializer::Sink sink;
+  std::unique_ptr<LioLi::SerializationPool> pool;
+  bool context_used = false; // The first batch of a context is serialized
+                             // on it, later ones on batch contexts
+  std::string output;
+  std::unique_ptr<LioLi::SpillRing> spill;
+  std::shared_ptr<LioLi::Serializer::Context> spill_context;
+  // Reads from the spill on the socket, by the socket's queued() after them
+  // and their size, until written
+  std::deque<std::pair<uint64_t, std::size_t>> spill_sent;
+
+  // Sets up what the worker needs, returns false if the serializer isn't
+  // there yet
+  bool init_worker() {
+    serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+
+    if (serializer == serializer->get_null_obj()) {
+      serializer.reset();
+      return false;
+    }
+
+    socket = std::make_unique<Socket>(*this, ipv4, port, get_name());
+
+    // Serializes in parallel if configured, leaving us to only write
+    pool = LioLi::SerializationPool::create(serializer, serializer_threads,
+                                            [this]() { queue.kick(); });
+
+    // Keeps the output on disk while the server is down or slow, if configured
+    if (!spill_dir.empty()) {
+      spill = std::make_unique<LioLi::SpillRing>(spill_dir, get_name(),
+                                                 spill_max_bytes,
+                                                 spill_segment_bytes,
+                                                 spill_sync);
+    }
+
+    return true;
+  }
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
+    }
+
+    queue.finish_wait(); // Whatever woke us
+
+    // Don't do anything until we have our serializer
+    if (!serializer && !terminate && !init_worker()) {
+      wake_at(clock::now() + std::chrono::milliseconds(100));
+      return;
+    }
+
+    // Bounded, so other tasks on the reactor thread get their turn
+    constexpr int max_batches = 16;
+    int budget = max_batches;
 
     // Main loop
     while (!terminate) {
-      if (!socket) {
-        socket.connect();
+      if (budget-- <= 0) {
+        wake(); // Come back for the rest
+        return;
+      }
+
+      // Rather than letting the queue overflow
+      if (spill) {
+        acknowledge_spill();
+
+        if (queue.fill() >= 0.5) {
+          spill_queue(*spill, *serializer, spill_context, batch, sink);
+        }
+
+        account_spill(*spill);
+      }
+
+      if (!*socket) {
+        // Give the server a break after it closed the connection
+        if (clock::now() < retry_at) {
+          wake_at(retry_at);
+          return;
+        }
+
+        if (!socket->connect()) {
+          retry_at =
+              clock::now() + std::chrono::milliseconds(retry_interval_ms);
+          continue;
+        }
 
         // A new connection should always start a new context
         context.reset();
+        if (pool) {
+          pool->discard(); // Belongs to the old connection
+        }
+        if (spill) {
+          // What was read but not written goes again, from the start of its
+          // segment as that might have gone to the old connection
+          spill->rewind();
+          spill_sent.clear();
+        }
 
         // This might set the data_loss too frequently, but it's only a help,
         // not a promise
@@ -322,36 +633,74 @@ class Logger : public LioLi::Logger {
         data_loss = true;
       }
 
-      // Wait for something to happen with the socket
-      switch (socket.epoll_wait(retry_interval_ms)) {
-      case 0:
-        continue; // socket is not ready/might need to be recreated
-      case -1:
-        goto while_end; // unhandled error, exit loop
-      default:
-        break; // socket is ready for writing
+      if (socket->blocked()) {
+        // Wait for something to happen with the socket
+        switch (socket->poll()) {
+        case 0:
+          // With a spill we must look at the queue more often, it's only half
+          // empty when we start spilling
+          watch(socket->fd(), EPOLLOUT);
+          wake_at(clock::now() +
+                  std::chrono::milliseconds(spill ? 100 : 1000));
+          return;
+        case -1:
+          retry_at =
+              clock::now() + std::chrono::milliseconds(retry_interval_ms);
+          continue; // socket is closed, and will be recreated
+        default:
+          break; // socket is ready for writing
+        }
+
+        // Flush what the socket didn't take
+        if (!socket->flush(max_batch_bytes)) {
+          continue; // Couldn't write what was stored, socket might be closed
+        }
       }
 
-      // Flush what we have stored
-      bool has_more;
-      {
-        std::scoped_lock lock(mutex);
-        has_more = !queue.empty();
+      // Output is gathered until there's enough for a write
+      if (socket->pending() >= max_batch_bytes) {
+        socket->flush(max_batch_bytes);
+        continue;
       }
 
-      if (!socket.flush(has_more)) {
-        continue; // Couldn't write what was stored, socket might be closed
+      // The spill is older than anything queued, but newer than what's with
+      // the pool.  It's whole contexts, so it goes between ours.
+      if (spill && !spill->empty() && !(pool && pool->outstanding())) {
+        if (context) {
+          socket->queue(context->close());
+          context.reset();
+          continue; // Will eventually be written
+        }
+
+        if (spill_context) {
+          spill->write(spill_context->close());
+          spill_context.reset();
+        }
+        spill->seal();
+        acknowledge_spill();
+
+        if (spill->read(output, spill_read_size)) {
+          spill_sent.emplace_back(socket->queued() + output.size(),
+                                  output.size());
+          socket->queue(std::move(output));
+          continue; // Will eventually be written
+        }
       }
 
-      // Ensure we have a valid context
-      if (next_timeout <= clock::now() || !context) {
+      bool replaying = spill && !spill->empty();
+
+      // Ensure we have a valid context, all batches of a context must be
+      // written before it's closed
+      if ((next_timeout <= clock::now() && !(pool && pool->outstanding())) ||
+          !context) {
         if (context) {
-          socket.queue(context->close());
+          socket->queue(context->close());
           context.reset();
-          continue; // Will eventually reach the flush
+          continue; // Will eventually be written
         }
 
         context = serializer->create_context();
+        context_used = false;
         if (serializer_restart_interval_s != 0) {
           next_timeout = clock::now() +
                          std::chrono::seconds(serializer_restart_interval_s);
@@ -363,29 +712,103 @@ class Logger : public LioLi::Logger {
         s_peg_counts.restarts++;
       }
 
-      std::unique_lock lock(mutex);
+      account_queue();
 
-      if (!queue.empty()) {
-        if (dropped_sequence_count != 0) {
-          snort::WarningMessage(
-              "WARNING: %s droped %lu tree(s) from queue, resuming output\n",
-              get_name(), dropped_sequence_count);
-          dropped_sequence_count = 0;
+      if (!replaying && !queue.empty() && pool) {
+        while (budget > 0 && queue.pop_all(batch, pool->batch_size) != 0) {
+          budget--;
+          auto queued =
+              pool->submit(std::move(batch), context_used ? nullptr : context);
+          context_used = true;
+          batch.clear();
+
+          std::scoped_lock lock(peg_count_mutex);
+          if (s_peg_counts.max_pool_queued < queued) {
+            s_peg_counts.max_pool_queued = queued;
+          }
+        }
+      } else if (!replaying && !queue.empty()) {
+        // Everything queued is serialized as one batch, and sent at once
+        queue.pop_all(batch);
+
+        context->serialize_batch(batch, sink);
+        socket->queue(std::move(sink.buffer()));
+        sink.clear();
+
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.logs_out += batch.size();
         }
-        socket.queue(context->serialize(std::move(queue.front())));
-        queue.pop_front();
-        continue; // Will eventually send
+
+        batch.clear();
+        continue; // Will eventually be written
+      }
+
+      std::size_t tree_count;
+      std::size_t waiting;
+
+      if (pool && pool->take(output, tree_count, waiting)) {
+        socket->queue(std::move(output));
+
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_out += tree_count;
+        if (s_peg_counts.max_pool_reordered < waiting) {
+          s_peg_counts.max_pool_reordered = waiting;
+        }
+        continue; // Will eventually be written
       }
 
-      cv.wait_until(lock, next_timeout,
-                    [this] { return terminate || !queue.empty(); });
+      // While batches are outstanding the pool wakes us, and we can't restart
+      // the context anyway
+      auto wake_time = (pool && pool->outstanding())
+                           ? std::chrono::time_point<clock>::max()
+                           : next_timeout;
+
+      // Nothing more is ready, what's gathered is written once it has been
+      // held back long enough
+      if (socket->pending() != 0) {
+        auto flush_at = socket->flush_deadline(
+            std::chrono::milliseconds(max_flush_latency_ms));
+
+        if (flush_at <= clock::now()) {
+          socket->flush(max_batch_bytes);
+          continue;
+        }
+
+        wake_time = std::min(wake_time, flush_at);
+      }
+
+      if (replaying) {
+        // The queue keeps trees for after the spill, so only the pool's kick
+        // wakes us, not what's queued.  The queue is still looked at now and
+        // then, as it's only half empty when we start spilling.
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(std::min(wake_time,
+                         clock::now() + std::chrono::milliseconds(100)));
+        return;
+      }
+
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(wake_time);
+        return;
+      }
     }
-  while_end:
 
-  {
-    std::unique_lock lock(mutex);
-    worker_done = true;
-  }
+    if (spill && !spill->empty()) {
+      snort::WarningMessage("WARNING: %s discarding %lu spilled bytes\n",
+                            get_name(), spill->take_stats().bytes);
+    }
+
+    unwatch(queue.get_event_fd());
+    pool.reset();
+    socket.reset();
+    spill.reset();
+
+    {
+      std::unique_lock lock(mutex);
+      worker_done = true;
+    }
     cv.notify_all();
   }
 
@@ -402,43 +825,23 @@ public:
 
     data_loss &= !clear_flag;
 
-    return old_value;
+    return streams.had_data_loss(clear_flag) || old_value;
   }
 
   void operator<<(const LioLi::Tree &&tree) override {
-    {
-      std::scoped_lock lock(mutex);
-
-      assert(max_queue_size > 0);
-
-      // Reduce size of the queue until there is space for the new element
-      while (queue.size() > max_queue_size - 1) {
-        if (dropped_sequence_count++ == 0) {
-          snort::WarningMessage("WARNING: %s dropping tree(s) from queue\n",
-                                get_name());
-        }
-        queue.pop_front();
-        data_loss = true;
-        {
-          std::scoped_lock lock(peg_count_mutex);
-          s_peg_counts.overflows++;
-        }
-      }
-
-      queue.push_back(std::move(tree));
-
-      {
-        std::scoped_lock lock(peg_count_mutex);
-        if (s_peg_counts.max_queued < queue.size()) {
-          s_peg_counts.max_queued = queue.size();
-        }
+    log(std::move(tree), LioLi::Priority::normal);
+  }
 
-        s_peg_counts.logs_in++;
-      }
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Packet threads with their own connection, bypass the queue, and so don't
+    // need a priority
+    if (auto stream = streams.get()) {
+      stream->write(tree);
+      return;
     }
 
-    // Kick worker
-    cv.notify_all();
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
   }
 
   void set_serializer(const char *name) {
@@ -453,22 +856,15 @@ public:
 
   const std::string &get_serializer() { return serializer_name; }
 
-  void set_max_queue_size(uint32_t max) {
+  void set_queue_config(const LioLi::QueueConfig &config) {
     std::scoped_lock lock(mutex);
 
-    assert(max > 0); // We need to be able to queue at least one element
-
-    // If queue size is being reduced, reduce it
-    if (queue.size() > max) {
+    // If queue size is being reduced, trees might be dropped
+    if (auto dropped = queue.configure(config)) {
       snort::WarningMessage(
           "WARNING: %s dropping %li trees from queue due to resize\n", s_name,
-          queue.size() - max);
+          dropped);
     }
-    while (queue.size() > max) {
-      queue.pop_front();
-    }
-
-    max_queue_size = max;
   }
 
   void set_serializer_restart_interval_s(uint32_t interval) {
@@ -478,7 +874,7 @@ public:
       serializer_restart_interval_s = interval;
     }
     // Kick worker
-    cv.notify_all();
+    queue.kick();
   }
 
   void set_port(uint16_t port) { this->port = port; }
@@ -489,44 +885,119 @@ public:
     retry_interval_ms = retry_interval;
   }
 
+  void set_serializer_threads(uint32_t threads) {
+    serializer_threads = threads;
+  }
+
+  void set_per_thread(bool enable, uint32_t buffer_max) {
+    per_thread = enable;
+    thread_buffer_max = buffer_max;
+  }
+
+  bool is_per_thread() const { return per_thread; }
+
+  void set_batching(uint32_t flush_latency_ms, std::size_t batch_bytes) {
+    max_flush_latency_ms = flush_latency_ms;
+    max_batch_bytes = batch_bytes;
+  }
+
+  void set_spill(std::string dir, uint64_t max_bytes, uint64_t segment_bytes,
+                 LioLi::SpillRing::Sync sync) {
+    spill_dir = dir;
+    spill_max_bytes = max_bytes;
+    spill_segment_bytes = segment_bytes;
+    spill_sync = sync;
+  }
+
+  // Connects the calling packet thread, if configured
+  void thread_init() {
+    if (!per_thread) {
+      return;
+    }
+
+    auto serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+
+    if (serializer == serializer->get_null_obj()) {
+      return; // Trees will go through the queue
+    }
+
+    // Writes fail with EAGAIN until the connection is up, and it's retried
+    // after retry_interval_ms if it fails
+    auto opener = [ipv4 = ipv4, port = port]() {
+      int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+      if (fd == -1) {
+        return -1;
+      }
+
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(port);
+      addr.sin_addr.s_addr = ipv4;
+
+      if (::connect(fd, (sockaddr *)&addr, sizeof(addr)) &&
+          errno != EINPROGRESS) {
+        ::close(fd);
+        return -1;
+      }
+
+      return fd;
+    };
+
+    streams.open(std::make_unique<LioLi::ThreadStream>(
+        serializer, opener, add_thread_counts, thread_buffer_max,
+        serializer_restart_interval_s, retry_interval_ms));
+  }
+
+  void thread_term() { streams.close(); }
+
   // Call after all configuration is done
   void start() {
+    if (per_thread) {
+      streams.resize(snort::ThreadConfig::get_instance_max());
+    }
+
     terminate = false;
     worker_done = false;
-    worker_thread = std::thread{&Logger::worker_loop, this};
+    started = true;
+    Common::Reactor::get().add(*this);
   }
 
   // Call to terminate
   void stop() {
     // Check worker is running
-    if (worker_thread.joinable()) {
-      std::unique_lock lock(mutex);
+    if (!started) {
+      return;
+    }
 
-      // If thread hasn't killed it self
-      if (!worker_done) {
-        terminate = true;
+    {
+      std::unique_lock lock(mutex);
+      terminate = true;
+    }
 
-        // Kick worker, we do not release the lock, as we need to reach
-        // wait_for(..) before the worker is allowed to continue
-        cv.notify_all();
+    wake();
 
-        // Give worker a chance to go down gracefully
-        cv.wait_for(lock, std::chrono::seconds(2),
-                    [this] { return worker_done; });
+    {
+      std::unique_lock lock(mutex);
 
-        if (!worker_done) {
-          // Still not done, set it free
-          worker_thread.detach();
-          return;
-        }
-      }
-      worker_thread.join();
+      // Give worker a chance to go down gracefully, it never blocks, so this
+      // is only to be sure
+      cv.wait_for(lock, std::chrono::seconds(2),
+                  [this] { return worker_done; });
     }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
   }
 };
 
+// Loggers with a connection per packet thread, connected and closed by the
+// tinit and tterm of the packet threads
+std::mutex thread_loggers_mutex;
+std::vector<std::shared_ptr<Logger>> thread_loggers;
+
 class Module : public snort::Module {
-  Module() : snort::Module(s_name, s_help, module_params) {}
+  Module() : snort::Module(s_name, s_help, module_params.data()) {}
 
   ~Module() {}
 
@@ -534,9 +1005,18 @@ class Module : public snort::Module {
     std::string name;
     uint32_t ipv4 = 0;
     uint16_t port = 0;
-    uint32_t queue_limit;
+    LioLi::QueueConfig queue;
     uint32_t restart_interval;
     uint32_t retry_interval;
+    uint32_t serializer_threads = 0;
+    bool per_thread = false;
+    uint32_t thread_buffer_max = 1048576;
+    uint32_t max_flush_latency_ms = 0;
+    uint32_t max_batch_bytes = 1048576;
+    std::string spill_dir;
+    uint64_t spill_max_bytes = 1073741824;
+    uint64_t spill_segment_bytes = 16777216;
+    LioLi::SpillRing::Sync spill_sync = LioLi::SpillRing::Sync::segment;
     std::string serializer;
   };
 
@@ -580,6 +1060,24 @@ class Module : public snort::Module {
       return false;
     }
 
+    if (!config_stack.top().spill_dir.empty()) {
+      if (::access(config_stack.top().spill_dir.c_str(), R_OK | W_OK | X_OK)) {
+        snort::ErrorMessage("ERROR: Can't use spill_dir %s: %s\n",
+                            config_stack.top().spill_dir.c_str(),
+                            std::strerror(errno));
+        config_stack.pop();
+        return false;
+      }
+
+      if (config_stack.top().spill_max_bytes <
+          config_stack.top().spill_segment_bytes) {
+        snort::ErrorMessage(
+            "ERROR: spill_max_bytes must be at least spill_segment_bytes\n");
+        config_stack.pop();
+        return false;
+      }
+    }
+
     // Create entry in DB
     if (!LioLi::LogDB::register_type<Logger>(config_stack.top().name.c_str())) {
       snort::ErrorMessage("ERROR: Found duplicate name/alias '%s'\n",
@@ -598,16 +1096,30 @@ class Module : public snort::Module {
 
     // Initialize specific logger
     logger->set_serializer(config_stack.top().serializer.c_str());
-    logger->set_max_queue_size(config_stack.top().queue_limit);
+    logger->set_queue_config(config_stack.top().queue);
     logger->set_serializer_restart_interval_s(
         config_stack.top().restart_interval);
     logger->set_port(config_stack.top().port);
     logger->set_ipv4(config_stack.top().ipv4);
     logger->set_retry_interval(config_stack.top().retry_interval);
+    logger->set_serializer_threads(config_stack.top().serializer_threads);
+    logger->set_per_thread(config_stack.top().per_thread,
+                           config_stack.top().thread_buffer_max);
+    logger->set_batching(config_stack.top().max_flush_latency_ms,
+                         config_stack.top().max_batch_bytes);
+    logger->set_spill(config_stack.top().spill_dir,
+                      config_stack.top().spill_max_bytes,
+                      config_stack.top().spill_segment_bytes,
+                      config_stack.top().spill_sync);
 
     // Start the logger
     logger->start();
 
+    if (logger->is_per_thread()) {
+      std::scoped_lock lock(thread_loggers_mutex);
+      thread_loggers.push_back(logger);
+    }
+
     config_stack.pop();
     return true;
   }
@@ -644,12 +1156,30 @@ class Module : public snort::Module {
             if (name && *name) {
               ...
           }*/
-    } else if (val.is("queue_max")) {
-      config_stack.top().queue_limit = val.get_uint32();
+    } else if (config_stack.top().queue.set(val)) {
     } else if (val.is("restart_interval_s")) {
       config_stack.top().restart_interval = val.get_uint32();
     } else if (val.is("retry_interval_ms")) {
       config_stack.top().retry_interval = val.get_uint32();
+    } else if (val.is("serializer_threads")) {
+      config_stack.top().serializer_threads = val.get_uint32();
+    } else if (val.is("per_thread")) {
+      config_stack.top().per_thread = val.get_bool();
+    } else if (val.is("thread_buffer_max")) {
+      config_stack.top().thread_buffer_max = val.get_uint32();
+    } else if (val.is("max_flush_latency_ms")) {
+      config_stack.top().max_flush_latency_ms = val.get_uint32();
+    } else if (val.is("max_batch_bytes")) {
+      config_stack.top().max_batch_bytes = val.get_uint32();
+    } else if (val.is("spill_dir")) {
+      config_stack.top().spill_dir = val.get_as_string();
+    } else if (val.is("spill_max_bytes")) {
+      config_stack.top().spill_max_bytes = val.get_uint64();
+    } else if (val.is("spill_segment_bytes")) {
+      config_stack.top().spill_segment_bytes = val.get_uint64();
+    } else if (val.is("spill_fsync")) {
+      config_stack.top().spill_sync =
+          static_cast<LioLi::SpillRing::Sync>(val.get_uint8());
     } else if (val.is("serializer")) {
       std::string serializer = val.get_as_string();
 
@@ -700,6 +1230,28 @@ public:
   static void dtor(snort::Inspector *p) { delete p; }
 };
 
+void thread_init() {
+  std::scoped_lock lock(thread_loggers_mutex);
+
+  for (auto &logger : thread_loggers) {
+    logger->thread_init();
+  }
+}
+
+void thread_term() {
+  std::vector<std::shared_ptr<Logger>> loggers;
+
+  // Not closed under the lock, as closing waits for pending output
+  {
+    std::scoped_lock lock(thread_loggers_mutex);
+    loggers = thread_loggers;
+  }
+
+  for (auto &logger : loggers) {
+    logger->thread_term();
+  }
+}
+
 } // namespace
 
 const snort::InspectApi inspect_api = {
@@ -722,8 +1274,8 @@ const snort::InspectApi inspect_api = {
     nullptr, // service
     nullptr, // pinit
     nullptr, // pterm
-    nullptr, // tinit
-    nullptr, // tterm
+    thread_init,
+    thread_term,
     Inspector::ctor,
     Inspector::dtor,
     nullptr, // ssn
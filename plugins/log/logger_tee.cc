@@ -0,0 +1,1087 @@
+
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stack>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+#include "logger_tee.h"
+#include "reactor.h"
+#include "tree_ring.h"
+
+// Debug includes
+
+namespace logger_tee {
+namespace {
+
+const char *s_name = "logger_tee";
+const char *s_help = "Outputs LioLi trees to several targets, serializing "
+                     "them once per serializer";
+
+/*
+Every branch has a target and a serializer, branches with the same serializer
+share one serializer context, and so the bytes it outputs.  Each branch has its
+own queue of output, written by its own task on the reactor, so a slow or
+absent target only makes its own queue overflow.
+
+A branch that loses output, by overflow, a failed write or a new connection,
+skips output until the start of the next serializer context, and has its
+serializer restarted so that comes soon.  The branches sharing the serializer
+then see an extra context end and start in their output.
+*/
+
+const snort::Parameter branch_params[] = {
+    {"target", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Where output goes, file:<path>, tcp:<ipv4>:<port> or unix:<path>"},
+    {"serializer", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Serializer to use for this target, targets with the same serializer "
+     "share its output"},
+    {"queue_max_bytes", snort::Parameter::PT_INT, "4096:max53", "16777216",
+     "Max bytes of output queued for this target before discarding"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const snort::Parameter module_params[] = {
+    {"alias", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "The alias name for the logger with specific config"},
+    {"branches", snort::Parameter::PT_LIST, branch_params, nullptr,
+     "Targets the trees are written to"},
+    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
+     "Max number of trees of each priority that will be queued before "
+     "discarding"},
+    {"queue_max_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "Max bytes of memory used by queued trees of each priority before "
+     "discarding (0 = no limit)"},
+    {"drop_policy", snort::Parameter::PT_ENUM, "oldest | newest | random_early",
+     "oldest",
+     "What is discarded when a queue is full, the oldest queued tree, the new "
+     "tree, or new trees at random once half full"},
+    {"restart_interval_s", snort::Parameter::PT_INT, "0:86400", "0",
+     "Seconds between restarting the serializers (max: 86400 s (1 day), 0 = "
+     "never))"},
+    {"retry_interval_ms", snort::Parameter::PT_INT, "10:10000", "1000",
+     "ms between attempts to connect or open a target"},
+
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
+    {CountType::SUM, "logs_out", "Count of logs we serialized"},
+    {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
+    {CountType::MAX, "max_queued",
+     "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "restarts", "Count of (re)starts of the serializers"},
+    {CountType::SUM, "serialized_bytes",
+     "Bytes output by the serializers, once per serializer"},
+    {CountType::SUM, "branch_bytes",
+     "Bytes handed to the branches, once per branch"},
+    {CountType::SUM, "branch_writes", "Number of writes to the targets"},
+    {CountType::SUM, "branch_written_bytes", "Bytes written to the targets"},
+    {CountType::SUM, "branch_dropped_bytes",
+     "Bytes a branch discarded, due to overflow or while skipping to the next "
+     "context"},
+    {CountType::SUM, "branch_resyncs",
+     "Count of branches skipping to the next context after losing output"},
+    {CountType::SUM, "branch_opens",
+     "Count of targets opened or connected to"},
+    {CountType::SUM, "branch_errors", "Count of failed opens and writes"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
+std::mutex peg_count_mutex; // Protects the peg counts
+struct PegCounts {
+  PegCount logs_in = 0;
+  PegCount logs_out = 0;
+  PegCount overflows = 0;
+  PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount restarts = 0;
+  PegCount serialized_bytes = 0;
+  PegCount branch_bytes = 0;
+  PegCount branch_writes = 0;
+  PegCount branch_written_bytes = 0;
+  PegCount branch_dropped_bytes = 0;
+  PegCount branch_resyncs = 0;
+  PegCount branch_opens = 0;
+  PegCount branch_errors = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+struct BranchConfig {
+  std::string target;
+  std::string serializer;
+  uint64_t queue_max_bytes = 16777216;
+};
+
+// Returns true if target is on a form we can handle
+bool valid_target(const std::string &target) {
+  if (target.starts_with("file:")) {
+    return target.size() > 5;
+  } else if (target.starts_with("unix:")) {
+    return target.size() > 5 &&
+           target.size() - 5 < sizeof(sockaddr_un::sun_path);
+  } else if (target.starts_with("tcp:")) {
+    auto colon = target.rfind(':');
+    in_addr ip;
+
+    return colon > 4 &&
+           inet_pton(AF_INET, target.substr(4, colon - 4).c_str(), &ip) == 1 &&
+           std::atoi(target.c_str() + colon + 1) > 0 &&
+           std::atoi(target.c_str() + colon + 1) < 65536;
+  }
+
+  return false;
+}
+
+// Output of a serializer, shared by the branches using it
+struct Output {
+  std::shared_ptr<const std::string> bytes;
+  bool context_start; // First output of a serializer context
+};
+
+// Writes the output of one serializer to one target, as its own task on the
+// reactor
+class Branch : public Common::Reactor::Task {
+  using clock = std::chrono::steady_clock;
+
+  BranchConfig config;
+  std::string my_name; // For messages, <logger>/<target>
+  uint32_t retry_interval_ms;
+
+  std::mutex mutex; // Protects the members below
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::deque<Output> queue;
+  uint64_t queued_bytes = 0;
+  bool skipping = false;  // Discarding until a context starts
+  bool connected = false; // The target is open
+  bool terminate = false;
+  bool worker_done = false; // Worker has stopped
+  bool started = false;
+
+  // Set when the branch wants the serializer restarted, so it gets a context
+  // start
+  std::atomic<bool> restart_wanted = false;
+
+  // Per branch accounting, reported when the branch stops
+  uint64_t written_bytes = 0;
+  uint64_t dropped_bytes = 0;
+  uint64_t resyncs = 0;
+
+  // Worker state, only used by run()
+  int fd = -1;
+  clock::time_point retry_at; // When to open the target again
+  std::vector<Output> taken;  // Taken from the queue, being written
+  std::vector<iovec> iov;     // What's left to write of taken
+  std::size_t iov_next = 0;
+  uint64_t taken_bytes = 0;
+
+  // Discards what's queued and what follows until the next context starts,
+  // mutex must be held
+  void resync() {
+    dropped_bytes += queued_bytes;
+    {
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.branch_dropped_bytes += queued_bytes;
+    }
+    queue.clear();
+    queued_bytes = 0;
+
+    if (!skipping) {
+      skipping = true;
+      resyncs++;
+
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.branch_resyncs++;
+    }
+
+    // A target we can't write to gets its new context once it's back
+    if (connected) {
+      restart_wanted = true;
+    }
+  }
+
+  // Sockets are non blocking, a connect in progress shows up as a write that
+  // would block, and a failed one as a failed write
+  bool open() {
+    if (config.target.starts_with("file:")) {
+      fd = ::open(config.target.c_str() + 5,
+                  O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    } else if (config.target.starts_with("unix:")) {
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      config.target.copy(addr.sun_path, sizeof(addr.sun_path) - 1, 5);
+
+      fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+      if (fd != -1 && ::connect(fd, (sockaddr *)&addr, sizeof(addr))) {
+        ::close(fd);
+        fd = -1;
+      }
+    } else {
+      auto colon = config.target.rfind(':');
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(std::atoi(config.target.c_str() + colon + 1));
+      inet_pton(AF_INET, config.target.substr(4, colon - 4).c_str(),
+                &addr.sin_addr);
+
+      fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+      if (fd != -1 && ::connect(fd, (sockaddr *)&addr, sizeof(addr)) &&
+          errno != EINPROGRESS) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+
+    std::scoped_lock lock(peg_count_mutex);
+    if (fd == -1) {
+      s_peg_counts.branch_errors++;
+    } else {
+      s_peg_counts.branch_opens++;
+    }
+
+    return fd != -1;
+  }
+
+  void close() {
+    if (fd != -1) {
+      unwatch(fd);
+      ::close(fd);
+      fd = -1;
+    }
+  }
+
+  // Writes what's left of taken, returns 1 when all is written, 0 if the
+  // target would block and -1 on error
+  int write_taken() {
+    while (iov_next != iov.size()) {
+      ssize_t bytes = ::writev(fd, iov.data() + iov_next, iov.size() - iov_next);
+
+      if (bytes < 0 && errno == EINTR) {
+        continue;
+      } else if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+      } else if (bytes < 0) {
+        return -1;
+      }
+
+      {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.branch_writes++;
+        s_peg_counts.branch_written_bytes += bytes;
+      }
+
+      while (iov_next != iov.size() &&
+             static_cast<std::size_t>(bytes) >= iov[iov_next].iov_len) {
+        bytes -= iov[iov_next].iov_len;
+        iov_next++;
+      }
+
+      if (iov_next != iov.size()) {
+        iov[iov_next].iov_base =
+            static_cast<char *>(iov[iov_next].iov_base) + bytes;
+        iov[iov_next].iov_len -= bytes;
+      }
+    }
+
+    return 1;
+  }
+
+  void clear_taken() {
+    taken.clear();
+    iov.clear();
+    iov_next = 0;
+    taken_bytes = 0;
+  }
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    // Max outputs gathered by one write
+    constexpr std::size_t max_iov = 64;
+    // Bounded, so other tasks on the reactor thread get their turn
+    constexpr int max_writes = 16;
+    int budget = max_writes;
+
+    if (worker_done) {
+      return;
+    }
+
+    while (true) {
+      if (budget-- <= 0) {
+        wake(); // Come back for the rest
+        return;
+      }
+
+      if (fd == -1) {
+        // Give the target a break after it failed
+        if (clock::now() < retry_at) {
+          std::scoped_lock lock(mutex);
+
+          if (terminate) {
+            break;
+          }
+
+          wake_at(retry_at);
+          return;
+        }
+
+        bool opened = open();
+        std::scoped_lock lock(mutex);
+
+        if (!opened) {
+          resync();
+
+          if (terminate) {
+            break;
+          }
+
+          retry_at =
+              clock::now() + std::chrono::milliseconds(retry_interval_ms);
+          continue;
+        }
+
+        connected = true;
+
+        // We missed the start of the current context
+        if (skipping) {
+          restart_wanted = true;
+        }
+      }
+
+      if (taken.empty()) {
+        std::scoped_lock lock(mutex);
+
+        // What's queued is written before we stop, offer() wakes us
+        if (queue.empty()) {
+          if (terminate) {
+            break;
+          }
+
+          wake_at(clock::time_point::max());
+          return;
+        }
+
+        while (!queue.empty() && taken.size() < max_iov) {
+          queued_bytes -= queue.front().bytes->size();
+          taken.push_back(std::move(queue.front()));
+          queue.pop_front();
+        }
+
+        for (auto &output : taken) {
+          iov.push_back({const_cast<char *>(output.bytes->data()),
+                         output.bytes->size()});
+          taken_bytes += output.bytes->size();
+        }
+      }
+
+      int written = write_taken();
+
+      if (written == 1) {
+        std::scoped_lock lock(mutex);
+        written_bytes += taken_bytes;
+        clear_taken();
+        continue;
+      } else if (written == 0) {
+        // Also when stopping, stop() only waits so long for a target that
+        // blocks
+        watch(fd, EPOLLOUT);
+        wake_at(clock::time_point::max());
+        return;
+      }
+
+      int error = errno;
+      close();
+      clear_taken();
+
+      std::scoped_lock lock(mutex);
+      connected = false;
+
+      // What was written of this is lost with the rest of the context
+      resync();
+
+      if (terminate) {
+        break;
+      }
+
+      snort::WarningMessage("WARNING: %s write failed: %s\n", my_name.c_str(),
+                            std::strerror(error));
+
+      std::scoped_lock peg_lock(peg_count_mutex);
+      s_peg_counts.branch_errors++;
+    }
+
+    close();
+    clear_taken();
+
+    {
+      std::scoped_lock lock(mutex);
+      worker_done = true;
+    }
+    cv.notify_all();
+  }
+
+public:
+  Branch(const BranchConfig &config, const char *logger_name,
+         uint32_t retry_interval_ms)
+      : config(config),
+        my_name(std::string(logger_name) + "/" + config.target),
+        retry_interval_ms(retry_interval_ms) {}
+
+  ~Branch() { stop(); }
+
+  const std::string &serializer() const { return config.serializer; }
+
+  // Returns true, and clears the request, if the branch wants a new context
+  bool take_restart_wanted() { return restart_wanted.exchange(false); }
+
+  // Queues output for writing, never blocks
+  void offer(const Output &output) {
+    {
+      std::scoped_lock lock(mutex);
+
+      if (skipping && output.context_start) {
+        skipping = false;
+      }
+
+      if (!skipping &&
+          queued_bytes + output.bytes->size() > config.queue_max_bytes) {
+        snort::WarningMessage("WARNING: %s queue full, skipping to the next "
+                              "context\n",
+                              my_name.c_str());
+        resync();
+      }
+
+      if (skipping) {
+        dropped_bytes += output.bytes->size();
+
+        std::scoped_lock peg_lock(peg_count_mutex);
+        s_peg_counts.branch_dropped_bytes += output.bytes->size();
+        return;
+      }
+
+      queued_bytes += output.bytes->size();
+      queue.push_back(output);
+    }
+
+    wake();
+  }
+
+  void start() {
+    if (started) {
+      return;
+    }
+
+    terminate = false;
+    worker_done = false;
+    started = true;
+    Common::Reactor::get().add(*this);
+  }
+
+  // Writes what's queued, giving a target that blocks a second
+  void stop() {
+    if (!started) {
+      return;
+    }
+
+    {
+      std::unique_lock lock(mutex);
+      terminate = true;
+    }
+
+    wake();
+
+    {
+      std::unique_lock lock(mutex);
+      cv.wait_for(lock, std::chrono::seconds(1),
+                  [this] { return worker_done; });
+    }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
+
+    // What the target didn't take in time is lost
+    if (!worker_done) {
+      std::scoped_lock lock(mutex);
+      resync();
+    }
+
+    close();
+    clear_taken();
+
+    snort::LogMessage("LOG: %s wrote %lu bytes, dropped %lu bytes, skipped "
+                      "to a new context %lu times\n",
+                      my_name.c_str(), written_bytes, dropped_bytes, resyncs);
+  }
+};
+
+// MAIN object of this file
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
+  using clock = std::chrono::steady_clock;
+
+  std::mutex mutex; // Protects members
+
+  // Configs
+  std::vector<BranchConfig> branch_configs;
+  uint32_t serializer_restart_interval_s = 0; // 0 = never
+  uint32_t retry_interval_ms = 1000;
+  LioLi::QueueAccount queue_account; // Only used by the worker
+
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
+  bool data_loss = false;   // Set to true when we might have lost data
+
+  // Branches sharing a serializer, only used by the worker
+  struct Group {
+    std::shared_ptr<LioLi::Serializer> serializer;
+    std::shared_ptr<LioLi::Serializer::Context> context;
+    bool context_start = false; // Next output starts the context
+    std::vector<Branch *> branches;
+    LioLi::Serializer::Sink sink;
+
+    void hand_out(std::string &&bytes) {
+      if (bytes.empty()) {
+        return;
+      }
+
+      Output output = {std::make_shared<const std::string>(std::move(bytes)),
+                       context_start};
+      context_start = false;
+
+      for (auto branch : branches) {
+        branch->offer(output);
+      }
+
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.serialized_bytes += output.bytes->size();
+      s_peg_counts.branch_bytes += output.bytes->size() * branches.size();
+    }
+
+    void close() {
+      if (context) {
+        hand_out(context->close());
+        context.reset();
+      }
+    }
+  };
+
+  // Set up by start(), each branch is a task of its own
+  std::list<Branch> branches;
+  std::vector<Group> groups;
+
+  // Worker state, only used by run()
+  bool serializers_found = false;
+  std::chrono::time_point<clock>
+      next_timeout; // Keeps track of when we should restart serializer
+                    // contexts
+  std::vector<LioLi::Tree> batch; // Trees taken from the queue
+
+  // Accounts for what producers did to the queue since last call, worker only
+  void account_queue() {
+    if (queue_account.take(queue, get_name(), s_peg_counts, peg_count_mutex)) {
+      std::scoped_lock lock(mutex);
+      data_loss = true;
+    }
+  }
+
+  // Returns false until all the serializers are registered
+  bool init_worker() {
+    for (auto &group : groups) {
+      if (group.serializer) {
+        continue;
+      }
+
+      group.serializer = LioLi::LogDB::get<LioLi::Serializer>(
+          group.branches.front()->serializer());
+
+      if (group.serializer == group.serializer->get_null_obj()) {
+        group.serializer.reset();
+        return false;
+      }
+    }
+
+    serializers_found = true;
+    return true;
+  }
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
+    }
+
+    queue.finish_wait(); // Whatever woke us
+
+    // Don't do anything until we have our serializers
+    if (!serializers_found && !terminate && !init_worker()) {
+      wake_at(clock::now() + std::chrono::milliseconds(100));
+      return;
+    }
+
+    // Main loop
+    while (!terminate) {
+      bool restart_all = next_timeout <= clock::now();
+
+      for (auto &group : groups) {
+        bool restart = restart_all;
+
+        for (auto branch : group.branches) {
+          restart |= branch->take_restart_wanted();
+        }
+
+        if (restart || !group.context) {
+          group.close();
+          group.context = group.serializer->create_context();
+          group.context_start = true;
+
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.restarts++;
+        }
+      }
+
+      if (restart_all) {
+        if (serializer_restart_interval_s != 0) {
+          next_timeout = clock::now() +
+                         std::chrono::seconds(serializer_restart_interval_s);
+        } else {
+          next_timeout = std::chrono::time_point<clock>::max();
+        }
+      }
+
+      account_queue();
+
+      if (!queue.empty()) {
+        queue.pop_all(batch);
+
+        // Serialized once per serializer, the output is shared by its branches
+        for (auto &group : groups) {
+          group.context->serialize_batch(batch, group.sink);
+          group.hand_out(std::move(group.sink.buffer()));
+          group.sink.clear();
+        }
+
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.logs_out += batch.size();
+        }
+
+        batch.clear();
+        continue;
+      }
+
+      // Wake up now and then, branches might want a restart
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(std::min(next_timeout,
+                         clock::now() + std::chrono::milliseconds(100)));
+        return;
+      }
+    }
+
+    // The branches write it when they stop
+    for (auto &group : groups) {
+      group.close();
+    }
+
+    unwatch(queue.get_event_fd());
+
+    {
+      std::unique_lock lock(mutex);
+      worker_done = true;
+    }
+    cv.notify_all();
+  }
+
+public:
+  Logger(const char *name) : LioLi::Logger(name) {}
+
+  ~Logger() {
+    stop(); // Stops worker
+  }
+
+  bool had_data_loss(bool clear_flag) override {
+    std::scoped_lock lock(mutex);
+    bool old_value = data_loss;
+
+    data_loss &= !clear_flag;
+
+    return old_value;
+  }
+
+  void operator<<(const LioLi::Tree &&tree) override {
+    log(std::move(tree), LioLi::Priority::normal);
+  }
+
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
+  }
+
+  void set_branches(const std::vector<BranchConfig> &configs) {
+    branch_configs = configs;
+  }
+
+  // Applied to every priority class
+  void set_queue_limits(uint32_t max, uint64_t max_bytes,
+                        LioLi::TreeRing::DropPolicy policy) {
+    std::scoped_lock lock(mutex);
+
+    assert(max > 0); // We need to be able to queue at least one element
+
+    for (std::size_t i = 0; i < LioLi::priority_count; i++) {
+      auto priority = static_cast<LioLi::Priority>(i);
+
+      // If queue size is being reduced, trees might be dropped
+      if (auto dropped = queue.set_capacity(max, priority)) {
+        snort::WarningMessage(
+            "WARNING: %s dropping %li trees from queue due to resize\n",
+            get_name(), dropped);
+      }
+      queue.set_max_bytes(max_bytes, priority);
+      queue.set_drop_policy(policy, priority);
+    }
+  }
+
+  void set_serializer_restart_interval_s(uint32_t interval) {
+    {
+      std::scoped_lock lock(mutex);
+
+      serializer_restart_interval_s = interval;
+    }
+    // Kick worker
+    queue.kick();
+  }
+
+  void set_retry_interval(uint32_t retry_interval) {
+    retry_interval_ms = retry_interval;
+  }
+
+  // Call after all configuration is done
+  void start() {
+    if (started) {
+      return;
+    }
+
+    for (auto &config : branch_configs) {
+      auto &branch =
+          branches.emplace_back(config, get_name(), retry_interval_ms);
+      auto group = std::find_if(groups.begin(), groups.end(), [&](auto &g) {
+        return g.branches.front()->serializer() == config.serializer;
+      });
+
+      if (group == groups.end()) {
+        group = groups.emplace(groups.end());
+      }
+
+      group->branches.push_back(&branch);
+      branch.start();
+    }
+
+    terminate = false;
+    worker_done = false;
+    serializers_found = false;
+    started = true;
+    Common::Reactor::get().add(*this);
+  }
+
+  // Call to terminate
+  void stop() {
+    // Check worker is running
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    wake();
+
+    {
+      std::unique_lock lock(mutex);
+
+      // Give worker a chance to go down gracefully, it never blocks, so this
+      // is only to be sure
+      cv.wait_for(lock, std::chrono::seconds(2),
+                  [this] { return worker_done; });
+    }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
+
+    // Writes what's queued, the branches get a second each if a target
+    // blocks
+    for (auto &branch : branches) {
+      branch.stop();
+    }
+
+    groups.clear();
+    branches.clear();
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {}
+
+  ~Module() {}
+
+  struct ConfigColector {
+    std::string name;
+    std::vector<BranchConfig> branches;
+    uint32_t queue_limit;
+    uint64_t queue_limit_bytes = 0;
+    LioLi::TreeRing::DropPolicy drop_policy = {};
+    uint32_t restart_interval;
+    uint32_t retry_interval;
+  };
+
+  std::stack<ConfigColector> config_stack;
+
+  static bool is_branch(const char *fqn) {
+    return std::string_view(fqn).ends_with(".branches");
+  }
+
+  bool begin(const char *fqn, int idx, snort::SnortConfig *) override {
+    if (is_branch(fqn)) {
+      assert(!config_stack.empty());
+
+      if (idx > 0) {
+        config_stack.top().branches.emplace_back();
+      }
+      return true;
+    }
+
+    // Make new element
+    config_stack.emplace();
+    return true;
+  }
+
+  bool end(const char *fqn, int idx, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    if (is_branch(fqn)) {
+      if (idx > 0) {
+        auto &branch = config_stack.top().branches.back();
+
+        if (!valid_target(branch.target)) {
+          snort::ErrorMessage("ERROR: %s invalid target '%s', use "
+                              "file:<path>, tcp:<ipv4>:<port> or "
+                              "unix:<path>\n",
+                              s_name, branch.target.c_str());
+          return false;
+        }
+
+        if (branch.serializer.empty()) {
+          snort::ErrorMessage("ERROR: %s no serializer given for target %s\n",
+                              s_name, branch.target.c_str());
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Check validity
+    if (config_stack.top().name.empty()) {
+      if (config_stack.size() > 1) {
+        snort::ErrorMessage("ERROR: No alias given for entry\n");
+        config_stack.pop();
+        return false;
+      }
+
+      config_stack.top().name = s_name;
+    }
+
+    if (config_stack.top().branches.empty()) {
+      snort::ErrorMessage("ERROR: %s needs at least one branch\n", s_name);
+      config_stack.pop();
+      return false;
+    }
+
+    // Create entry in DB
+    if (!LioLi::LogDB::register_type<Logger>(config_stack.top().name.c_str())) {
+      snort::ErrorMessage("ERROR: Found duplicate name/alias '%s'\n",
+                          config_stack.top().name.c_str());
+      config_stack.pop();
+      return false;
+    }
+
+    auto logger = LioLi::LogDB::get<Logger>(config_stack.top().name.c_str());
+
+    if (!logger) {
+      snort::ErrorMessage("ERROR: Unable to initialize logger\n");
+      config_stack.pop();
+      return false;
+    }
+
+    // Initialize specific logger
+    logger->set_branches(config_stack.top().branches);
+    logger->set_queue_limits(config_stack.top().queue_limit,
+                             config_stack.top().queue_limit_bytes,
+                             config_stack.top().drop_policy);
+    logger->set_serializer_restart_interval_s(
+        config_stack.top().restart_interval);
+    logger->set_retry_interval(config_stack.top().retry_interval);
+
+    // Start the logger
+    logger->start();
+
+    config_stack.pop();
+    return true;
+  }
+
+  bool set(const char *fqn, snort::Value &val, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    if (std::string_view(fqn).find(".branches.") != std::string_view::npos) {
+      if (config_stack.top().branches.empty()) {
+        return false;
+      }
+
+      auto &branch = config_stack.top().branches.back();
+
+      if (val.is("target")) {
+        branch.target = val.get_as_string();
+      } else if (val.is("serializer")) {
+        branch.serializer = val.get_as_string();
+      } else if (val.is("queue_max_bytes")) {
+        branch.queue_max_bytes = val.get_uint64();
+      } else {
+        return false;
+      }
+
+      return true;
+    }
+
+    if (val.is("alias")) {
+      std::string alias = val.get_as_string();
+
+      if (alias.empty()) {
+        snort::ErrorMessage("ERROR: Alias specified with empty name\n");
+        return false;
+      }
+
+      config_stack.top().name = alias;
+    } else if (val.is("queue_max")) {
+      config_stack.top().queue_limit = val.get_uint32();
+    } else if (val.is("queue_max_bytes")) {
+      config_stack.top().queue_limit_bytes = val.get_uint64();
+    } else if (val.is("drop_policy")) {
+      config_stack.top().drop_policy =
+          static_cast<LioLi::TreeRing::DropPolicy>(val.get_uint8());
+    } else if (val.is("restart_interval_s")) {
+      config_stack.top().restart_interval = val.get_uint32();
+    } else if (val.is("retry_interval_ms")) {
+      config_stack.top().retry_interval = val.get_uint32();
+    } else {
+      // fail if we didn't get something valid
+      return false;
+    }
+
+    return true;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // TODO: This will mess when snort tries to clear the pegs, find a solution
+    // that lets this work in a multithreaded environment
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static PegCounts static_pegs;
+
+    std::scoped_lock lock(peg_count_mutex);
+    static_pegs = s_peg_counts;
+
+    return reinterpret_cast<PegCount *>(&static_pegs);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace logger_tee
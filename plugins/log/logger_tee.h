@@ -0,0 +1,18 @@
+#ifndef logger_tee_3f7b0d62
+#define logger_tee_3f7b0d62
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace logger_tee {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace logger_tee
+
+#endif // #ifndef logger_tee_3f7b0d62
@@ -0,0 +1,965 @@
+
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <stack>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+#include "logger_unix.h"
+#include "reactor.h"
+#include "tree_ring.h"
+
+// Debug includes
+
+namespace logger_unix {
+namespace {
+
+const char *s_name = "logger_unix";
+const char *s_help = "Outputs LioLi trees over a unix domain socket";
+
+const snort::Parameter module_params[] = {
+    {"alias", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "The alias name for the logger with specific config"},
+    {"socket_path", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Path of the unix domain socket data should be written to"},
+    {"socket_type", snort::Parameter::PT_ENUM, "stream | seqpacket", "stream",
+     "Type of the socket, stream is the serializer's output as a byte stream, "
+     "with seqpacket every message is a batch of trees, or the start or end "
+     "of a serializer context"},
+    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
+     "Max number of trees of each priority that will be queued before "
+     "discarding"},
+    {"queue_max_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "Max bytes of memory used by queued trees of each priority before "
+     "discarding (0 = no limit)"},
+    {"drop_policy", snort::Parameter::PT_ENUM, "oldest | newest | random_early",
+     "oldest",
+     "What is discarded when a queue is full, the oldest queued tree, the new "
+     "tree, or new trees at random once half full"},
+    {"restart_interval_s", snort::Parameter::PT_INT, "0:86400", "0",
+     "Seconds between restarting the serializer (max: 86400 s (1 day), 0 = "
+     "never))"},
+    {"serializer", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Serializer to use for generating output"},
+    {"retry_interval_ms", snort::Parameter::PT_INT, "10:10000", "100",
+     "ms between retries after a connection has been rejected or closed by "
+     "the receiving side"},
+    {"max_flush_latency_ms", snort::Parameter::PT_INT, "0:10000", "0",
+     "ms output may be held back, to be written together with later output "
+     "(0 = write as soon as nothing more is ready)"},
+    {"max_batch_bytes", snort::Parameter::PT_INT, "4096:67108864", "1048576",
+     "Max bytes gathered for one write to a stream socket"},
+    {"pass_fd_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "Only with seqpacket, messages of at least this many bytes are put in a "
+     "sealed memfd, whose fd is passed in a message of a single placeholder "
+     "byte (0 = only messages too large for the socket)"},
+
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "logs_in", "Count of logs we were asked to write"},
+    {CountType::SUM, "logs_out", "Count of logs we sent on the socket"},
+    {CountType::SUM, "overflows", "Count of logs we discarded due to overflow"},
+    {CountType::MAX, "max_queued",
+     "Max number of items ever queued at one time"},
+    {CountType::NOW, "queued_bytes",
+     "Bytes of memory used by queued trees, when last checked"},
+    {CountType::MAX, "max_queued_bytes",
+     "Max bytes of memory ever used by queued trees"},
+    {CountType::SUM, "overflow_bytes",
+     "Bytes of memory of the logs we discarded due to overflow"},
+    {CountType::SUM, "write_errors", "Count of write errors detected"},
+    {CountType::SUM, "restarts", "Count of (re)starts of the serializer"},
+    {CountType::SUM, "writes", "Number of writes to the socket"},
+    {CountType::SUM, "written_bytes", "Bytes written to the socket"},
+    {CountType::NOW, "avg_write_bytes",
+     "Average bytes per write to the socket, written_bytes / writes"},
+    {CountType::SUM, "passed_fds",
+     "Number of writes passed as a memfd rather than as bytes"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
+std::mutex peg_count_mutex; // Protects the peg counts
+struct PegCounts {
+  PegCount logs_in = 0;
+  PegCount logs_out = 0;
+  PegCount overflows = 0;
+  PegCount max_queued = 0;
+  PegCount queued_bytes = 0;
+  PegCount max_queued_bytes = 0;
+  PegCount overflow_bytes = 0;
+  PegCount write_errors = 0;
+  PegCount restarts = 0;
+  PegCount writes = 0;
+  PegCount written_bytes = 0;
+  PegCount avg_write_bytes = 0;
+  PegCount passed_fds = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// MAIN object of this file
+class Logger : public LioLi::Logger, public Common::Reactor::Task {
+  using clock = std::chrono::steady_clock;
+
+  std::mutex mutex; // Protects members
+
+  // Configs
+  std::string serializer_name;
+  std::string socket_path;
+  bool seqpacket = false;
+  uint32_t serializer_restart_interval_s = 0; // 0 = never
+  LioLi::QueueAccount queue_account; // Only used by the worker
+  uint32_t retry_interval_ms = 100;
+  uint32_t max_flush_latency_ms = 0; // 0 = write once nothing more is ready
+  std::size_t max_batch_bytes = 1048576; // Max bytes gathered for a write
+  uint64_t pass_fd_bytes = 0;            // 0 = never pass fds
+
+  LioLi::TreeRing queue; // Lock free, so packet threads don't contend
+
+  // Worker controls, the worker is our task on the reactor
+  bool started = false;
+  std::condition_variable cv; // Used to wait for the worker to stop
+  std::atomic<bool> terminate =
+      false;                // Set to true if worker loop should be terminated
+  bool worker_done = false; // Worker has stopped
+  bool data_loss = false;   // Set to true when we might have lost data
+
+  // Framing of what's written:
+  //
+  // stream: the serializer's output as a byte stream, as logger_tcp would
+  //   send it, writes are gathered and split as it suits us.  No fds.
+  //
+  // seqpacket: one message per output, that is the serialized batch of trees
+  //   taken from the queue at once, or what closing a context gives, and
+  //   never part of one or more than one.  A message is either the bytes
+  //   themselves, or a single placeholder byte (0) with one fd, a sealed
+  //   memfd holding the bytes.  Messages of at least pass_fd_bytes are
+  //   passed that way, as are those the socket says are too large.
+  class Socket {
+    // NOTE: Calling functions in this class has a lot of sideeffects, use with
+    // caution
+    Logger &logger; // Whose reactor task watches the socket
+    std::string path;
+    bool seqpacket;
+
+    int osocket = -1;                // Socket used for communication
+    std::deque<std::string> outputs; // What we are trying to write, in order
+    std::size_t output_index = 0;    // Place in outputs.front() we write from
+    std::size_t output_bytes = 0;    // Bytes in outputs not yet written
+    clock::time_point first_queued;  // When the oldest of outputs was queued
+    bool writable = false; // The last write took everything we gave it
+    std::string my_name;
+
+    // Max buffers gathered by one write
+    static constexpr int max_iov = 256;
+
+    void close_socket() {
+      if (-1 != osocket) {
+        logger.unwatch(osocket);
+        ::close(osocket);
+      }
+
+      osocket = -1;
+      writable = false;
+
+      // We never split an output over multiple connections
+      outputs.clear();
+      output_index = 0;
+      output_bytes = 0;
+    }
+
+    void consume(std::size_t bytes) {
+      output_bytes -= bytes;
+
+      while (bytes != 0) {
+        std::size_t left = outputs.front().size() - output_index;
+
+        if (bytes < left) {
+          output_index += bytes;
+          return;
+        }
+
+        bytes -= left;
+        outputs.pop_front();
+        output_index = 0;
+      }
+    }
+
+    // Sends the bytes as a sealed memfd, in a message of its own, returns the
+    // bytes sent (all or nothing) or -1 with errno set
+    ssize_t send_fd(const iovec *iov, int count, std::size_t bytes) {
+      int memfd = ::memfd_create(my_name.c_str(),
+                                 MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+      if (memfd == -1) {
+        return -1;
+      }
+
+      // Writes to a memfd are only short when out of memory
+      if (::writev(memfd, iov, count) != static_cast<ssize_t>(bytes) ||
+          ::fcntl(memfd, F_ADD_SEALS,
+                  F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)) {
+        int error = errno;
+        ::close(memfd);
+        errno = error;
+        return -1;
+      }
+
+      char placeholder = 0;
+      iovec placeholder_iov = {&placeholder, 1};
+      alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+      msghdr msg = {};
+      msg.msg_iov = &placeholder_iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      std::memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+      ssize_t sent = ::sendmsg(osocket, &msg, MSG_NOSIGNAL);
+      int error = errno;
+
+      // The receiver has its own reference now
+      ::close(memfd);
+
+      if (sent != 1) {
+        errno = error;
+        return -1;
+      }
+
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.passed_fds++;
+
+      return bytes;
+    }
+
+  public:
+    Socket(Logger &logger, std::string path, bool seqpacket,
+           std::string my_name)
+        : logger(logger), path(path), seqpacket(seqpacket), my_name(my_name) {}
+
+    ~Socket() { close_socket(); }
+
+    // Returns false if the receiver isn't there, try again after the retry
+    // interval
+    bool connect() {
+      close_socket(); // Make sure we are in a known state
+
+      osocket =
+          ::socket(AF_UNIX,
+                   (seqpacket ? SOCK_SEQPACKET : SOCK_STREAM) | SOCK_NONBLOCK |
+                       SOCK_CLOEXEC,
+                   0);
+
+      if (-1 == osocket) {
+        snort::ErrorMessage("ERROR: %s could not create socket: %s\n",
+                            my_name.c_str(), std::strerror(errno));
+        return false;
+      }
+
+      sockaddr_un addr = {};
+      addr.sun_family = AF_UNIX;
+      path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+
+      // Unix sockets connect at once, or fail with EAGAIN if the receiver's
+      // backlog is full
+      if (::connect(osocket, (sockaddr *)&addr, sizeof(addr))) {
+        close_socket();
+        return false;
+      }
+
+      writable = true;
+      return true;
+    }
+
+    operator bool() const { return (-1 != osocket); }
+
+    // Returns -1 if the socket was closed, 0 if it isn't writable yet, and
+    // the caller should watch it, 1 if socket writeable
+    int poll() {
+      pollfd pfd = {osocket, POLLOUT, 0};
+      int ret = ::poll(&pfd, 1, 0);
+
+      if (0 == ret || (-1 == ret && errno == EINTR)) {
+        return 0;
+      } else if (-1 == ret) {
+        snort::ErrorMessage("ERROR: %s poll failed: %s\n", my_name.c_str(),
+                            std::strerror(errno));
+        close_socket();
+        return -1;
+      }
+
+      if (pfd.revents & (POLLHUP | POLLERR)) {
+        close_socket();
+        return -1;
+      }
+
+      writable = true;
+      return 1;
+    }
+
+    int fd() const { return osocket; }
+
+    // True if we must wait for the socket before writing, it didn't take all
+    // of the last write
+    bool blocked() const { return !writable; }
+
+    void queue(std::string &&input) {
+      if (input.empty()) {
+        return;
+      }
+
+      if (outputs.empty()) {
+        first_queued = clock::now();
+      }
+
+      output_bytes += input.size();
+      outputs.push_back(std::move(input));
+    }
+
+    // Bytes queued but not yet written
+    std::size_t pending() const { return output_bytes; }
+
+    // When what's pending has been held back for latency
+    clock::time_point flush_deadline(std::chrono::milliseconds latency) const {
+      return first_queued + latency;
+    }
+
+    // Writes what's pending, see the framing above, with a stream gathering up
+    // to max_bytes of it per write.  Returns true if flush was complete, false
+    // if loop should be restarted
+    bool flush(std::size_t max_bytes, uint64_t pass_fd_bytes) {
+      while (output_bytes != 0) {
+        iovec iov[max_iov];
+        int count = 0;
+        std::size_t bytes = 0;
+        std::size_t index = output_index;
+
+        if (seqpacket) {
+          // A message is sent whole, or not at all
+          iov[0] = {outputs.front().data(), outputs.front().size()};
+          count = 1;
+          bytes = outputs.front().size();
+        }
+
+        for (auto itr = outputs.begin(); !seqpacket && itr != outputs.end() &&
+                                         count < max_iov && bytes < max_bytes;
+             itr++) {
+          iov[count].iov_base = itr->data() + index;
+          iov[count].iov_len = std::min(itr->size() - index, max_bytes - bytes);
+          bytes += iov[count].iov_len;
+          index = 0;
+          count++;
+        }
+
+        ssize_t sent;
+
+        if (seqpacket && pass_fd_bytes != 0 && bytes >= pass_fd_bytes) {
+          sent = send_fd(iov, count, bytes);
+        } else {
+          msghdr msg = {};
+          msg.msg_iov = iov;
+          msg.msg_iovlen = count;
+
+          sent = ::sendmsg(osocket, &msg, MSG_NOSIGNAL);
+
+          if (sent < 0 && errno == EMSGSIZE && seqpacket) {
+            sent = send_fd(iov, count, bytes); // Too large for a message
+          }
+        }
+
+        if (sent < 0) {
+          if (errno == EINTR) {
+            continue;
+          } else if (errno == EAGAIN || errno == ENOBUFS) {
+            writable = false;
+          } else {
+            std::scoped_lock lock(peg_count_mutex);
+            s_peg_counts.write_errors++;
+
+            close_socket();
+          }
+          return false;
+        }
+
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.writes++;
+          s_peg_counts.written_bytes += sent;
+          s_peg_counts.avg_write_bytes =
+              s_peg_counts.written_bytes / s_peg_counts.writes;
+        }
+
+        consume(sent);
+
+        // All was not sent
+        if (static_cast<std::size_t>(sent) < bytes) {
+          writable = false;
+          return false;
+        }
+      }
+
+      return true;
+    }
+  };
+
+  // Accounts for what producers did to the queue since last call, worker only
+  void account_queue() {
+    if (queue_account.take(queue, get_name(), s_peg_counts, peg_count_mutex)) {
+      std::scoped_lock lock(mutex);
+      data_loss = true;
+    }
+  }
+
+  // Worker state, only used by run()
+  std::shared_ptr<LioLi::Serializer> serializer;
+  std::chrono::time_point<clock>
+      next_timeout; // Keeps track of when we should restart serializer
+                    // context
+  std::shared_ptr<LioLi::Serializer::Context> context;
+  std::unique_ptr<Socket> socket;
+  clock::time_point retry_at; // When to connect again after losing connection
+  std::vector<LioLi::Tree> batch; // Trees taken from the queue
+  LioLi::Serializer::Sink sink;
+
+  // Runs on the reactor, does what can be done without blocking and returns
+  // with what it waits for watched
+  void run() override {
+    if (worker_done) {
+      return;
+    }
+
+    queue.finish_wait(); // Whatever woke us
+
+    // Don't do anything until we have our serializer
+    if (!serializer && !terminate) {
+      serializer = LioLi::LogDB::get<LioLi::Serializer>(serializer_name);
+
+      if (serializer == serializer->get_null_obj()) {
+        serializer.reset();
+        wake_at(clock::now() + std::chrono::milliseconds(100));
+        return;
+      }
+
+      socket =
+          std::make_unique<Socket>(*this, socket_path, seqpacket, get_name());
+    }
+
+    // Bounded, so other tasks on the reactor thread get their turn
+    constexpr int max_batches = 16;
+    int budget = max_batches;
+
+    // Main loop
+    while (!terminate) {
+      if (budget-- <= 0) {
+        wake(); // Come back for the rest
+        return;
+      }
+
+      if (!*socket) {
+        // Give the receiver a break after it went away
+        if (clock::now() < retry_at) {
+          account_queue();
+          wake_at(retry_at);
+          return;
+        }
+
+        if (!socket->connect()) {
+          retry_at =
+              clock::now() + std::chrono::milliseconds(retry_interval_ms);
+          continue;
+        }
+
+        // A new connection should always start a new context
+        context.reset();
+
+        // This might set the data_loss too frequently, but it's only a help,
+        // not a promise
+        std::scoped_lock lock(mutex);
+        data_loss = true;
+      }
+
+      if (socket->blocked()) {
+        // Wait for something to happen with the socket
+        switch (socket->poll()) {
+        case 0:
+          watch(socket->fd(), EPOLLOUT);
+          wake_at(clock::now() + std::chrono::seconds(1));
+          return;
+        case -1:
+          retry_at =
+              clock::now() + std::chrono::milliseconds(retry_interval_ms);
+          continue; // socket is closed, and will be recreated
+        default:
+          break; // socket is ready for writing
+        }
+
+        // Flush what the socket didn't take
+        if (!socket->flush(max_batch_bytes, pass_fd_bytes)) {
+          continue; // Couldn't write what was stored, socket might be closed
+        }
+      }
+
+      // Output is gathered until there's enough for a write
+      if (socket->pending() >= max_batch_bytes) {
+        socket->flush(max_batch_bytes, pass_fd_bytes);
+        continue;
+      }
+
+      // Ensure we have a valid context
+      if (next_timeout <= clock::now() || !context) {
+        if (context) {
+          socket->queue(context->close());
+          context.reset();
+          continue; // Will eventually be written
+        }
+
+        context = serializer->create_context();
+        if (serializer_restart_interval_s != 0) {
+          next_timeout = clock::now() +
+                         std::chrono::seconds(serializer_restart_interval_s);
+        } else {
+          next_timeout = std::chrono::time_point<clock>::max();
+        }
+
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.restarts++;
+      }
+
+      account_queue();
+
+      if (!queue.empty()) {
+        // Everything queued is serialized as one batch
+        queue.pop_all(batch);
+
+        context->serialize_batch(batch, sink);
+        socket->queue(std::move(sink.buffer()));
+        sink.clear();
+
+        {
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.logs_out += batch.size();
+        }
+
+        batch.clear();
+        continue; // Will eventually be written
+      }
+
+      auto wake_time = next_timeout;
+
+      // Nothing more is ready, what's gathered is written once it has been
+      // held back long enough
+      if (socket->pending() != 0) {
+        auto flush_at = socket->flush_deadline(
+            std::chrono::milliseconds(max_flush_latency_ms));
+
+        if (flush_at <= clock::now()) {
+          socket->flush(max_batch_bytes, pass_fd_bytes);
+          continue;
+        }
+
+        wake_time = std::min(wake_time, flush_at);
+      }
+
+      if (queue.prepare_wait()) {
+        watch(queue.get_event_fd(), EPOLLIN);
+        wake_at(wake_time);
+        return;
+      }
+    }
+
+    // What's left is written, as far as the socket takes it without waiting,
+    // so a receiver sees the end of the context
+    if (socket && *socket && context) {
+      account_queue();
+      queue.pop_all(batch);
+
+      if (!batch.empty()) {
+        context->serialize_batch(batch, sink);
+        socket->queue(std::move(sink.buffer()));
+
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.logs_out += batch.size();
+      }
+
+      socket->queue(context->close());
+      socket->flush(max_batch_bytes, pass_fd_bytes);
+    }
+
+    unwatch(queue.get_event_fd());
+    socket.reset();
+
+    {
+      std::unique_lock lock(mutex);
+      worker_done = true;
+    }
+    cv.notify_all();
+  }
+
+public:
+  Logger(const char *name) : LioLi::Logger(name) {}
+
+  ~Logger() {
+    stop(); // Stops worker
+  }
+
+  bool had_data_loss(bool clear_flag) override {
+    std::scoped_lock lock(mutex);
+    bool old_value = data_loss;
+
+    data_loss &= !clear_flag;
+
+    return old_value;
+  }
+
+  void operator<<(const LioLi::Tree &&tree) override {
+    log(std::move(tree), LioLi::Priority::normal);
+  }
+
+  void log(const LioLi::Tree &&tree, LioLi::Priority priority) override {
+    // Counted and checked for overflows by the worker, see account_queue()
+    queue.push(LioLi::Tree(tree), priority);
+  }
+
+  void set_serializer(const char *name) {
+    std::scoped_lock lock(mutex);
+
+    assert(serializer_name.empty() ||
+           name == serializer_name); // We do not handle changing of the
+                                     // serializer name
+
+    serializer_name = name;
+  }
+
+  void set_socket(std::string path, bool use_seqpacket) {
+    socket_path = path;
+    seqpacket = use_seqpacket;
+  }
+
+  // Applied to every priority class
+  void set_queue_limits(uint32_t max, uint64_t max_bytes,
+                        LioLi::TreeRing::DropPolicy policy) {
+    std::scoped_lock lock(mutex);
+
+    assert(max > 0); // We need to be able to queue at least one element
+
+    for (std::size_t i = 0; i < LioLi::priority_count; i++) {
+      auto priority = static_cast<LioLi::Priority>(i);
+
+      // If queue size is being reduced, trees might be dropped
+      if (auto dropped = queue.set_capacity(max, priority)) {
+        snort::WarningMessage(
+            "WARNING: %s dropping %li trees from queue due to resize\n",
+            get_name(), dropped);
+      }
+      queue.set_max_bytes(max_bytes, priority);
+      queue.set_drop_policy(policy, priority);
+    }
+  }
+
+  void set_serializer_restart_interval_s(uint32_t interval) {
+    {
+      std::scoped_lock lock(mutex);
+
+      serializer_restart_interval_s = interval;
+    }
+    // Kick worker
+    queue.kick();
+  }
+
+  void set_retry_interval(uint32_t retry_interval) {
+    retry_interval_ms = retry_interval;
+  }
+
+  void set_batching(uint32_t flush_latency_ms, std::size_t batch_bytes,
+                    uint64_t fd_bytes) {
+    max_flush_latency_ms = flush_latency_ms;
+    max_batch_bytes = batch_bytes;
+    pass_fd_bytes = fd_bytes;
+  }
+
+  // Call after all configuration is done
+  void start() {
+    if (started) {
+      return;
+    }
+
+    terminate = false;
+    worker_done = false;
+    started = true;
+    Common::Reactor::get().add(*this);
+  }
+
+  // Call to terminate
+  void stop() {
+    // Check worker is running
+    if (!started) {
+      return;
+    }
+
+    terminate = true;
+    wake();
+
+    {
+      std::unique_lock lock(mutex);
+
+      // Give worker a chance to go down gracefully, it never blocks on the
+      // socket, so this is only to be sure
+      cv.wait_for(lock, std::chrono::seconds(2),
+                  [this] { return worker_done; });
+    }
+
+    Common::Reactor::get().remove(*this);
+    started = false;
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {}
+
+  ~Module() {}
+
+  struct ConfigColector {
+    std::string name;
+    std::string socket_path;
+    bool seqpacket = false;
+    uint32_t queue_limit;
+    uint64_t queue_limit_bytes = 0;
+    LioLi::TreeRing::DropPolicy drop_policy = {};
+    uint32_t restart_interval;
+    uint32_t retry_interval;
+    uint32_t max_flush_latency_ms = 0;
+    uint32_t max_batch_bytes = 1048576;
+    uint64_t pass_fd_bytes = 0;
+    std::string serializer;
+  };
+
+  std::stack<ConfigColector> config_stack;
+
+  bool begin(const char *, int, snort::SnortConfig *) override {
+    // Make new element
+    config_stack.emplace();
+    return true;
+  }
+
+  bool end(const char *, int, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    // Check validity
+    if (config_stack.top().name.empty()) {
+      if (config_stack.size() > 1) {
+        snort::ErrorMessage("ERROR: No alias given for entry\n");
+        config_stack.pop();
+        return false;
+      }
+
+      config_stack.top().name = s_name;
+    }
+
+    if (config_stack.top().serializer.empty()) {
+      snort::ErrorMessage("ERROR: No serializer given for entry\n");
+      config_stack.pop();
+      return false;
+    }
+
+    if (config_stack.top().pass_fd_bytes != 0 &&
+        !config_stack.top().seqpacket) {
+      snort::ErrorMessage(
+          "ERROR: %s can only pass fds with socket_type seqpacket\n", s_name);
+      config_stack.pop();
+      return false;
+    }
+
+    if (config_stack.top().socket_path.empty() ||
+        config_stack.top().socket_path.size() >=
+            sizeof(sockaddr_un::sun_path)) {
+      snort::ErrorMessage("ERROR: %s needs a socket_path of 1 to %zu chars\n",
+                          s_name, sizeof(sockaddr_un::sun_path) - 1);
+      config_stack.pop();
+      return false;
+    }
+
+    // Create entry in DB
+    if (!LioLi::LogDB::register_type<Logger>(config_stack.top().name.c_str())) {
+      snort::ErrorMessage("ERROR: Found duplicate name/alias '%s'\n",
+                          config_stack.top().name.c_str());
+      config_stack.pop();
+      return false;
+    }
+
+    auto logger = LioLi::LogDB::get<Logger>(config_stack.top().name.c_str());
+
+    if (!logger) {
+      snort::ErrorMessage("ERROR: Unable to initialize logger\n");
+      config_stack.pop();
+      return false;
+    }
+
+    // Initialize specific logger
+    logger->set_serializer(config_stack.top().serializer.c_str());
+    logger->set_socket(config_stack.top().socket_path,
+                       config_stack.top().seqpacket);
+    logger->set_queue_limits(config_stack.top().queue_limit,
+                             config_stack.top().queue_limit_bytes,
+                             config_stack.top().drop_policy);
+    logger->set_serializer_restart_interval_s(
+        config_stack.top().restart_interval);
+    logger->set_retry_interval(config_stack.top().retry_interval);
+    logger->set_batching(config_stack.top().max_flush_latency_ms,
+                         config_stack.top().max_batch_bytes,
+                         config_stack.top().pass_fd_bytes);
+
+    // Start the logger
+    logger->start();
+
+    config_stack.pop();
+    return true;
+  }
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    assert(!config_stack.empty());
+
+    if (val.is("alias")) {
+      std::string alias = val.get_as_string();
+
+      if (alias.empty()) {
+        snort::ErrorMessage("ERROR: Alias specified with empty name\n");
+        return false;
+      }
+
+      config_stack.top().name = alias;
+    } else if (val.is("socket_path")) {
+      config_stack.top().socket_path = val.get_as_string();
+    } else if (val.is("socket_type")) {
+      config_stack.top().seqpacket = val.get_uint8() == 1;
+    } else if (val.is("queue_max")) {
+      config_stack.top().queue_limit = val.get_uint32();
+    } else if (val.is("queue_max_bytes")) {
+      config_stack.top().queue_limit_bytes = val.get_uint64();
+    } else if (val.is("drop_policy")) {
+      config_stack.top().drop_policy =
+          static_cast<LioLi::TreeRing::DropPolicy>(val.get_uint8());
+    } else if (val.is("restart_interval_s")) {
+      config_stack.top().restart_interval = val.get_uint32();
+    } else if (val.is("retry_interval_ms")) {
+      config_stack.top().retry_interval = val.get_uint32();
+    } else if (val.is("max_flush_latency_ms")) {
+      config_stack.top().max_flush_latency_ms = val.get_uint32();
+    } else if (val.is("max_batch_bytes")) {
+      config_stack.top().max_batch_bytes = val.get_uint32();
+    } else if (val.is("pass_fd_bytes")) {
+      config_stack.top().pass_fd_bytes = val.get_uint64();
+    } else if (val.is("serializer")) {
+      std::string serializer = val.get_as_string();
+
+      if (serializer.empty()) {
+        snort::ErrorMessage("ERROR: empty name given for serializer\n");
+        return false;
+      }
+
+      config_stack.top().serializer = serializer;
+    } else {
+      // fail if we didn't get something valid
+      return false;
+    }
+
+    return true;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // TODO: This will mess when snort tries to clear the pegs, find a solution
+    // that lets this work in a multithreaded environment
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static PegCounts static_pegs;
+
+    std::scoped_lock lock(peg_count_mutex);
+    static_pegs = s_peg_counts;
+
+    return reinterpret_cast<PegCount *>(&static_pegs);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace logger_unix
@@ -0,0 +1,18 @@
+#ifndef logger_unix_6e1d0c47
+#define logger_unix_6e1d0c47
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace logger_unix {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace logger_unix
+
+#endif // #ifndef logger_unix_6e1d0c47
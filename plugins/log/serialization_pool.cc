@@ -0,0 +1,152 @@
+// Snort includes
+#include <log/messages.h>
+
+// System includes
+#include <cassert>
+
+// Local includes
+#include "serialization_pool.h"
+
+// Debug includes
+
+namespace LioLi {
+
+std::unique_ptr<SerializationPool>
+SerializationPool::create(std::shared_ptr<Serializer> serializer,
+                          unsigned threads, std::function<void()> on_ready) {
+  if (threads == 0) {
+    return nullptr;
+  }
+
+  if (!serializer->create_batch_context()) {
+    snort::WarningMessage("WARNING: %s can't serialize in parallel, using a "
+                          "single thread\n",
+                          serializer->get_name());
+    return nullptr;
+  }
+
+  return std::make_unique<SerializationPool>(serializer, threads, on_ready);
+}
+
+SerializationPool::SerializationPool(std::shared_ptr<Serializer> serializer,
+                                     unsigned threads,
+                                     std::function<void()> on_ready)
+    : serializer(serializer), on_ready(on_ready) {
+  assert(serializer);
+  assert(threads > 0);
+
+  for (unsigned i = 0; i < threads; i++) {
+    workers.emplace_back(&SerializationPool::worker_loop, this);
+  }
+}
+
+SerializationPool::~SerializationPool() {
+  {
+    std::scoped_lock lock(mutex);
+    terminate = true;
+  }
+
+  cv.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void SerializationPool::worker_loop() {
+  std::unique_lock lock(mutex);
+
+  while (true) {
+    cv.wait(lock, [this] { return terminate || !jobs.empty(); });
+
+    if (terminate) {
+      return;
+    }
+
+    Job job = std::move(jobs.front());
+    jobs.pop_front();
+
+    lock.unlock();
+
+    if (!job.context) {
+      job.context = serializer->create_batch_context();
+      assert(job.context); // Pool must only be used if batches are supported
+    }
+
+    Serializer::Sink sink;
+    job.context->serialize_batch(job.trees, sink);
+    if (job.close) {
+      sink.append(job.context->close());
+    }
+
+    lock.lock();
+
+    if (job.generation == generation) {
+      results.emplace(job.sequence,
+                      Result{std::move(sink.buffer()), job.trees.size()});
+
+      if (job.sequence == next_take) {
+        lock.unlock();
+        on_ready();
+        lock.lock();
+      }
+    }
+  }
+}
+
+std::size_t
+SerializationPool::submit(std::vector<Tree> &&trees,
+                          std::shared_ptr<Serializer::Context> stream_context) {
+  std::size_t queued;
+
+  {
+    std::scoped_lock lock(mutex);
+    bool close = !stream_context;
+    jobs.push_back(Job{next_submit++, generation, std::move(stream_context),
+                       close, std::move(trees)});
+    queued = jobs.size();
+  }
+
+  cv.notify_one();
+  return queued;
+}
+
+bool SerializationPool::take(std::string &output, std::size_t &tree_count,
+                             std::size_t &waiting) {
+  std::scoped_lock lock(mutex);
+  auto itr = results.find(next_take);
+
+  waiting = results.size();
+
+  if (itr == results.end()) {
+    return false;
+  }
+
+  output = std::move(itr->second.output);
+  tree_count = itr->second.tree_count;
+  results.erase(itr);
+  next_take++;
+  waiting--;
+
+  return true;
+}
+
+bool SerializationPool::is_ready() {
+  std::scoped_lock lock(mutex);
+  return results.contains(next_take);
+}
+
+std::size_t SerializationPool::outstanding() {
+  std::scoped_lock lock(mutex);
+  return next_submit - next_take;
+}
+
+void SerializationPool::discard() {
+  std::scoped_lock lock(mutex);
+  generation++;
+  jobs.clear();
+  results.clear();
+  next_take = next_submit;
+}
+
+} // namespace LioLi
@@ -5,12 +5,14 @@
 #include <framework/module.h>
 
 // System includes
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <mutex>
 #include <vector>
 
 // Local includes
+#include "atomic_pegs.h"
 #include "lioli.h"
 #include "log_framework.h"
 #include "serializer_bill.h"
@@ -41,11 +43,12 @@ const PegInfo s_pegs[] = {
     {CountType::END, nullptr, nullptr}};
 
 // This must match the s_pegs[] array
-// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
-std::mutex peg_count_mutex; // Protects the peg counts
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads,
+// the counts are atomic as contexts are used from many threads at once (every
+// packet thread has its own with ThreadStream)
 struct PegCounts {
-  PegCount tree_count = 0;
-  PegCount output_bytes = 0;
+  std::atomic<PegCount> tree_count = 0;
+  std::atomic<PegCount> output_bytes = 0;
 } s_peg_counts;
 
 // Compile time sanity check of number of entries in s_pegs and s_peg_counts
@@ -73,39 +76,61 @@ public:
     LioLi::LioLi lioli;
     bool first_write = true;
     bool closed = false;
+    bool continuation; // Continues a stream, so has no header
 
-  public:
-    std::string serialize(const LioLi::Tree &&tree) override {
-      std::scoped_lock lock(mutex);
+    // Inserts the header before the first tree, returns false if the context
+    // can't be used, mutex must be held
+    bool start() {
       if (first_write) {
         if (settings.option_no_root_node) {
           lioli.set_no_root_node();
         }
         if (settings.secret.size() != 9) {
           snort::ErrorMessage("ERROR: BILL secret not set to a valid value\n");
-          {
-            std::scoped_lock lock(peg_count_mutex);
-            s_peg_counts.tree_count++;
-          }
-
-          return "";
+          return false;
         }
         lioli.set_secret(settings.secret);
-        lioli.insert_header();
+        if (!continuation) {
+          lioli.insert_header();
+        }
         first_write = false;
       }
 
-      lioli << std::move(tree);
+      return true;
+    }
+
+  public:
+    Context(bool continuation = false) : continuation(continuation) {}
 
-      {
-        std::scoped_lock lock(peg_count_mutex);
-        s_peg_counts.tree_count++;
-        s_peg_counts.output_bytes += lioli.length();
+    std::string serialize(const LioLi::Tree &&tree) override {
+      std::scoped_lock lock(mutex);
+
+      if (start()) {
+        lioli << std::move(tree);
       }
 
+      s_peg_counts.tree_count++;
+      s_peg_counts.output_bytes += lioli.length();
+
       return lioli.move_binary();
     }
 
+    void serialize_batch(std::span<const LioLi::Tree> trees,
+                         LioLi::Serializer::Sink &sink) override {
+      std::scoped_lock lock(mutex);
+
+      if (start()) {
+        for (auto &tree : trees) {
+          lioli << tree;
+        }
+      }
+
+      s_peg_counts.tree_count += trees.size();
+      s_peg_counts.output_bytes += lioli.length();
+
+      sink.append(lioli.move_binary());
+    }
+
     // Terminate current context, returned byte sequence is any remaining
     // data/end marker of current context.  Context object is invalid after
     // this, except the is_closed() function.
@@ -116,10 +141,7 @@ public:
       }
       closed = true;
 
-      {
-        std::scoped_lock lock(peg_count_mutex);
-        s_peg_counts.output_bytes += lioli.length();
-      }
+      s_peg_counts.output_bytes += lioli.length();
 
       return lioli.move_binary();
     }
@@ -135,6 +157,10 @@ public:
     std::shared_ptr<Context> context = std::make_shared<Context>();
     return context;
   };
+
+  std::shared_ptr<LioLi::Serializer::Context> create_batch_context() override {
+    return std::make_shared<Context>(true);
+  }
 };
 
 class Module : public snort::Module {
@@ -240,12 +266,8 @@ class Module : public snort::Module {
   PegCount *get_counts() const override {
     // We need to return a copy of the peg counts as we don't know when snort
     // are done with them
-    static PegCounts static_pegs;
-
-    std::scoped_lock lock(peg_count_mutex);
-    static_pegs = s_peg_counts;
-
-    return reinterpret_cast<PegCount *>(&static_pegs);
+    static Common::AtomicPegs<PegCounts> static_pegs;
+    return static_pegs.get(s_peg_counts);
   }
 
 public:
@@ -0,0 +1,612 @@
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+#include <log/messages.h>
+
+// System includes
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Local includes
+#include "atomic_pegs.h"
+#include "columnar.h"
+#include "lioli.h"
+#include "log_framework.h"
+#include "serializer_columnar.h"
+
+namespace serializer_columnar {
+namespace {
+
+static const char *s_name = "serializer_columnar";
+static const char *s_help =
+    "Serializes LioLi trees to blocks of columns, see includes/columnar.h";
+
+/*
+serializer_columnar = {
+  rows_per_block = 4096,
+  max_block_delay_ms = 1000,
+  columns = { { name = "start_time", lookup = "$.start_time",
+                type = "timestamp" },
+              { name = "src_ip",     lookup = "$.principal.addr.ip" },
+              { name = "src_port",   lookup = "$.principal.addr.port",
+                type = "int" },
+              { name = "packets",    lookup = "$.delta.packet",
+                type = "int" } }
+}
+
+Trees are buffered until rows_per_block trees are collected, or a tree is
+serialized more than max_block_delay_ms after the first tree of the block, at
+which point a block is emitted.  Any remaining trees are emitted as a block
+when the output is closed.  The delay is only checked when a tree arrives, the
+loggers have no hook to flush a serializer when idle, so on a quiet link a
+partial block waits for the next tree.
+
+A context uses the columns configured when it was created, a reload applies
+to contexts created after it.
+
+Values that are missing, empty or can't be parsed as the type of the column
+are null.
+*/
+
+static const snort::Parameter column_params[] = {
+    {"name", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "name of column"},
+    {"lookup", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "key of value in tree"},
+    {"type", snort::Parameter::PT_ENUM, "string | int | timestamp", "string",
+     "type of column, timestamps are stored as ns since epoch"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+static const snort::Parameter module_params[] = {
+    {"columns", snort::Parameter::PT_LIST, column_params, nullptr,
+     "columns of the blocks"},
+    {"rows_per_block", snort::Parameter::PT_INT, "1:max32", "4096",
+     "number of trees in each block"},
+    {"max_block_delay_ms", snort::Parameter::PT_INT, "0:max32", "1000",
+     "max time trees are buffered before a block is emitted, 0 means no "
+     "limit; only checked when a tree arrives, a partial block isn't flushed "
+     "while no trees come"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "tree_count", "Number of trees serialized"},
+    {CountType::SUM, "block_count", "Number of blocks emitted"},
+    {CountType::SUM, "null_count", "Number of null values"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads,
+// the counts are atomic as contexts are used from many threads at once (every
+// packet thread has its own with ThreadStream)
+struct PegCounts {
+  std::atomic<PegCount> tree_count = 0;
+  std::atomic<PegCount> block_count = 0;
+  std::atomic<PegCount> null_count = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+struct Column {
+  std::string name;
+  std::string lookup;
+  Columnar::Type type = Columnar::Type::string;
+  LioLi::Tree::Key key; // Compiled lookup
+};
+
+// Settings for this module
+struct Settings {
+  std::vector<Column> columns;
+  uint32_t rows_per_block = 4096;
+  std::chrono::milliseconds max_block_delay{1000};
+} settings;
+
+// Parses timestamps as generated by TreeGenerators::timestamp(), e.g.
+// 2024-01-31T12:34:56.123456789Z, to ns since epoch
+std::optional<int64_t> parse_timestamp(std::string_view text) {
+  auto number = [&text](size_t pos, size_t length) -> std::optional<int> {
+    int value;
+    if (pos + length > text.size() ||
+        std::from_chars(text.data() + pos, text.data() + pos + length, value)
+                .ptr != text.data() + pos + length) {
+      return std::nullopt;
+    }
+    return value;
+  };
+
+  auto year = number(0, 4);
+  auto month = number(5, 2);
+  auto day = number(8, 2);
+  auto hours = number(11, 2);
+  auto minutes = number(14, 2);
+  auto seconds = number(17, 2);
+
+  if (!year || !month || !day || !hours || !minutes || !seconds ||
+      text.back() != 'Z' || (text.size() > 20 && text[19] != '.')) {
+    return std::nullopt;
+  }
+
+  std::chrono::year_month_day date{std::chrono::year(*year),
+                                   std::chrono::month(*month),
+                                   std::chrono::day(*day)};
+  if (!date.ok()) {
+    return std::nullopt;
+  }
+
+  int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::sys_days(date).time_since_epoch() +
+                   std::chrono::hours(*hours) + std::chrono::minutes(*minutes) +
+                   std::chrono::seconds(*seconds))
+                   .count();
+
+  // Fraction of seconds, as many digits as given (up to ns)
+  if (text.size() > 20 && text[19] == '.') {
+    int64_t scale = 100'000'000;
+    for (size_t pos = 20; pos < text.size() - 1; pos++, scale /= 10) {
+      if (text[pos] < '0' || text[pos] > '9') {
+        return std::nullopt;
+      }
+      ns += (text[pos] - '0') * scale;
+    }
+  }
+
+  return ns;
+}
+
+std::optional<int64_t> parse_integer(std::string_view text) {
+  int64_t value;
+  auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+
+  if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+    return std::nullopt;
+  }
+
+  return value;
+}
+
+// Values of a column for the rows of the current block
+class ColumnBuilder {
+  Column column; // A copy, the settings might be reloaded while it's used
+  std::vector<uint8_t> nulls; // Bitmap, set if row is null
+  uint32_t rows = 0;
+
+  // String columns
+  std::unordered_map<std::string, uint32_t> dictionary;
+  std::vector<const std::string *> entries; // Dictionary in index order
+  uint64_t text_size = 0;
+  std::vector<uint32_t> indexes;
+
+  // Int and timestamp columns
+  std::vector<int64_t> values;
+
+  uint64_t data_size(uint8_t delta_width) const {
+    if (column.type == Columnar::Type::string) {
+      return Columnar::align((entries.size() + 1) * sizeof(uint32_t) +
+                             text_size) +
+             Columnar::align(rows * sizeof(uint32_t));
+    }
+
+    return 16 + Columnar::align(rows * delta_width);
+  }
+
+  // Smallest width that holds all the zigzag encoded deltas
+  uint8_t delta_width() const {
+    uint64_t max = 0;
+    int64_t previous = values.empty() ? 0 : values.front();
+
+    for (auto value : values) {
+      max |= Columnar::zigzag_encode(static_cast<int64_t>(
+          static_cast<uint64_t>(value) - static_cast<uint64_t>(previous)));
+      previous = value;
+    }
+
+    return (max <= UINT8_MAX) ? 1 : (max <= UINT16_MAX) ? 2
+                                : (max <= UINT32_MAX)   ? 4
+                                                        : 8;
+  }
+
+public:
+  ColumnBuilder(const Column &column) : column(column) {}
+
+  // Adds a row, returns false if the value is null
+  bool add(const LioLi::Tree &tree) {
+    std::string_view text = tree.lookup(column.key);
+    std::optional<int64_t> value;
+    bool is_null = text.empty();
+
+    if (!is_null && column.type != Columnar::Type::string) {
+      value = (column.type == Columnar::Type::timestamp) ? parse_timestamp(text)
+                                                         : parse_integer(text);
+      is_null = !value;
+    }
+
+    if (rows % 8 == 0) {
+      nulls.push_back(0);
+    }
+
+    if (is_null) {
+      nulls.back() |= 1 << (rows % 8);
+    }
+
+    if (column.type == Columnar::Type::string) {
+      uint32_t index = 0;
+
+      if (!is_null) {
+        auto [itr, added] =
+            dictionary.try_emplace(std::string(text), entries.size());
+        if (added) {
+          entries.push_back(&itr->first);
+          text_size += text.size();
+        }
+        index = itr->second;
+      }
+
+      indexes.push_back(index);
+    } else {
+      // Null rows repeat the previous value, so they get a zero delta
+      values.push_back(value ? *value : values.empty() ? 0 : values.back());
+    }
+
+    rows++;
+    return !is_null;
+  }
+
+  // Bytes needed for this column in a block
+  uint64_t size() const {
+    return Columnar::align(column.name.size()) + Columnar::align(nulls.size()) +
+           data_size(delta_width());
+  }
+
+  // Writes the column at offset in block, returns offset after it
+  uint64_t write(std::string &block, uint16_t index, uint64_t offset) const {
+    Columnar::ColumnHeader header{};
+    uint8_t width = delta_width();
+
+    header.type = column.type;
+    header.encoding = (column.type == Columnar::Type::string)
+                          ? Columnar::Encoding::dictionary
+                          : Columnar::Encoding::delta;
+    header.name_length = column.name.size();
+    header.dictionary_count = entries.size();
+
+    header.name_offset = offset;
+    std::memcpy(block.data() + offset, column.name.data(), column.name.size());
+    offset += Columnar::align(column.name.size());
+
+    header.null_bitmap_offset = offset;
+    std::memcpy(block.data() + offset, nulls.data(), nulls.size());
+    offset += Columnar::align(nulls.size());
+
+    header.data_offset = offset;
+    char *data = block.data() + offset;
+
+    if (column.type == Columnar::Type::string) {
+      uint32_t text_offset = 0;
+      char *text = data + (entries.size() + 1) * sizeof(uint32_t);
+
+      for (size_t entry = 0; entry < entries.size(); entry++) {
+        std::memcpy(data + entry * sizeof(uint32_t), &text_offset,
+                    sizeof(uint32_t));
+        std::memcpy(text + text_offset, entries[entry]->data(),
+                    entries[entry]->size());
+        text_offset += entries[entry]->size();
+      }
+      std::memcpy(data + entries.size() * sizeof(uint32_t), &text_offset,
+                  sizeof(uint32_t));
+
+      std::memcpy(data + Columnar::align((entries.size() + 1) *
+                                             sizeof(uint32_t) +
+                                         text_size),
+                  indexes.data(), indexes.size() * sizeof(uint32_t));
+    } else {
+      int64_t previous = values.empty() ? 0 : values.front();
+
+      std::memcpy(data, &previous, sizeof(previous));
+      data[8] = width;
+
+      for (size_t row = 0; row < values.size(); row++) {
+        uint64_t delta = Columnar::zigzag_encode(
+            static_cast<int64_t>(static_cast<uint64_t>(values[row]) -
+                                 static_cast<uint64_t>(previous)));
+        std::memcpy(data + 16 + row * width, &delta, width);
+        previous = values[row];
+      }
+    }
+
+    offset += data_size(width);
+
+    std::memcpy(block.data() + sizeof(Columnar::BlockHeader) +
+                    index * sizeof(Columnar::ColumnHeader),
+                &header, sizeof(header));
+
+    return offset;
+  }
+};
+
+// MAIN object of this file
+class Serializer : public LioLi::Serializer {
+
+public:
+  Serializer(const char *name) : LioLi::Serializer(name) {}
+
+  ~Serializer() = default;
+
+  class Context : public LioLi::Serializer::Context {
+    std::mutex mutex;
+    bool closed = false;
+
+    // Copied when created, so a reload doesn't change a block being built
+    const std::vector<Column> columns = settings.columns;
+    const uint32_t rows_per_block = settings.rows_per_block;
+    const std::chrono::milliseconds max_block_delay = settings.max_block_delay;
+
+    std::vector<ColumnBuilder> builders;
+    uint32_t rows = 0;
+    std::chrono::steady_clock::time_point first_row_time;
+
+    // Returns the buffered rows as a block, and starts a new block
+    std::string flush() {
+      if (rows == 0) {
+        return "";
+      }
+
+      uint64_t size = sizeof(Columnar::BlockHeader) +
+                      builders.size() * sizeof(Columnar::ColumnHeader);
+      for (auto &builder : builders) {
+        size += builder.size();
+      }
+
+      std::string block(size, '\0');
+      uint64_t offset = sizeof(Columnar::BlockHeader) +
+                        builders.size() * sizeof(Columnar::ColumnHeader);
+
+      for (size_t index = 0; index < builders.size(); index++) {
+        offset = builders[index].write(block, index, offset);
+      }
+
+      assert(offset == size);
+
+      Columnar::BlockHeader header{};
+      std::memcpy(header.magic, Columnar::block_magic, sizeof(header.magic));
+      header.version = Columnar::block_version;
+      header.column_count = builders.size();
+      header.row_count = rows;
+      header.block_size = size;
+      std::memcpy(block.data(), &header, sizeof(header));
+
+      reset();
+
+      s_peg_counts.block_count++;
+
+      return block;
+    }
+
+    void reset() {
+      builders.clear();
+      for (auto &column : columns) {
+        builders.emplace_back(column);
+      }
+      rows = 0;
+    }
+
+    // Adds tree as a row, returns true if the block is complete, mutex must
+    // be held
+    bool add_row(const LioLi::Tree &tree,
+                 std::chrono::steady_clock::time_point now, PegCount &nulls) {
+      if (rows == 0) {
+        first_row_time = now;
+      }
+
+      for (auto &builder : builders) {
+        if (!builder.add(tree)) {
+          nulls++;
+        }
+      }
+
+      rows++;
+
+      return rows >= rows_per_block ||
+             (max_block_delay.count() &&
+              now - first_row_time >= max_block_delay);
+    }
+
+  public:
+    Context() { reset(); }
+
+    std::string serialize(const LioLi::Tree &&tree) override {
+      std::scoped_lock lock(mutex);
+      PegCount nulls = 0;
+      bool complete = add_row(tree, std::chrono::steady_clock::now(), nulls);
+
+      s_peg_counts.tree_count++;
+      s_peg_counts.null_count += nulls;
+
+      return complete ? flush() : "";
+    }
+
+    void serialize_batch(std::span<const LioLi::Tree> trees,
+                         LioLi::Serializer::Sink &sink) override {
+      std::scoped_lock lock(mutex);
+      auto now = std::chrono::steady_clock::now();
+      PegCount nulls = 0;
+
+      for (auto &tree : trees) {
+        if (add_row(tree, now, nulls)) {
+          sink.append(flush());
+        }
+      }
+
+      s_peg_counts.tree_count += trees.size();
+      s_peg_counts.null_count += nulls;
+    }
+
+    // Terminate current context, returned byte sequence is any remaining
+    // data/end marker of current context.  Context object is invalid after
+    // this, except the is_closed() function.
+    std::string close() override {
+      std::scoped_lock lock(mutex);
+      closed = true;
+      return flush();
+    }
+
+    // Returns true if context is closed (invalid to call)
+    bool is_closed() override { return closed; }
+  };
+
+  // Return TRUE if the serialized output is binary, FALSE if it is text based
+  bool is_binary() override { return true; };
+
+  std::shared_ptr<LioLi::Serializer::Context> create_context() override {
+    return std::make_shared<Context>();
+  };
+
+  // Blocks are self contained, a batch context just ends its last block when
+  // closed
+  std::shared_ptr<LioLi::Serializer::Context> create_batch_context() override {
+    return create_context();
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {
+    LioLi::LogDB::register_type<Serializer>(s_name);
+  }
+
+  bool begin(const char *fqn, int idx, snort::SnortConfig *) override {
+    std::string name(fqn);
+
+    if (name == s_name) {
+      settings.columns.clear();
+    } else if (name == std::string(s_name) + ".columns" && idx > 0) {
+      settings.columns.emplace_back();
+    }
+
+    return true;
+  }
+
+  bool end(const char *fqn, int idx, snort::SnortConfig *) override {
+    std::string name(fqn);
+
+    if (name == s_name) {
+      if (settings.columns.empty()) {
+        snort::ErrorMessage("ERROR: %s needs at least one column\n", s_name);
+        return false;
+      }
+    } else if (name == std::string(s_name) + ".columns" && idx > 0) {
+      auto &column = settings.columns.back();
+
+      if (column.name.empty() || column.lookup.empty()) {
+        snort::ErrorMessage("ERROR: %s columns must have a name and lookup\n",
+                            s_name);
+        return false;
+      }
+
+      column.key = LioLi::Tree::compile_key(column.lookup);
+    }
+
+    return true;
+  }
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    if (val.is("rows_per_block")) {
+      settings.rows_per_block = val.get_uint32();
+      return true;
+    } else if (val.is("max_block_delay_ms")) {
+      settings.max_block_delay = std::chrono::milliseconds(val.get_uint32());
+      return true;
+    }
+
+    if (settings.columns.empty()) {
+      return false;
+    }
+
+    auto &column = settings.columns.back();
+
+    if (val.is("name")) {
+      column.name = val.get_as_string();
+    } else if (val.is("lookup")) {
+      column.lookup = val.get_as_string();
+    } else if (val.is("type")) {
+      // Enum values are in the order of the range string
+      static const Columnar::Type types[] = {Columnar::Type::string,
+                                             Columnar::Type::integer,
+                                             Columnar::Type::timestamp};
+      column.type = types[val.get_uint8()];
+    } else {
+      return false;
+    }
+
+    return true;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static Common::AtomicPegs<PegCounts> static_pegs;
+    return static_pegs.get(s_peg_counts);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace serializer_columnar
@@ -0,0 +1,18 @@
+#ifndef serializer_columnar_0c6e2f85
+#define serializer_columnar_0c6e2f85
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace serializer_columnar {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace serializer_columnar
+
+#endif // #ifndef serializer_columnar_0c6e2f85
@@ -5,14 +5,22 @@
 #include <framework/module.h>
 
 // System includes
-#include <format>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <regex>
+#include <string_view>
+#include <vector>
 
 // Local includes
 #include "lioli.h"
 #include "log_framework.h"
 #include "serializer_csv.h"
+#include "text_kernels.h"
 
 namespace serializer_csv {
 namespace {
@@ -22,78 +30,278 @@ static const char *s_help = "Serializes parts of LioLi trees to csv format";
 
 /*
 serializer_csv = {
-  item_seperator = " ",
+  item_separator = " ",
   items= { { lookup = "$.#Chunks.chunk.first_from",
              map = { { if_input = "",       then_output = "-" },
                      { if_input = "client", then_output = "S" },
                      { if_input = "server", then_output = "C" },
                      { default_output = "O" } } },
-           { seperator = " " },
            { lookup = "$.protocol",
              map = { { if_input = "",    then_output = "-" },
                      { if_input = "TCP", then_output = "T" },
                      { if_input = "UDP", then_output = "U" },
                      { default_output = "O" } } },
-           { seperator = " " },
            { lookup = "$.port", },
-           { seperator = " " },
            { lookup_regex = "\\$\\.\\#Chunks\\.chunk\\.(client|server)\\.data",
              format_as_hex = true,
-             pad = { padding = "0",
-                     length = 2048 }
+             pad_output = { padding = "0",
+                            length = 2048 },
              truncate_input_after = 1024,
-  }
+           } }
 }
 
+The above is also the layout used if no items are given.
+
+Each item is processed as: lookup -> truncate -> map -> format -> pad, input
+found in the map (or replaced by the default) isn't formatted, and output that
+ends up empty is replaced by if_item_blank_then_output without being padded.
+
+The items are compiled to a column plan when the configuration ends, so no
+keys or regexes are parsed while serializing.  A context uses the plan there
+was when it was created, a reload applies to contexts created after it.
 */
 
 static const snort::Parameter map_params[] = {
     {"if_input", snort::Parameter::PT_STRING, nullptr, nullptr,
-     "(NOT IMPLEMENTED) key of entry"},
+     "key of entry"},
     {"then_output", snort::Parameter::PT_STRING, nullptr, nullptr,
-     "(NOT IMPLEMENTED) value of entry"},
+     "value of entry"},
     {"default_output", snort::Parameter::PT_STRING, nullptr, nullptr,
-     "(NOT IMPLEMENTED) default value of map"},
+     "default value of map, used for input not found in the map"},
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
 static const snort::Parameter pad_params[] = {
     {"padding", snort::Parameter::PT_STRING, nullptr, nullptr,
-     "(NOT IMPLEMENTED) padding string/char"},
+     "padding string/char"},
     {"length", snort::Parameter::PT_INT, "1:max53", nullptr,
-     "(NOT IMPLEMENTED) length that should be padded to"},
+     "length that should be padded to"},
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
 static const snort::Parameter item_params[] = {
-    {"lookup", snort::Parameter::PT_STRING, nullptr, nullptr,
-     "(NOT IMPLEMENTED) key of entry"},
+    {"lookup", snort::Parameter::PT_STRING, nullptr, nullptr, "key of entry"},
     {"lookup_regex", snort::Parameter::PT_STRING, nullptr, nullptr,
-     "(NOT IMPLEMENTED) key of entry as regex, all values will be concatenated "
-     "as input"},
+     "key of entry as regex, all values will be concatenated as input"},
     {"truncate_input_after", snort::Parameter::PT_INT, "1:max53", nullptr,
-     "(NOT IMPLEMENTED) max size of input value that will be considered"},
+     "max size of input value that will be considered"},
     {"format_as_hex", snort::Parameter::PT_BOOL, nullptr, "false",
-     "(NOT IMPLEMENTED) set to true to get all input converted to hex"},
+     "set to true to get all input converted to hex"},
+    {"format_as_base64", snort::Parameter::PT_BOOL, nullptr, "false",
+     "set to true to get all input converted to base64"},
     {"map", snort::Parameter::PT_LIST, map_params, nullptr,
-     "(NOT IMPLEMENTED) map to translate input to output"},
+     "map to translate input to output"},
     {"pad_output", snort::Parameter::PT_TABLE, pad_params, nullptr,
-     "(NOT IMPLEMENTED) padding options of output"},
+     "padding options of output"},
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
 static const snort::Parameter module_params[] = {
     {"item_separator", snort::Parameter::PT_STRING, nullptr, ", ",
      "string inserted between each item"},
     {"items", snort::Parameter::PT_LIST, item_params, nullptr,
-     "(NOT IMPLEMENTED) list of items that should be added"},
+     "list of items that should be added, if not given the trout_wizard "
+     "layout is used"},
     {"if_item_blank_then_output", snort::Parameter::PT_STRING, nullptr, "-",
      "string to output if item is missing or empty"},
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
-// Settings for this module
+// How input is formatted, if it isn't mapped
+enum class Format { raw, hex, base64 };
+
+// An item as given in the configuration
+struct Item {
+  std::string lookup;
+  std::string lookup_regex;
+  size_t truncate_input_after = std::string::npos;
+  Format format = Format::raw;
+  std::vector<std::pair<std::string, std::string>> map;
+  std::optional<std::string> default_output;
+  std::string padding;
+  size_t pad_length = 0;
+};
+
+// Map of an item, as a flat table: the entries are kept in one vector and
+// found by linear probing in a power of two table of their indexes, looked up
+// with the input as is, without copying it
+class FlatMap {
+  std::vector<std::pair<std::string, std::string>> entries;
+  std::vector<uint32_t> slots; // Index in entries + 1, 0 if free
+  size_t mask = 0;
+
+  static size_t hash(std::string_view input) {
+    return std::hash<std::string_view>()(input);
+  }
+
+public:
+  FlatMap() = default;
+
+  // The first entry of an input is used, as the if_input entries are given
+  explicit FlatMap(
+      const std::vector<std::pair<std::string, std::string>> &map) {
+    size_t size = 4;
+    while (size < map.size() * 2) {
+      size *= 2;
+    }
+
+    slots.resize(size);
+    mask = size - 1;
+
+    for (auto &entry : map) {
+      if (find(entry.first)) {
+        continue;
+      }
+
+      size_t slot = hash(entry.first) & mask;
+      while (slots[slot]) {
+        slot = (slot + 1) & mask;
+      }
+
+      entries.push_back(entry);
+      slots[slot] = entries.size();
+    }
+  }
+
+  // Output for input, nullptr if it isn't in the map
+  const std::string *find(std::string_view input) const {
+    if (entries.empty()) {
+      return nullptr;
+    }
+
+    for (size_t slot = hash(input) & mask; slots[slot];
+         slot = (slot + 1) & mask) {
+      auto &entry = entries[slots[slot] - 1];
+
+      if (entry.first == input) {
+        return &entry.second;
+      }
+    }
+
+    return nullptr;
+  }
+
+  bool empty() const { return entries.empty(); }
+};
+
+// An item compiled to the form used while serializing
+struct Column {
+  LioLi::Tree::Key key;
+  std::optional<std::regex> regex; // Used instead of key if set
+  size_t truncate_input_after = std::string::npos;
+  Format format = Format::raw;
+  FlatMap map;
+  std::optional<std::string> default_output;
+  std::string padding;
+  size_t pad_length = 0;
+
+  bool has_map() const { return !map.empty() || default_output; }
+};
+
+// Settings for this module, only used while configuring
 struct Settings {
   std::string separator;
   std::string blank_replace;
+  std::vector<Item> items;
 } settings;
 
+// What a context serializes with, compiled from the settings at the end of
+// configuration.  A reload compiles a new plan, contexts keep the one they
+// were created with.
+struct Plan {
+  std::string separator;
+  std::string blank_replace;
+  std::vector<Column> columns;
+};
+
+std::mutex plan_mutex; // Protects current_plan
+std::shared_ptr<const Plan> current_plan = std::make_shared<Plan>();
+
+std::shared_ptr<const Plan> get_plan() {
+  std::scoped_lock lock(plan_mutex);
+  return current_plan;
+}
+
+// Map entry being parsed
+struct MapEntry {
+  std::optional<std::string> if_input;
+  std::optional<std::string> then_output;
+  std::optional<std::string> default_output;
+} map_entry;
+
+// The layout that was hard coded before items were configurable
+std::vector<Item> wizard_items() {
+  std::vector<Item> items(4);
+
+  items[0].lookup = "$.#Chunks.chunk.first_from";
+  items[0].map = {
+      {"", settings.blank_replace}, {"client", "S"}, {"server", "C"}};
+  items[0].default_output = "O";
+
+  items[1].lookup = "$.protocol";
+  items[1].map = {{"", settings.blank_replace}, {"TCP", "T"}, {"UDP", "U"}};
+  items[1].default_output = "O";
+
+  items[2].lookup = "$.port";
+
+  items[3].lookup_regex = "\\$\\.\\#Chunks\\.chunk\\.(client|server)\\.data";
+  items[3].truncate_input_after = 1024;
+  items[3].format = Format::hex;
+  items[3].padding = "0";
+  items[3].pad_length = 2048;
+
+  return items;
+}
+
+bool compile_plan() {
+  auto plan = std::make_shared<Plan>();
+  plan->separator = settings.separator;
+  plan->blank_replace = settings.blank_replace;
+
+  for (auto &item : settings.items.empty() ? wizard_items() : settings.items) {
+    Column column;
+
+    if (!item.lookup_regex.empty()) {
+      try {
+        column.regex.emplace(item.lookup_regex, std::regex::optimize);
+      } catch (const std::regex_error &e) {
+        snort::ErrorMessage("ERROR: %s invalid lookup_regex \"%s\" (%s)\n",
+                            s_name, item.lookup_regex.c_str(), e.what());
+        return false;
+      }
+    } else {
+      column.key = LioLi::Tree::compile_key(item.lookup);
+    }
+
+    column.truncate_input_after = item.truncate_input_after;
+    column.format = item.format;
+    column.map = FlatMap(item.map);
+    column.default_output = item.default_output;
+    column.padding = item.padding;
+    column.pad_length = item.pad_length;
+
+    plan->columns.push_back(std::move(column));
+  }
+
+  std::scoped_lock lock(plan_mutex);
+  current_plan = std::move(plan);
+  return true;
+}
+
+// Pads output with the columns padding, until there is pad_length chars after
+// start
+void append_padding(std::string &output, size_t start, const Column &column) {
+  size_t length = output.size() - start;
+
+  if (column.padding.empty() || length >= column.pad_length) {
+    return;
+  }
+
+  size_t missing = column.pad_length - length;
+
+  while (missing > 0) {
+    size_t count = std::min(missing, column.padding.size());
+    output.append(column.padding, 0, count);
+    missing -= count;
+  }
+}
+
 // MAIN object of this file
 class Serializer : public LioLi::Serializer {
 
@@ -103,64 +311,68 @@ public:
   ~Serializer() = default;
 
   class Context : public LioLi::Serializer::Context {
+    const std::shared_ptr<const Plan> plan = get_plan();
     bool closed = false;
+    std::string regex_input; // Concatenated regex matches, kept to reuse the
+                             // allocation
+
+    std::string_view get_input(const LioLi::Tree &tree, const Column &column) {
+      if (!column.regex) {
+        return tree.lookup(column.key);
+      }
+
+      regex_input.clear();
+      tree.regex_lookup(*column.regex, [this](std::string_view value) {
+        regex_input += value;
+        return true;
+      });
+
+      return regex_input;
+    }
 
   public:
     std::string serialize(const LioLi::Tree &&tree) override {
+      std::string output;
 
-      // Input is where data is from, output is where it is going to
-      std::map<std::string, std::string> direction_map;
-      direction_map[""] = settings.blank_replace;
-      direction_map["client"] = "S";
-      direction_map["server"] = "C";
-      std::string direction = tree.lookup("$.#Chunks.chunk.first_from");
-      std::string output =
-          (direction_map.contains(direction) ? direction_map[direction] : "O") +
-          settings.separator;
-
-      std::map<std::string, std::string> protocol_map;
-      protocol_map[""] = settings.blank_replace;
-      protocol_map["TCP"] = "T";
-      protocol_map["UDP"] = "U";
-      std::string protocol = tree.lookup("$.protocol");
-      output +=
-          (protocol_map.contains(protocol) ? protocol_map[protocol] : "O") +
-          settings.separator;
-
-      std::string port = tree.lookup("$.port");
-      output += (port.length() > 0 ? port : settings.blank_replace) +
-                settings.separator;
-
-      std::string data;
-      tree.regex_lookup("\\$\\.\\#Chunks\\.chunk\\.(client|server)\\.data",
-                        [&data](std::string value) {
-                          data += value;
-                          return true;
-                        });
-
-      if (data.length() > 0) {
-        static const unsigned max_length =
-            1024; // Max number of bytes of data serialized, note this is input
-                  // bytes, each byte will be 2 hex chars
-        static const bool zero_extend =
-            true; // Set to true to pad shorter data with zero up to max_length
-        unsigned cur_length = 0;
-        std::string data_string;
-        data_string.reserve(max_length * 2);
-
-        for (char &c : data) {
-          data_string += std::format("{:02x}", c);
-          if (++cur_length >= max_length)
-            break;
+      for (auto &column : plan->columns) {
+        if (&column != &plan->columns.front()) {
+          output += plan->separator;
         }
 
-        if (zero_extend) {
-          data_string = std::format("{:0<2048}", data_string);
+        std::string_view input =
+            get_input(tree, column).substr(0, column.truncate_input_after);
+        size_t start = output.size();
+        bool mapped = false;
+
+        if (column.has_map()) {
+          if (auto mapped_output = column.map.find(input)) {
+            output += *mapped_output;
+            mapped = true;
+          } else if (column.default_output) {
+            output += *column.default_output;
+            mapped = true;
+          }
         }
 
-        output += data_string;
-      } else {
-        output += settings.blank_replace;
+        if (!mapped) {
+          switch (column.format) {
+          case Format::raw:
+            output += input;
+            break;
+          case Format::hex:
+            Common::append_hex(output, input);
+            break;
+          case Format::base64:
+            Common::append_base64(output, input);
+            break;
+          }
+        }
+
+        if (output.size() == start) {
+          output += plan->blank_replace;
+        } else {
+          append_padding(output, start, column);
+        }
       }
 
       output += '\n';
@@ -185,16 +397,67 @@ public:
   std::shared_ptr<LioLi::Serializer::Context> create_context() override {
     return std::make_shared<Context>();
   };
+
+  std::shared_ptr<LioLi::Serializer::Context> create_batch_context() override {
+    return create_context();
+  }
 };
 
 class Module : public snort::Module {
   Module() : snort::Module(s_name, s_help, module_params) {
     LioLi::LogDB::register_type<Serializer>(s_name);
+
+    // Gives the default layout, if we aren't configured
+    compile_plan();
   }
 
-  bool begin(const char *, int, snort::SnortConfig *) override { return true; }
+  bool begin(const char *fqn, int idx, snort::SnortConfig *) override {
+    std::string name(fqn);
 
-  bool end(const char *, int, snort::SnortConfig *) override { return true; }
+    if (name == s_name) {
+      settings.items.clear();
+    } else if (name == std::string(s_name) + ".items" && idx > 0) {
+      settings.items.emplace_back();
+    } else if (name == std::string(s_name) + ".items.map" && idx > 0) {
+      map_entry = MapEntry();
+    }
+
+    return true;
+  }
+
+  bool end(const char *fqn, int idx, snort::SnortConfig *) override {
+    std::string name(fqn);
+
+    if (name == s_name) {
+      return compile_plan();
+    } else if (name == std::string(s_name) + ".items" && idx > 0) {
+      auto &item = settings.items.back();
+
+      if (item.lookup.empty() == item.lookup_regex.empty()) {
+        snort::ErrorMessage("ERROR: %s items must have exactly one of lookup "
+                            "and lookup_regex\n",
+                            s_name);
+        return false;
+      }
+    } else if (name == std::string(s_name) + ".items.map" && idx > 0) {
+      auto &item = settings.items.back();
+
+      if (map_entry.default_output && !map_entry.if_input &&
+          !map_entry.then_output) {
+        item.default_output = map_entry.default_output;
+      } else if (map_entry.if_input && map_entry.then_output &&
+                 !map_entry.default_output) {
+        item.map.emplace_back(*map_entry.if_input, *map_entry.then_output);
+      } else {
+        snort::ErrorMessage("ERROR: %s map entries must have either if_input "
+                            "and then_output or only default_output\n",
+                            s_name);
+        return false;
+      }
+    }
+
+    return true;
+  }
 
   bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
     if (val.is("item_separator")) {
@@ -205,7 +468,41 @@ class Module : public snort::Module {
       return true;
     }
 
-    return false;
+    if (settings.items.empty()) {
+      return false;
+    }
+
+    auto &item = settings.items.back();
+
+    if (val.is("lookup")) {
+      item.lookup = val.get_as_string();
+    } else if (val.is("lookup_regex")) {
+      item.lookup_regex = val.get_as_string();
+    } else if (val.is("truncate_input_after")) {
+      item.truncate_input_after = val.get_uint64();
+    } else if (val.is("format_as_hex") || val.is("format_as_base64")) {
+      Format format = val.is("format_as_hex") ? Format::hex : Format::base64;
+
+      if (val.get_bool()) {
+        item.format = format;
+      } else if (item.format == format) {
+        item.format = Format::raw;
+      }
+    } else if (val.is("if_input")) {
+      map_entry.if_input = val.get_as_string();
+    } else if (val.is("then_output")) {
+      map_entry.then_output = val.get_as_string();
+    } else if (val.is("default_output")) {
+      map_entry.default_output = val.get_as_string();
+    } else if (val.is("padding")) {
+      item.padding = val.get_as_string();
+    } else if (val.is("length")) {
+      item.pad_length = val.get_uint64();
+    } else {
+      return false;
+    }
+
+    return true;
   }
 
   Usage get_usage() const override {
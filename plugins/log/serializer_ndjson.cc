@@ -0,0 +1,198 @@
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Local includes
+#include "atomic_pegs.h"
+#include "lioli.h"
+#include "log_framework.h"
+#include "serializer_ndjson.h"
+
+namespace serializer_ndjson {
+namespace {
+
+static const char *s_name = "serializer_ndjson";
+static const char *s_help =
+    "Serializes LioLi trees to newline delimited JSON, one object per line";
+
+/*
+A tree is serialized as one JSON object per line, e.g.
+
+{"timestamp":"1970-01-01T00:00:00.000000000Z","endpoint":{"addr":{"ip":"209.85.202.100","port":"80"}}}
+
+Nodes with children become objects, nodes named #... become arrays of the
+values of their children, and nodes without children become strings.  Bytes
+outside printable ascii are escaped as \u00NN.
+*/
+
+static const snort::Parameter module_params[] = {
+    {"add_text", snort::Parameter::PT_BOOL, nullptr, "false",
+     "if true the text between the children of a node is added as _text"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "tree_count", "Number of trees serialized"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads,
+// the counts are atomic as contexts are used from many threads at once (every
+// packet thread has its own with ThreadStream)
+struct PegCounts {
+  std::atomic<PegCount> tree_count = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// Settings for this module
+struct Settings {
+  bool add_text = false;
+} settings;
+
+// MAIN object of this file
+class Serializer : public LioLi::Serializer {
+
+public:
+  Serializer(const char *name) : LioLi::Serializer(name) {}
+
+  ~Serializer() = default;
+
+  class Context : public LioLi::Serializer::Context {
+    bool closed = false;
+
+  public:
+    std::string serialize(const LioLi::Tree &&tree) override {
+      s_peg_counts.tree_count++;
+
+      std::string output;
+      tree.as_json(output, settings.add_text);
+      output += '\n';
+      return output;
+    }
+
+    void serialize_batch(std::span<const LioLi::Tree> trees,
+                         LioLi::Serializer::Sink &sink) override {
+      s_peg_counts.tree_count += trees.size();
+
+      // Encode directly into the sink, avoiding a string per tree
+      std::string &output = sink.buffer();
+      for (auto &tree : trees) {
+        tree.as_json(output, settings.add_text);
+        output += '\n';
+      }
+    }
+
+    // Terminate current context, returned byte sequence is any remaining
+    // data/end marker of current context.  Context object is invalid after
+    // this, except the is_closed() function.
+    std::string close() override {
+      closed = true;
+      return "";
+    }
+
+    // Returns true if context is closed (invalid to call)
+    bool is_closed() override { return closed; }
+  };
+
+  // Return TRUE if the serialized output is binary, FALSE if it is text based
+  bool is_binary() override { return false; };
+
+  std::shared_ptr<LioLi::Serializer::Context> create_context() override {
+    return std::make_shared<Context>();
+  };
+
+  std::shared_ptr<LioLi::Serializer::Context> create_batch_context() override {
+    return create_context();
+  }
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {
+    LioLi::LogDB::register_type<Serializer>(s_name);
+  }
+
+  bool begin(const char *, int, snort::SnortConfig *) override {
+    settings.add_text = false;
+    return true;
+  }
+
+  bool end(const char *, int, snort::SnortConfig *) override { return true; }
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    if (val.is("add_text")) {
+      settings.add_text = val.get_bool();
+      return true;
+    }
+
+    // fail as we got something we didn't understand
+    return false;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static Common::AtomicPegs<PegCounts> static_pegs;
+    return static_pegs.get(s_peg_counts);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace serializer_ndjson
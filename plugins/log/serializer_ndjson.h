@@ -0,0 +1,18 @@
+#ifndef serializer_ndjson_4f8a61c3
+#define serializer_ndjson_4f8a61c3
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace serializer_ndjson {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace serializer_ndjson
+
+#endif // #ifndef serializer_ndjson_4f8a61c3
@@ -5,12 +5,14 @@
 #include <framework/module.h>
 
 // System includes
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <mutex>
 #include <vector>
 
 // Local includes
+#include "atomic_pegs.h"
 #include "lioli.h"
 #include "log_framework.h"
 #include "serializer_python.h"
@@ -35,10 +37,11 @@ const PegInfo s_pegs[] = {
     {CountType::END, nullptr, nullptr}};
 
 // This must match the s_pegs[] array
-// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
-std::mutex peg_count_mutex; // Protects the peg counts
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads,
+// the counts are atomic as contexts are used from many threads at once (every
+// packet thread has its own with ThreadStream)
 struct PegCounts {
-  PegCount tree_count = 0;
+  std::atomic<PegCount> tree_count = 0;
 } s_peg_counts;
 
 // Compile time sanity check of number of entries in s_pegs and s_peg_counts
@@ -64,14 +67,12 @@ public:
 
   class Context : public LioLi::Serializer::Context {
     std::mutex mutex;
-    bool first_write = true;
+    bool first_write;
     bool closed = false;
+    bool continuation; // Continues a stream, so has no start or end
 
-  public:
-    std::string serialize(const LioLi::Tree &&tree) override {
-      std::scoped_lock lock(mutex);
-      s_peg_counts.tree_count++;
-      std::string output;
+    // Appends tree to output, mutex must be held
+    void serialize_locked(const LioLi::Tree &tree, std::string &output) {
       if (first_write) {
         first_write = false;
         output += "#!/usr/bin/env python3\n" + settings.data_name + " = ( {";
@@ -84,15 +85,38 @@ public:
       }
 
       output += tree.as_python() + "\n },";
+    }
+
+  public:
+    Context(bool continuation = false)
+        : first_write(!continuation), continuation(continuation) {}
+
+    std::string serialize(const LioLi::Tree &&tree) override {
+      std::scoped_lock lock(mutex);
+      s_peg_counts.tree_count++;
+      std::string output;
+      serialize_locked(tree, output);
       return output;
     }
 
+    void serialize_batch(std::span<const LioLi::Tree> trees,
+                         LioLi::Serializer::Sink &sink) override {
+      std::scoped_lock lock(mutex);
+      s_peg_counts.tree_count += trees.size();
+
+      for (auto &tree : trees) {
+        serialize_locked(tree, sink.buffer());
+      }
+    }
+
     // Terminate current context, returned byte sequence is any remaining
     // data/end marker of current context.  Context object is invalid after
     // this, except the is_closed() function.
     std::string close() override {
       closed = true;
-      if (settings.add_print) {
+      if (continuation) {
+        return "";
+      } else if (settings.add_print) {
         return ")\n\nprint(" + settings.data_name + ")\n";
       } else {
         return ")\n";
@@ -110,6 +134,10 @@ public:
     std::shared_ptr<Context> context = std::make_shared<Context>();
     return context;
   };
+
+  std::shared_ptr<LioLi::Serializer::Context> create_batch_context() override {
+    return std::make_shared<Context>(true);
+  }
 };
 
 class Module : public snort::Module {
@@ -149,12 +177,8 @@ class Module : public snort::Module {
   PegCount *get_counts() const override {
     // We need to return a copy of the peg counts as we don't know when snort
     // are done with them
-    static PegCounts static_pegs;
-
-    std::scoped_lock lock(peg_count_mutex);
-    static_pegs = s_peg_counts;
-
-    return reinterpret_cast<PegCount *>(&static_pegs);
+    static Common::AtomicPegs<PegCounts> static_pegs;
+    return static_pegs.get(s_peg_counts);
   }
 
 public:
@@ -57,6 +57,10 @@ public:
   std::shared_ptr<LioLi::Serializer::Context> create_context() override {
     return std::make_shared<Context>();
   };
+
+  std::shared_ptr<LioLi::Serializer::Context> create_batch_context() override {
+    return create_context();
+  }
 };
 
 class Module : public snort::Module {
@@ -0,0 +1,331 @@
+// Snort includes
+#include <framework/decode_data.h>
+#include <framework/inspector.h>
+#include <framework/module.h>
+
+// System includes
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <zstd.h>
+
+// Local includes
+#include "lioli.h"
+#include "log_framework.h"
+#include "serializer_zstd.h"
+
+namespace serializer_zstd {
+namespace {
+
+static const char *s_name = "serializer_zstd";
+static const char *s_help =
+    "Compresses the output of another serializer with zstd";
+
+/*
+The output is a sequence of standard zstd frames, one per serializer context,
+so a receiver can tell it from uncompressed output by the frame magic
+(28 B5 2F FD), and it can be decompressed with e.g. "zstd -dc".
+
+With flush_per_batch, everything handed to the logger can be decompressed as
+soon as it's received, at some cost in ratio for small batches.  Without it,
+zstd holds back output until it has a full block (128 KiB), or the context is
+closed.
+
+If compressing fails, the frame being written is left unfinished, and the
+context of the other serializer is restarted in a new frame.  What follows
+can be read from the start of that frame, the trees in between are lost.
+*/
+
+static const snort::Parameter module_params[] = {
+    {"serializer", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "Serializer whose output is compressed, e.g. serializer_bill"},
+    {"level", snort::Parameter::PT_INT, "-7:22", "3",
+     "zstd compression level, negative levels trade ratio for speed"},
+    {"flush_per_batch", snort::Parameter::PT_BOOL, nullptr, "true",
+     "if true the output of every batch (or tree) is flushed, so it can be "
+     "decompressed without waiting for more"},
+    {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
+
+const PegInfo s_pegs[] = {
+    {CountType::SUM, "tree_count", "Number of trees serialized"},
+    {CountType::SUM, "input_bytes", "Bytes from the serializer compressed"},
+    {CountType::SUM, "output_bytes", "Bytes of compressed output"},
+    {CountType::NOW, "output_percent",
+     "Compressed size in percent of the input, output_bytes / input_bytes"},
+    {CountType::SUM, "cpu_us", "CPU time spent compressing, in microseconds"},
+    {CountType::SUM, "frames", "Number of zstd frames ended"},
+    {CountType::SUM, "errors", "Number of compression errors"},
+    {CountType::END, nullptr, nullptr}};
+
+// This must match the s_pegs[] array
+// NOTE: we cant use the THREAD_LOCAL pattern here as we have our own threads
+std::mutex peg_count_mutex; // Protects the peg counts
+struct PegCounts {
+  PegCount tree_count = 0;
+  PegCount input_bytes = 0;
+  PegCount output_bytes = 0;
+  PegCount output_percent = 0;
+  PegCount cpu_us = 0;
+  PegCount frames = 0;
+  PegCount errors = 0;
+} s_peg_counts;
+
+// Compile time sanity check of number of entries in s_pegs and s_peg_counts
+static_assert(
+    (sizeof(s_pegs) / sizeof(PegInfo)) - 1 ==
+        sizeof(PegCounts) / sizeof(PegCount),
+    "Entries in s_pegs doesn't match number of entries in s_peg_counts");
+
+// Settings for this module
+struct Settings {
+  std::string serializer;
+  int level = 3;
+  bool flush_per_batch = true;
+} settings;
+
+// CPU time used by the calling thread, in microseconds
+uint64_t thread_cpu_us() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
+
+// MAIN object of this file
+class Serializer : public LioLi::Serializer {
+
+public:
+  Serializer(const char *name) : LioLi::Serializer(name) {}
+
+  ~Serializer() = default;
+
+  class Context : public LioLi::Serializer::Context {
+    std::mutex mutex;
+    std::shared_ptr<LioLi::Serializer> serializer; // Whose output we compress
+    std::shared_ptr<LioLi::Serializer::Context> inner;
+    ZSTD_CCtx *cctx;
+    bool closed = false;
+
+    // Compresses input, appending to output, mutex must be held.  Returns
+    // false on error, nothing is then appended.
+    bool compress(std::string_view input, ZSTD_EndDirective mode,
+                  std::string &output) {
+      uint64_t start_us = thread_cpu_us();
+      std::size_t start_size = output.size();
+      ZSTD_inBuffer in = {input.data(), input.size(), 0};
+      bool done;
+
+      do {
+        std::size_t before = output.size();
+        output.resize(before + ZSTD_CStreamOutSize());
+
+        ZSTD_outBuffer out = {output.data() + before, ZSTD_CStreamOutSize(),
+                              0};
+        std::size_t left = ZSTD_compressStream2(cctx, &out, &in, mode);
+
+        output.resize(before + out.pos);
+
+        if (ZSTD_isError(left)) {
+          snort::ErrorMessage("ERROR: %s unable to compress: %s\n", s_name,
+                              ZSTD_getErrorName(left));
+
+          output.resize(start_size);
+
+          std::scoped_lock lock(peg_count_mutex);
+          s_peg_counts.errors++;
+          return false;
+        }
+
+        // Flushing and ending are done when nothing is left in zstd
+        done = mode == ZSTD_e_continue ? in.pos == in.size : left == 0;
+      } while (!done);
+
+      std::scoped_lock lock(peg_count_mutex);
+      s_peg_counts.input_bytes += input.size();
+      s_peg_counts.output_bytes += output.size() - start_size;
+      if (s_peg_counts.input_bytes != 0) {
+        s_peg_counts.output_percent =
+            s_peg_counts.output_bytes * 100 / s_peg_counts.input_bytes;
+      }
+      s_peg_counts.cpu_us += thread_cpu_us() - start_us;
+      s_peg_counts.frames += mode == ZSTD_e_end;
+      return true;
+    }
+
+    // After an error the frame can't be ended, and what was written of it
+    // is lost.  The inner context is closed and a new one started, in a new
+    // frame, so what follows can be read from the start of a context.  Mutex
+    // must be held.
+    void restart() {
+      ZSTD_CCtx_reset(cctx, ZSTD_reset_session_only);
+      inner->close();
+      inner = serializer->create_context();
+    }
+
+    ZSTD_EndDirective batch_mode() const {
+      return settings.flush_per_batch ? ZSTD_e_flush : ZSTD_e_continue;
+    }
+
+  public:
+    Context(std::shared_ptr<LioLi::Serializer> serializer)
+        : serializer(serializer), inner(serializer->create_context()),
+          cctx(ZSTD_createCCtx()) {
+      ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, settings.level);
+    }
+
+    ~Context() { ZSTD_freeCCtx(cctx); }
+
+    std::string serialize(const LioLi::Tree &&tree) override {
+      std::scoped_lock lock(mutex);
+      std::string output;
+
+      if (!compress(inner->serialize(std::move(tree)), batch_mode(), output)) {
+        restart();
+      }
+
+      {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.tree_count++;
+      }
+
+      return output;
+    }
+
+    void serialize_batch(std::span<const LioLi::Tree> trees,
+                         LioLi::Serializer::Sink &sink) override {
+      std::scoped_lock lock(mutex);
+      LioLi::Serializer::Sink uncompressed;
+
+      inner->serialize_batch(trees, uncompressed);
+      if (!compress(uncompressed.buffer(), batch_mode(), sink.buffer())) {
+        restart();
+      }
+
+      {
+        std::scoped_lock lock(peg_count_mutex);
+        s_peg_counts.tree_count += trees.size();
+      }
+    }
+
+    // Terminate current context, returned byte sequence is any remaining
+    // data/end marker of current context.  Context object is invalid after
+    // this, except the is_closed() function.
+    std::string close() override {
+      std::scoped_lock lock(mutex);
+      std::string output;
+
+      compress(inner->close(), ZSTD_e_end, output);
+      closed = true;
+
+      return output;
+    }
+
+    // Returns true if context is closed (invalid to call)
+    bool is_closed() override { return closed; }
+  };
+
+  // Return TRUE if the serialized output is binary, FALSE if it is text based
+  bool is_binary() override { return true; };
+
+  // The compressed stream is sequential, so there are no batch contexts
+  std::shared_ptr<LioLi::Serializer::Context> create_context() override {
+    return std::make_shared<Context>(
+        LioLi::LogDB::get<LioLi::Serializer>(settings.serializer));
+  };
+};
+
+class Module : public snort::Module {
+  Module() : snort::Module(s_name, s_help, module_params) {
+    LioLi::LogDB::register_type<Serializer>(s_name);
+  }
+
+  bool begin(const char *, int, snort::SnortConfig *) override {
+    settings = Settings();
+    return true;
+  }
+
+  bool end(const char *, int, snort::SnortConfig *) override {
+    if (settings.serializer.empty() || settings.serializer == s_name) {
+      snort::ErrorMessage("ERROR: %s needs another serializer to compress\n",
+                          s_name);
+      return false;
+    }
+    return true;
+  }
+
+  bool set(const char *, snort::Value &val, snort::SnortConfig *) override {
+    if (val.is("serializer")) {
+      settings.serializer = val.get_as_string();
+      return true;
+    } else if (val.is("level")) {
+      settings.level = val.get_int32();
+      return true;
+    } else if (val.is("flush_per_batch")) {
+      settings.flush_per_batch = val.get_bool();
+      return true;
+    }
+
+    // fail as we got something we didn't understand
+    return false;
+  }
+
+  Usage get_usage() const override {
+    return GLOBAL;
+  } // TODO(mkr): Figure out what the usage type means
+
+  const PegInfo *get_pegs() const override { return s_pegs; }
+
+  PegCount *get_counts() const override {
+    // We need to return a copy of the peg counts as we don't know when snort
+    // are done with them
+    static PegCounts static_pegs;
+
+    std::scoped_lock lock(peg_count_mutex);
+    static_pegs = s_peg_counts;
+
+    return reinterpret_cast<PegCount *>(&static_pegs);
+  }
+
+public:
+  static snort::Module *ctor() { return new Module(); }
+  static void dtor(snort::Module *p) { delete p; }
+};
+
+class Inspector : public snort::Inspector {
+  void eval(snort::Packet *) override {};
+
+public:
+  static snort::Inspector *ctor(snort::Module *) { return new Inspector(); }
+  static void dtor(snort::Inspector *p) { delete p; }
+};
+
+} // namespace
+
+const snort::InspectApi inspect_api = {
+    {
+        PT_INSPECTOR,
+        sizeof(snort::InspectApi),
+        INSAPI_VERSION,
+        0,
+        API_RESERVED,
+        API_OPTIONS,
+        s_name,
+        s_help,
+        Module::ctor,
+        Module::dtor,
+    },
+
+    snort::IT_PASSIVE,
+    PROTO_BIT__NONE,
+    nullptr, // buffers
+    nullptr, // service
+    nullptr, // pinit
+    nullptr, // pterm
+    nullptr, // tinit
+    nullptr, // tterm
+    Inspector::ctor,
+    Inspector::dtor,
+    nullptr, // ssn
+    nullptr  // reset
+};
+
+} // namespace serializer_zstd
@@ -0,0 +1,18 @@
+#ifndef serializer_zstd_5b0e93c2
+#define serializer_zstd_5b0e93c2
+
+// Snort includes
+#include <framework/base_api.h>
+#include <framework/inspector.h>
+
+// System includes
+
+// Local includes
+
+namespace serializer_zstd {
+
+extern const snort::InspectApi inspect_api;
+
+} // namespace serializer_zstd
+
+#endif // #ifndef serializer_zstd_5b0e93c2
@@ -0,0 +1,270 @@
+// Snort includes
+#include <log/messages.h>
+
+// System includes
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <system_error>
+#include <unistd.h>
+
+// Local includes
+#include "spill_ring.h"
+
+// Debug includes
+
+namespace LioLi {
+
+SpillRing::SpillRing(std::string dir, std::string name, uint64_t max_bytes,
+                     uint64_t segment_bytes, Sync sync)
+    : dir(dir), name(name), max_bytes(max_bytes),
+      segment_bytes(segment_bytes), sync(sync) {
+  assert(segment_bytes > 0 && max_bytes >= segment_bytes);
+
+  // Nothing tells how far an earlier run got with these, so they're not
+  // replayed
+  std::error_code ec;
+  std::string prefix = name + ".";
+
+  for (auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    std::string file = entry.path().filename();
+
+    if (file.starts_with(prefix) && file.ends_with(".spill")) {
+      std::filesystem::remove(entry.path(), ec);
+    }
+  }
+}
+
+SpillRing::~SpillRing() {
+  discard_open();
+
+  while (!sealed.empty()) {
+    remove_front();
+  }
+}
+
+std::string SpillRing::path(uint64_t number) const {
+  return dir + "/" + name + "." + std::to_string(number) + ".spill";
+}
+
+bool SpillRing::reserve() {
+  if (write_fd != -1) {
+    return true;
+  }
+
+  if (!make_room()) {
+    return false;
+  }
+
+  open = {next_number++, 0};
+  write_fd = ::open(path(open.number).c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+  if (write_fd == -1) {
+    snort::WarningMessage("WARNING: Unable to create spill file %s: %s\n",
+                          path(open.number).c_str(), std::strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+bool SpillRing::make_room() {
+  while (total_bytes + segment_bytes > max_bytes) {
+    // The segment being read is kept, its start has already been sent
+    if (read_fd == -1 && !sealed.empty()) {
+      remove_front();
+    } else if (sealed.size() > 1) {
+      Segment segment = sealed[1];
+
+      ::unlink(path(segment.number).c_str());
+      total_bytes -= segment.size;
+      dropped += segment.size;
+      sealed.erase(sealed.begin() + 1);
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool SpillRing::write(const std::string &data) {
+  assert(write_fd != -1);
+
+  std::size_t index = 0;
+
+  while (index < data.size()) {
+    ssize_t bytes = ::write(write_fd, data.data() + index, data.size() - index);
+
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    } else if (bytes < 0) {
+      snort::WarningMessage("WARNING: Unable to write spill file %s: %s\n",
+                            path(open.number).c_str(), std::strerror(errno));
+      discard_open();
+      return false;
+    }
+
+    index += bytes;
+  }
+
+  if (sync == Sync::write) {
+    ::fdatasync(write_fd);
+  }
+
+  open.size += data.size();
+  total_bytes += data.size();
+  spilled += data.size();
+
+  return true;
+}
+
+bool SpillRing::segment_full() const {
+  return write_fd != -1 && open.size >= segment_bytes;
+}
+
+void SpillRing::seal() {
+  if (write_fd == -1) {
+    return;
+  }
+
+  if (sync == Sync::segment) {
+    ::fdatasync(write_fd);
+  }
+
+  ::close(write_fd);
+  write_fd = -1;
+
+  if (open.size == 0) {
+    ::unlink(path(open.number).c_str());
+  } else {
+    sealed.push_back(open);
+  }
+}
+
+void SpillRing::discard_open() {
+  if (write_fd == -1) {
+    return;
+  }
+
+  ::close(write_fd);
+  write_fd = -1;
+  ::unlink(path(open.number).c_str());
+
+  total_bytes -= open.size;
+  dropped += open.size;
+}
+
+bool SpillRing::empty() const { return total_bytes == 0; }
+
+bool SpillRing::read(std::string &data, std::size_t max) {
+  while (!sealed.empty()) {
+    Segment &segment = sealed.front();
+
+    if (read_fd == -1) {
+      read_fd = ::open(path(segment.number).c_str(), O_RDONLY | O_CLOEXEC);
+      read_offset = 0;
+
+      if (read_fd == -1) {
+        snort::WarningMessage("WARNING: Unable to open spill file %s: %s\n",
+                              path(segment.number).c_str(),
+                              std::strerror(errno));
+        remove_front();
+        continue;
+      }
+    }
+
+    // All of it is out, it's removed when acknowledged
+    if (read_offset == segment.size) {
+      return false;
+    }
+
+    std::size_t want = std::min<uint64_t>(max, segment.size - read_offset);
+    data.resize(want);
+
+    ssize_t bytes = ::read(read_fd, data.data(), want);
+
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    } else if (bytes <= 0) {
+      // The rest of the segment is lost, and with it the end of a context,
+      // so it's not sent at all
+      snort::WarningMessage("WARNING: Unable to read spill file %s: %s\n",
+                            path(segment.number).c_str(),
+                            bytes < 0 ? std::strerror(errno) : "truncated");
+      remove_front();
+      continue;
+    }
+
+    data.resize(bytes);
+    read_offset += bytes;
+
+    return true;
+  }
+
+  return false;
+}
+
+void SpillRing::acknowledge(uint64_t bytes) {
+  assert(!sealed.empty() && acked + bytes <= read_offset);
+
+  acked += bytes;
+  total_bytes -= bytes;
+  replayed += bytes;
+
+  if (acked == sealed.front().size) {
+    ::close(read_fd);
+    read_fd = -1;
+    ::unlink(path(sealed.front().number).c_str());
+    read_offset = 0;
+    acked = 0;
+    sealed.pop_front();
+  }
+}
+
+void SpillRing::rewind() {
+  if (read_fd == -1) {
+    return;
+  }
+
+  ::close(read_fd);
+  read_fd = -1;
+  total_bytes += acked;
+  read_offset = 0;
+  acked = 0;
+}
+
+void SpillRing::remove_front() {
+  assert(!sealed.empty());
+
+  Segment &segment = sealed.front();
+  uint64_t unsent = segment.size - acked;
+
+  if (read_fd != -1) {
+    ::close(read_fd);
+    read_fd = -1;
+  }
+
+  ::unlink(path(segment.number).c_str());
+  total_bytes -= unsent;
+  dropped += unsent;
+  read_offset = 0;
+  acked = 0;
+  sealed.pop_front();
+}
+
+SpillRing::Stats SpillRing::take_stats() {
+  Stats stats = {spilled, replayed, dropped, total_bytes};
+
+  spilled = 0;
+  replayed = 0;
+  dropped = 0;
+
+  return stats;
+}
+
+} // namespace LioLi
@@ -0,0 +1,233 @@
+// Snort includes
+#include <main/thread.h>
+
+// System includes
+#include <cassert>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+// Local includes
+#include "thread_stream.h"
+
+// Debug includes
+
+namespace LioLi {
+namespace {
+
+// Slot of the calling packet thread, the same for all loggers as it's the
+// snort instance id.  -1 if the thread hasn't opened any stream.
+thread_local int thread_slot = -1;
+
+} // namespace
+
+ThreadStream::ThreadStream(std::shared_ptr<Serializer> serializer,
+                           Opener opener, Reporter reporter,
+                           std::size_t max_pending,
+                           uint32_t restart_interval_s,
+                           uint32_t retry_interval_ms)
+    : serializer(serializer), opener(opener), reporter(reporter),
+      max_pending(max_pending), restart_interval(restart_interval_s),
+      retry_interval(retry_interval_ms) {
+  assert(serializer);
+  next_report = clock::now() + std::chrono::seconds(1);
+}
+
+ThreadStream::~ThreadStream() { close(); }
+
+bool ThreadStream::ensure_open(clock::time_point now) {
+  if (fd == -1) {
+    if (now < next_retry) {
+      return false;
+    }
+
+    fd = opener();
+
+    if (fd == -1) {
+      next_retry = now + retry_interval;
+      return false;
+    }
+
+    // A new stream always starts with a new context
+    context.reset();
+  }
+
+  if (context && restart_interval.count() != 0 && next_restart <= now) {
+    pending += context->close();
+    context.reset();
+  }
+
+  if (!context) {
+    context = serializer->create_context();
+    next_restart = now + restart_interval;
+    counts.restarts++;
+  }
+
+  return true;
+}
+
+void ThreadStream::write(const Tree &tree) {
+  auto now = clock::now();
+
+  counts.logs_in++;
+
+  if (!ensure_open(now) || pending.size() - pending_index >= max_pending) {
+    counts.overflows++;
+    data_loss = true;
+  } else {
+    pending += context->serialize(std::move(tree));
+    counts.logs_out++;
+  }
+
+  if (fd != -1) {
+    flush();
+  }
+
+  report(now);
+}
+
+void ThreadStream::flush() {
+  while (pending_index < pending.size()) {
+    ssize_t bytes = ::write(fd, pending.data() + pending_index,
+                            pending.size() - pending_index);
+
+    if (bytes >= 0) {
+      pending_index += bytes;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else {
+      counts.write_errors++;
+      drop_stream();
+      return;
+    }
+  }
+
+  if (pending_index == pending.size()) {
+    pending.clear();
+    pending_index = 0;
+  } else if (pending_index > pending.size() / 2) {
+    // Keep the buffer from only growing while the reader is slow
+    pending.erase(0, pending_index);
+    pending_index = 0;
+  }
+}
+
+void ThreadStream::drop_stream() {
+  ::close(fd);
+  fd = -1;
+  next_retry = clock::now() + retry_interval;
+
+  // Nothing pending belongs to the next stream
+  if (pending_index != pending.size()) {
+    data_loss = true;
+  }
+  pending.clear();
+  pending_index = 0;
+  context.reset();
+}
+
+void ThreadStream::close() {
+  if (fd != -1) {
+    if (context) {
+      pending += context->close();
+      context.reset();
+    }
+
+    auto deadline = clock::now() + std::chrono::seconds(1);
+
+    flush();
+    while (fd != -1 && !pending.empty() && clock::now() < deadline) {
+      pollfd pfd = {fd, POLLOUT, 0};
+      ::poll(&pfd, 1, 100);
+      flush();
+    }
+
+    if (fd != -1) {
+      if (!pending.empty()) {
+        data_loss = true;
+      }
+      ::close(fd);
+      fd = -1;
+    }
+  }
+
+  pending.clear();
+  pending_index = 0;
+
+  report(clock::now(), true);
+}
+
+void ThreadStream::report(clock::time_point now, bool force) {
+  if (!force && now < next_report) {
+    return;
+  }
+
+  reporter(counts);
+  counts = {};
+  next_report = now + std::chrono::seconds(1);
+}
+
+void ThreadStreams::resize(unsigned count) {
+  std::scoped_lock lock(mutex);
+
+  if (slots) {
+    return; // Packet threads might already use the slots
+  }
+
+  slots = std::make_unique<std::unique_ptr<ThreadStream>[]>(count);
+  slot_count = count;
+}
+
+void ThreadStreams::open(std::unique_ptr<ThreadStream> stream) {
+  unsigned slot = snort::get_instance_id();
+
+  std::scoped_lock lock(mutex);
+
+  if (slot >= slot_count) {
+    return; // Stream is simply closed again, trees go the shared way
+  }
+
+  slots[slot] = std::move(stream);
+  thread_slot = slot;
+}
+
+void ThreadStreams::close() {
+  if (thread_slot < 0 || static_cast<unsigned>(thread_slot) >= slot_count) {
+    return;
+  }
+
+  std::unique_ptr<ThreadStream> stream;
+
+  {
+    std::scoped_lock lock(mutex);
+    stream = std::move(slots[thread_slot]);
+  }
+
+  // Closed outside the lock, as it might wait for the stream
+  stream.reset();
+}
+
+ThreadStream *ThreadStreams::get() {
+  if (thread_slot < 0 || static_cast<unsigned>(thread_slot) >= slot_count) {
+    return nullptr;
+  }
+
+  return slots[thread_slot].get();
+}
+
+bool ThreadStreams::had_data_loss(bool clear_flag) {
+  std::scoped_lock lock(mutex);
+  bool data_loss = false;
+
+  for (unsigned i = 0; i < slot_count; i++) {
+    if (slots[i]) {
+      data_loss |= slots[i]->had_data_loss(clear_flag);
+    }
+  }
+
+  return data_loss;
+}
+
+} // namespace LioLi
@@ -0,0 +1,468 @@
+// Snort includes
+#include <log/messages.h>
+
+// System includes
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <iterator>
+#include <poll.h>
+#include <random>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Local includes
+#include "tree_ring.h"
+
+// Debug includes
+
+// The ring follows Dmitry Vyukov's bounded queue: every cell has a sequence
+// number telling which position it's ready for.  A cell is free for the push
+// at position pos when its sequence is pos, it holds the tree of pos when the
+// sequence is pos + 1, and once popped it's set to pos + cell_count, ready for
+// the next round.  Producers claim a position by advancing tail, and anyone
+// popping (the consumer, or a producer dropping the oldest tree) by advancing
+// head.
+
+namespace LioLi {
+
+TreeRing::TreeRing(std::size_t capacity)
+    : event_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+  assert(-1 != event_fd);
+
+  for (auto &lane : lanes) {
+    lane.set_capacity(capacity);
+  }
+}
+
+TreeRing::~TreeRing() { ::close(event_fd); }
+
+std::size_t TreeRing::set_capacity(std::size_t new_capacity,
+                                   Priority priority) {
+  return lane(priority).set_capacity(new_capacity);
+}
+
+std::size_t TreeRing::configure(const QueueConfig &config) {
+  std::size_t dropped = 0;
+
+  for (std::size_t i = 0; i < priority_count; i++) {
+    auto priority = static_cast<Priority>(i);
+
+    dropped += set_capacity(config.max[i], priority);
+    set_max_bytes(config.max_bytes[i], priority);
+    set_drop_policy(config.policy[i], priority);
+  }
+
+  return dropped;
+}
+
+std::size_t TreeRing::Lane::set_capacity(std::size_t new_capacity) {
+  assert(new_capacity > 0);
+
+  std::vector<Tree> trees;
+
+  if (cells) {
+    Tree tree;
+    std::size_t bytes;
+
+    while (take(tree, bytes)) {
+      trees.push_back(std::move(tree));
+    }
+  }
+
+  std::size_t drop =
+      trees.size() > new_capacity ? trees.size() - new_capacity : 0;
+
+  capacity = new_capacity;
+  cell_count = std::max<std::size_t>(capacity, 2);
+  cells = std::make_unique<Cell[]>(cell_count);
+
+  // Kept trees are queued again, ending at the current tail, so they aren't
+  // counted twice by take_stats()
+  uint64_t pos = tail.load() - (trees.size() - drop);
+
+  head.store(pos);
+  tail.store(pos);
+  queued_bytes.store(0);
+
+  for (std::size_t i = 0; i < cell_count; i++) {
+    cells[(pos + i) % cell_count].sequence.store(pos + i);
+  }
+
+  for (auto itr = trees.begin() + drop; itr != trees.end(); itr++) {
+    [[maybe_unused]] bool queued = enqueue(*itr, itr->footprint());
+    assert(queued);
+  }
+
+  return drop;
+}
+
+void TreeRing::push(Tree &&tree, Priority priority) {
+  Lane &lane = this->lane(priority);
+  std::size_t bytes = tree.footprint();
+  DropPolicy policy = lane.policy.load(std::memory_order_relaxed);
+  std::size_t max = lane.max_bytes.load(std::memory_order_relaxed);
+
+  if (policy == DropPolicy::random_early && lane.drop_early(bytes)) {
+    lane.reject(bytes);
+    return;
+  }
+
+  if (max != 0 &&
+      lane.queued_bytes.load(std::memory_order_relaxed) + bytes > max) {
+    if (policy == DropPolicy::oldest) {
+      while (lane.queued_bytes.load(std::memory_order_relaxed) + bytes > max &&
+             lane.drop_oldest()) {
+      }
+    } else if (lane.queued_bytes.load(std::memory_order_relaxed) != 0) {
+      lane.reject(bytes);
+      return;
+    }
+  }
+
+  while (!lane.enqueue(tree, bytes)) {
+    if (policy != DropPolicy::oldest) {
+      lane.reject(bytes);
+      return;
+    }
+
+    // Might fail if the consumer just made space, then we simply retry
+    lane.drop_oldest();
+  }
+
+  // Pairs with the fence in wait_until(), either we see the consumer going to
+  // sleep, or it sees our tree
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (sleeping.load(std::memory_order_relaxed) &&
+      sleeping.exchange(false, std::memory_order_relaxed)) {
+    kick();
+  }
+}
+
+bool TreeRing::Lane::enqueue(Tree &tree, std::size_t bytes) {
+  // Added before the tree is visible, so it never goes below zero
+  queued_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+  uint64_t pos = tail.load(std::memory_order_relaxed);
+
+  while (true) {
+    Cell &cell = cells[pos % cell_count];
+    uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence - pos);
+
+    // A capacity below cell_count isn't caught by the sequence numbers
+    bool full = diff < 0 || (capacity < cell_count &&
+                             pos - head.load(std::memory_order_acquire) >=
+                                 capacity);
+
+    if (full) {
+      queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+      return false;
+    } else if (diff == 0) {
+      if (tail.compare_exchange_weak(pos, pos + 1,
+                                     std::memory_order_relaxed)) {
+        cell.tree = std::move(tree);
+        cell.bytes = bytes;
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else {
+      // Another producer took pos
+      pos = tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool TreeRing::Lane::drop_oldest() {
+  Tree oldest;
+  std::size_t bytes;
+
+  if (!take(oldest, bytes)) {
+    return false;
+  }
+
+  dropped.fetch_add(1, std::memory_order_relaxed);
+  dropped_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  return true;
+}
+
+void TreeRing::Lane::reject(std::size_t bytes) {
+  rejected.fetch_add(1, std::memory_order_relaxed);
+  dropped.fetch_add(1, std::memory_order_relaxed);
+  dropped_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+double TreeRing::Lane::fill(std::size_t bytes) const {
+  // head before tail, so the size can't come out negative
+  uint64_t popped = head.load(std::memory_order_relaxed);
+  uint64_t pushed = tail.load(std::memory_order_relaxed);
+  double fill = static_cast<double>(pushed - popped) / capacity;
+  std::size_t max = max_bytes.load(std::memory_order_relaxed);
+
+  if (max != 0) {
+    fill = std::max(
+        fill,
+        static_cast<double>(queued_bytes.load(std::memory_order_relaxed) +
+                            bytes) /
+            max);
+  }
+
+  return fill;
+}
+
+bool TreeRing::Lane::drop_early(std::size_t bytes) {
+  double fill = this->fill(bytes);
+
+  if (fill <= 0.5) {
+    return false;
+  }
+
+  // Drop probability rises linearly from 0 at half full to 1 when full
+  thread_local std::minstd_rand rng(std::random_device{}());
+  return std::uniform_real_distribution<double>(0.5, 1.0)(rng) < fill;
+}
+
+bool TreeRing::Lane::take(Tree &tree, std::size_t &bytes) {
+  uint64_t pos = head.load(std::memory_order_relaxed);
+
+  while (true) {
+    Cell &cell = cells[pos % cell_count];
+    uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence - (pos + 1));
+
+    if (diff == 0) {
+      if (head.compare_exchange_weak(pos, pos + 1,
+                                     std::memory_order_relaxed)) {
+        tree = std::move(cell.tree);
+        bytes = cell.bytes;
+        cell.sequence.store(pos + cell_count, std::memory_order_release);
+        queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false; // Empty, or the push of pos isn't done yet
+    } else {
+      // Someone else popped pos
+      pos = head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool TreeRing::Lane::empty() const {
+  uint64_t pos = head.load(std::memory_order_relaxed);
+  return cells[pos % cell_count].sequence.load(std::memory_order_acquire) !=
+         pos + 1;
+}
+
+bool TreeRing::pop(Tree &tree) {
+  std::size_t bytes;
+
+  for (auto &lane : lanes) {
+    if (lane.take(tree, bytes)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void TreeRing::kick() {
+  uint64_t one = 1;
+
+  // Can only fail if the counter would overflow, it's then readable anyway
+  [[maybe_unused]] auto ret = ::write(event_fd, &one, sizeof(one));
+}
+
+bool TreeRing::empty() const {
+  return std::all_of(std::begin(lanes), std::end(lanes),
+                     [](const Lane &lane) { return lane.empty(); });
+}
+
+double TreeRing::fill() const {
+  double fill = 0;
+
+  for (auto &lane : lanes) {
+    fill = std::max(fill, lane.fill(0));
+  }
+
+  return std::min(fill, 1.0);
+}
+
+std::size_t TreeRing::pop_all(std::vector<Tree> &trees, std::size_t max) {
+  std::size_t count = 0;
+  Tree tree;
+
+  while (count < max && pop(tree)) {
+    trees.push_back(std::move(tree));
+    count++;
+  }
+
+  return count;
+}
+
+void TreeRing::wait_until(std::chrono::steady_clock::time_point deadline) {
+  using namespace std::chrono;
+
+  if (prepare_wait()) {
+    int timeout_ms = -1; // Forever
+
+    if (deadline != steady_clock::time_point::max()) {
+      auto now = steady_clock::now();
+      timeout_ms = deadline <= now
+                       ? 0
+                       : std::min<int64_t>(
+                             ceil<milliseconds>(deadline - now).count(),
+                             INT_MAX);
+    }
+
+    pollfd pfd = {event_fd, POLLIN, 0};
+    ::poll(&pfd, 1, timeout_ms);
+  }
+
+  finish_wait();
+}
+
+bool TreeRing::prepare_wait() {
+  sleeping.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (!empty()) {
+    sleeping.store(false, std::memory_order_relaxed);
+    return false;
+  }
+
+  return true;
+}
+
+void TreeRing::finish_wait() {
+  sleeping.store(false, std::memory_order_relaxed);
+
+  // Reset the event, a kick arriving after this just gives an early wake up
+  uint64_t count;
+  [[maybe_unused]] auto ret = ::read(event_fd, &count, sizeof(count));
+}
+
+TreeRing::Stats TreeRing::take_stats() {
+  Stats stats = {};
+
+  for (std::size_t i = 0; i < priority_count; i++) {
+    Lane &lane = lanes[i];
+
+    // head before tail, so size can't come out negative
+    uint64_t popped = lane.head.load(std::memory_order_acquire);
+    uint64_t pushed = lane.tail.load(std::memory_order_acquire) +
+                      lane.rejected.load(std::memory_order_relaxed);
+    uint64_t dropped = lane.dropped.load(std::memory_order_relaxed);
+    uint64_t dropped_bytes = lane.dropped_bytes.load(std::memory_order_relaxed);
+
+    stats.pushed += pushed - lane.last_pushed;
+    stats.dropped += dropped - lane.last_dropped;
+    stats.dropped_bytes += dropped_bytes - lane.last_dropped_bytes;
+    stats.size += static_cast<std::size_t>(
+        lane.tail.load(std::memory_order_relaxed) - popped);
+    stats.bytes += lane.queued_bytes.load(std::memory_order_relaxed);
+    stats.class_dropped[i] = dropped - lane.last_dropped;
+
+    lane.last_pushed = pushed;
+    lane.last_dropped = dropped;
+    lane.last_dropped_bytes = dropped_bytes;
+  }
+
+  return stats;
+}
+
+namespace {
+
+const snort::Parameter queue_params[] = {
+    {"queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
+     "Max number of normal priority trees that will be queued before "
+     "discarding"},
+    {"queue_max_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "Max bytes of memory used by queued normal priority trees before "
+     "discarding (0 = no limit)"},
+    {"drop_policy", snort::Parameter::PT_ENUM, "oldest | newest | random_early",
+     "oldest",
+     "What is discarded when the normal priority queue is full, the oldest "
+     "queued tree, the new tree, or new trees at random once half full"},
+    {"high_queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
+     "As queue_max, for high priority trees (alerts)"},
+    {"high_queue_max_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "As queue_max_bytes, for high priority trees (alerts)"},
+    {"high_drop_policy", snort::Parameter::PT_ENUM,
+     "oldest | newest | random_early", "oldest",
+     "As drop_policy, for high priority trees (alerts)"},
+    {"bulk_queue_max", snort::Parameter::PT_INT, "1:10000", "1024",
+     "As queue_max, for bulk trees (flow records)"},
+    {"bulk_queue_max_bytes", snort::Parameter::PT_INT, "0:max53", "0",
+     "As queue_max_bytes, for bulk trees (flow records)"},
+    {"bulk_drop_policy", snort::Parameter::PT_ENUM,
+     "oldest | newest | random_early", "oldest",
+     "As drop_policy, for bulk trees (flow records)"}};
+
+// Class of a queue setting, by the prefix of its name, which is removed
+Priority setting_class(std::string_view &name) {
+  if (name.starts_with("high_")) {
+    name.remove_prefix(5);
+    return Priority::high;
+  }
+
+  if (name.starts_with("bulk_")) {
+    name.remove_prefix(5);
+    return Priority::bulk;
+  }
+
+  return Priority::normal;
+}
+
+} // namespace
+
+std::vector<snort::Parameter>
+with_queue_params(std::span<const snort::Parameter> params) {
+  assert(!params.empty() && params.back().name == nullptr);
+
+  std::vector<snort::Parameter> rows(params.begin(), params.end() - 1);
+  rows.insert(rows.end(), std::begin(queue_params), std::end(queue_params));
+  rows.push_back(params.back());
+
+  return rows;
+}
+
+bool QueueConfig::set(const snort::Value &val) {
+  std::string_view name = val.get_name();
+  auto index = static_cast<std::size_t>(setting_class(name));
+
+  if (name == "queue_max") {
+    max[index] = val.get_uint32();
+  } else if (name == "queue_max_bytes") {
+    max_bytes[index] = val.get_uint64();
+  } else if (name == "drop_policy") {
+    policy[index] = static_cast<TreeRing::DropPolicy>(val.get_uint8());
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+bool QueueAccount::warn(const TreeRing::Stats &stats, const char *name) {
+  if (stats.dropped != 0) {
+    if (dropped_sequence_count == 0) {
+      snort::WarningMessage("WARNING: %s dropping tree(s) from queue\n", name);
+    }
+    dropped_sequence_count += stats.dropped;
+    return true;
+  }
+
+  if (dropped_sequence_count != 0 && stats.size != 0) {
+    snort::WarningMessage(
+        "WARNING: %s droped %lu tree(s) from queue, resuming output\n", name,
+        dropped_sequence_count);
+    dropped_sequence_count = 0;
+  }
+
+  return false;
+}
+
+} // namespace LioLi
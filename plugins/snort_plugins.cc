@@ -18,18 +18,28 @@
 #include "dhcp_option/ips_option.h"
 #include "dhcp_option/ips_option_ip_filter.h"
 #include "icmp_logger/plugin_def.h"
+#include "log/io_reactor.h"
 #include "log/logger_file.h"
 #include "log/logger_null.h"
 #include "log/logger_pipe.h"
 #include "log/logger_pipe_netflow.h"
+#include "log/logger_rollup.h"
+#include "log/logger_router.h"
+#include "log/logger_shm.h"
 #include "log/logger_stdout.h"
+#include "log/logger_store.h"
 #include "log/logger_tcp.h"
+#include "log/logger_tee.h"
+#include "log/logger_unix.h"
 #include "log/serializer_bill.h"
+#include "log/serializer_columnar.h"
 #include "log/serializer_csv.h"
 #include "log/serializer_lorth.h"
+#include "log/serializer_ndjson.h"
 #include "log/serializer_python.h"
 #include "log/serializer_raw.h"
 #include "log/serializer_txt.h"
+#include "log/serializer_zstd.h"
 #include "smnp/inspector.h"
 #include "trout_netflow/trout_netflow.h"
 #include "trout_netflow2/plugin_def.h"
@@ -47,18 +57,28 @@ SO_PUBLIC const snort::BaseApi *snort_plugins[] = {
   &ip_filter::ips_option.base,
   &ips_lioli_bind::ips_option.base,
   &ips_lioli_tag::ips_option.base,
+  &io_reactor::inspect_api.base,
   &logger_file::inspect_api.base,
   &logger_null::inspect_api.base,
   &logger_pipe::inspect_api.base,
   &logger_pipe_netflow::inspect_api.base,
+  &logger_rollup::inspect_api.base,
+  &logger_router::inspect_api.base,
+  &logger_shm::inspect_api.base,
   &logger_stdout::inspect_api.base,
+  &logger_store::inspect_api.base,
   &logger_tcp::inspect_api.base,
+  &logger_tee::inspect_api.base,
+  &logger_unix::inspect_api.base,
   &serializer_bill::inspect_api.base,
+  &serializer_columnar::inspect_api.base,
   &serializer_csv::inspect_api.base,
   &serializer_lorth::inspect_api.base,
+  &serializer_ndjson::inspect_api.base,
   &serializer_python::inspect_api.base,
   &serializer_raw::inspect_api.base,
   &serializer_txt::inspect_api.base,
+  &serializer_zstd::inspect_api.base,
   &smnp::inspect_api.base,
   &trout_netflow::inspect_api.base,
   &trout_netflow2::inspect_api.base,
@@ -43,7 +43,7 @@ FlowData *FlowData::get_from_flow(snort::Flow *flow, Settings &settings) {
 FlowData::~FlowData() {
   auto tmp = gen_delta();
   tmp << LioLi::TreeGenerators::timestamp("end_time", settings.testmode);
-  settings.get_logger() << std::move(tmp);
+  settings.get_logger().log(std::move(tmp), LioLi::Priority::bulk);
 }
 
 void FlowData::process(snort::Packet *pkt) {
@@ -60,12 +60,18 @@ void FlowData::process(snort::Packet *pkt) {
 
     root << LioLi::TreeGenerators::timestamp("start_time", settings.testmode);
 
-    // format_IP_MAC handles a null flow
-    root << (LioLi::Tree("principal")
-             << LioLi::TreeGenerators::format_IP_MAC(pkt, pkt->flow, true));
+    // format_IP_MAC handles a null flow, principal and endpoint never change
+    // for a flow, so their encodings are memoized for the later dumps.  The
+    // subtrees are moved into root, not copied with their cache
+    root << std::move((LioLi::Tree("principal")
+                       << LioLi::TreeGenerators::format_IP_MAC(pkt, pkt->flow,
+                                                               true))
+                          .memoize());
 
-    root << (LioLi::Tree("endpoint")
-             << LioLi::TreeGenerators::format_IP_MAC(pkt, pkt->flow, false));
+    root << std::move((LioLi::Tree("endpoint")
+                       << LioLi::TreeGenerators::format_IP_MAC(pkt, pkt->flow,
+                                                               false))
+                          .memoize());
 
     first_pkt = false;
   }
@@ -100,7 +106,9 @@ LioLi::Tree FlowData::gen_delta() {
   return tmp;
 }
 
-void FlowData::dump_delta() { settings.get_logger() << gen_delta(); }
+void FlowData::dump_delta() {
+  settings.get_logger().log(gen_delta(), LioLi::Priority::bulk);
+}
 
 void FlowData::set_service_name(const char *name) {
   root << (LioLi::Tree("service") << std::string(name));
@@ -30,7 +30,13 @@ Cache::ServiceMap::ServiceMap() { get_add("[unknown]"); }
 Cache::ServiceMap::ServiceKey
 Cache::ServiceMap::get_add(const char *service_name) {
   std::scoped_lock lock(mutex);
-  return (service_map.emplace(service_name, service_map.size()).first)->second;
+  auto [itr, inserted] = service_map.emplace(service_name, service_map.size());
+
+  if (inserted) {
+    names.push_back(itr->first);
+  }
+
+  return itr->second;
 }
 
 Cache::ServiceMap::ServiceKey
@@ -38,6 +44,11 @@ Cache::ServiceMap::get_add(const std::string &service_name) {
   return get_add(service_name.c_str());
 }
 
+std::string Cache::ServiceMap::get_name(ServiceKey key) {
+  std::scoped_lock lock(mutex);
+  return (key == 0 || key >= names.size()) ? std::string() : names[key];
+}
+
 std::size_t Cache::ServiceMap::size() { return service_map.size() - 1; }
 
 bool Cache::CacheElement2::ConstValuesComp::operator()(
@@ -56,6 +67,28 @@ bool Cache::CacheElement2::ConstValuesComp::operator()(
                   ((lhs.dst_mac <=> rhs.dst_mac) < 0))))))))));
 };
 
+void Cache::CacheElement2::VolatileValues::add_packet(const snort::Packet *p) {
+  if (p->is_from_client()) {
+    in_pkts++;
+    in_bytes += p->pktlen;
+  } else {
+    out_pkts++;
+    out_bytes += p->pktlen;
+  }
+
+  if (p->pkth) {
+    uint64_t ms = static_cast<uint64_t>(p->pkth->ts.tv_sec) * 1000 +
+                  p->pkth->ts.tv_usec / 1000;
+
+    if (!first_ms) {
+      first_ms = ms;
+    }
+    last_ms = ms;
+  }
+
+  updated = true;
+}
+
 Cache::Handle::Handle(std::shared_ptr<Cache> cache,
                       std::shared_ptr<CacheElement2::VolatileValues> data)
     : data(data), cache(cache) {
@@ -66,13 +99,7 @@ Cache::Handle::Handle(std::shared_ptr<Cache> cache,
 void Cache::Handle::add_sizes(snort::Packet *p) {
   assert(p);
   std::scoped_lock lock(data->mutex);
-  if (p->is_from_client()) {
-    data->in_pkts++;
-    data->in_bytes += p->pktlen;
-  } else {
-    data->out_pkts++;
-    data->out_bytes += p->pktlen;
-  }
+  data->add_packet(p);
 
   Pegs::s_peg_counts.total_bytes += p->pktlen;
 }
@@ -143,13 +170,7 @@ Cache::add_to_cache(snort::Packet *p) {
 
   std::scoped_lock value_lock(itr->second->mutex);
 
-  if (p->is_from_client()) {
-    itr->second->in_pkts++;
-    itr->second->in_bytes += p->pktlen;
-  } else {
-    itr->second->out_pkts++;
-    itr->second->out_bytes += p->pktlen;
-  }
+  itr->second->add_packet(p);
 
   // TODO: Figure out if this is ever relevant, or the service is always given
   // through the event system too
@@ -163,9 +184,40 @@ Cache::add_to_cache(snort::Packet *p) {
     itr->second->service_key = key;
   }
 
-  itr->second->updated = true;
-
   return itr->second;
 }
 
+void Cache::dump(const std::function<void(const Record &)> &lambda) {
+  std::scoped_lock cache_lock(mutex);
+
+  for (auto itr = cache.begin(); itr != cache.end();) {
+    auto &values = *itr->second;
+
+    {
+      std::scoped_lock value_lock(values.mutex);
+
+      if (values.updated) {
+        lambda({itr->first.ipv4_src_addr, itr->first.ipv4_dst_addr,
+                itr->first.l4_src_port, itr->first.l4_dst_port,
+                itr->first.src_mac, itr->first.dst_mac, values.in_bytes,
+                values.in_pkts, values.out_bytes, values.out_pkts,
+                values.first_ms, values.last_ms,
+                service_map.get_name(values.service_key)});
+
+        values.in_bytes = values.in_pkts = 0;
+        values.out_bytes = values.out_pkts = 0;
+        values.first_ms = values.last_ms = 0;
+        values.updated = false;
+      }
+    }
+
+    // We hold the cache lock, so no new Handle can be created for the element
+    if (itr->second.use_count() == 1) {
+      itr = cache.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
 } // namespace trout_netflow2
@@ -6,6 +6,7 @@
 
 // System includes
 #include <array>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -31,14 +32,17 @@ class Cache : public std::enable_shared_from_this<Cache> {
     using ServiceKey = uint32_t;
 
   private:
-    std::mutex mutex; // Protects the service_map
+    std::mutex mutex; // Protects the service_map and names
     std::unordered_map<std::string, ServiceKey> service_map;
+    std::vector<std::string> names; // Service names indexed by ServiceKey
 
   public:
     ServiceMap();
     // Returns the ServiceKey corresponding to service_name
     ServiceKey get_add(const char *service_name);
     ServiceKey get_add(const std::string &service_name);
+    // Returns the service name of key, empty for the unknown service
+    std::string get_name(ServiceKey key);
     std::size_t size();
   } service_map;
 
@@ -71,8 +75,13 @@ class Cache : public std::enable_shared_from_this<Cache> {
           0; // (24) Outgoing counter for packets (reset on dump)
       ServiceMap::ServiceKey service_key =
           0; // (25) Propritary service name key (NOT reset on dump)
+      uint64_t first_ms = 0; // (152) Time of first packet (reset on dump)
+      uint64_t last_ms = 0;  // (153) Time of last packet (reset on dump)
       bool updated =
           false; // Set to true when a field is updated, false when dumped
+
+      // Adds size and time of p, mutex must be held
+      void add_packet(const snort::Packet *p);
     };
   };
 
@@ -93,6 +102,24 @@ class Cache : public std::enable_shared_from_this<Cache> {
   std::shared_ptr<CacheElement2::VolatileValues> add_to_cache(snort::Packet *p);
 
 public:
+  // Values of a cache element as they are exported, ipv4 addresses are in
+  // network byte order as given by snort
+  struct Record {
+    uint32_t ipv4_src_addr;
+    uint32_t ipv4_dst_addr;
+    uint16_t l4_src_port;
+    uint16_t l4_dst_port;
+    std::array<uint8_t, 6> src_mac;
+    std::array<uint8_t, 6> dst_mac;
+    uint64_t in_bytes;
+    uint64_t in_pkts;
+    uint64_t out_bytes;
+    uint64_t out_pkts;
+    uint64_t first_ms; // ms since epoch
+    uint64_t last_ms;
+    std::string service; // Empty if unknown
+  };
+
   // Using a Handle to add service names or packets to the cache is faster than
   // adding them without
   class Handle {
@@ -123,6 +150,11 @@ public:
   void add(snort::Packet *p); // Adds values from snort packet to cache (for use
                               // when there isn't a snort flow associated)
 
+  // Calls lambda with every element updated since the last dump and resets
+  // its counters, elements no longer referenced by a Handle are removed.
+  // Lambda is called with the cache locked, so must not use the cache.
+  void dump(const std::function<void(const Record &)> &lambda);
+
   static std::shared_ptr<Cache> create_cache(std::shared_ptr<Settings>);
 };
 
@@ -0,0 +1,240 @@
+// Snort includes
+#include <log/messages.h>
+
+// System includes
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Global includes
+
+// Local includes
+#include "cache.h"
+#include "exporter.h"
+#include "pegs.h"
+#include "settings.h"
+
+// Debug includes
+
+namespace trout_netflow2 {
+
+namespace {
+
+class FileTransport : public Exporter::Transport {
+  std::string file_name;
+  std::ofstream file;
+
+public:
+  FileTransport(const std::string &file_name) : file_name(file_name) {}
+
+  bool open() override {
+    if (file.is_open()) {
+      return false;
+    }
+
+    file.open(file_name, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open()) {
+      snort::ErrorMessage("ERROR: Could not open IPFIX file %s\n",
+                          file_name.c_str());
+      return false;
+    }
+
+    return true;
+  }
+
+  bool send(const std::string &message) override {
+    if (!file.is_open()) {
+      return false;
+    }
+
+    file.write(message.data(), message.size());
+    file.flush();
+    return file.good();
+  }
+
+  bool is_stream() override { return true; }
+};
+
+// Base for the udp and tcp transports
+class SocketTransport : public Exporter::Transport {
+  int type;
+  uint32_t ipv4;
+  uint16_t port;
+
+protected:
+  int osocket = -1;
+
+  bool connect() {
+    osocket = ::socket(AF_INET, type, 0);
+
+    if (osocket == -1) {
+      return false;
+    }
+
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = ipv4;
+
+    if (::connect(osocket, (sockaddr *)&addr, sizeof(addr))) {
+      close_socket();
+      return false;
+    }
+
+    return true;
+  }
+
+  void close_socket() {
+    if (osocket != -1) {
+      ::close(osocket);
+      osocket = -1;
+    }
+  }
+
+public:
+  SocketTransport(int type, uint32_t ipv4, uint16_t port)
+      : type(type), ipv4(ipv4), port(port) {}
+
+  ~SocketTransport() { close_socket(); }
+};
+
+// Each message is a datagram, there is no stream so the template is resent
+// periodically
+class UdpTransport : public SocketTransport {
+public:
+  UdpTransport(uint32_t ipv4, uint16_t port)
+      : SocketTransport(SOCK_DGRAM, ipv4, port) {}
+
+  bool open() override { return osocket == -1 && connect(); }
+
+  bool send(const std::string &message) override {
+    return osocket != -1 &&
+           ::send(osocket, message.data(), message.size(), MSG_NOSIGNAL) ==
+               static_cast<ssize_t>(message.size());
+  }
+
+  bool is_stream() override { return false; }
+};
+
+// Messages are written back to back on a connection, that is reconnected
+// (starting a new stream) if it fails
+class TcpTransport : public SocketTransport {
+public:
+  TcpTransport(uint32_t ipv4, uint16_t port)
+      : SocketTransport(SOCK_STREAM, ipv4, port) {}
+
+  bool open() override { return osocket == -1 && connect(); }
+
+  bool send(const std::string &message) override {
+    std::size_t sent = 0;
+
+    while (osocket != -1 && sent < message.size()) {
+      ssize_t result = ::send(osocket, message.data() + sent,
+                              message.size() - sent, MSG_NOSIGNAL);
+
+      if (result > 0) {
+        sent += result;
+      } else if (result == -1 && errno == EINTR) {
+        continue;
+      } else {
+        close_socket();
+      }
+    }
+
+    return sent == message.size();
+  }
+
+  bool is_stream() override { return true; }
+};
+
+} // namespace
+
+Exporter::Exporter(std::shared_ptr<Settings> settings,
+                   std::shared_ptr<Cache> cache)
+    : settings(settings), cache(cache),
+      encoder(settings->ipfix_observation_domain,
+              settings->ipfix_max_message_size) {
+  assert(settings);
+  assert(cache);
+
+  switch (settings->ipfix_transport) {
+  case Settings::IpfixTransport::file:
+    transport = std::make_unique<FileTransport>(settings->ipfix_file);
+    break;
+  case Settings::IpfixTransport::udp:
+    transport =
+        std::make_unique<UdpTransport>(settings->ipfix_ip, settings->ipfix_port);
+    break;
+  case Settings::IpfixTransport::tcp:
+    transport =
+        std::make_unique<TcpTransport>(settings->ipfix_ip, settings->ipfix_port);
+    break;
+  case Settings::IpfixTransport::none:
+    break;
+  }
+
+  assert(transport);
+
+  thread = std::thread(&Exporter::run, this);
+}
+
+Exporter::~Exporter() {
+  {
+    std::scoped_lock lock(mutex);
+    stop = true;
+  }
+
+  cv.notify_all();
+  thread.join();
+}
+
+void Exporter::run() {
+  auto interval = std::chrono::seconds(settings->ipfix_interval_s);
+  std::unique_lock lock(mutex);
+
+  while (!stop) {
+    cv.wait_for(lock, interval, [this]() { return stop; });
+
+    lock.unlock();
+    export_cache();
+    lock.lock();
+  }
+}
+
+void Exporter::export_cache() {
+  auto now = std::chrono::steady_clock::now();
+
+  if (transport->open()) {
+    encoder.reset();
+    last_template = now;
+  } else if (!transport->is_stream() &&
+             now - last_template >=
+                 std::chrono::seconds(settings->ipfix_template_refresh_s)) {
+    encoder.send_template();
+    last_template = now;
+  }
+
+  encoder.begin(settings->get_testmode() ? 0 : std::time(nullptr));
+
+  cache->dump([this](const Cache::Record &record) {
+    Pegs::s_peg_counts.ipfix_records++;
+    encoder.add(record);
+  });
+
+  for (const auto &message : encoder.end()) {
+    if (transport->send(message)) {
+      Pegs::s_peg_counts.ipfix_messages++;
+      Pegs::s_peg_counts.ipfix_bytes += message.size();
+    } else {
+      Pegs::s_peg_counts.ipfix_errors++;
+    }
+  }
+}
+
+} // namespace trout_netflow2
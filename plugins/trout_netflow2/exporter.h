@@ -0,0 +1,68 @@
+#ifndef exporter_a4d2961f
+#define exporter_a4d2961f
+
+// Snort includes
+
+// System includes
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Global includes
+
+// Local includes
+#include "ipfix.h"
+
+// Debug includes
+
+namespace trout_netflow2 {
+
+class Cache;
+class Settings;
+
+// Periodically exports the cache as IPFIX messages over the transport given
+// in the settings, the cache is exported a last time when destroyed
+class Exporter {
+public:
+  // Where messages are sent
+  class Transport {
+  public:
+    virtual ~Transport() = default;
+
+    // Makes the transport ready for sending, returns true if a new stream
+    // (file or connection) was started and the template must be (re)sent
+    virtual bool open() = 0;
+
+    // Returns false if message couldn't be sent
+    virtual bool send(const std::string &message) = 0;
+
+    // True for file and tcp, where the template is only sent once per stream
+    virtual bool is_stream() = 0;
+  };
+
+private:
+  std::shared_ptr<Settings> settings;
+  std::shared_ptr<Cache> cache;
+  std::unique_ptr<Transport> transport;
+  IpfixEncoder encoder;
+
+  std::chrono::steady_clock::time_point last_template;
+
+  std::mutex mutex; // Protects stop
+  std::condition_variable cv;
+  bool stop = false;
+  std::thread thread;
+
+  void run();
+  void export_cache();
+
+public:
+  Exporter(std::shared_ptr<Settings> settings, std::shared_ptr<Cache> cache);
+  ~Exporter();
+};
+
+} // namespace trout_netflow2
+
+#endif // #ifndef exporter_a4d2961f
@@ -12,6 +12,7 @@
 #include "inspector.h"
 #include "module.h"
 #include "pegs.h"
+#include "settings.h"
 
 // Debug includes
 
@@ -75,7 +76,11 @@ bool Inspector::configure(snort::SnortConfig *) {
 }
 
 Inspector::Inspector(Module *module)
-    : settings(module->get_settings()), cache(Cache::create_cache(settings)) {}
+    : settings(module->get_settings()), cache(Cache::create_cache(settings)) {
+  if (settings->ipfix_transport != Settings::IpfixTransport::none) {
+    exporter = std::make_unique<Exporter>(settings, cache);
+  }
+}
 
 Inspector::~Inspector() {}
 
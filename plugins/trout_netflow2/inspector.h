@@ -11,6 +11,7 @@
 
 // Local includes
 #include "cache.h"
+#include "exporter.h"
 
 // Debug includes
 
@@ -22,6 +23,7 @@ class Inspector : public snort::Inspector {
 private:
   std::shared_ptr<Settings> settings;
   std::shared_ptr<Cache> cache;
+  std::unique_ptr<Exporter> exporter; // Only set if exporting as IPFIX
 
   void eval(snort::Packet *) override;
 
@@ -0,0 +1,188 @@
+// Snort includes
+
+// System includes
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+// Global includes
+
+// Local includes
+#include "ipfix.h"
+
+// Debug includes
+
+namespace trout_netflow2 {
+
+namespace {
+
+constexpr uint16_t ipfix_version = 10;
+constexpr uint16_t template_set_id = 2;
+constexpr uint16_t template_id = 256;
+constexpr std::size_t message_header_size = 16;
+constexpr std::size_t set_header_size = 4;
+constexpr uint32_t reverse_pen = 29305; // RFC 5103 reverse information elements
+constexpr uint16_t variable_length = 0xffff;
+constexpr std::size_t max_name_length = 254; // Fits single byte length prefix
+
+struct Field {
+  uint16_t id;
+  uint16_t length;
+  uint32_t pen; // Enterprise number, 0 for IANA elements
+};
+
+// Must match the order add() writes the record in
+constexpr Field fields[] = {
+    {8, 4, 0},                  // sourceIPv4Address
+    {12, 4, 0},                 // destinationIPv4Address
+    {7, 2, 0},                  // sourceTransportPort
+    {11, 2, 0},                 // destinationTransportPort
+    {56, 6, 0},                 // sourceMacAddress
+    {80, 6, 0},                 // destinationMacAddress
+    {1, 8, 0},                  // octetDeltaCount
+    {2, 8, 0},                  // packetDeltaCount
+    {1, 8, reverse_pen},        // reverseOctetDeltaCount
+    {2, 8, reverse_pen},        // reversePacketDeltaCount
+    {152, 8, 0},                // flowStartMilliseconds
+    {153, 8, 0},                // flowEndMilliseconds
+    {96, variable_length, 0}}; // applicationName
+
+constexpr std::size_t fixed_record_size = 4 + 4 + 2 + 2 + 6 + 6 + 6 * 8;
+
+void put_u8(std::string &out, uint8_t value) { out.push_back(value); }
+
+void put_u16(std::string &out, uint16_t value) {
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+void put_u32(std::string &out, uint32_t value) {
+  put_u16(out, value >> 16);
+  put_u16(out, value);
+}
+
+void put_u64(std::string &out, uint64_t value) {
+  put_u32(out, value >> 32);
+  put_u32(out, value);
+}
+
+void set_u16(std::string &out, std::size_t pos, uint16_t value) {
+  out[pos] = value >> 8;
+  out[pos + 1] = value;
+}
+
+void set_u32(std::string &out, std::size_t pos, uint32_t value) {
+  set_u16(out, pos, value >> 16);
+  set_u16(out, pos + 2, value);
+}
+
+// Values already in network byte order are copied as is
+void put_raw(std::string &out, const void *data, std::size_t size) {
+  out.append(static_cast<const char *>(data), size);
+}
+
+} // namespace
+
+IpfixEncoder::IpfixEncoder(uint32_t observation_domain,
+                           uint16_t max_message_size)
+    : observation_domain(observation_domain),
+      max_message_size(max_message_size) {}
+
+void IpfixEncoder::reset() {
+  sequence_number = 0;
+  template_pending = true;
+}
+
+void IpfixEncoder::send_template() { template_pending = true; }
+
+void IpfixEncoder::begin(uint32_t export_time) {
+  this->export_time = export_time;
+  start_message();
+}
+
+void IpfixEncoder::start_message() {
+  message.assign(message_header_size, 0);
+  data_set_start = 0;
+  message_records = 0;
+
+  if (template_pending) {
+    std::size_t set_start = message.size();
+
+    put_u16(message, template_set_id);
+    put_u16(message, 0); // Length, set below
+    put_u16(message, template_id);
+    put_u16(message, std::size(fields));
+
+    for (const auto &field : fields) {
+      put_u16(message, field.pen ? field.id | 0x8000 : field.id);
+      put_u16(message, field.length);
+      if (field.pen) {
+        put_u32(message, field.pen);
+      }
+    }
+
+    set_u16(message, set_start + 2, message.size() - set_start);
+    template_pending = false;
+  }
+}
+
+void IpfixEncoder::finish_message() {
+  if (data_set_start) {
+    set_u16(message, data_set_start + 2, message.size() - data_set_start);
+    data_set_start = 0;
+  }
+
+  if (message.size() > message_header_size) {
+    set_u16(message, 0, ipfix_version);
+    set_u16(message, 2, message.size());
+    set_u32(message, 4, export_time);
+    set_u32(message, 8, sequence_number);
+    set_u32(message, 12, observation_domain);
+
+    messages.push_back(std::move(message));
+    sequence_number += message_records;
+  }
+
+  message.clear();
+}
+
+void IpfixEncoder::add(const Cache::Record &record) {
+  std::size_t name_length = std::min(record.service.size(), max_name_length);
+  std::size_t record_size = fixed_record_size + 1 + name_length;
+
+  if (message.size() + (data_set_start ? 0 : set_header_size) + record_size >
+      max_message_size) {
+    finish_message();
+    start_message();
+  }
+
+  if (!data_set_start) {
+    data_set_start = message.size();
+    put_u16(message, template_id);
+    put_u16(message, 0); // Length, set when message is finished
+  }
+
+  put_raw(message, &record.ipv4_src_addr, 4);
+  put_raw(message, &record.ipv4_dst_addr, 4);
+  put_u16(message, record.l4_src_port);
+  put_u16(message, record.l4_dst_port);
+  put_raw(message, record.src_mac.data(), 6);
+  put_raw(message, record.dst_mac.data(), 6);
+  put_u64(message, record.in_bytes);
+  put_u64(message, record.in_pkts);
+  put_u64(message, record.out_bytes);
+  put_u64(message, record.out_pkts);
+  put_u64(message, record.first_ms);
+  put_u64(message, record.last_ms);
+  put_u8(message, name_length);
+  message.append(record.service, 0, name_length);
+
+  message_records++;
+}
+
+std::vector<std::string> IpfixEncoder::end() {
+  finish_message();
+  return std::exchange(messages, {});
+}
+
+} // namespace trout_netflow2
@@ -0,0 +1,63 @@
+#ifndef ipfix_3e81c07a
+#define ipfix_3e81c07a
+
+// Snort includes
+
+// System includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Global includes
+
+// Local includes
+#include "cache.h"
+
+// Debug includes
+
+namespace trout_netflow2 {
+
+// Encodes cache records as IPFIX (RFC 7011) messages.  Every record uses the
+// same template (id 256), data records are batched into data sets of as few
+// messages as max_message_size allows.
+//
+// The in (client to server) counters are exported as octet/packetDeltaCount
+// and the out counters as their RFC 5103 reverse elements.
+class IpfixEncoder {
+  uint32_t observation_domain;
+  uint16_t max_message_size;
+
+  uint32_t sequence_number = 0; // Data records in messages before current one
+  uint32_t export_time = 0;
+  bool template_pending = true;
+
+  std::string message;            // Message being built
+  std::size_t data_set_start = 0; // Offset of open data set, 0 if none
+  uint32_t message_records = 0;   // Data records in current message
+  std::vector<std::string> messages;
+
+  void start_message();
+  void finish_message();
+
+public:
+  IpfixEncoder(uint32_t observation_domain, uint16_t max_message_size);
+
+  // Starts a new stream, sequence numbers restart and the template is sent
+  void reset();
+
+  // Makes the next message start with the template set
+  void send_template();
+
+  // Starts a batch of records, export_time is seconds since epoch
+  void begin(uint32_t export_time);
+
+  // Adds record to the batch
+  void add(const Cache::Record &record);
+
+  // Ends the batch, returns its messages in order
+  std::vector<std::string> end();
+};
+
+} // namespace trout_netflow2
+
+#endif // #ifndef ipfix_3e81c07a
@@ -1,6 +1,7 @@
 
 
 // Snort includes
+#include <log/messages.h>
 
 // System includes
 
@@ -25,6 +26,22 @@ const snort::Parameter module_params[] = {
     {"cache_size", snort::Parameter::PT_INT, "1:100000", "10000",
      "The max number of simultaneous conections that can be handled at any "
      "given time"},
+    {"ipfix_transport", snort::Parameter::PT_ENUM, "none | file | udp | tcp",
+     "none", "Where the cache is exported as IPFIX (RFC 7011) messages"},
+    {"ipfix_file", snort::Parameter::PT_STRING, nullptr, nullptr,
+     "File IPFIX messages are written to, for the file transport"},
+    {"ipfix_ip", snort::Parameter::PT_IP4, nullptr, nullptr,
+     "IPFIX collector address, for the udp and tcp transports"},
+    {"ipfix_port", snort::Parameter::PT_PORT, nullptr, "4739",
+     "IPFIX collector port, for the udp and tcp transports"},
+    {"ipfix_interval_s", snort::Parameter::PT_INT, "1:max32", "60",
+     "Seconds between exports of the cache"},
+    {"ipfix_template_refresh_s", snort::Parameter::PT_INT, "1:max32", "600",
+     "Seconds between resending the template, for the udp transport"},
+    {"ipfix_observation_domain", snort::Parameter::PT_INT, "0:max32", "0",
+     "Observation domain id of exported messages"},
+    {"ipfix_max_message_size", snort::Parameter::PT_INT, "512:65535", "1400",
+     "Max size of an IPFIX message, data sets are split to stay below it"},
     {nullptr, snort::Parameter::PT_MAX, nullptr, nullptr, nullptr}};
 
 } // namespace
@@ -36,7 +53,28 @@ bool Module::begin(const char *, int, snort::SnortConfig *) {
   return true;
 }
 
-bool Module::end(const char *, int, snort::SnortConfig *) { return true; }
+bool Module::end(const char *, int, snort::SnortConfig *) {
+  using IpfixTransport = Settings::IpfixTransport;
+
+  if (settings->ipfix_transport == IpfixTransport::file &&
+      settings->ipfix_file.empty()) {
+    snort::ErrorMessage("ERROR: %s ipfix_file must be set for the file "
+                        "transport\n",
+                        s_name);
+    return false;
+  }
+
+  if ((settings->ipfix_transport == IpfixTransport::udp ||
+       settings->ipfix_transport == IpfixTransport::tcp) &&
+      !settings->ipfix_ip) {
+    snort::ErrorMessage("ERROR: %s ipfix_ip must be set for the udp and tcp "
+                        "transports\n",
+                        s_name);
+    return false;
+  }
+
+  return true;
+}
 
 bool Module::set(const char *, snort::Value &val, snort::SnortConfig *) {
   if (val.is("logger") && val.get_as_string().size() > 0) {
@@ -45,6 +83,23 @@ bool Module::set(const char *, snort::Value &val, snort::SnortConfig *) {
     settings->testmode = val.get_bool();
   } else if (val.is("cache_size")) {
     settings->cache_size = val.get_int32();
+  } else if (val.is("ipfix_transport")) {
+    settings->ipfix_transport =
+        static_cast<Settings::IpfixTransport>(val.get_uint8());
+  } else if (val.is("ipfix_file")) {
+    settings->ipfix_file = val.get_as_string();
+  } else if (val.is("ipfix_ip")) {
+    settings->ipfix_ip = val.get_ip4();
+  } else if (val.is("ipfix_port")) {
+    settings->ipfix_port = val.get_uint16();
+  } else if (val.is("ipfix_interval_s")) {
+    settings->ipfix_interval_s = val.get_uint32();
+  } else if (val.is("ipfix_template_refresh_s")) {
+    settings->ipfix_template_refresh_s = val.get_uint32();
+  } else if (val.is("ipfix_observation_domain")) {
+    settings->ipfix_observation_domain = val.get_uint32();
+  } else if (val.is("ipfix_max_message_size")) {
+    settings->ipfix_max_message_size = val.get_uint16();
   } else {
     // fail if we didn't get something we knew about
     return false;
@@ -23,6 +23,11 @@ PegInfo Pegs::s_pegs[] = {
      "Count of times a service was assigned to a flow"},
     {CountType::SUM, "different_services",
      "Number of different services that were seen"},
+    {CountType::SUM, "ipfix_messages", "Number of IPFIX messages exported"},
+    {CountType::SUM, "ipfix_records", "Number of IPFIX data records exported"},
+    {CountType::SUM, "ipfix_bytes", "Sum of size of IPFIX messages exported"},
+    {CountType::SUM, "ipfix_errors",
+     "Number of IPFIX messages that could not be sent"},
 
     {CountType::END, nullptr, nullptr}};
 
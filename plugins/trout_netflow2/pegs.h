@@ -25,6 +25,10 @@ struct Pegs {
     PegCount service_change = 0;     // Updated by cache
     PegCount services_seen = 0;      // Updated by inspector
     PegCount different_services = 0; // Updated by cache
+    PegCount ipfix_messages = 0;     // Updated by exporter
+    PegCount ipfix_records = 0;      // Updated by exporter
+    PegCount ipfix_bytes = 0;        // Updated by exporter
+    PegCount ipfix_errors = 0;       // Updated by exporter
   };
 
   static PegInfo s_pegs[];
@@ -24,6 +24,17 @@ struct Settings {
   bool testmode;
   uint32_t cache_size;
 
+  // IPFIX export of the cache
+  enum class IpfixTransport { none, file, udp, tcp };
+  IpfixTransport ipfix_transport = IpfixTransport::none;
+  std::string ipfix_file;
+  uint32_t ipfix_ip = 0; // Collector address in network byte order
+  uint16_t ipfix_port = 4739;
+  uint32_t ipfix_interval_s = 60;
+  uint32_t ipfix_template_refresh_s = 600; // Only used for udp
+  uint32_t ipfix_observation_domain = 0;
+  uint16_t ipfix_max_message_size = 1400;
+
 public:
   LioLi::Logger &get_logger();
   bool get_testmode();
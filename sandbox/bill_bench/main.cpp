@@ -0,0 +1,211 @@
+// Round trip test and decode benchmark of the BILL decoder (includes/bill.h).
+//
+// Random trees are encoded with every LioLi variant (BILL with and without
+// root node, RAW, memoized and not) and decoded again, the decoded trees must
+// render identically to the originals.  Then the decode throughput of a large
+// stream is measured, walking all nodes of every tree.
+//
+// Build from this directory with:
+//   g++ -std=c++2b -O2 -I ../../includes main.cpp ../../plugins/common/bill.cc
+//       ../../plugins/common/lioli.cc ../../plugins/common/lioli_path.cc
+//       ../../plugins/common/text_kernels.cc -o bill_bench
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <bill.h>
+#include <lioli.h>
+
+std::mt19937 rng(42);
+
+// Text of random length, mostly short to use all three span encodings
+std::string make_text() {
+  static const size_t lengths[] = {0, 1, 7, 15, 16, 63, 255, 256, 1000};
+  std::string text(lengths[rng() % std::size(lengths)], 0);
+
+  for (auto &c : text) {
+    c = (rng() % 8) ? static_cast<char>('a' + rng() % 26)
+                    : static_cast<char>(rng());
+  }
+
+  return text;
+}
+
+LioLi::Tree make_tree(unsigned depth, bool memoize) {
+  static const char *names[] = {"$", "endpoint", "addr", "ip", "#tags",
+                                "port", "a1"};
+  LioLi::Tree tree(depth ? names[1 + rng() % (std::size(names) - 1)] : "$");
+  unsigned children = depth < 3 ? rng() % 4 : 0;
+
+  for (unsigned i = 0; i < children; i++) {
+    if (rng() % 2) {
+      tree << make_text();
+    }
+    tree << make_tree(depth + 1, memoize);
+  }
+
+  tree << make_text();
+
+  if (memoize && rng() % 2) {
+    tree.memoize();
+  }
+
+  return tree;
+}
+
+std::string encode(const std::vector<LioLi::Tree> &trees, bool raw,
+                   bool root) {
+  std::vector<uint8_t> secret = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  LioLi::LioLi lioli;
+
+  lioli.set_secret(secret);
+  if (raw) {
+    lioli.set_raw_mode();
+  }
+  if (!root) {
+    lioli.set_no_root_node();
+  }
+
+  lioli.insert_header();
+  for (auto &tree : trees) {
+    lioli << tree;
+  }
+
+  return lioli.move_binary();
+}
+
+// Renders the decoded nodes, with their values, to compare variants
+void render(Bill::NodeCursor cursor, std::string &output) {
+  Bill::NodeView node;
+
+  while (cursor.next(node)) {
+    output += node.name();
+    output += '=';
+    output += node.value();
+    output += '{';
+    render(node.children(), output);
+    output += '}';
+  }
+
+  if (cursor.is_corrupt()) {
+    output += "CORRUPT";
+  }
+}
+
+bool round_trip(const std::vector<LioLi::Tree> &trees, bool memoized) {
+  auto bill = encode(trees, false, true);
+  auto bill_no_root = encode(trees, false, false);
+  auto raw = encode(trees, true, true);
+
+  Bill::StreamReader bill_reader(
+      reinterpret_cast<const uint8_t *>(bill.data()), bill.size());
+  Bill::StreamReader no_root_reader(
+      reinterpret_cast<const uint8_t *>(bill_no_root.data()),
+      bill_no_root.size());
+  Bill::StreamReader raw_reader(reinterpret_cast<const uint8_t *>(raw.data()),
+                                raw.size());
+  Bill::TreeView tree, no_root_tree, raw_tree;
+  bool ok = bill_reader.has_header() && no_root_reader.has_header() &&
+            raw_reader.has_header() &&
+            raw_reader.header().format == Bill::Format::raw;
+
+  for (auto &original : trees) {
+    if (!bill_reader.next(tree) || !no_root_reader.next(no_root_tree) ||
+        !raw_reader.next(raw_tree)) {
+      ok = false;
+      break;
+    }
+
+    // The root node variant renders exactly as the original
+    ok &= tree.as_lorth() == original.as_lorth();
+
+    // Without root node the top level is the children of the root
+    Bill::NodeCursor cursor = tree.nodes();
+    Bill::NodeView root;
+    std::string with_root_children, without_root;
+
+    ok &= cursor.next(root);
+    render(root.children(), with_root_children);
+    render(no_root_tree.nodes(), without_root);
+    ok &= with_root_children == without_root;
+
+    ok &= tree.get_raw() == raw_tree.get_raw() && raw_tree.get_encoded().empty();
+  }
+
+  ok &= !bill_reader.remaining() && !no_root_reader.remaining() &&
+        !raw_reader.remaining();
+
+  std::cout << "round trip" << (memoized ? " (memoized)" : "") << ": "
+            << (ok ? "ok" : "FAILED") << std::endl;
+  return ok;
+}
+
+// Visits every node, returns number of nodes
+size_t walk(Bill::NodeCursor cursor, size_t &value_bytes) {
+  Bill::NodeView node;
+  size_t count = 0;
+
+  while (cursor.next(node)) {
+    value_bytes += node.value().size();
+    count += 1 + walk(node.children(), value_bytes);
+  }
+
+  return count;
+}
+
+void benchmark(const std::vector<LioLi::Tree> &trees) {
+  auto stream = encode(trees, false, true);
+  const size_t target_bytes = 1ul << 30; // Decode 1GiB per measurement
+  size_t done = 0;
+  size_t nodes = 0;
+  size_t value_bytes = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  while (done < target_bytes) {
+    Bill::StreamReader reader(
+        reinterpret_cast<const uint8_t *>(stream.data()), stream.size());
+    Bill::TreeView tree;
+
+    while (reader.next(tree)) {
+      nodes += walk(tree.nodes(), value_bytes);
+    }
+
+    done += stream.size();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::cout << std::fixed << std::setprecision(2) << "decode: "
+            << done / elapsed.count() / 1e9 << " GB/s, "
+            << nodes / elapsed.count() / 1e6 << " M nodes/s" << std::endl;
+}
+
+int main() {
+  bool ok = true;
+
+  for (bool memoize : {false, true}) {
+    std::vector<LioLi::Tree> trees;
+
+    for (int i = 0; i < 2000; i++) {
+      trees.push_back(make_tree(0, memoize));
+    }
+
+    ok &= round_trip(trees, memoize);
+
+    if (memoize) {
+      // Second encoding uses the memoized encodings
+      ok &= round_trip(trees, memoize);
+    } else {
+      benchmark(trees);
+    }
+  }
+
+  return ok ? 0 : 1;
+}
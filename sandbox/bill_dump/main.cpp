@@ -0,0 +1,124 @@
+// Prints the content of BILL and RAW streams, e.g. files written by
+// logger_file or data captured with socket_read, using the decoder in
+// includes/bill.h
+//
+// Usage: bill_dump [-s] [-p path] <file | ->
+//   -s       only print the tree count and sizes
+//   -p path  only print the values of nodes matching the dotted path, e.g.
+//            $.endpoint.addr.ip (no root node: endpoint.addr.ip)
+//
+// Build from this directory with:
+//   g++ -std=c++2b -O2 -I ../../includes main.cpp ../../plugins/common/bill.cc
+//       ../../plugins/common/text_kernels.cc -o bill_dump
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include <bill.h>
+#include <mapped_file.h>
+#include <text_kernels.h>
+
+int dump(const uint8_t *data, size_t size, bool summary, const char *path) {
+  Bill::StreamReader reader(data, size);
+
+  if (!reader.has_header()) {
+    std::cout << "Not a BILL or RAW stream" << std::endl;
+    return 1;
+  }
+
+  bool is_bill = reader.header().format == Bill::Format::bill;
+  Bill::TreeView tree;
+  uint64_t tree_count = 0;
+  uint64_t raw_bytes = 0;
+  uint64_t encoded_bytes = 0;
+  uint64_t match_count = 0;
+  bool corrupt = false;
+
+  while (reader.next(tree)) {
+    raw_bytes += tree.get_raw().size();
+    encoded_bytes += tree.get_encoded().size();
+
+    if (path) {
+      corrupt |= !tree.for_each_match(path, [&](const Bill::NodeView &node) {
+        std::string value;
+        Common::append_escaped(value, node.value());
+        if (!summary) {
+          std::cout << tree_count << ": " << value << std::endl;
+        }
+        match_count++;
+        return true;
+      });
+    } else if (!summary) {
+      if (is_bill) {
+        std::cout << tree.as_lorth();
+      } else {
+        std::string value;
+        Common::append_escaped(value, tree.get_raw());
+        std::cout << value << std::endl;
+      }
+    }
+
+    tree_count++;
+  }
+
+  std::cout << (is_bill ? "BILL" : "RAW") << " stream: " << tree_count
+            << " trees, " << raw_bytes << " raw bytes, " << encoded_bytes
+            << " node bytes";
+  if (path) {
+    std::cout << ", " << match_count << " matches";
+  }
+  std::cout << std::endl;
+
+  if (corrupt) {
+    std::cout << "Stream has corrupt node encodings" << std::endl;
+    return 1;
+  }
+
+  if (reader.remaining()) {
+    std::cout << reader.remaining() << " bytes of truncated or corrupt data"
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  bool summary = false;
+  const char *path = nullptr;
+  int arg = 1;
+
+  for (; arg < argc - 1; arg++) {
+    if (std::strcmp(argv[arg], "-s") == 0) {
+      summary = true;
+    } else if (std::strcmp(argv[arg], "-p") == 0 && arg + 2 < argc) {
+      path = argv[++arg];
+    } else {
+      break;
+    }
+  }
+
+  if (arg != argc - 1) {
+    std::cout << "Usage: " << argv[0] << " [-s] [-p path] <file | ->"
+              << std::endl;
+    return 1;
+  }
+
+  if (std::strcmp(argv[arg], "-") == 0) {
+    std::string input(std::istreambuf_iterator<char>(std::cin), {});
+    return dump(reinterpret_cast<const uint8_t *>(input.data()), input.size(),
+                summary, path);
+  }
+
+  Common::MappedFile file(argv[arg]);
+
+  if (!file.is_open()) {
+    std::cout << "Unable to open " << argv[arg] << std::endl;
+    return 1;
+  }
+
+  return dump(file.data(), file.size(), summary, path);
+}
@@ -0,0 +1,74 @@
+// Prints the content of files written by serializer_columnar, one line per
+// row, using the reader in includes/columnar.h
+//
+// Build from this directory with:
+//   g++ -std=c++2b -O2 -I ../../includes main.cpp -o columnar_dump
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <columnar.h>
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cout << "Usage: " << argv[0] << " <file>" << std::endl;
+    return 1;
+  }
+
+  Columnar::MappedFile file(argv[1]);
+
+  if (!file.is_open()) {
+    std::cout << "Unable to open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  auto reader = file.reader();
+  Columnar::BlockView block;
+  unsigned block_count = 0;
+
+  while (reader.next(block)) {
+    std::cout << "block " << block_count++ << ": " << block.row_count()
+              << " rows, " << block.size() << " bytes" << std::endl;
+
+    // Render the columns to text, a column at a time as they are stored
+    std::vector<std::vector<std::string>> rows(
+        block.row_count(), std::vector<std::string>(block.column_count(), "-"));
+
+    for (uint16_t index = 0; index < block.column_count(); index++) {
+      auto column = block.column(index);
+
+      std::cout << (index ? "," : "") << column.name();
+
+      if (column.type() == Columnar::Type::string) {
+        for (uint32_t row = 0; row < block.row_count(); row++) {
+          if (!column.is_null(row)) {
+            rows[row][index] = column.string(row);
+          }
+        }
+      } else {
+        column.for_each_integer([&rows, index](uint32_t row, int64_t value) {
+          rows[row][index] = std::to_string(value);
+        });
+      }
+    }
+
+    std::cout << std::endl;
+
+    for (auto &row : rows) {
+      for (size_t index = 0; index < row.size(); index++) {
+        std::cout << (index ? "," : "") << row[index];
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  if (reader.remaining()) {
+    std::cout << reader.remaining() << " bytes of truncated or corrupt data"
+              << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,231 @@
+// Throughput of the shared memory ring used by logger_shm (includes/shm_ring.h)
+// against a pipe, as used by logger_pipe, between two processes.
+//
+// The producer writes the same records to both, on the pipe one write() per
+// record and one write() per batch (as logger_pipe does with a batching
+// serializer), in the ring one publish() per batch.  The consumer checksums
+// every byte it gets, in place for the ring and after read() for the pipe, and
+// the time is taken until the consumer has seen all of it.  The serializers
+// are left out, this only compares the transports.
+//
+// Usage: shm_bench [ring_bytes], ring_bytes is a power of two, default 1 MiB
+//
+// Build from this directory with:
+//   g++ -std=c++2b -O2 -I ../../includes main.cpp
+//       ../../plugins/common/shm_ring.cc -o shm_bench
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <shm_ring.h>
+
+const size_t total_bytes = 1ul << 30; // Sent per measurement
+const size_t batch_records = 64;      // Records per publish / batched write
+size_t ring_bytes = 1ul << 20;        // Data area of the ring
+
+// Cheap enough that the transport is what's measured, but touches every byte
+uint64_t checksum(const char *data, size_t size, uint64_t sum) {
+  for (size_t i = 0; i < size; i++) {
+    sum += static_cast<uint8_t>(data[i]);
+  }
+  return sum;
+}
+
+std::vector<std::string> make_records(size_t size) {
+  std::mt19937 rng(42);
+  std::vector<std::string> records(batch_records, std::string(size, 0));
+
+  for (auto &record : records) {
+    for (auto &c : record) {
+      c = static_cast<char>('a' + rng() % 26);
+    }
+  }
+
+  return records;
+}
+
+// Runs consumer in a child process, producer in this one, returns seconds
+// until the child is done
+template <class Producer, class Consumer>
+double run(Producer producer, Consumer consumer) {
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    consumer();
+    _exit(0);
+  }
+
+  producer();
+
+  int status;
+  waitpid(pid, &status, 0);
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+double bench_pipe(const std::vector<std::string> &records, bool batched) {
+  size_t count = total_bytes / records[0].size();
+  int fds[2];
+
+  if (pipe(fds)) {
+    return 0;
+  }
+
+  double seconds = run(
+      [&] {
+        close(fds[0]);
+        std::string batch;
+
+        for (size_t i = 0; i < count; i++) {
+          auto &record = records[i % batch_records];
+
+          if (batched) {
+            batch += record;
+            if (batch.size() < batch_records * record.size() && i + 1 < count) {
+              continue;
+            }
+          }
+
+          const std::string &output = batched ? batch : record;
+          size_t done = 0;
+
+          while (done < output.size()) {
+            ssize_t bytes = write(fds[1], output.data() + done,
+                                  output.size() - done);
+            if (bytes <= 0) {
+              return;
+            }
+            done += bytes;
+          }
+
+          batch.clear();
+        }
+
+        close(fds[1]);
+      },
+      [&] {
+        close(fds[1]);
+        static char buffer[1 << 20];
+        uint64_t sum = 0;
+        ssize_t bytes;
+
+        while ((bytes = read(fds[0], buffer, sizeof(buffer))) > 0) {
+          sum = checksum(buffer, bytes, sum);
+        }
+
+        // Keep the checksum from being optimized away
+        if (sum == 42) {
+          std::cout << "";
+        }
+      });
+
+  close(fds[0]);
+  close(fds[1]);
+
+  return seconds;
+}
+
+double bench_ring(const std::vector<std::string> &records) {
+  size_t count = total_bytes / records[0].size();
+  int sockets[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets)) {
+    return 0;
+  }
+
+  ShmRing::Writer writer("shm_bench", ring_bytes);
+
+  if (!writer.is_open()) {
+    std::cerr << "Unable to create ring: " << std::strerror(errno) << "\n";
+    return 0;
+  }
+
+  double seconds = run(
+      [&] {
+        writer.hand_out(sockets[0]);
+
+        for (size_t i = 0; i < count; i++) {
+          // Full, let the consumer run, like logger_shm does
+          while (!writer.write(records[i % batch_records], 0)) {
+            writer.publish();
+            std::this_thread::yield();
+          }
+
+          if (i % batch_records == batch_records - 1) {
+            writer.publish();
+          }
+        }
+
+        writer.publish();
+      },
+      [&] {
+        ShmRing::Reader reader;
+
+        if (!reader.receive(sockets[1])) {
+          std::cerr << "Unable to attach: " << std::strerror(errno) << "\n";
+          return;
+        }
+
+        ShmRing::Record record;
+        uint64_t sum = 0;
+        size_t seen = 0;
+
+        while (seen < count) {
+          while (reader.next(record)) {
+            sum = checksum(record.payload.data(), record.payload.size(), sum);
+            reader.release();
+            seen++;
+          }
+
+          reader.wait(100);
+        }
+
+        if (sum == 42) {
+          std::cout << "";
+        }
+      });
+
+  close(sockets[0]);
+  close(sockets[1]);
+
+  return seconds;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    ring_bytes = std::stoul(argv[1]);
+  }
+
+  std::cout << "MB/s moving " << (total_bytes >> 20)
+            << " MiB between two processes\n\n"
+            << std::setw(8) << "record" << std::setw(14) << "pipe/record"
+            << std::setw(14) << "pipe/batch" << std::setw(14) << "shm ring"
+            << "\n";
+
+  for (size_t size : {64, 256, 1500, 16384}) {
+    auto records = make_records(size);
+
+    std::cout << std::setw(8) << size << std::fixed << std::setprecision(0);
+    for (double seconds : {bench_pipe(records, false),
+                           bench_pipe(records, true), bench_ring(records)}) {
+      std::cout << std::setw(14) << total_bytes / seconds / 1e6;
+    }
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+// Consumer of logger_shm, attaches to the ring through the logger's socket
+// and copies the records to stdout, using the reader in includes/shm_ring.h
+//
+// Usage: shm_read [-c] [-n] [-r <records>] <socket_path>
+//   -c  only count records and bytes, printing the rate every second
+//   -n  skip records until the start of a serializer context, for binary
+//       serializers whose output can't be read from the middle
+//   -r  detach after reading records, so another consumer can attach
+//
+// The logger ends its serializer context when a consumer attaches, so a
+// second consumer started with -n gets output it can read on its own, e.g.:
+//   shm_read -r 100 /tmp/shm.sock > first.bin
+//   shm_read -n /tmp/shm.sock > second.bin
+//
+// Build from this directory with:
+//   g++ -std=c++2b -O2 -I ../../includes main.cpp
+//       ../../plugins/common/shm_ring.cc -o shm_read
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <shm_ring.h>
+
+int main(int argc, char *argv[]) {
+  bool count_only = false;
+  bool skip_to_context = false;
+  uint64_t max_records = 0; // 0 = no limit
+  const char *socket_path = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-c") == 0) {
+      count_only = true;
+    } else if (std::strcmp(argv[i], "-n") == 0) {
+      skip_to_context = true;
+    } else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      max_records = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      socket_path = argv[i];
+    }
+  }
+
+  if (!socket_path) {
+    std::cerr << "Usage: " << argv[0] << " [-c] [-n] [-r <records>] <socket_path>\n";
+    return 1;
+  }
+
+  ShmRing::Reader reader;
+
+  if (!reader.connect(socket_path)) {
+    std::cerr << "Unable to attach to " << socket_path << ": "
+              << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  std::cerr << "Attached, ring of " << reader.get_data_size() << " bytes"
+            << std::endl;
+
+  ShmRing::Record record;
+  uint64_t expected_seq = 0;
+  bool first = true;
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+  uint64_t last_records = 0;
+  uint64_t last_bytes = 0;
+  auto last_report = std::chrono::steady_clock::now();
+
+  while (true) {
+    while ((max_records == 0 || records < max_records) &&
+           reader.next(record)) {
+      // The ring never drops records, a gap means the logger was restarted
+      if (!first && record.seq != expected_seq) {
+        std::cerr << "Sequence gap, expected " << expected_seq << " got "
+                  << record.seq << std::endl;
+      }
+      first = false;
+      expected_seq = record.seq + 1;
+
+      if (record.flags & ShmRing::context_start) {
+        std::cerr << "Context starts at record " << record.seq << std::endl;
+      }
+
+      if (skip_to_context) {
+        if (!(record.flags & ShmRing::context_start)) {
+          reader.release();
+          continue;
+        }
+        skip_to_context = false;
+      }
+
+      records++;
+      bytes += record.payload.size();
+
+      if (!count_only) {
+        std::cout.write(record.payload.data(), record.payload.size());
+      }
+
+      // Cheap, no syscall, and lets the logger go on while we read
+      reader.release();
+    }
+
+    if (reader.is_corrupt()) {
+      std::cerr << "Corrupt record, stopping" << std::endl;
+      return 1;
+    }
+
+    if (count_only) {
+      auto now = std::chrono::steady_clock::now();
+
+      if (now - last_report >= std::chrono::seconds(1)) {
+        double seconds = std::chrono::duration<double>(now - last_report).count();
+        std::cerr << records << " records, " << bytes << " bytes, "
+                  << static_cast<uint64_t>((records - last_records) / seconds)
+                  << " records/s, "
+                  << (bytes - last_bytes) / seconds / 1e6 << " MB/s"
+                  << std::endl;
+        last_report = now;
+        last_records = records;
+        last_bytes = bytes;
+      }
+    } else {
+      std::cout.flush();
+    }
+
+    if (max_records != 0 && records >= max_records) {
+      break;
+    }
+
+    if (!reader.wait(1000)) {
+      std::cerr << "Logger closed the connection" << std::endl;
+      break;
+    }
+  }
+
+  std::cerr << records << " records, " << bytes << " bytes" << std::endl;
+  return 0;
+}
@@ -0,0 +1,189 @@
+// Prints the trees logger_store kept in a store directory, found by time and
+// by the value of the indexed key, using the reader in
+// includes/segment_store.h
+//
+// Usage: store_query [-f <from>] [-t <to>] [-k <value>] [-c] [-l] <store_dir>
+//   -f  only trees logged at or after from, seconds since epoch, or seconds
+//       ago if negative (e.g. -f -3600 for the last hour)
+//   -t  only trees logged at or before to, as -f
+//   -k  only trees whose indexed key has value
+//   -c  only count the trees found
+//   -l  list the segments, instead of printing trees
+//
+// The serializer's header (BILL, csv, ...) is only in the first record of a
+// segment, together with its first tree, so that record is printed before the
+// first tree found in each segment.  The first tree of a segment might then
+// be printed though it wasn't asked for.  Trees serialized by serializer_zstd
+// or serializer_columnar don't have a record each, and can only be counted.
+//
+// Build from this directory with:
+//   g++ -std=c++2b -O2 -I ../../includes main.cpp
+//       ../../plugins/common/segment_store.cc -o store_query
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include <segment_store.h>
+
+// Serializers whose output isn't a record per tree, a compressed stream or
+// blocks of many trees, so their records can't be printed on their own
+const char *const not_self_contained[] = {"serializer_zstd",
+                                          "serializer_columnar"};
+
+bool is_self_contained(std::string_view serializer) {
+  for (auto name : not_self_contained) {
+    if (serializer.starts_with(name)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Returns the time argument in ns since epoch
+int64_t parse_time(const char *text) {
+  int64_t seconds = std::strtoll(text, nullptr, 10);
+
+  if (seconds < 0) {
+    seconds += std::chrono::duration_cast<std::chrono::seconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+  }
+
+  return seconds * 1000000000;
+}
+
+int main(int argc, char *argv[]) {
+  int64_t from = std::numeric_limits<int64_t>::min();
+  int64_t to = std::numeric_limits<int64_t>::max();
+  const char *value = nullptr;
+  bool count_only = false;
+  bool list = false;
+  const char *store_dir = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      from = parse_time(argv[++i]);
+    } else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      to = parse_time(argv[++i]);
+    } else if (std::strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      value = argv[++i];
+    } else if (std::strcmp(argv[i], "-c") == 0) {
+      count_only = true;
+    } else if (std::strcmp(argv[i], "-l") == 0) {
+      list = true;
+    } else {
+      store_dir = argv[i];
+    }
+  }
+
+  if (!store_dir) {
+    std::cerr << "Usage: " << argv[0]
+              << " [-f <from>] [-t <to>] [-k <value>] [-c] [-l] <store_dir>\n";
+    return 1;
+  }
+
+  if (list) {
+    for (auto &path : SegmentStore::list_segments(store_dir)) {
+      SegmentStore::Segment segment(path);
+
+      if (!segment.is_valid()) {
+        std::cout << path << ": not a valid segment" << std::endl;
+        continue;
+      }
+
+      auto &header = segment.get_header();
+      std::cout << path << ": "
+                << header.data_end.load() - header.data_start << " bytes, "
+                << header.first_time.load() / 1000000000 << "-"
+                << header.last_time.load() / 1000000000 << ", "
+                << (header.sealed.load() ? "sealed" : "being written")
+                << ", serializer " << header.serializer << ", key "
+                << (*header.key ? header.key : "-") << std::endl;
+    }
+
+    return 0;
+  }
+
+  uint64_t records = 0;
+  uint64_t bytes = 0;
+  uint64_t context_starts = 0; // Printed for their header
+  uint64_t current = 0; // Sequence of the segment of the last record found
+  bool found = false;
+  bool refused = false;
+
+  auto print = [&](const SegmentStore::Segment &segment,
+                   const SegmentStore::Record &record) {
+    // Only the end of a serializer context, not a tree
+    if (record.flags & SegmentStore::context_end) {
+      return true;
+    }
+
+    // The first record found in a segment
+    auto &header = segment.get_header();
+
+    if ((!found || header.sequence != current) && !count_only) {
+      current = header.sequence;
+      found = true;
+
+      if (!is_self_contained(header.serializer)) {
+        std::cerr << "Trees serialized by " << header.serializer
+                  << " can't be printed one by one, only counted (-c)"
+                  << std::endl;
+        refused = true;
+        return false;
+      }
+
+      // Its context start carries the serializer's header
+      if (!(record.flags & SegmentStore::context_start)) {
+        segment.for_each(std::numeric_limits<int64_t>::min(),
+                         std::numeric_limits<int64_t>::max(),
+                         [&](const SegmentStore::Record &first) {
+                           if (first.flags & SegmentStore::context_start) {
+                             std::cout.write(first.payload.data(),
+                                             first.payload.size());
+                             context_starts++;
+                           }
+                           return false;
+                         });
+      }
+    }
+
+    records++;
+    bytes += record.payload.size();
+
+    if (!count_only) {
+      std::cout.write(record.payload.data(), record.payload.size());
+    }
+
+    return true;
+  };
+
+  SegmentStore::Store store(store_dir);
+
+  if (value) {
+    store.for_each_key(value, from, to, print);
+  } else {
+    store.for_each(from, to, print);
+  }
+
+  std::cout.flush();
+
+  if (refused) {
+    return 1;
+  }
+
+  std::cerr << records << " trees, " << bytes << " bytes";
+  if (context_starts != 0) {
+    std::cerr << ", and the first record of " << context_starts
+              << " segments for the serializer's header";
+  }
+  std::cerr << std::endl;
+  return 0;
+}
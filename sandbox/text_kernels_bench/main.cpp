@@ -0,0 +1,96 @@
+// Micro benchmark of the text kernels (includes/text_kernels.h), prints GB/s
+// of input processed per kernel set, for printable, mixed and binary payloads.
+//
+// Build from this directory with:
+//   g++ -std=c++2b -O2 -I ../../includes main.cpp
+//       ../../plugins/common/text_kernels.cc -o text_kernels_bench
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <text_kernels.h>
+
+// Generates size bytes, where 1 in binary_ratio is a random byte and the
+// rest printable ascii (0 gives only printable)
+std::string make_payload(size_t size, unsigned binary_ratio) {
+  std::mt19937 rng(42);
+  std::string payload(size, 0);
+
+  for (auto &c : payload) {
+    if (binary_ratio && rng() % binary_ratio == 0) {
+      c = static_cast<char>(rng());
+    } else {
+      c = static_cast<char>('a' + rng() % 26);
+    }
+  }
+
+  return payload;
+}
+
+double measure(const std::string &payload,
+               std::function<void(std::string &, std::string_view)> kernel) {
+  const size_t target_bytes = 1ul << 30; // Process 1GiB per measurement
+  std::string output;
+  size_t done = 0;
+
+  auto start = std::chrono::steady_clock::now();
+
+  while (done < target_bytes) {
+    output.clear();
+    kernel(output, payload);
+    done += payload.size();
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  return done / elapsed.count() / 1e9;
+}
+
+int main() {
+  const size_t payload_size = 64 * 1024;
+
+  struct {
+    const char *name;
+    std::string data;
+  } payloads[] = {{"printable", make_payload(payload_size, 0)},
+                  {"mixed", make_payload(payload_size, 16)},
+                  {"binary", make_payload(payload_size, 1)}};
+
+  struct {
+    const char *name;
+    std::function<void(std::string &, std::string_view)> kernel;
+  } kernels[] = {{"escaped", Common::append_escaped},
+                 {"json_escaped", Common::append_json_escaped},
+                 {"hex", Common::append_hex},
+                 {"base64", Common::append_base64}};
+
+  std::cout << std::fixed << std::setprecision(2);
+
+  for (auto isa : {Common::TextKernelsIsa::scalar, Common::TextKernelsIsa::sse42,
+                   Common::TextKernelsIsa::avx2}) {
+    if (!Common::select_text_kernels(isa)) {
+      std::cout << Common::text_kernels_isa_name(isa) << ": not supported"
+                << std::endl;
+      continue;
+    }
+
+    for (auto &kernel : kernels) {
+      std::cout << std::setw(7) << Common::text_kernels_isa_name(isa)
+                << std::setw(15) << kernel.name;
+
+      for (auto &payload : payloads) {
+        std::cout << "  " << payload.name << ": "
+                  << measure(payload.data, kernel.kernel) << " GB/s";
+      }
+
+      std::cout << std::endl;
+    }
+  }
+
+  return 0;
+}
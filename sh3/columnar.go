@@ -0,0 +1,112 @@
+package main
+
+import (
+	"bytes"
+	"flag"
+	"fmt"
+	"os"
+	"os/exec"
+	"path/filepath"
+	"sync"
+
+	"rsc.io/script"
+)
+
+// ColumnarDump prints a file written by serializer_columnar to a text file,
+// with the reader in includes/columnar.h, so the reader is tested on what
+// snort wrote.  The reader is sandbox/columnar_dump, built once with the c++
+// compiler in our PATH; the test is skipped if there is none.
+//
+// With -truncate the file is first cut to that many bytes, as a crash might
+// leave it.  Like columnar_dump, it fails if the file has data that isn't
+// complete valid blocks, what was read is still written.
+func ColumnarDump(wd string) script.Cmd {
+	var (
+		once  sync.Once
+		tool  string
+		build error
+	)
+
+	return script.Command(
+		script.CmdUsage{
+			Summary: "print a file of columnar blocks",
+			Args:    "[-truncate bytes] input output",
+		},
+		func(s *script.State, args ...string) (script.WaitFunc, error) {
+			var truncate int64
+
+			fs := flag.NewFlagSet("columnar_dump", flag.ContinueOnError)
+			fs.Int64Var(&truncate, "truncate", -1, "cut the input to this many bytes")
+			if err := fs.Parse(args); err != nil {
+				return nil, err
+			}
+			if fs.NArg() != 2 {
+				return nil, script.ErrUsage
+			}
+
+			once.Do(func() { tool, build = buildColumnarDump(wd) })
+			if build != nil {
+				return nil, build
+			}
+
+			input := s.Path(fs.Arg(0))
+			if truncate >= 0 {
+				data, err := os.ReadFile(input)
+				if err != nil {
+					return nil, err
+				}
+				if truncate > int64(len(data)) {
+					return nil, fmt.Errorf("%s has only %d bytes", fs.Arg(0), len(data))
+				}
+
+				input += ".truncated"
+				if err := os.WriteFile(input, data[:truncate], 0644); err != nil {
+					return nil, err
+				}
+			}
+
+			output, err := os.Create(s.Path(fs.Arg(1)))
+			if err != nil {
+				return nil, err
+			}
+			defer output.Close()
+
+			cmd := exec.CommandContext(s.Context(), tool, input)
+			cmd.Stdout = output
+
+			if err := cmd.Run(); err != nil {
+				return nil, fmt.Errorf("columnar_dump %s: %w", fs.Arg(0), err)
+			}
+			return nil, nil
+		})
+}
+
+// buildColumnarDump builds sandbox/columnar_dump, returns the path of the
+// binary
+func buildColumnarDump(wd string) (string, error) {
+	// The script environment has no PATH, so it's looked up in ours
+	cxx, err := exec.LookPath("c++")
+	if err != nil {
+		return "", skipError{"no c++ compiler to build columnar_dump"}
+	}
+
+	dir, err := os.MkdirTemp("", "columnar_dump_")
+	if err != nil {
+		return "", err
+	}
+
+	tool := filepath.Join(dir, "columnar_dump")
+
+	var stderr bytes.Buffer
+
+	cmd := exec.Command(cxx, "-std=c++2b", "-O2",
+		"-I", filepath.Join(wd, "includes"),
+		filepath.Join(wd, "sandbox/columnar_dump/main.cpp"),
+		"-o", tool)
+	cmd.Stderr = &stderr
+
+	if err := cmd.Run(); err != nil {
+		return "", fmt.Errorf("building columnar_dump: %w: %s", err, stderr.String())
+	}
+	return tool, nil
+}
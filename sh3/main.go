@@ -77,6 +77,8 @@ func main() {
 	ng.Cmds["pcap"] = snort(gdb)
 	ng.Cmds["skip"] = Skip()
 	ng.Cmds["cmp"] = Eq()
+	ng.Cmds["unix_listen"] = UnixListen()
+	ng.Cmds["unzstd"] = Unzstd()
 
 	if wd == "" {
 		w, err := os.Getwd()
@@ -93,6 +95,9 @@ func main() {
 		}
 	}
 
+	// Needs the source tree, to build the reader
+	ng.Cmds["columnar_dump"] = ColumnarDump(wd)
+
 	var scripts []string
 	for _, path := range modules {
 		s, err := filepath.Glob(path + "/tests/*.script")
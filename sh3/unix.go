@@ -0,0 +1,147 @@
+package main
+
+import (
+	"errors"
+	"flag"
+	"fmt"
+	"io"
+	"net"
+	"os"
+	"syscall"
+	"time"
+
+	"rsc.io/script"
+)
+
+// UnixListen is a local receiver for logger_unix: it listens on a unix domain
+// socket, and copies what the first connection sends to a file, until the
+// connection is closed.  Run it in the background before snort, and wait for it.
+//
+// The framing logger_unix promises is checked: fds are only passed with
+// seqpacket, and a message with an fd is a single placeholder byte, whose
+// memfd is copied in its place.
+func UnixListen() script.Cmd {
+	return script.Command(
+		script.CmdUsage{
+			Summary: "receive from a unix domain socket into a file",
+			Args:    "[-seqpacket] socket file",
+			Async:   true,
+		},
+		func(s *script.State, args ...string) (script.WaitFunc, error) {
+			var seqpacket bool
+
+			fs := flag.NewFlagSet("unix_listen", flag.ContinueOnError)
+			fs.BoolVar(&seqpacket, "seqpacket", false, "use a SOCK_SEQPACKET socket")
+			if err := fs.Parse(args); err != nil {
+				return nil, err
+			}
+			if fs.NArg() != 2 {
+				return nil, script.ErrUsage
+			}
+
+			network := "unix"
+			if seqpacket {
+				network = "unixpacket"
+			}
+
+			listener, err := net.ListenUnix(network, &net.UnixAddr{Name: s.Path(fs.Arg(0)), Net: network})
+			if err != nil {
+				return nil, err
+			}
+
+			output, err := os.Create(s.Path(fs.Arg(1)))
+			if err != nil {
+				listener.Close()
+				return nil, err
+			}
+
+			wait := func(s *script.State) (stdout, stderr string, err error) {
+				defer listener.Close()
+				defer output.Close()
+
+				listener.SetDeadline(time.Now().Add(time.Minute))
+				conn, err := listener.AcceptUnix()
+				if err != nil {
+					return "", "", fmt.Errorf("accepting: %w", err)
+				}
+				defer conn.Close()
+
+				messages, fds, err := receive(conn, output, seqpacket)
+				return fmt.Sprintf("%d messages, %d fds\n", messages, fds), "", err
+			}
+			return wait, nil
+		})
+}
+
+func receive(conn *net.UnixConn, output *os.File, seqpacket bool) (messages, fds int, err error) {
+	buf := make([]byte, 16<<20)
+	oob := make([]byte, syscall.CmsgSpace(16*4))
+
+	for {
+		n, oobn, flags, _, err := conn.ReadMsgUnix(buf, oob)
+		if errors.Is(err, io.EOF) || (err == nil && n == 0 && oobn == 0) {
+			return messages, fds, nil
+		} else if err != nil {
+			return messages, fds, err
+		}
+		if flags&(syscall.MSG_TRUNC|syscall.MSG_CTRUNC) != 0 {
+			return messages, fds, fmt.Errorf("message %d truncated", messages)
+		}
+
+		files, err := passed(oob[:oobn])
+		if err != nil {
+			return messages, fds, err
+		}
+
+		messages++
+		fds += len(files)
+
+		switch {
+		case len(files) == 0:
+			_, err = output.Write(buf[:n])
+		case !seqpacket:
+			err = fmt.Errorf("fd passed on a stream socket")
+		case n != 1 || len(files) != 1:
+			err = fmt.Errorf("message %d has %d bytes and %d fds, not a placeholder and one fd", messages, n, len(files))
+		default:
+			err = copyFile(output, files[0])
+		}
+		for _, file := range files {
+			file.Close()
+		}
+		if err != nil {
+			return messages, fds, err
+		}
+	}
+}
+
+// passed returns the fds passed in the control messages oob
+func passed(oob []byte) ([]*os.File, error) {
+	cmsgs, err := syscall.ParseSocketControlMessage(oob)
+	if err != nil {
+		return nil, err
+	}
+
+	var files []*os.File
+	for _, cmsg := range cmsgs {
+		rights, err := syscall.ParseUnixRights(&cmsg)
+		if err != nil {
+			return nil, err
+		}
+		for _, fd := range rights {
+			files = append(files, os.NewFile(uintptr(fd), "passed"))
+		}
+	}
+	return files, nil
+}
+
+// copyFile copies all of file to output, from its start as the sender leaves
+// the offset it shares with us at the end
+func copyFile(output io.Writer, file *os.File) error {
+	info, err := file.Stat()
+	if err != nil {
+		return err
+	}
+	_, err = io.Copy(output, io.NewSectionReader(file, 0, info.Size()))
+	return err
+}
@@ -0,0 +1,49 @@
+package main
+
+import (
+	"bytes"
+	"fmt"
+	"os"
+	"os/exec"
+
+	"rsc.io/script"
+)
+
+// Unzstd decompresses a file written with serializer_zstd, with the zstd
+// command ("zstd -dc"), so its output can be compared.  The test is skipped
+// if zstd isn't installed.
+func Unzstd() script.Cmd {
+	return script.Command(
+		script.CmdUsage{
+			Summary: "decompress a zstd file",
+			Args:    "input output",
+		},
+		func(s *script.State, args ...string) (script.WaitFunc, error) {
+			if len(args) != 2 {
+				return nil, script.ErrUsage
+			}
+
+			// The script environment has no PATH, so it's looked up in ours
+			zstd, err := exec.LookPath("zstd")
+			if err != nil {
+				return nil, skipError{"zstd is not installed"}
+			}
+
+			output, err := os.Create(s.Path(args[1]))
+			if err != nil {
+				return nil, err
+			}
+			defer output.Close()
+
+			var stderr bytes.Buffer
+
+			cmd := exec.CommandContext(s.Context(), zstd, "-dc", s.Path(args[0]))
+			cmd.Stdout = output
+			cmd.Stderr = &stderr
+
+			if err := cmd.Run(); err != nil {
+				return nil, fmt.Errorf("zstd -dc %s: %w: %s", args[0], err, stderr.String())
+			}
+			return nil, nil
+		})
+}